@@ -7,6 +7,19 @@
 
 static __thread uint32_t _ALIGN(128) M[65536][8];
 
+/* axiomhash of AXIOM_LANES nonces in lockstep, one per Shabal SIMD lane */
+#ifndef SSE
+#define AXIOM_LANES 8
+#define axiom_shabal256 sph_shabal256_AVX
+#else
+#define AXIOM_LANES 4
+#define axiom_shabal256 sph_shabal256_SSE2
+#endif
+#define AXIOM_N 65536
+
+/* one 2 MiB matrix per lane, row i of lane l at axiom_M + (i * AXIOM_LANES + l) * 8 */
+static __thread uint32_t *axiom_M = NULL;
+
 void axiomhash(void *output, const void *input)
 {
 	sph_shabal256_context ctx;
@@ -43,9 +56,61 @@ void axiomhash(void *output, const void *input)
 	memcpy(output, M[N-1], 32);
 }
 
+static void axiom_store_row(uint32_t *row, const uint32_t *H)
+{
+	for (int l = 0; l < AXIOM_LANES; l++)
+		for (int w = 0; w < 8; w++)
+			row[l * 8 + w] = H[w * AXIOM_LANES + l];
+}
+
+static void axiomhash_lanes(uint32_t *hash, const uint32_t *endiandata, uint32_t nonce)
+{
+	uint32_t _ALIGN(64) in[20 * AXIOM_LANES];
+	uint32_t _ALIGN(64) H[8 * AXIOM_LANES];
+	uint32_t *Ml = axiom_M;
+
+	for (int l = 0; l < AXIOM_LANES; l++) {
+		for (int w = 0; w < 19; w++)
+			in[w * AXIOM_LANES + l] = endiandata[w];
+		be32enc(&in[19 * AXIOM_LANES + l], nonce + l);
+	}
+	axiom_shabal256(H, in, 80);
+	axiom_store_row(Ml, H);
+
+	for (int i = 1; i < AXIOM_N; i++) {
+		axiom_shabal256(H, H, 32);
+		axiom_store_row(Ml + i * AXIOM_LANES * 8, H);
+	}
+
+	/* M[p] is always the previous output, still in H */
+	for (int b = 0; b < AXIOM_N; b++) {
+		for (int l = 0; l < AXIOM_LANES; l++) {
+			const int q = H[l] % 0xFFFF;
+			const int j = (b + q) % AXIOM_N;
+			const uint32_t *row = Ml + (j * AXIOM_LANES + l) * 8;
+			for (int w = 0; w < 8; w++) {
+				in[w * AXIOM_LANES + l] = H[w * AXIOM_LANES + l];
+				in[(8 + w) * AXIOM_LANES + l] = row[w];
+			}
+		}
+		axiom_shabal256(H, in, 64);
+		axiom_store_row(Ml + b * AXIOM_LANES * 8, H);
+	}
+
+	for (int l = 0; l < AXIOM_LANES; l++)
+		for (int w = 0; w < 8; w++)
+			hash[l * 8 + w] = H[w * AXIOM_LANES + l];
+}
+
+/* nonces in flight per scan, each over a 2 MiB matrix */
+int axiom_lanes(void)
+{
+	return AXIOM_LANES;
+}
+
 int scanhash_axiom(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done)
 {
-	uint32_t _ALIGN(128) hash32[8];
+	uint32_t _ALIGN(128) hash32[8 * AXIOM_LANES];
 	uint32_t _ALIGN(128) endiandata[20];
 	uint32_t *pdata = work->data;
 	uint32_t *ptarget = work->target;
@@ -59,18 +124,36 @@ int scanhash_axiom(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *
 		be32enc(&endiandata[i], pdata[i]);
 	}
 
-	do {
-		be32enc(&endiandata[19], n);
-		axiomhash(hash32, endiandata);
-		if (hash32[7] < Htarg && fulltest(hash32, ptarget)) {
-			work_set_target_ratio(work, hash32);
-			*hashes_done = n - first_nonce + 1;
-			pdata[19] = n;
-			return true;
-		}
-		n++;
-
-	} while (n < max_nonce && !work_restart[thr_id].restart);
+	if (!axiom_M)
+		axiom_M = (uint32_t *)hugepage_alloc((size_t)AXIOM_N * AXIOM_LANES * 32);
+
+	if (axiom_M) {
+		do {
+			axiomhash_lanes(hash32, endiandata, n);
+			int l = fulltest_lanes(hash32, hash_lanes_le_target(&hash32[7], 8, AXIOM_LANES, Htarg, 0), ptarget);
+			if (l >= 0) {
+				work_set_target_ratio(work, hash32 + l * 8);
+				*hashes_done = n + l - first_nonce + 1;
+				pdata[19] = n + l;
+				return true;
+			}
+			n += AXIOM_LANES;
+
+		} while (n < max_nonce && !work_restart[thr_id].restart);
+	} else {
+		do {
+			be32enc(&endiandata[19], n);
+			axiomhash(hash32, endiandata);
+			if (hash32[7] < Htarg && fulltest(hash32, ptarget)) {
+				work_set_target_ratio(work, hash32);
+				*hashes_done = n - first_nonce + 1;
+				pdata[19] = n;
+				return true;
+			}
+			n++;
+
+		} while (n < max_nonce && !work_restart[thr_id].restart);
+	}
 
 	*hashes_done = n - first_nonce + 1;
 	pdata[19] = n;
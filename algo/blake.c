@@ -29,6 +29,65 @@ void blakehash(void *state, const void *input)
 	sph_blake256_close(&ctx, state);
 }
 
+#ifndef SSE
+#ifdef __AVX512F__
+#define BLAKE_LANES 16
+#define blake256_final_lanes sph_blake256_final_16way
+#else
+#define BLAKE_LANES 8
+#define blake256_final_lanes sph_blake256_final_8way
+#endif
+
+/*
+ * Scan the last BLAKE-256 block over BLAKE_LANES nonces at a time.
+ * pre_h is the midstate, m the padded last block in host order with the
+ * nonce in word nonce_w (byte swapped when swap is set), bits the total
+ * message length. Shared by blake, blakecoin/vanilla and decred.
+ */
+int blake256_scan_lanes(int thr_id, struct work *work, const uint32_t *pre_h,
+	const uint32_t *m, int nonce_w, bool swap, uint32_t bits, int rounds,
+	uint32_t *nonce, uint32_t max_nonce, uint64_t *hashes_done)
+{
+	uint32_t _ALIGN(64) hashv[8 * BLAKE_LANES];
+	uint32_t _ALIGN(64) mn[BLAKE_LANES];
+	uint32_t _ALIGN(32) hash32[8];
+	uint32_t *ptarget = work->target;
+
+	const uint32_t first_nonce = *nonce;
+	const uint32_t HTarget = opt_benchmark ? 0x7f : ptarget[7];
+
+	uint32_t n = first_nonce;
+	int mask, i, l;
+
+	do {
+		for (l = 0; l < BLAKE_LANES; l++)
+			mn[l] = swap ? swab32(n + l) : n + l;
+
+		mask = blake256_final_lanes(hashv, pre_h, m, nonce_w, mn, bits, rounds, HTarget);
+
+		for (l = 0; mask; l++, mask >>= 1) {
+			if (!(mask & 1))
+				continue;
+			for (i = 0; i < 8; i++)
+				hash32[i] = hashv[BLAKE_LANES * i + l];
+			if (fulltest(hash32, ptarget)) {
+				work_set_target_ratio(work, hash32);
+				*hashes_done = n - first_nonce + l + 1;
+				*nonce = n + l;
+				return 1;
+			}
+		}
+
+		n += BLAKE_LANES;
+
+	} while (n < max_nonce && !work_restart[thr_id].restart);
+
+	*hashes_done = n - first_nonce + 1;
+	*nonce = n;
+	return 0;
+}
+#endif
+
 int scanhash_blake(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done)
 {
 	uint32_t _ALIGN(128) hash32[8];
@@ -52,6 +111,22 @@ int scanhash_blake(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *
 	applog(LOG_DEBUG,"[%d] Target=%08x %08x", thr_id, ptarget[6], ptarget[7]);
 #endif
 
+#ifndef SSE
+	{
+		uint32_t _ALIGN(64) m[16] = { 0 };
+		sph_blake256_context ctx;
+
+		sph_blake256_init(&ctx);
+		sph_blake256(&ctx, endiandata, 64);
+
+		m[0] = pdata[16]; m[1] = pdata[17]; m[2] = pdata[18];
+		m[4] = 0x80000000; m[13] = 1; m[15] = 640;
+
+		return blake256_scan_lanes(thr_id, work, ctx.H, m, 3, false, 640, 14,
+			&pdata[19], max_nonce, hashes_done);
+	}
+#endif
+
 	do {
 		be32enc(&endiandata[19], n);
 		blakehash(hash32, endiandata);
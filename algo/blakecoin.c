@@ -56,6 +56,22 @@ int scanhash_blakecoin(int thr_id, struct work *work, uint32_t max_nonce, uint64
 	applog(LOG_DEBUG,"[%d] Target=%08x %08x", thr_id, ptarget[6], ptarget[7]);
 #endif
 
+#ifndef SSE
+	{
+		uint32_t _ALIGN(64) m[16] = { 0 };
+		sph_blake256_context ctx;
+
+		blakecoin_init(&ctx);
+		blakecoin(&ctx, endiandata, 64);
+
+		m[0] = pdata[16]; m[1] = pdata[17]; m[2] = pdata[18];
+		m[4] = 0x80000000; m[13] = 1; m[15] = 640;
+
+		return blake256_scan_lanes(thr_id, work, ctx.H, m, 3, false, 640, BLAKE32_ROUNDS,
+			&pdata[19], max_nonce, hashes_done);
+	}
+#endif
+
 	do {
 		be32enc(&endiandata[19], n);
 		blakecoinhash(hash32, endiandata);
@@ -18,6 +18,7 @@
 #include "crypto/c_skein.h"
 #include "crypto/int-util.h"
 #include "crypto/hash-ops.h"
+#include "crypto/soft_aes.h"
 
 #if USE_INT128
 
@@ -171,9 +172,17 @@ static void cryptolight_hash_ctx(void* output, const void* input, int len, struc
 	hash_process(&ctx->state.hs, (const uint8_t*) input, len);
 	ctx->aes_ctx = (oaes_ctx*) oaes_alloc();
 	size_t i, j;
+#ifdef HAVE_SOFT_AES
+	const bool soft_aes = has_ssse3();
+#endif
 	memcpy(ctx->text, ctx->state.init, INIT_SIZE_BYTE);
 
 	oaes_key_import_data(ctx->aes_ctx, ctx->state.hs.b, AES_KEY_SIZE);
+#ifdef HAVE_SOFT_AES
+	if (soft_aes)
+		soft_aes_explode(ctx->text, ctx->aes_ctx->key->exp_data, ctx->long_state, MEMORY);
+	else
+#endif
 	for (i = 0; likely(i < MEMORY); i += INIT_SIZE_BYTE) {
 		aesb_pseudo_round_mut(&ctx->text[AES_BLOCK_SIZE * 0], ctx->aes_ctx->key->exp_data);
 		aesb_pseudo_round_mut(&ctx->text[AES_BLOCK_SIZE * 1], ctx->aes_ctx->key->exp_data);
@@ -210,6 +219,11 @@ static void cryptolight_hash_ctx(void* output, const void* input, int len, struc
 
 	memcpy(ctx->text, ctx->state.init, INIT_SIZE_BYTE);
 	oaes_key_import_data(ctx->aes_ctx, &ctx->state.hs.b[32], AES_KEY_SIZE);
+#ifdef HAVE_SOFT_AES
+	if (soft_aes)
+		soft_aes_implode(ctx->text, ctx->aes_ctx->key->exp_data, ctx->long_state, MEMORY);
+	else
+#endif
 	for (i = 0; likely(i < MEMORY); i += INIT_SIZE_BYTE) {
 		xor_blocks(&ctx->text[0 * AES_BLOCK_SIZE], &ctx->long_state[i + 0 * AES_BLOCK_SIZE]);
 		aesb_pseudo_round_mut(&ctx->text[0 * AES_BLOCK_SIZE], ctx->aes_ctx->key->exp_data);
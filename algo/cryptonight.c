@@ -20,6 +20,7 @@
 #include "crypto/c_skein.h"
 #include "crypto/int-util.h"
 #include "crypto/hash-ops.h"
+#include "crypto/soft_aes.h"
 
 #if USE_INT128
 
@@ -113,10 +114,27 @@ static uint64_t mul128(uint64_t multiplier, uint64_t multiplicand, uint64_t* pro
 
 	return product_lo;
 }
+#elif defined(__GNUC__)
+static inline uint64_t mul128(uint64_t multiplier, uint64_t multiplicand, uint64_t* product_hi) {
+	unsigned __int128 product = (unsigned __int128) multiplier * multiplicand;
+	*product_hi = (uint64_t) (product >> 64);
+	return (uint64_t) product;
+}
 #else
 extern uint64_t mul128(uint64_t multiplier, uint64_t multiplicand, uint64_t* product_hi);
 #endif
 
+#if defined(__AES__) && !defined(NOASM)
+#include <wmmintrin.h>
+/* inlined, so the aesenc of interleaved hashes can overlap */
+static inline void aes_ni_single_round(const uint8_t *in, uint8_t *out, const uint8_t *expandedKey) {
+	_mm_store_si128((__m128i*) out, _mm_aesenc_si128(_mm_load_si128((const __m128i*) in),
+		_mm_load_si128((const __m128i*) expandedKey)));
+}
+#else
+#define aes_ni_single_round fast_aesb_single_round
+#endif
+
 static void (* const extra_hashes[4])(const void *, size_t, char *) = {
 		do_blake_hash, do_groestl_hash, do_jh_hash, do_skein_hash
 };
@@ -159,7 +177,7 @@ static inline void xor_blocks_dst(const uint8_t* a, const uint8_t* b, uint8_t* d
 }
 
 struct cryptonight_ctx {
-	uint8_t _ALIGN(16) long_state[MEMORY];
+	uint8_t *long_state;
 	union cn_slow_hash_state state;
 	uint8_t _ALIGN(16) text[INIT_SIZE_BYTE];
 	uint8_t _ALIGN(16) a[AES_BLOCK_SIZE];
@@ -173,9 +191,17 @@ static void cryptonight_hash_ctx(void* output, const void* input, int len, struc
 	hash_process(&ctx->state.hs, (const uint8_t*) input, len);
 	ctx->aes_ctx = (oaes_ctx*) oaes_alloc();
 	size_t i, j;
+#ifdef HAVE_SOFT_AES
+	const bool soft_aes = has_ssse3();
+#endif
 	memcpy(ctx->text, ctx->state.init, INIT_SIZE_BYTE);
 
 	oaes_key_import_data(ctx->aes_ctx, ctx->state.hs.b, AES_KEY_SIZE);
+#ifdef HAVE_SOFT_AES
+	if (soft_aes)
+		soft_aes_explode(ctx->text, ctx->aes_ctx->key->exp_data, ctx->long_state, MEMORY);
+	else
+#endif
 	for (i = 0; likely(i < MEMORY); i += INIT_SIZE_BYTE) {
 		aesb_pseudo_round_mut(&ctx->text[AES_BLOCK_SIZE * 0], ctx->aes_ctx->key->exp_data);
 		aesb_pseudo_round_mut(&ctx->text[AES_BLOCK_SIZE * 1], ctx->aes_ctx->key->exp_data);
@@ -212,6 +238,11 @@ static void cryptonight_hash_ctx(void* output, const void* input, int len, struc
 
 	memcpy(ctx->text, ctx->state.init, INIT_SIZE_BYTE);
 	oaes_key_import_data(ctx->aes_ctx, &ctx->state.hs.b[32], AES_KEY_SIZE);
+#ifdef HAVE_SOFT_AES
+	if (soft_aes)
+		soft_aes_implode(ctx->text, ctx->aes_ctx->key->exp_data, ctx->long_state, MEMORY);
+	else
+#endif
 	for (i = 0; likely(i < MEMORY); i += INIT_SIZE_BYTE) {
 		xor_blocks(&ctx->text[0 * AES_BLOCK_SIZE], &ctx->long_state[i + 0 * AES_BLOCK_SIZE]);
 		aesb_pseudo_round_mut(&ctx->text[0 * AES_BLOCK_SIZE], ctx->aes_ctx->key->exp_data);
@@ -239,15 +270,18 @@ static void cryptonight_hash_ctx(void* output, const void* input, int len, struc
 
 void cryptonight_hash(void* output, const void* input, int len) {
 	struct cryptonight_ctx *ctx = (struct cryptonight_ctx*)malloc(sizeof(struct cryptonight_ctx));
+	ctx->long_state = (uint8_t*)malloc(MEMORY);
 	cryptonight_hash_ctx(output, input, len, ctx);
+	free(ctx->long_state);
 	free(ctx);
 }
 
-static void cryptonight_hash_ctx_aes_ni(void* output, const void* input, int len, struct cryptonight_ctx* ctx)
+static inline void cryptonight_explode_aes_ni(const void* input, int len, struct cryptonight_ctx* ctx)
 {
+	size_t i;
+
 	hash_process(&ctx->state.hs, (const uint8_t*)input, len);
 	ctx->aes_ctx = (oaes_ctx*) oaes_alloc();
-	size_t i, j;
 	memcpy(ctx->text, ctx->state.init, INIT_SIZE_BYTE);
 
 	oaes_key_import_data(ctx->aes_ctx, ctx->state.hs.b, AES_KEY_SIZE);
@@ -265,25 +299,11 @@ static void cryptonight_hash_ctx_aes_ni(void* output, const void* input, int len
 
 	xor_blocks_dst(&ctx->state.k[0], &ctx->state.k[32], ctx->a);
 	xor_blocks_dst(&ctx->state.k[16], &ctx->state.k[48], ctx->b);
+}
 
-	for (i = 0; likely(i < ITER / 4); ++i) {
-		/* Dependency chain: address -> read value ------+
-		 * written value <-+ hard function (AES or MUL) <+
-		 * next address  <-+
-		 */
-		/* Iteration 1 */
-		j = e2i(ctx->a);
-		fast_aesb_single_round(&ctx->long_state[j], ctx->c, ctx->a);
-		xor_blocks_dst(ctx->c, ctx->b, &ctx->long_state[j]);
-		/* Iteration 2 */
-		mul_sum_xor_dst(ctx->c, ctx->a, &ctx->long_state[e2i(ctx->c)]);
-		/* Iteration 3 */
-		j = e2i(ctx->a);
-		fast_aesb_single_round(&ctx->long_state[j], ctx->b, ctx->a);
-		xor_blocks_dst(ctx->b, ctx->c, &ctx->long_state[j]);
-		/* Iteration 4 */
-		mul_sum_xor_dst(ctx->b, ctx->a, &ctx->long_state[e2i(ctx->b)]);
-	}
+static inline void cryptonight_implode_aes_ni(void* output, struct cryptonight_ctx* ctx)
+{
+	size_t i;
 
 	memcpy(ctx->text, ctx->state.init, INIT_SIZE_BYTE);
 	oaes_key_import_data(ctx->aes_ctx, &ctx->state.hs.b[32], AES_KEY_SIZE);
@@ -312,43 +332,133 @@ static void cryptonight_hash_ctx_aes_ni(void* output, const void* input, int len
 	oaes_free((OAES_CTX **) &ctx->aes_ctx);
 }
 
+/*
+ * The main loop of one hash is a single dependency chain (AES or MUL on
+ * the value just read), run the chains of several nonces in lockstep so
+ * their latencies overlap. Each lane has its own scratchpad.
+ */
+static inline void cryptonight_hash_ctx_aes_ni(void** output, const void** input, int len,
+	struct cryptonight_ctx** ctx, const int lanes)
+{
+	size_t i, j;
+	int l;
+
+	for (l = 0; l < lanes; l++)
+		cryptonight_explode_aes_ni(input[l], len, ctx[l]);
+
+	for (i = 0; likely(i < ITER / 4); ++i) {
+		/* Dependency chain: address -> read value ------+
+		 * written value <-+ hard function (AES or MUL) <+
+		 * next address  <-+
+		 */
+		/* Iteration 1 */
+		for (l = 0; l < lanes; l++) {
+			j = e2i(ctx[l]->a);
+			aes_ni_single_round(&ctx[l]->long_state[j], ctx[l]->c, ctx[l]->a);
+			xor_blocks_dst(ctx[l]->c, ctx[l]->b, &ctx[l]->long_state[j]);
+		}
+		/* Iteration 2 */
+		for (l = 0; l < lanes; l++)
+			mul_sum_xor_dst(ctx[l]->c, ctx[l]->a, &ctx[l]->long_state[e2i(ctx[l]->c)]);
+		/* Iteration 3 */
+		for (l = 0; l < lanes; l++) {
+			j = e2i(ctx[l]->a);
+			aes_ni_single_round(&ctx[l]->long_state[j], ctx[l]->b, ctx[l]->a);
+			xor_blocks_dst(ctx[l]->b, ctx[l]->c, &ctx[l]->long_state[j]);
+		}
+		/* Iteration 4 */
+		for (l = 0; l < lanes; l++)
+			mul_sum_xor_dst(ctx[l]->b, ctx[l]->a, &ctx[l]->long_state[e2i(ctx[l]->b)]);
+	}
+
+	for (l = 0; l < lanes; l++)
+		cryptonight_implode_aes_ni(output[l], ctx[l]);
+}
+
+#define CN_MAX_WAYS 3
+
+/* per thread, the scratchpads are kept between the scans */
+static __thread struct cryptonight_ctx cn_ctx[CN_MAX_WAYS];
+static __thread uint8_t *cn_scratchpad = NULL;
+static __thread bool cn_huge;	/* opt_hugepages when it was allocated */
+
 int scanhash_cryptonight(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done)
 {
-	uint32_t _ALIGN(128) hash[HASH_SIZE / 4];
+	uint32_t _ALIGN(128) hash[CN_MAX_WAYS][HASH_SIZE / 4];
+	uint32_t _ALIGN(16) blob[CN_MAX_WAYS][20];
+	struct cryptonight_ctx *ctx[CN_MAX_WAYS];
+	void *output[CN_MAX_WAYS];
+	const void *input[CN_MAX_WAYS];
 	uint32_t *pdata = work->data;
 	uint32_t *ptarget = work->target;
 
 	uint32_t *nonceptr = (uint32_t*) (((char*)pdata) + 39);
 	uint32_t n = *nonceptr - 1;
 	const uint32_t first_nonce = n + 1;
+	int ways = aes_ni_supported ? opt_cn_ways : 1;
+	int l;
 
-	struct cryptonight_ctx *ctx = (struct cryptonight_ctx*)malloc(sizeof(struct cryptonight_ctx));
+	if (ways < 1 || ways > CN_MAX_WAYS)
+		ways = 1;
+
+	if (cn_scratchpad && cn_huge != opt_hugepages) {
+		/* the tuner switched the page size */
+		hugepage_free(cn_scratchpad, (size_t) MEMORY * CN_MAX_WAYS);
+		cn_scratchpad = NULL;
+	}
+	if (!cn_scratchpad) {
+		cn_huge = opt_hugepages;
+		cn_scratchpad = (uint8_t*) hugepage_alloc((size_t) MEMORY * CN_MAX_WAYS);
+		if (!cn_scratchpad) {
+			applog(LOG_ERR, "CPU #%d: unable to allocate cryptonight scratchpad", thr_id);
+			*hashes_done = 0;
+			return 0;
+		}
+	}
+	for (l = 0; l < CN_MAX_WAYS; l++) {
+		cn_ctx[l].long_state = cn_scratchpad + (size_t) MEMORY * l;
+		ctx[l] = &cn_ctx[l];
+		output[l] = hash[l];
+		input[l] = blob[l];
+		memcpy(blob[l], pdata, 76);
+	}
 
-	if (aes_ni_supported) {
+	if (!aes_ni_supported) {
 		do {
 			*nonceptr = ++n;
-			cryptonight_hash_ctx_aes_ni(hash, pdata, 76, ctx);
-			if (unlikely(hash[7] < ptarget[7])) {
-				work_set_target_ratio(work, hash);
+			cryptonight_hash_ctx(hash[0], pdata, 76, ctx[0]);
+			if (unlikely(hash[0][7] < ptarget[7])) {
+				work_set_target_ratio(work, hash[0]);
 				*hashes_done = n - first_nonce + 1;
-				free(ctx);
 				return 1;
 			}
 		} while (likely((n <= max_nonce && !work_restart[thr_id].restart)));
-	} else {
-		do {
-			*nonceptr = ++n;
-			cryptonight_hash_ctx(hash, pdata, 76, ctx);
-			if (unlikely(hash[7] < ptarget[7])) {
-				work_set_target_ratio(work, hash);
+		*hashes_done = n - first_nonce + 1;
+		return 0;
+	}
+
+	do {
+		for (l = 0; l < ways; l++)
+			*(uint32_t*) (((char*)blob[l]) + 39) = ++n;
+
+		if (ways == 3)
+			cryptonight_hash_ctx_aes_ni(output, input, 76, ctx, 3);
+		else if (ways == 2)
+			cryptonight_hash_ctx_aes_ni(output, input, 76, ctx, 2);
+		else
+			cryptonight_hash_ctx_aes_ni(output, input, 76, ctx, 1);
+
+		for (l = 0; l < ways; l++) {
+			if (unlikely(hash[l][7] < ptarget[7])) {
+				*nonceptr = n - ways + 1 + l;
+				work_set_target_ratio(work, hash[l]);
 				*hashes_done = n - first_nonce + 1;
-				free(ctx);
 				return 1;
 			}
-		} while (likely((n <= max_nonce && !work_restart[thr_id].restart)));
-	}
+		}
+	} while (likely((n <= max_nonce && !work_restart[thr_id].restart)));
 
-	free(ctx);
+	*nonceptr = n;
 	*hashes_done = n - first_nonce + 1;
 	return 0;
 }
@@ -63,6 +63,23 @@ int scanhash_decred(int thr_id, struct work *work, uint32_t max_nonce, uint64_t
 	if (!thr_id) applog(LOG_DEBUG,"[%d] Target=%08x %08x", thr_id, ptarget[6], ptarget[7]);
 #endif
 
+#ifndef SSE
+	{
+		uint32_t _ALIGN(64) m[16];
+		sph_blake256_context ctx;
+
+		sph_blake256_init(&ctx);
+		sph_blake256(&ctx, endiandata, MIDSTATE_LEN);
+
+		for (int k = 0; k < 13; k++)
+			m[k] = swab32(endiandata[32 + k]);
+		m[13] = 0x80000001; m[14] = 0; m[15] = 180 * 8;
+
+		return blake256_scan_lanes(thr_id, work, ctx.H, m, DCR_NONCE_OFT32 - 32, true,
+			180 * 8, 14, &pdata[DCR_NONCE_OFT32], max_nonce, hashes_done);
+	}
+#endif
+
 	do {
 		//be32enc(&endiandata[DCR_NONCE_OFT32], n);
 		endiandata[DCR_NONCE_OFT32] = n;
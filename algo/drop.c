@@ -114,9 +114,38 @@ static void switchHash(const void *input, void *output, int id)
 	}
 }
 
+/*
+ * The (shift << 4 | algo) steps droplp runs after jh512 for a given start
+ * position: four or five rotations through the ten algorithms.
+ */
+static int droplp_schedule(unsigned int startPosition, uint8_t *steps)
+{
+	unsigned int i;
+	int j, start, n = 0;
+
+	for (i = startPosition; i < 31; i+=9) {
+		start = i % 10;
+		for (j = start; j < 10; j++)
+			steps[n++] = (uint8_t)(((i & 3) << 4) | j);
+		for (j = 0; j < start; j++)
+			steps[n++] = (uint8_t)(((i & 3) << 4) | j);
+	}
+	for (i = 0; i < startPosition; i += 9) {
+		start = i % 10;
+		for (j = start; j < 10; j++)
+			steps[n++] = (uint8_t)(((i & 3) << 4) | j);
+		for (j = 0; j < start; j++)
+			steps[n++] = (uint8_t)(((i & 3) << 4) | j);
+	}
+	return n;
+}
+
+#define DROP_MAX_STEPS 50
+
 void droplp_hash(void *state, const void *input)
 {
 	uint32_t _ALIGN(64) hash[2][16];
+	uint8_t steps[DROP_MAX_STEPS];
 	sph_jh512_context ctx_jh;
 	uint32_t *hashA = hash[0];
 	uint32_t *hashB = hash[1];
@@ -125,52 +154,104 @@ void droplp_hash(void *state, const void *input)
 	sph_jh512(&ctx_jh, input, 80);
 	sph_jh512_close(&ctx_jh, (void*)(hashA));
 
-	unsigned int startPosition = hashA[0] % 31;
-	unsigned int i = 0;
-	int j = 0;
-	int start = 0;
-
-	for (i = startPosition; i < 31; i+=9) {
-		start = i % 10;
-		for (j = start; j < 10; j++) {
-			shiftr_lp(hashA, hashB, (i & 3));
-			switchHash((const void*)hashB, (void*)hashA, j);
-		}
-		for (j = 0; j < start; j++) {
-			shiftr_lp(hashA, hashB, (i & 3));
-			switchHash((const void*)hashB, (void*)hashA, j);
-		}
-	}
-	for (i = 0; i < startPosition; i += 9) {
-		start = i % 10;
-		for (j = start; j < 10; j++) {
-			shiftr_lp(hashA, hashB, (i & 3));
-			switchHash((const void*)hashB, (void*)hashA, j);
-		}
-		for (j = 0; j < start; j++) {
-			shiftr_lp(hashA, hashB, (i & 3));
-			switchHash((const void*)hashB, (void*)hashA, j);
-		}
+	int n = droplp_schedule(hashA[0] % 31, steps);
+	for (int s = 0; s < n; s++) {
+		shiftr_lp(hashA, hashB, steps[s] >> 4);
+		switchHash((const void*)hashB, (void*)hashA, steps[s] & 15);
 	}
 
 	memcpy(state, hashA, 32);
 }
 
-static void droplp_hash_pok(void *output, uint32_t *pdata, const uint32_t version)
+#ifndef SSE
+#ifdef __AVX512F__
+#define DROP_LANES 8
+#define drop_keccak512_lanes sph_keccak512_AVX512
+#define drop_skein512_lanes sph_skein512_AVX512
+#else
+#define DROP_LANES 4
+#define drop_keccak512_lanes sph_keccak512_AVX
+#define drop_skein512_lanes sph_skein512_AVX
+#endif
+#else
+#define DROP_LANES 2
+#define drop_keccak512_lanes sph_keccak512_SSE2
+#define drop_skein512_lanes sph_skein512_SSE2
+#endif
+
+/* nonces per batch: each step spreads them over ten buckets */
+#define DROP_BATCH (4 * DROP_LANES)
+
+typedef void (*drop_lanes_fn)(void *dst, const void *data, size_t len);
+
+/*
+ * Run a 64-byte lane kernel over the lanes idx[0..cnt) of a batch, 16
+ * words per lane, from src to dst. A short last group is padded with its
+ * first lane; a lone lane is left to the caller and its count returned.
+ */
+static int drop_run_lanes(drop_lanes_fn fn, uint32_t *dst, const uint32_t *src,
+	const int *idx, int cnt)
 {
-	uint32_t _ALIGN(64) hash[8];
-	uint32_t pok;
+	uint64_t _ALIGN(64) vin[8 * DROP_LANES];
+	uint64_t _ALIGN(64) vout[8 * DROP_LANES];
+	int k = 0;
 
-	pdata[0] = version;
-	droplp_hash(hash, pdata);
+	for (; cnt - k >= 2; k += DROP_LANES) {
+		for (int w = 0; w < 8; w++)
+			for (int l = 0; l < DROP_LANES; l++) {
+				int x = idx[k + (k + l < cnt ? l : 0)];
+				vin[w * DROP_LANES + l] = ((const uint64_t *)(src + x * 16))[w];
+			}
+		fn(vout, vin, 64);
+		for (int l = 0; l < DROP_LANES && k + l < cnt; l++)
+			for (int w = 0; w < 8; w++)
+				((uint64_t *)(dst + idx[k + l] * 16))[w] = vout[w * DROP_LANES + l];
+	}
+	return cnt > k ? cnt - k : 0;
+}
 
-	// fill PoK
-	pok = version | (hash[0] & POK_DATA_MASK);
-	if (pdata[0] != pok) {
-		pdata[0] = pok;
-		droplp_hash(hash, pdata);
+/*
+ * droplp_hash of cnt headers (20 words each) into hash (16 words each).
+ * At every step the live lanes are bucketed by the algorithm their
+ * schedule picks; keccak and skein buckets run as lane kernels, the
+ * other algorithms back to back on warm tables.
+ */
+static void droplp_hash_batch(uint32_t *hash, const uint32_t *data, int cnt)
+{
+	uint32_t _ALIGN(64) tmp[DROP_BATCH * 16];
+	uint8_t steps[DROP_BATCH][DROP_MAX_STEPS];
+	int nsteps[DROP_BATCH], maxsteps = 0;
+	int bucket[10][DROP_BATCH], nb[10];
+	sph_jh512_context ctx_jh;
+
+	for (int l = 0; l < cnt; l++) {
+		sph_jh512_init(&ctx_jh);
+		sph_jh512(&ctx_jh, data + l * 20, 80);
+		sph_jh512_close(&ctx_jh, hash + l * 16);
+		nsteps[l] = droplp_schedule(hash[l * 16] % 31, steps[l]);
+		if (nsteps[l] > maxsteps)
+			maxsteps = nsteps[l];
+	}
+
+	for (int s = 0; s < maxsteps; s++) {
+		memset(nb, 0, sizeof(nb));
+		for (int l = 0; l < cnt; l++) {
+			if (s >= nsteps[l])
+				continue;
+			int id = steps[l][s] & 15;
+			shiftr_lp(hash + l * 16, tmp + l * 16, steps[l][s] >> 4);
+			bucket[id][nb[id]++] = l;
+		}
+		for (int id = 0; id < 10; id++) {
+			int k = 0;
+			if (id == 0)
+				k = nb[id] - drop_run_lanes(drop_keccak512_lanes, hash, tmp, bucket[id], nb[id]);
+			else if (id == 3)
+				k = nb[id] - drop_run_lanes(drop_skein512_lanes, hash, tmp, bucket[id], nb[id]);
+			for (; k < nb[id]; k++)
+				switchHash(tmp + bucket[id][k] * 16, hash + bucket[id][k] * 16, id);
+		}
 	}
-	memcpy(output, hash, 32);
 }
 
 int scanhash_drop(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done)
@@ -181,7 +262,6 @@ int scanhash_drop(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *h
 	const uint32_t version = pdata[0] & (~POK_DATA_MASK);
 	const uint32_t first_nonce = pdata[19];
 	uint32_t nonce = first_nonce;
-	#define tmpdata pdata
 
 	if (opt_benchmark)
 		ptarget[7] = 0x07ff;
@@ -189,17 +269,52 @@ int scanhash_drop(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *h
 	const uint32_t htarg = ptarget[7];
 
 	do {
-		tmpdata[19] = nonce;
-		droplp_hash_pok(hash, tmpdata, version);
-
-		if (hash[7] <= htarg && fulltest(hash, ptarget)) {
-			work_set_target_ratio(work, hash);
-			pdata[0] = tmpdata[0];
-			pdata[19] = nonce;
-			*hashes_done = pdata[19] - first_nonce + 1;
-			return 1;
+		uint32_t _ALIGN(64) data[DROP_BATCH * 20];
+		uint32_t _ALIGN(64) vhash[DROP_BATCH * 16];
+		uint32_t pok[DROP_BATCH];
+		int redo[DROP_BATCH], nredo = 0;
+		int cnt = DROP_BATCH;
+
+		if (nonce < max_nonce && max_nonce - nonce < DROP_BATCH)
+			cnt = max_nonce - nonce;
+
+		for (int l = 0; l < cnt; l++) {
+			memcpy(data + l * 20, pdata, 80);
+			data[l * 20] = version;
+			data[l * 20 + 19] = nonce + l;
+		}
+		droplp_hash_batch(vhash, data, cnt);
+
+		/* fill PoK, then rehash only the lanes whose header changed */
+		for (int l = 0; l < cnt; l++) {
+			pok[l] = version | (vhash[l * 16] & POK_DATA_MASK);
+			if (pok[l] != version) {
+				memcpy(data + nredo * 20, data + l * 20, 80);
+				data[nredo * 20] = pok[l];
+				redo[nredo++] = l;
+			}
+		}
+		if (nredo) {
+			uint32_t _ALIGN(64) rhash[DROP_BATCH * 16];
+			droplp_hash_batch(rhash, data, nredo);
+			for (int r = 0; r < nredo; r++)
+				memcpy(vhash + redo[r] * 16, rhash + r * 16, 32);
+		}
+
+		uint32_t mask = hash_lanes_le_target(&vhash[7], 16, cnt, htarg, 0);
+		for (int l = 0; mask; l++, mask >>= 1) {
+			if (!(mask & 1))
+				continue;
+			memcpy(hash, vhash + l * 16, 32);
+			if (fulltest(hash, ptarget)) {
+				work_set_target_ratio(work, hash);
+				pdata[0] = pok[l];
+				pdata[19] = nonce + l;
+				*hashes_done = pdata[19] - first_nonce + 1;
+				return 1;
+			}
 		}
-		nonce++;
+		nonce += cnt;
 
 	} while (nonce < max_nonce && !work_restart[thr_id].restart);
 
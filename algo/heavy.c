@@ -8,22 +8,40 @@
 #include "sha3/sph_blake.h"
 #include "sha3/sph_groestl.h"
 
-/* Combines top 64-bits from each hash into a single hash */
+/* MSVC has no __BMI2__, its AVX2 build (no SSE define) targets BMI2 cpus */
+#if defined(__BMI2__) || (defined(_MSC_VER) && !defined(SSE))
+#define HEAVY_PDEP
+#include <immintrin.h>
+#endif
+
+/* Spread the low 8 bits of x to every fourth bit, bit 7 landing on bit 28 */
+static inline uint32_t spread4(uint32_t x)
+{
+#ifdef HEAVY_PDEP
+	return _pdep_u32(x, 0x11111111);
+#else
+	x = (x | (x << 12)) & 0x000F000F;
+	x = (x | (x << 6)) & 0x03030303;
+	x = (x | (x << 3)) & 0x11111111;
+	return x;
+#endif
+}
+
+/*
+ * Combines top 64-bits from each hash into a single hash: bit b of
+ * hash k lands four times further up, hash 0 first, one output word per
+ * input byte from the most significant down.
+ */
 static void combine_hashes(uint32_t *out, uint32_t *hash1, uint32_t *hash2, uint32_t *hash3, uint32_t *hash4)
 {
-	uint32_t *hash[4] = { hash1, hash2, hash3, hash4 };
-
-	/* Transpose first 64 bits of each hash into out */
-	memset(out, 0, 32);
-	int bits = 0;
-	for (unsigned int i = 7; i >= 6; i--) {
-		for (uint32_t mask = 0x80000000; mask; mask >>= 1) {
-			for (unsigned int k = 0; k < 4; k++) {
-				out[(255 - bits)/32] <<= 1;
-				if ((hash[k][i] & mask) != 0)
-					out[(255 - bits)/32] |= 1;
-				bits++;
-			}
+	for (int i = 6; i <= 7; i++) {
+		for (int b = 0; b < 4; b++) {
+			const int sh = 8 * b;
+			out[(i - 6) * 4 + b] =
+				(spread4(hash1[i] >> sh & 0xff) << 3) |
+				(spread4(hash2[i] >> sh & 0xff) << 2) |
+				(spread4(hash3[i] >> sh & 0xff) << 1) |
+				spread4(hash4[i] >> sh & 0xff);
 		}
 	}
 }
@@ -78,6 +96,123 @@ extern void heavyhash(unsigned char* output, const unsigned char* input, int len
 	combine_hashes(final, (uint32_t *)hash2, hash3, hash4, hash5);
 }
 
+#ifndef SSE
+#define HEAVY_LANES 8
+#define heavy_sha256_lanes sha256_transform_8way_intrin
+#ifdef __AVX512F__
+#define HEAVY_KECCAK_LANES 8
+#define heavy_keccakf_lanes sph_keccakf1600_AVX512
+#else
+#define HEAVY_KECCAK_LANES 4
+#define heavy_keccakf_lanes sph_keccakf1600_AVX
+#endif
+#else
+#define HEAVY_LANES 4
+#define heavy_sha256_lanes sha256_transform_4way_intrin
+#define HEAVY_KECCAK_LANES 2
+#define heavy_keccakf_lanes sph_keccakf1600_SSE2
+#endif
+
+/*
+ * Everything that depends only on the nonce-free part of the header:
+ * HEFTY1, groestl512 and blake512 contexts after its first 64 bytes,
+ * the SHA-256 state after its first block and the keccak512 state after
+ * its first 72 bytes. Groestl and blake have 128-byte blocks, so theirs
+ * only spare the init and the copy of the prefix.
+ */
+struct heavy_midstate {
+	HEFTY1_CTX hefty;
+	sph_groestl512_context groestl;
+	sph_blake512_context blake;
+	uint32_t sha[8];
+	uint64_t keccak[25];
+};
+
+static void heavy_prepare(struct heavy_midstate *ms, const uint32_t *pdata)
+{
+	HEFTY1_Init(&ms->hefty);
+	HEFTY1_Update(&ms->hefty, pdata, 64);
+	sph_groestl512_init(&ms->groestl);
+	sph_groestl512(&ms->groestl, pdata, 64);
+	sph_blake512_init(&ms->blake);
+	sph_blake512(&ms->blake, pdata, 64);
+
+	sha256_init(ms->sha);
+	sha256_transform(ms->sha, pdata, 1);
+
+	memset(ms->keccak, 0, sizeof(ms->keccak));
+	for (int w = 0; w < 9; w++)
+		ms->keccak[w] = ((const uint64_t *)pdata)[w];
+	sph_keccakf1600(ms->keccak);
+}
+
+/* heavyhash of the 80-byte header pdata with nonces nonce .. nonce + HEAVY_LANES - 1 */
+static void heavyhash_lanes(uint32_t *hash, const struct heavy_midstate *ms,
+	const uint32_t *pdata, uint32_t nonce)
+{
+	uint32_t _ALIGN(64) tail[HEAVY_LANES][12];
+	uint32_t _ALIGN(64) vstate[8 * HEAVY_LANES];
+	uint32_t _ALIGN(64) vblock[16 * HEAVY_LANES];
+	uint64_t _ALIGN(64) vkeccak[25 * HEAVY_KECCAK_LANES];
+	uint32_t hash2[HEAVY_LANES][8];
+	uint64_t hash3[HEAVY_LANES][8];
+
+	/* bytes 64..111 of input || HEFTY1(input) for every lane */
+	for (int l = 0; l < HEAVY_LANES; l++) {
+		HEFTY1_CTX hefty = ms->hefty;
+		memcpy(tail[l], pdata + 16, 12);
+		tail[l][3] = nonce + l;
+		HEFTY1_Update(&hefty, tail[l], 16);
+		HEFTY1_Final((unsigned char *)&tail[l][4], &hefty);
+	}
+
+	/* SHA-256: second block of 112 bytes, then the big-endian digest */
+	for (int l = 0; l < HEAVY_LANES; l++) {
+		for (int i = 0; i < 8; i++)
+			vstate[i * HEAVY_LANES + l] = ms->sha[i];
+		for (int w = 0; w < 12; w++)
+			vblock[w * HEAVY_LANES + l] = swab32(tail[l][w]);
+		vblock[12 * HEAVY_LANES + l] = 0x80000000;
+		vblock[13 * HEAVY_LANES + l] = 0;
+		vblock[14 * HEAVY_LANES + l] = 0;
+		vblock[15 * HEAVY_LANES + l] = 112 * 8;
+	}
+	heavy_sha256_lanes(vstate, vblock, 0);
+	for (int l = 0; l < HEAVY_LANES; l++)
+		for (int i = 0; i < 8; i++)
+			hash2[l][i] = swab32(vstate[i * HEAVY_LANES + l]);
+
+	/* keccak512: bytes 72..111 and the padding in the second 72-byte block */
+	for (int g = 0; g < HEAVY_LANES; g += HEAVY_KECCAK_LANES) {
+		for (int k = 0; k < HEAVY_KECCAK_LANES; k++) {
+			const uint64_t *t = (const uint64_t *)tail[g + k];
+			for (int w = 0; w < 25; w++)
+				vkeccak[w * HEAVY_KECCAK_LANES + k] = ms->keccak[w];
+			for (int w = 0; w < 5; w++)
+				vkeccak[w * HEAVY_KECCAK_LANES + k] ^= t[1 + w];
+			vkeccak[5 * HEAVY_KECCAK_LANES + k] ^= 0x01;
+			vkeccak[8 * HEAVY_KECCAK_LANES + k] ^= 0x8000000000000000ULL;
+		}
+		heavy_keccakf_lanes(vkeccak);
+		for (int k = 0; k < HEAVY_KECCAK_LANES; k++)
+			for (int w = 0; w < 8; w++)
+				hash3[g + k][w] = vkeccak[w * HEAVY_KECCAK_LANES + k];
+	}
+
+	for (int l = 0; l < HEAVY_LANES; l++) {
+		sph_groestl512_context groestl = ms->groestl;
+		sph_blake512_context blake = ms->blake;
+		uint32_t _ALIGN(64) hash4[16], hash5[16];
+
+		sph_groestl512(&groestl, tail[l], 48);
+		sph_groestl512_close(&groestl, hash4);
+		sph_blake512(&blake, tail[l], 48);
+		sph_blake512_close(&blake, hash5);
+
+		combine_hashes(hash + 8 * l, hash2[l], (uint32_t *)hash3[l], hash4, hash5);
+	}
+}
+
 int scanhash_heavy(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done)
 {
 	uint32_t _ALIGN(128) hash[8];
@@ -87,20 +222,27 @@ int scanhash_heavy(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *
 	uint32_t nonce = first_nonce;
 
 	const uint32_t Htarg = ptarget[7];
+	uint32_t _ALIGN(64) vhash[8 * HEAVY_LANES];
+	struct heavy_midstate ms;
+
+	heavy_prepare(&ms, pdata);
+
 	do {
-		pdata[19] = nonce;
-		heavyhash((unsigned char *)hash, (unsigned char *)pdata, 80);
+		heavyhash_lanes(vhash, &ms, pdata, nonce);
 
-		if (hash[7] <= Htarg && fulltest(hash, ptarget)) {
+		int l = fulltest_lanes(vhash, hash_lanes_le_target(&vhash[7], 8, HEAVY_LANES, Htarg, 0), ptarget);
+		if (l >= 0) {
+			memcpy(hash, vhash + 8 * l, 32);
 			work_set_target_ratio(work, hash);
-			pdata[19] = nonce;
+			pdata[19] = nonce + l;
 			*hashes_done = pdata[19] - first_nonce;
 			return 1;
 		}
-		nonce++;
+		nonce += HEAVY_LANES;
 
 	} while (nonce < max_nonce && !work_restart[thr_id].restart);
 
+	pdata[19] = nonce - 1;
 	*hashes_done = pdata[19] - first_nonce;
 	return 0;
-}
\ No newline at end of file
+}
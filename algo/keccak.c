@@ -17,8 +17,24 @@ extern void keccakhash(void *state, const void *input)
 	memcpy(state, hash, 32);
 }
 
+#ifndef SSE
+#ifdef __AVX512F__
+#define KECCAK_LANES 8
+#define keccak256_lanes sph_keccak256_AVX512
+#else
+#define KECCAK_LANES 4
+#define keccak256_lanes sph_keccak256_AVX
+#endif
+#else
+#define KECCAK_LANES 2
+#define keccak256_lanes sph_keccak256_SSE2
+#endif
+
 int scanhash_keccak(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done)
 {
+	/* 80-byte headers and 32-byte digests, interleaved by 64-bit word */
+	uint64_t _ALIGN(64) vdata[10 * KECCAK_LANES];
+	uint64_t _ALIGN(64) vhash[4 * KECCAK_LANES];
 	uint32_t _ALIGN(128) hash32[8];
 	uint32_t _ALIGN(128) endiandata[20];
 	uint32_t *pdata = work->data;
@@ -30,19 +46,33 @@ int scanhash_keccak(int thr_id, struct work *work, uint32_t max_nonce, uint64_t
 	for (int k=0; k < 19; k++)
 		be32enc(&endiandata[k], pdata[k]);
 
+	for (int w = 0; w < 9; w++)
+		for (int l = 0; l < KECCAK_LANES; l++)
+			vdata[w * KECCAK_LANES + l] = ((uint64_t *)endiandata)[w];
+
 	const uint32_t Htarg = ptarget[7];
 	do {
+		for (int l = 0; l < KECCAK_LANES; l++) {
+			be32enc(&endiandata[19], n + 1 + l);
+			vdata[9 * KECCAK_LANES + l] = ((uint64_t *)endiandata)[9];
+		}
+		keccak256_lanes(vhash, vdata, 80);
 
-		pdata[19] = ++n;
-		be32enc(&endiandata[19], n);
-		keccakhash(hash32, endiandata);
-
-		if (hash32[7] <= Htarg && fulltest(hash32, ptarget)) {
-			work_set_target_ratio(work, hash32);
-			pdata[19] = n;
-			*hashes_done = pdata[19] - first_nonce;
-			return true;
+		/* high half of word 3, i.e. hash32[7], of every lane */
+		uint32_t mask = hash_lanes_le_target((uint32_t *)&vhash[3 * KECCAK_LANES] + 1, 2, KECCAK_LANES, Htarg, 0);
+		for (int l = 0; mask; l++, mask >>= 1) {
+			if (!(mask & 1))
+				continue;
+			for (int w = 0; w < 4; w++)
+				((uint64_t *)hash32)[w] = vhash[w * KECCAK_LANES + l];
+			if (fulltest(hash32, ptarget)) {
+				work_set_target_ratio(work, hash32);
+				pdata[19] = n + 1 + l;
+				*hashes_done = pdata[19] - first_nonce;
+				return true;
+			}
 		}
+		n += KECCAK_LANES;
 	} while (n < max_nonce && !work_restart[thr_id].restart);
 
 	*hashes_done = n - first_nonce + 1;
@@ -48,6 +48,108 @@ void lyra2_hash(void *state, const void *input, __m256i *wholeMatrix)
 	memcpy(state, hashA, 32);
 }
 
+/* 8 nonces from the one of input on, pre_h is sph_blake256_80_init() of input */
+void lyra2_hash_AVX(void *state, const void *input, __m256i *wholeMatrix, const void *pre_h)
+{
+	__m256i hashA[8], hashB[8];
+
+	sph_blake256_80_AVX(hashA, input, 80, pre_h);
+
+	hashB[0] = _mm256_unpacklo_epi32(hashA[0], hashA[1]); // 00 01 08 09 20 21 28 29
+	hashB[1] = _mm256_unpacklo_epi32(hashA[2], hashA[3]); // 02 03 0A 0B 22 23 2A 2B
+	hashB[2] = _mm256_unpacklo_epi32(hashA[4], hashA[5]); // 04 05 0C 0D 24 25 2C 2D
+	hashB[3] = _mm256_unpacklo_epi32(hashA[6], hashA[7]); // 06 07 0E 0F 26 27 2E 2F
+	hashB[4] = _mm256_unpackhi_epi32(hashA[0], hashA[1]); // 10 11 18 19 30 31 38 39
+	hashB[5] = _mm256_unpackhi_epi32(hashA[2], hashA[3]); // 12 13 1A 1B 32 33 3A 3B
+	hashB[6] = _mm256_unpackhi_epi32(hashA[4], hashA[5]); // 14 15 1C 1D 34 35 3C 3D
+	hashB[7] = _mm256_unpackhi_epi32(hashA[6], hashA[7]); // 16 17 1E 1F 36 37 3E 3F
+
+	sph_keccak256_32_AVX(hashA + 0, hashB + 0, 32);
+	sph_keccak256_32_AVX(hashA + 4, hashB + 4, 32);
+
+	hashB[0] = _mm256_unpacklo_epi64(hashA[0], hashA[1]); // 00 01 02 03 20 21 22 23
+	hashB[1] = _mm256_unpacklo_epi64(hashA[2], hashA[3]); // 04 05 06 07 24 25 26 27
+	hashB[2] = _mm256_unpacklo_epi64(hashA[4], hashA[5]); // 10 11 12 13 30 31 32 33
+	hashB[3] = _mm256_unpacklo_epi64(hashA[6], hashA[7]); // 14 15 16 17 34 35 36 37
+	hashB[4] = _mm256_unpackhi_epi64(hashA[0], hashA[1]); // 08 09 0A 0B 28 29 2A 2B
+	hashB[5] = _mm256_unpackhi_epi64(hashA[2], hashA[3]); // 0C 0D 0E 0F 2C 2D 2E 2F
+	hashB[6] = _mm256_unpackhi_epi64(hashA[4], hashA[5]); // 18 19 1A 1B 38 39 3A 3B
+	hashB[7] = _mm256_unpackhi_epi64(hashA[6], hashA[7]); // 1C 1D 1E 1F 3C 3D 3E 3F
+
+	hashA[0] = _mm256_permute2x128_si256(hashB[0], hashB[1], 0x20); // 00 01 02 03 04 05 06 07
+	hashA[1] = _mm256_permute2x128_si256(hashB[4], hashB[5], 0x20); // 08 09 0A 0B 0C 0D 0E 0F
+	hashA[2] = _mm256_permute2x128_si256(hashB[2], hashB[3], 0x20); // 10 11 12 13 14 15 16 17
+	hashA[3] = _mm256_permute2x128_si256(hashB[6], hashB[7], 0x20); // 18 19 1A 1B 1C 1D 1E 1F
+	hashA[4] = _mm256_permute2x128_si256(hashB[0], hashB[1], 0x31); // 20 21 22 23 24 25 26 27
+	hashA[5] = _mm256_permute2x128_si256(hashB[4], hashB[5], 0x31); // 28 29 2A 2B 2C 2D 2E 2F
+	hashA[6] = _mm256_permute2x128_si256(hashB[2], hashB[3], 0x31); // 30 31 32 33 34 35 36 37
+	hashA[7] = _mm256_permute2x128_si256(hashB[6], hashB[7], 0x31); // 38 39 3A 3B 3C 3D 3E 3F
+	for (int i = 0; i < 8; i++)
+		LYRA2(hashA + i, 32, hashA + i, 32, hashA + i, 32, 1, 8, 8, wholeMatrix);
+
+	hashB[0] = _mm256_unpacklo_epi64(hashA[0], hashA[2]); // 00 01 10 11 04 05 14 15
+	hashB[1] = _mm256_unpackhi_epi64(hashA[0], hashA[2]); // 02 03 12 13 06 07 16 17
+	hashB[2] = _mm256_unpacklo_epi64(hashA[1], hashA[3]); // 08 09 18 19 0C 0D 1C 1D
+	hashB[3] = _mm256_unpackhi_epi64(hashA[1], hashA[3]); // 0A 0B 1A 1B 0E 0F 1E 1F
+	hashB[4] = _mm256_unpacklo_epi64(hashA[4], hashA[6]); // 20 21 30 31 24 25 34 35
+	hashB[5] = _mm256_unpackhi_epi64(hashA[4], hashA[6]); // 22 23 32 33 26 27 36 37
+	hashB[6] = _mm256_unpacklo_epi64(hashA[5], hashA[7]); // 28 29 38 39 2C 2D 3C 3D
+	hashB[7] = _mm256_unpackhi_epi64(hashA[5], hashA[7]); // 2A 2B 3A 3B 2E 2F 3E 3F
+
+	hashA[0] = _mm256_permute2x128_si256(hashB[0], hashB[2], 0x20); // 00 01 10 11 08 09 18 19
+	hashA[1] = _mm256_permute2x128_si256(hashB[1], hashB[3], 0x20); // 02 03 12 13 0A 0B 1A 1B
+	hashA[2] = _mm256_permute2x128_si256(hashB[0], hashB[2], 0x31); // 04 05 14 15 0C 0D 1C 1D
+	hashA[3] = _mm256_permute2x128_si256(hashB[1], hashB[3], 0x31); // 06 07 16 17 0E 0F 1E 1F
+	hashA[4] = _mm256_permute2x128_si256(hashB[4], hashB[6], 0x20); // 20 21 30 31 28 29 38 39
+	hashA[5] = _mm256_permute2x128_si256(hashB[5], hashB[7], 0x20); // 22 23 32 33 2A 2B 3A 3B
+	hashA[6] = _mm256_permute2x128_si256(hashB[4], hashB[6], 0x31); // 24 25 34 35 2C 2D 3C 3D
+	hashA[7] = _mm256_permute2x128_si256(hashB[5], hashB[7], 0x31); // 26 27 36 37 2E 2F 3E 3F
+
+	hashB[0] = _mm256_permute2x128_si256(hashA[0], hashA[4], 0x20); // 00 01 10 11 20 21 30 31
+	hashB[1] = _mm256_permute2x128_si256(hashA[1], hashA[5], 0x20); // 02 03 12 13 22 23 32 33
+	hashB[2] = _mm256_permute2x128_si256(hashA[2], hashA[6], 0x20); // 04 05 14 15 24 25 34 35
+	hashB[3] = _mm256_permute2x128_si256(hashA[3], hashA[7], 0x20); // 06 07 16 17 26 27 36 37
+	hashB[4] = _mm256_permute2x128_si256(hashA[0], hashA[4], 0x31); // 08 09 18 19 28 29 38 39
+	hashB[5] = _mm256_permute2x128_si256(hashA[1], hashA[5], 0x31); // 0A 0B 1A 1B 2A 2B 3A 3B
+	hashB[6] = _mm256_permute2x128_si256(hashA[2], hashA[6], 0x31); // 0C 0D 1C 1D 2C 2D 3C 3D
+	hashB[7] = _mm256_permute2x128_si256(hashA[3], hashA[7], 0x31); // 0E 0F 1E 1F 2E 2F 3D 3F
+
+	sph_skein256_32_AVX(hashA + 0, hashB + 0, 32);
+	sph_skein256_32_AVX(hashA + 4, hashB + 4, 32);
+
+	hashB[0] = _mm256_unpacklo_epi64(hashA[0], hashA[1]); // 00 01 02 03 20 21 22 23
+	hashB[1] = _mm256_unpacklo_epi64(hashA[2], hashA[3]); // 04 05 06 07 24 25 26 27
+	hashB[2] = _mm256_unpackhi_epi64(hashA[0], hashA[1]); // 10 11 12 13 30 31 32 33
+	hashB[3] = _mm256_unpackhi_epi64(hashA[2], hashA[3]); // 14 15 16 17 34 35 36 37
+	hashB[4] = _mm256_unpacklo_epi64(hashA[4], hashA[5]); // 08 09 0A 0B 28 29 2A 2B
+	hashB[5] = _mm256_unpacklo_epi64(hashA[6], hashA[7]); // 0C 0D 0E 0F 2C 2D 2E 2F
+	hashB[6] = _mm256_unpackhi_epi64(hashA[4], hashA[5]); // 18 19 1A 1B 38 39 3A 3B
+	hashB[7] = _mm256_unpackhi_epi64(hashA[6], hashA[7]); // 1C 1D 1E 1F 3C 3D 3E 3F
+
+	hashA[0] = _mm256_permute2x128_si256(hashB[0], hashB[1], 0x20); // 00 01 02 03 04 05 06 07
+	hashA[1] = _mm256_permute2x128_si256(hashB[4], hashB[5], 0x20); // 08 09 0A 0B 0C 0D 0E 0F
+	hashA[2] = _mm256_permute2x128_si256(hashB[2], hashB[3], 0x20); // 10 11 12 13 14 15 16 17
+	hashA[3] = _mm256_permute2x128_si256(hashB[6], hashB[7], 0x20); // 18 19 1A 1B 1C 1D 1E 1F
+	hashA[4] = _mm256_permute2x128_si256(hashB[0], hashB[1], 0x31); // 20 21 22 23 24 25 26 27
+	hashA[5] = _mm256_permute2x128_si256(hashB[4], hashB[5], 0x31); // 28 29 2A 2B 2C 2D 2E 2F
+	hashA[6] = _mm256_permute2x128_si256(hashB[2], hashB[3], 0x31); // 30 31 32 33 34 35 36 37
+	hashA[7] = _mm256_permute2x128_si256(hashB[6], hashB[7], 0x31); // 38 39 3A 3B 3C 3D 3E 3F
+
+	if (aes_ni_supported) {
+		for (int i = 0; i < 8; i += 2)
+			sph_groestl256_32_AES((__m256i*)state + i, hashA + i, 32);
+	} else {
+		sph_groestl256_context ctx_groestl;
+
+		for (int i = 0; i < 8; i++) {
+			sph_groestl256_init(&ctx_groestl);
+			sph_groestl256(&ctx_groestl, hashA + i, 32);
+			sph_groestl256_close(&ctx_groestl, (__m256i*)state + i);
+		}
+	}
+	_mm256_zeroupper();
+}
+
 #else
 void lyra2_hash_SSE(void *state, const void *input, __m128i *wholeMatrix)
 {
@@ -85,7 +187,12 @@ void lyra2_hash_SSE(void *state, const void *input, __m128i *wholeMatrix)
 
 int scanhash_lyra2(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done)
 {
+#ifndef SSE
+	uint32_t _ALIGN(128) hash[64];
+	uint32_t _ALIGN(128) pre_h[8];
+#else
 	uint32_t _ALIGN(128) hash[8];
+#endif
 	uint32_t _ALIGN(128) endiandata[20];
 	uint32_t *pdata = work->data;
 	uint32_t *ptarget = work->target;
@@ -107,13 +214,28 @@ int scanhash_lyra2(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *
 	}
 	memset(wholeMatrix, 0, 6144);
 
+#ifndef SSE
+	sph_blake256_80_init(pre_h, endiandata, 80);
+
 	do {
 		be32enc(&endiandata[19], nonce);
-#ifndef SSE
-		lyra2_hash(hash, endiandata, (__m256i*)wholeMatrix);
+		lyra2_hash_AVX(hash, endiandata, (__m256i*)wholeMatrix, pre_h);
+
+		int l = fulltest_lanes(hash, hash_lanes_le_target(&hash[7], 8, 8, Htarg, 0), ptarget);
+		if (l >= 0) {
+			work_set_target_ratio(work, hash + l * 8);
+			pdata[19] = nonce + l;
+			*hashes_done = pdata[19] - first_nonce;
+			_aligned_free(wholeMatrix);
+			return 1;
+		}
+		nonce += 8;
+
+	} while (nonce < max_nonce && !work_restart[thr_id].restart);
 #else
+	do {
+		be32enc(&endiandata[19], nonce);
 		lyra2_hash_SSE(hash, endiandata, wholeMatrix);
-#endif
 		if (hash[7] <= Htarg && fulltest(hash, ptarget)) {
 			work_set_target_ratio(work, hash);
 			pdata[19] = nonce;
@@ -124,6 +246,7 @@ int scanhash_lyra2(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *
 		nonce++;
 
 	} while (nonce < max_nonce && !work_restart[thr_id].restart);
+#endif
 
 	pdata[19] = nonce;
 	*hashes_done = pdata[19] - first_nonce + 1;
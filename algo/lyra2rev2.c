@@ -25,12 +25,15 @@ void lyra2rev2_hash_AVX(void *state, const void *input, __m256i *wholeMatrix, in
 {
 	__m256i hashA[8], hashB[8];
 
+	PROF_START();
+
 	if (flag) {
 		sph_blake256_80_init(wholeMatrix2, input, 80);
 		flag = 0;
 	}
 
 	sph_blake256_80_AVX(hashA, input, 80, wholeMatrix2);
+	PROF_STAGE(0, "blake");
 
 	hashB[0] = _mm256_unpacklo_epi32(hashA[0], hashA[1]); // 00 01 08 09 20 21 28 29
 	hashB[1] = _mm256_unpacklo_epi32(hashA[2], hashA[3]); // 02 03 0A 0B 22 23 2A 2B
@@ -41,8 +44,10 @@ void lyra2rev2_hash_AVX(void *state, const void *input, __m256i *wholeMatrix, in
 	hashB[6] = _mm256_unpackhi_epi32(hashA[4], hashA[5]); // 14 15 1C 1D 34 35 3C 3D
 	hashB[7] = _mm256_unpackhi_epi32(hashA[6], hashA[7]); // 16 17 1E 1F 36 37 3E 3F
 
+	PROF_STAGE(1, "transpose");
 	sph_keccak256_32_AVX(hashA + 0, hashB + 0, 32);
 	sph_keccak256_32_AVX(hashA + 4, hashB + 4, 32);
+	PROF_STAGE(2, "keccak");
 
 	hashB[0] = _mm256_unpacklo_epi64(hashA[0], hashA[1]); // 00 01 02 03 20 21 22 23
 	hashB[1] = _mm256_unpacklo_epi64(hashA[2], hashA[3]); // 04 05 06 07 24 25 26 27
@@ -61,11 +66,22 @@ void lyra2rev2_hash_AVX(void *state, const void *input, __m256i *wholeMatrix, in
 	hashA[5] = _mm256_permute2x128_si256(hashB[4], hashB[5], 0x31); // 28 29 2A 2B 2C 2D 2E 2F
 	hashA[6] = _mm256_permute2x128_si256(hashB[2], hashB[3], 0x31); // 30 31 32 33 34 35 36 37
 	hashA[7] = _mm256_permute2x128_si256(hashB[6], hashB[7], 0x31); // 38 39 3A 3B 3C 3D 3E 3F
+#ifdef HASH_PROFILE
+	/* split so that cubehash and lyra2 are timed apart */
+	PROF_STAGE(1, "transpose");
+	for (int i = 0; i < 8; i++)
+		sph_cubehash256(hashB + i, hashA + i, 32);
+	PROF_STAGE(3, "cubehash");
+	for (int i = 0; i < 8; i++)
+		LYRA2v2(hashA + i, hashB + i, wholeMatrix);
+	PROF_STAGE(4, "lyra2");
+#else
 	for (int i = 0; i < 8; i++)
 	{
 		sph_cubehash256(hashB + i, hashA + i, 32);
 		LYRA2v2(hashA + i, hashB + i, wholeMatrix);
 	}
+#endif
 
 	hashB[0] = _mm256_unpacklo_epi64(hashA[0], hashA[2]); // 00 01 10 11 04 05 14 15
 	hashB[1] = _mm256_unpackhi_epi64(hashA[0], hashA[2]); // 02 03 12 13 06 07 16 17
@@ -94,8 +110,10 @@ void lyra2rev2_hash_AVX(void *state, const void *input, __m256i *wholeMatrix, in
 	hashB[6] = _mm256_permute2x128_si256(hashA[2], hashA[6], 0x31); // 0C 0D 1C 1D 2C 2D 3C 3D
 	hashB[7] = _mm256_permute2x128_si256(hashA[3], hashA[7], 0x31); // 0E 0F 1E 1F 2E 2F 3D 3F
 
+	PROF_STAGE(1, "transpose");
 	sph_skein256_32_AVX(hashA + 0, hashB + 0, 32);
 	sph_skein256_32_AVX(hashA + 4, hashB + 4, 32);
+	PROF_STAGE(5, "skein");
 
 	hashB[0] = _mm256_unpacklo_epi64(hashA[0], hashA[1]); // 00 01 02 03 20 21 22 23
 	hashB[1] = _mm256_unpacklo_epi64(hashA[2], hashA[3]); // 04 05 06 07 24 25 26 27
@@ -115,10 +133,12 @@ void lyra2rev2_hash_AVX(void *state, const void *input, __m256i *wholeMatrix, in
 	hashA[6] = _mm256_permute2x128_si256(hashB[2], hashB[3], 0x31); // 30 31 32 33 34 35 36 37
 	hashA[7] = _mm256_permute2x128_si256(hashB[6], hashB[7], 0x31); // 38 39 3A 3B 3C 3D 3E 3F
 
+	PROF_STAGE(1, "transpose");
 	for (int i = 0; i < 8; i++)
 	{
 		sph_cubehash256(hashB + i, hashA + i, 32);
 	}
+	PROF_STAGE(3, "cubehash");
 
 	hashA[0] = _mm256_unpacklo_epi32(hashB[0], hashB[1]); // 00 10 01 11 04 14 05 15
 	hashA[1] = _mm256_unpackhi_epi32(hashB[0], hashB[1]); // 02 12 03 13 06 16 07 17
@@ -147,7 +167,9 @@ void lyra2rev2_hash_AVX(void *state, const void *input, __m256i *wholeMatrix, in
 	hashA[6] = _mm256_permute2x128_si256(hashB[2], hashB[6], 0x31); // 06 16 26 36 46 56 66 76
 	hashA[7] = _mm256_permute2x128_si256(hashB[3], hashB[7], 0x31); // 07 17 27 37 47 57 67 77
 
+	PROF_STAGE(1, "transpose");
 	sph_bmw256_AVX(hashB, hashA, 32);
+	PROF_STAGE(6, "bmw");
 
 	hashA[0] = _mm256_unpacklo_epi32(hashB[0], hashB[1]); // 00 01 10 11 40 41 50 51
 	hashA[1] = _mm256_unpackhi_epi32(hashB[0], hashB[1]); // 20 21 30 31 60 61 70 71
@@ -179,6 +201,7 @@ void lyra2rev2_hash_AVX(void *state, const void *input, __m256i *wholeMatrix, in
 	for (int i = 0; i < 8; i++)
 		_mm256_storeu_si256(((__m256i*)state) + i, hashA[i]);
 	_mm256_zeroupper();
+	PROF_STAGE(1, "transpose");
 }
 #else
 
@@ -188,6 +211,8 @@ void lyra2rev2_hash_SSE(void *state, const void *input, __m128i *wholeMatrix, in
 	__m128i *hashA = hash;
 	__m128i *hashB = hash + 16;
 
+	PROF_START();
+
 	if (flag) {
 		sph_blake256_80_init(wholeMatrix2, input, 80);
 		flag = 0;
@@ -196,6 +221,7 @@ void lyra2rev2_hash_SSE(void *state, const void *input, __m128i *wholeMatrix, in
 	for (int j = 0; j < 2; j++, hashA += 8, hashB += 8)
 	{
 		sph_blake256_80_SSE2(hashA, input, 80, wholeMatrix2);
+		PROF_STAGE(0, "blake");
 
 		hashB[0] = _mm_unpacklo_epi32(hashA[0], hashA[1]); // 00 01 08 09
 		hashB[1] = _mm_unpacklo_epi32(hashA[2], hashA[3]); // 02 03 0A 0B
@@ -206,8 +232,10 @@ void lyra2rev2_hash_SSE(void *state, const void *input, __m128i *wholeMatrix, in
 		hashB[6] = _mm_unpackhi_epi32(hashA[4], hashA[5]); // 14 15 1C 1D
 		hashB[7] = _mm_unpackhi_epi32(hashA[6], hashA[7]); // 16 17 1E 1F
 
+		PROF_STAGE(1, "transpose");
 		sph_keccak256_32_SSE2(hashA + 0, hashB + 0, 32);
 		sph_keccak256_32_SSE2(hashA + 4, hashB + 4, 32);
+		PROF_STAGE(2, "keccak");
 
 		hashB[0] = _mm_unpacklo_epi64(hashA[0], hashA[1]); // 00 01 02 03
 		hashB[1] = _mm_unpacklo_epi64(hashA[2], hashA[3]); // 04 05 06 07
@@ -218,6 +246,22 @@ void lyra2rev2_hash_SSE(void *state, const void *input, __m128i *wholeMatrix, in
 		hashB[6] = _mm_unpackhi_epi64(hashA[4], hashA[5]); // 18 19 1A 1B
 		hashB[7] = _mm_unpackhi_epi64(hashA[6], hashA[7]); // 1C 1D 1E 1F
 
+#ifdef HASH_PROFILE
+		/* split so that cubehash and lyra2 are timed apart */
+		PROF_STAGE(1, "transpose");
+		for (int i = 0; i < 8; i += 2)
+			sph_cubehash256_SSE2(hashA + i, hashB + i, 32);
+		PROF_STAGE(3, "cubehash");
+		for (int i = 0; i < 8; i += 2)
+		{
+#ifdef SSE3
+			LYRA2v2_SSSE3(hashB + i, hashA + i, wholeMatrix);
+#else
+			LYRA2v2_SSE2(hashB + i, hashA + i, wholeMatrix);
+#endif
+		}
+		PROF_STAGE(4, "lyra2");
+#else
 		for (int i = 0; i < 8; i += 2)
 		{
 			sph_cubehash256_SSE2(hashA + i, hashB + i, 32);
@@ -227,6 +271,7 @@ void lyra2rev2_hash_SSE(void *state, const void *input, __m128i *wholeMatrix, in
 			LYRA2v2_SSE2(hashB + i, hashA + i, wholeMatrix);
 #endif
 		}
+#endif
 
 		hashA[0] = _mm_unpacklo_epi64(hashB[0], hashB[2]); // 00 01 08 09
 		hashA[1] = _mm_unpackhi_epi64(hashB[0], hashB[2]); // 02 03 0A 0B
@@ -237,8 +282,10 @@ void lyra2rev2_hash_SSE(void *state, const void *input, __m128i *wholeMatrix, in
 		hashA[6] = _mm_unpacklo_epi64(hashB[5], hashB[7]); // 14 15 1C 1D
 		hashA[7] = _mm_unpackhi_epi64(hashB[5], hashB[7]); // 16 17 1E 1F
 
+		PROF_STAGE(1, "transpose");
 		sph_skein256_32_SSE2(hashB + 0, hashA + 0, 32);
 		sph_skein256_32_SSE2(hashB + 4, hashA + 4, 32);
+		PROF_STAGE(5, "skein");
 
 		hashA[0] = _mm_unpacklo_epi64(hashB[0], hashB[1]); // 00 01 02 03
 		hashA[1] = _mm_unpacklo_epi64(hashB[2], hashB[3]); // 04 05 06 07
@@ -249,11 +296,13 @@ void lyra2rev2_hash_SSE(void *state, const void *input, __m128i *wholeMatrix, in
 		hashA[6] = _mm_unpackhi_epi64(hashB[4], hashB[5]); // 18 19 1A 1B
 		hashA[7] = _mm_unpackhi_epi64(hashB[6], hashB[7]); // 1C 1D 1E 1F
 
+		PROF_STAGE(1, "transpose");
 		for (int i = 0; i < 8; i += 2)
 		{
 			sph_cubehash256_SSE2(hashB + i, hashA + i, 32);
 			//sph_cubehash256(hashB + i, hashA + i, 32);
 		}
+		PROF_STAGE(3, "cubehash");
 
 		hashA[0] = _mm_unpacklo_epi32(hashB[0], hashB[2]); // 00 08 01 09
 		hashA[1] = _mm_unpackhi_epi32(hashB[0], hashB[2]); // 02 0A 03 0B
@@ -273,7 +322,9 @@ void lyra2rev2_hash_SSE(void *state, const void *input, __m128i *wholeMatrix, in
 		hashB[6] = _mm_unpacklo_epi64(hashA[3], hashA[7]); // 06 1E 16 1E
 		hashB[7] = _mm_unpackhi_epi64(hashA[3], hashA[7]); // 07 1F 17 1F
 
+		PROF_STAGE(1, "transpose");
 		sph_bmw256_SSE2(hashA, hashB, 32);
+		PROF_STAGE(6, "bmw");
 
 		hashB[0] = _mm_unpacklo_epi32(hashA[0], hashA[1]); // 00 01 08 09
 		hashB[1] = _mm_unpacklo_epi32(hashA[2], hashA[3]); // 02 03 0A 0B
@@ -295,6 +346,7 @@ void lyra2rev2_hash_SSE(void *state, const void *input, __m128i *wholeMatrix, in
 
 		for (int i = 0; i < 8; i++)
 			_mm_storeu_si128(((__m128i*)state) + i + j * 8, hashA[i]);
+		PROF_STAGE(1, "transpose");
 	}
 }
 #endif
@@ -328,15 +380,14 @@ int scanhash_lyra2rev2(int thr_id, struct work *work, uint32_t max_nonce, uint64
 #else
 		lyra2rev2_hash_SSE(hash, endiandata, wholeMatrix, &flag, wholeMatrix2);
 #endif
-		for (int i = 0; i < 8; i++) {
-			if (hash[7 + i * 8] <= Htarg && fulltest(hash + i * 8, ptarget)) {
-				work_set_target_ratio(work, hash + i * 8);
-				pdata[19] = nonce;
-				*hashes_done = pdata[19] - first_nonce;
-				return 1;
-			}
-			nonce ++;
+		int l = fulltest_lanes(hash, hash_lanes_le_target(&hash[7], 8, 8, Htarg, 0), ptarget);
+		if (l >= 0) {
+			work_set_target_ratio(work, hash + l * 8);
+			pdata[19] = nonce + l;
+			*hashes_done = pdata[19] - first_nonce;
+			return 1;
 		}
+		nonce += 8;
 
 	} while (nonce < max_nonce && !work_restart[thr_id].restart);
 
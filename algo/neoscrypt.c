@@ -768,6 +768,333 @@ void neoscrypt(uchar *output, const uchar *password, uint32_t profile)
 
 }
 
+/*
+ * Lane-parallel NeoScrypt(N, 2, 1): one nonce per 32-bit element, 8 lanes
+ * with AVX2 or 16 with AVX-512. All mixing state is kept word-major (word w
+ * of lane l at [w * NS_LANES + l]) so Salsa20, ChaCha20 and BLAKE2s need no
+ * shuffles; the per-lane V indices of SMix and buffer pointers of FastKDF
+ * are served with gathers.
+ */
+#ifdef __AVX512F__
+#define NS_LANES 16
+#define NS_LANES_SHIFT 4
+typedef __m512i nsv;
+#define ns_add(a, b)            _mm512_add_epi32(a, b)
+#define ns_xor(a, b)            _mm512_xor_si512(a, b)
+#define ns_and(a, b)            _mm512_and_si512(a, b)
+#define ns_srli(a, c)           _mm512_srli_epi32(a, c)
+#define ns_slli(a, c)           _mm512_slli_epi32(a, c)
+#define ns_rol(a, c)            _mm512_rol_epi32(a, c)
+#define ns_ror(a, c)            _mm512_ror_epi32(a, c)
+#define ns_set1(x)              _mm512_set1_epi32(x)
+#define ns_gather(base, idx, s) _mm512_i32gather_epi32(idx, (const void *)(base), s)
+#define ns_iota()               _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15)
+#else
+#define NS_LANES 8
+#define NS_LANES_SHIFT 3
+typedef __m256i nsv;
+#define ns_add(a, b)            _mm256_add_epi32(a, b)
+#define ns_xor(a, b)            _mm256_xor_si256(a, b)
+#define ns_and(a, b)            _mm256_and_si256(a, b)
+#define ns_srli(a, c)           _mm256_srli_epi32(a, c)
+#define ns_slli(a, c)           _mm256_slli_epi32(a, c)
+#define ns_rol(a, c)            _mm256_or_si256(_mm256_slli_epi32(a, c), _mm256_srli_epi32(a, 32 - (c)))
+#define ns_ror(a, c)            _mm256_or_si256(_mm256_srli_epi32(a, c), _mm256_slli_epi32(a, 32 - (c)))
+#define ns_set1(x)              _mm256_set1_epi32(x)
+#define ns_gather(base, idx, s) _mm256_i32gather_epi32((const int *)(base), idx, s)
+#define ns_iota()               _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)
+#endif
+
+#ifdef _MSC_VER
+#define NS_INLINE __forceinline
+#else
+#define NS_INLINE inline __attribute__((always_inline))
+#endif
+
+/* FastKDF buffer of one lane: 256 bytes + a 64 (A) or 32 (B) byte tail */
+#define NS_KDF_STRIDE 320
+
+/* Salsa20/20 */
+static inline void neoscrypt_salsa_lanes(nsv *B)
+{
+	nsv x0 = B[0], x1 = B[1], x2 = B[2], x3 = B[3], x4 = B[4], x5 = B[5], x6 = B[6], x7 = B[7];
+	nsv x8 = B[8], x9 = B[9], x10 = B[10], x11 = B[11], x12 = B[12], x13 = B[13], x14 = B[14], x15 = B[15];
+	int i;
+
+#define R(a, b, c, n) a = ns_xor(a, ns_rol(ns_add(b, c), n))
+	for (i = 0; i < 20; i += 2) {
+		R(x4, x0, x12, 7);   R(x9, x5, x1, 7);    R(x14, x10, x6, 7);  R(x3, x15, x11, 7);
+		R(x8, x4, x0, 9);    R(x13, x9, x5, 9);   R(x2, x14, x10, 9);  R(x7, x3, x15, 9);
+		R(x12, x8, x4, 13);  R(x1, x13, x9, 13);  R(x6, x2, x14, 13);  R(x11, x7, x3, 13);
+		R(x0, x12, x8, 18);  R(x5, x1, x13, 18);  R(x10, x6, x2, 18);  R(x15, x11, x7, 18);
+
+		R(x1, x0, x3, 7);    R(x6, x5, x4, 7);    R(x11, x10, x9, 7);  R(x12, x15, x14, 7);
+		R(x2, x1, x0, 9);    R(x7, x6, x5, 9);    R(x8, x11, x10, 9);  R(x13, x12, x15, 9);
+		R(x3, x2, x1, 13);   R(x4, x7, x6, 13);   R(x9, x8, x11, 13);  R(x14, x13, x12, 13);
+		R(x0, x3, x2, 18);   R(x5, x4, x7, 18);   R(x10, x9, x8, 18);  R(x15, x14, x13, 18);
+	}
+#undef R
+
+	B[0] = ns_add(B[0], x0);    B[1] = ns_add(B[1], x1);    B[2] = ns_add(B[2], x2);    B[3] = ns_add(B[3], x3);
+	B[4] = ns_add(B[4], x4);    B[5] = ns_add(B[5], x5);    B[6] = ns_add(B[6], x6);    B[7] = ns_add(B[7], x7);
+	B[8] = ns_add(B[8], x8);    B[9] = ns_add(B[9], x9);    B[10] = ns_add(B[10], x10); B[11] = ns_add(B[11], x11);
+	B[12] = ns_add(B[12], x12); B[13] = ns_add(B[13], x13); B[14] = ns_add(B[14], x14); B[15] = ns_add(B[15], x15);
+}
+
+/* ChaCha20/20 */
+static inline void neoscrypt_chacha_lanes(nsv *B)
+{
+	nsv x0 = B[0], x1 = B[1], x2 = B[2], x3 = B[3], x4 = B[4], x5 = B[5], x6 = B[6], x7 = B[7];
+	nsv x8 = B[8], x9 = B[9], x10 = B[10], x11 = B[11], x12 = B[12], x13 = B[13], x14 = B[14], x15 = B[15];
+	int i;
+
+#define Q(a, b, c, d) \
+	a = ns_add(a, b); d = ns_rol(ns_xor(d, a), 16); \
+	c = ns_add(c, d); b = ns_rol(ns_xor(b, c), 12); \
+	a = ns_add(a, b); d = ns_rol(ns_xor(d, a), 8); \
+	c = ns_add(c, d); b = ns_rol(ns_xor(b, c), 7);
+	for (i = 0; i < 20; i += 2) {
+		Q(x0, x4, x8, x12);  Q(x1, x5, x9, x13);  Q(x2, x6, x10, x14); Q(x3, x7, x11, x15);
+		Q(x0, x5, x10, x15); Q(x1, x6, x11, x12); Q(x2, x7, x8, x13);  Q(x3, x4, x9, x14);
+	}
+#undef Q
+
+	B[0] = ns_add(B[0], x0);    B[1] = ns_add(B[1], x1);    B[2] = ns_add(B[2], x2);    B[3] = ns_add(B[3], x3);
+	B[4] = ns_add(B[4], x4);    B[5] = ns_add(B[5], x5);    B[6] = ns_add(B[6], x6);    B[7] = ns_add(B[7], x7);
+	B[8] = ns_add(B[8], x8);    B[9] = ns_add(B[9], x9);    B[10] = ns_add(B[10], x10); B[11] = ns_add(B[11], x11);
+	B[12] = ns_add(B[12], x12); B[13] = ns_add(B[13], x13); B[14] = ns_add(B[14], x14); B[15] = ns_add(B[15], x15);
+}
+
+/* Block mixer with r = 2, same flow as neoscrypt_blkmix_chacha */
+#define NEOSCRYPT_BLKMIX_LANES(name, mix) \
+static void name(nsv *X) \
+{ \
+	nsv T[16]; \
+	int k; \
+	for (k = 0; k < 16; k++) X[k] = ns_xor(X[k], X[48 + k]); \
+	mix(X); \
+	for (k = 0; k < 16; k++) T[k] = ns_xor(X[16 + k], X[k]); \
+	mix(T); \
+	for (k = 0; k < 16; k++) X[16 + k] = ns_xor(X[32 + k], T[k]); \
+	mix(X + 16); \
+	for (k = 0; k < 16; k++) X[48 + k] = ns_xor(X[48 + k], X[16 + k]); \
+	mix(X + 48); \
+	for (k = 0; k < 16; k++) X[32 + k] = T[k]; \
+}
+
+NEOSCRYPT_BLKMIX_LANES(neoscrypt_blkmix_chacha_lanes, neoscrypt_chacha_lanes)
+NEOSCRYPT_BLKMIX_LANES(neoscrypt_blkmix_salsa_lanes, neoscrypt_salsa_lanes)
+
+#undef NEOSCRYPT_BLKMIX_LANES
+
+/* X = SMix(X), V holds N blocks of 64 word vectors */
+static NS_INLINE void neoscrypt_smix_lanes(nsv *X, nsv *V, uint N, void (*blkmix)(nsv *))
+{
+	const nsv lane = ns_iota();
+	uint i, k;
+
+	for (i = 0; i < N; i++) {
+		memcpy(V + i * 64, X, 64 * sizeof(nsv));
+		blkmix(X);
+	}
+	for (i = 0; i < N; i++) {
+		/* integerify(X) mod N, scaled to an element index into V */
+		nsv j = ns_add(ns_slli(ns_and(X[48], ns_set1(N - 1)), 6 + NS_LANES_SHIFT), lane);
+		for (k = 0; k < 64; k++)
+			X[k] = ns_xor(X[k], ns_gather(V, ns_add(j, ns_set1(k * NS_LANES)), 4));
+		blkmix(X);
+	}
+}
+
+static const uint32_t neoscrypt_blake2s_iv[8] = {
+	0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+	0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+static const uchar neoscrypt_blake2s_sigma[10][16] = {
+	{  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+	{ 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+	{ 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+	{  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+	{  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+	{  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+	{ 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+	{ 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+	{  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+	{ 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 }
+};
+
+static inline void neoscrypt_blake2s_compress_lanes(nsv *h, const nsv *m, uint32_t t, int last)
+{
+	nsv v[16];
+	int i, r;
+
+	for (i = 0; i < 8; i++) {
+		v[i] = h[i];
+		v[i + 8] = ns_set1(neoscrypt_blake2s_iv[i]);
+	}
+	v[12] = ns_set1(neoscrypt_blake2s_iv[4] ^ t);
+	if (last)
+		v[14] = ns_set1(~neoscrypt_blake2s_iv[6]);
+
+#define G(a, b, c, d, x, y) \
+	a = ns_add(ns_add(a, b), x); d = ns_ror(ns_xor(d, a), 16); \
+	c = ns_add(c, d);            b = ns_ror(ns_xor(b, c), 12); \
+	a = ns_add(ns_add(a, b), y); d = ns_ror(ns_xor(d, a), 8); \
+	c = ns_add(c, d);            b = ns_ror(ns_xor(b, c), 7);
+	for (r = 0; r < 10; r++) {
+		const uchar *s = neoscrypt_blake2s_sigma[r];
+		G(v[0], v[4], v[8], v[12], m[s[0]], m[s[1]]);
+		G(v[1], v[5], v[9], v[13], m[s[2]], m[s[3]]);
+		G(v[2], v[6], v[10], v[14], m[s[4]], m[s[5]]);
+		G(v[3], v[7], v[11], v[15], m[s[6]], m[s[7]]);
+		G(v[0], v[5], v[10], v[15], m[s[8]], m[s[9]]);
+		G(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+		G(v[2], v[7], v[8], v[13], m[s[12]], m[s[13]]);
+		G(v[3], v[4], v[9], v[14], m[s[14]], m[s[15]]);
+	}
+#undef G
+
+	for (i = 0; i < 8; i++)
+		h[i] = ns_xor(h[i], ns_xor(v[i], v[i + 8]));
+}
+
+/* FastKDF with 32 iterations over the per-lane byte buffers A and B
+ * (NS_KDF_STRIDE apart), output_len bytes per lane stored word-major */
+static void neoscrypt_fastkdf_lanes(const uchar *A, uchar *B, nsv *output, uint output_len)
+{
+	const nsv base = ns_slli(ns_iota(), 6), byte_mask = ns_set1(0x00FF00FF);
+	uint32_t _ALIGN(64) bufptr[NS_LANES];
+	uint32_t _ALIGN(64) prf_output[8][NS_LANES];
+	nsv h[8], m[16], ptr, lo, hi;
+	uint i, k, l;
+
+	/* lane l starts at l * NS_KDF_STRIDE, i.e. l * 5 * 64 */
+	ptr = ns_add(base, ns_slli(base, 2));
+	memset(bufptr, 0, sizeof(bufptr));
+
+	for (i = 0; i < 32; i++) {
+		/* PRF = BLAKE2s(A + bufptr, key = B + bufptr) */
+		for (k = 0; k < 8; k++) {
+			h[k] = ns_set1(neoscrypt_blake2s_iv[k]);
+			m[k] = ns_gather(B, ns_add(ptr, ns_set1(4 * k)), 1);
+			m[k + 8] = ns_set1(0);
+		}
+		h[0] = ns_set1(neoscrypt_blake2s_iv[0] ^ 0x01012020);
+		neoscrypt_blake2s_compress_lanes(h, m, 64, 0);
+		for (k = 0; k < 16; k++)
+			m[k] = ns_gather(A, ns_add(ptr, ns_set1(4 * k)), 1);
+		neoscrypt_blake2s_compress_lanes(h, m, 128, 1);
+
+		/* Calculate the next buffer pointer: the sum of the output bytes */
+		lo = hi = ns_set1(0);
+		for (k = 0; k < 8; k++) {
+			lo = ns_add(lo, ns_and(h[k], byte_mask));
+			hi = ns_add(hi, ns_and(ns_srli(h[k], 8), byte_mask));
+			memcpy(prf_output[k], &h[k], sizeof(nsv));
+		}
+		lo = ns_add(lo, hi);
+		lo = ns_and(ns_add(lo, ns_srli(lo, 16)), ns_set1(0xFF));
+		memcpy(bufptr, &lo, sizeof(nsv));
+		ptr = ns_add(ns_add(base, ns_slli(base, 2)), lo);
+
+		/* Modify the salt buffer */
+		for (l = 0; l < NS_LANES; l++) {
+			uchar *b = B + l * NS_KDF_STRIDE;
+			uint32_t *key = (uint32_t *)(b + bufptr[l]);
+			for (k = 0; k < 8; k++)
+				key[k] ^= prf_output[k][l];
+
+			/* Head modified, tail updated */
+			if (bufptr[l] < 32)
+				memcpy(b + 256, b, 32);
+			/* Tail modified, head updated */
+			if ((256 - bufptr[l]) < 32)
+				memcpy(b, b + 256, 32);
+		}
+	}
+
+	/* Modify and copy into the output buffer */
+	for (l = 0; l < NS_LANES; l++) {
+		const uchar *a = A + l * NS_KDF_STRIDE;
+		const uchar *b = B + l * NS_KDF_STRIDE;
+		for (k = 0; k < output_len / 4; k++) {
+			uint off = (bufptr[l] + 4 * k) & 255;
+			((uint32_t *)output)[k * NS_LANES + l] = *(uint32_t *)(b + off) ^ *(uint32_t *)(a + 4 * k);
+		}
+	}
+}
+
+static __thread nsv *neoscrypt_V = NULL;
+static __thread uint neoscrypt_V_N = 0;
+
+/* V for N blocks, kept per thread; NULL if it cannot be allocated */
+static nsv *neoscrypt_scratch(uint N)
+{
+	if (N > neoscrypt_V_N) {
+		hugepage_free(neoscrypt_V, (size_t)neoscrypt_V_N * 64 * sizeof(nsv));
+		neoscrypt_V = (nsv *)hugepage_alloc((size_t)N * 64 * sizeof(nsv));
+		neoscrypt_V_N = neoscrypt_V ? N : 0;
+	}
+	return neoscrypt_V;
+}
+
+/* NeoScrypt of NS_LANES headers, nonces nonce .. nonce + NS_LANES - 1 */
+static NS_INLINE void neoscrypt_lanes(uint32_t *hash, const uint32_t *data, uint32_t nonce, nsv *V, uint N)
+{
+	uchar _ALIGN(64) A[NS_LANES * NS_KDF_STRIDE];
+	uchar _ALIGN(64) B[NS_LANES * NS_KDF_STRIDE];
+	nsv X[64], Z[64], O[8];
+	uint k, l;
+
+	/* Initialise the password and salt buffers: the header repeated,
+	 * then its first 64 (A) or 32 (B) bytes again as the tail */
+	for (l = 0; l < NS_LANES; l++) {
+		uchar *a = A + l * NS_KDF_STRIDE;
+		memcpy(a, data, 76);
+		memcpy(a + 76, &nonce, 4);
+		((uint32_t *)a)[19] += l;
+		memcpy(a + 80, a, 80);
+		memcpy(a + 160, a, 80);
+		memcpy(a + 240, a, 16);
+		memcpy(a + 256, a, 64);
+		memcpy(B + l * NS_KDF_STRIDE, a, 288);
+	}
+
+	neoscrypt_fastkdf_lanes(A, B, X, 256);
+
+	/* Process ChaCha 1st, Salsa 2nd and XOR them into FastKDF */
+	memcpy(Z, X, sizeof(Z));
+	neoscrypt_smix_lanes(Z, V, N, neoscrypt_blkmix_chacha_lanes);
+	neoscrypt_smix_lanes(X, V, N, neoscrypt_blkmix_salsa_lanes);
+	for (k = 0; k < 64; k++)
+		X[k] = ns_xor(X[k], Z[k]);
+
+	/* output = KDF(password, X) */
+	for (l = 0; l < NS_LANES; l++) {
+		uint32_t *b = (uint32_t *)(B + l * NS_KDF_STRIDE);
+		for (k = 0; k < 64; k++)
+			b[k] = ((uint32_t *)X)[k * NS_LANES + l];
+		memcpy(b + 64, b, 32);
+	}
+	neoscrypt_fastkdf_lanes(A, B, O, 32);
+
+	for (l = 0; l < NS_LANES; l++)
+		for (k = 0; k < 8; k++)
+			hash[l * 8 + k] = ((uint32_t *)O)[k * NS_LANES + l];
+}
+
+/* The default profile: N, the SMix loop bounds and the index mask are constants */
+static void neoscrypt_lanes_128(uint32_t *hash, const uint32_t *data, uint32_t nonce, nsv *V)
+{
+	neoscrypt_lanes(hash, data, nonce, V, 128);
+}
+
+static void neoscrypt_lanes_n(uint32_t *hash, const uint32_t *data, uint32_t nonce, nsv *V, uint N)
+{
+	neoscrypt_lanes(hash, data, nonce, V, N);
+}
+
 #else
 
 /* NeoScrypt */
@@ -1423,13 +1750,46 @@ static bool fulltest_le(const uint *hash, const uint *target)
 int scanhash_neoscrypt(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done,
 	uint32_t profile)
 {
-	uint32_t _ALIGN(128) hash[16];
 	uint32_t *pdata = work->data;
 	uint32_t *ptarget = work->target;
 
 	const uint32_t Htarg = ptarget[7];
 	const uint32_t first_nonce = pdata[19];
 
+#ifndef SSE
+	uint32_t _ALIGN(64) lanes_hash[NS_LANES * 8];
+	/* profile bits 12 to 8: N = 2 << Nfactor */
+	const uint N = (profile & 0x80000000) ? 2U << ((profile >> 8) & 0x1F) : 128;
+	nsv *V = neoscrypt_scratch(N);
+
+	if (!V) {
+		applog(LOG_ERR, "CPU #%d: unable to allocate neoscrypt scratchpad", thr_id);
+		*hashes_done = 0;
+		return 0;
+	}
+
+	while (pdata[19] < max_nonce && !work_restart[thr_id].restart)
+	{
+		if (N == 128)
+			neoscrypt_lanes_128(lanes_hash, pdata, pdata[19], V);
+		else
+			neoscrypt_lanes_n(lanes_hash, pdata, pdata[19], V, N);
+
+		uint32_t mask = hash_lanes_le_target(&lanes_hash[7], 8, NS_LANES, Htarg, 0);
+		for (int l = 0; mask; l++, mask >>= 1) {
+			if ((mask & 1) && fulltest_le(lanes_hash + l * 8, ptarget)) {
+				work_set_target_ratio(work, lanes_hash + l * 8);
+				pdata[19] += l;
+				*hashes_done = pdata[19] - first_nonce + 1;
+				return 1;
+			}
+		}
+		pdata[19] += NS_LANES;
+	}
+#else
+	uint32_t _ALIGN(128) hash[16];
+
+	/* both halves of neoscrypt() hash the same header */
 	while (pdata[19] < max_nonce && !work_restart[thr_id].restart)
 	{
 		neoscrypt((uint8_t *)hash, (uint8_t *)pdata, profile);
@@ -1441,14 +1801,8 @@ int scanhash_neoscrypt(int thr_id, struct work *work, uint32_t max_nonce, uint64
 			return 1;
 		}
 		pdata[19]++;
-
-		if (hash[15] <= Htarg && fulltest_le(hash + 8, ptarget)) {
-			work_set_target_ratio(work, hash + 8);
-			*hashes_done = pdata[19] - first_nonce + 1;
-			return 1;
-		}
-		pdata[19]++;
 	}
+#endif
 
 	*hashes_done = pdata[19] - first_nonce;
 	return 0;
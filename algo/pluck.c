@@ -442,10 +442,208 @@ void pluck_hash(uint32_t *hash, const uint32_t *data, uchar *hashbuffer, const i
 	memcpy(hash, hashbuffer, 32);
 }
 
+/*
+ * pluck_hash of PLUCK_LANES nonces in lockstep, each over its own buffer.
+ * SHA-256 and salsa8 run one nonce per SIMD lane on word-major arrays,
+ * the data-dependent reads and writes stay scalar, in order, per lane.
+ */
+#ifndef SSE
+#define PLUCK_LANES 8
+#define PL_T __m256i
+#define PL_SET1(x) _mm256_set1_epi32((int)(x))
+#define PL_ADD(a, b) _mm256_add_epi32(a, b)
+#define PL_XOR(a, b) _mm256_xor_si256(a, b)
+#define PL_AND(a, b) _mm256_and_si256(a, b)
+#define PL_OR(a, b) _mm256_or_si256(a, b)
+#define PL_SLL(a, n) _mm256_slli_epi32(a, n)
+#define PL_SRL(a, n) _mm256_srli_epi32(a, n)
+#else
+#define PLUCK_LANES 4
+#define PL_T __m128i
+#define PL_SET1(x) _mm_set1_epi32((int)(x))
+#define PL_ADD(a, b) _mm_add_epi32(a, b)
+#define PL_XOR(a, b) _mm_xor_si128(a, b)
+#define PL_AND(a, b) _mm_and_si128(a, b)
+#define PL_OR(a, b) _mm_or_si128(a, b)
+#define PL_SLL(a, n) _mm_slli_epi32(a, n)
+#define PL_SRL(a, n) _mm_srli_epi32(a, n)
+#endif
+
+#define PL_ROTL(a, n) PL_OR(PL_SLL(a, n), PL_SRL(a, 32 - (n)))
+#define PL_ROTR(a, n) PL_OR(PL_SRL(a, n), PL_SLL(a, 32 - (n)))
+
+/* per-lane buffer stride, offset so the lanes do not alias in L1 */
+#define PLUCK_STRIDE(N) ((size_t)(N) * 1024 + 256)
+
+static __thread uchar *pluck_lanes_buf = NULL;
+static __thread int pluck_lanes_N = 0;
+
+/* B = B + salsa20/8(B) */
+static void pluck_salsa8_lanes(PL_T B[16])
+{
+	PL_T x[16];
+	int i;
+
+	for (i = 0; i < 16; i++)
+		x[i] = B[i];
+	for (i = 0; i < 8; i += 2) {
+#define PL_QR(a, b, c, d) \
+		x[b] = PL_XOR(x[b], PL_ROTL(PL_ADD(x[a], x[d]), 7)); \
+		x[c] = PL_XOR(x[c], PL_ROTL(PL_ADD(x[b], x[a]), 9)); \
+		x[d] = PL_XOR(x[d], PL_ROTL(PL_ADD(x[c], x[b]), 13)); \
+		x[a] = PL_XOR(x[a], PL_ROTL(PL_ADD(x[d], x[c]), 18));
+		/* Operate on columns. */
+		PL_QR(0, 4, 8, 12) PL_QR(5, 9, 13, 1) PL_QR(10, 14, 2, 6) PL_QR(15, 3, 7, 11)
+		/* Operate on rows. */
+		PL_QR(0, 1, 2, 3) PL_QR(5, 6, 7, 4) PL_QR(10, 11, 8, 9) PL_QR(15, 12, 13, 14)
+#undef PL_QR
+	}
+	for (i = 0; i < 16; i++)
+		B[i] = PL_ADD(B[i], x[i]);
+}
+
+#define PL_S0(x) PL_XOR(PL_XOR(PL_ROTR(x, 2), PL_ROTR(x, 13)), PL_ROTR(x, 22))
+#define PL_S1(x) PL_XOR(PL_XOR(PL_ROTR(x, 6), PL_ROTR(x, 11)), PL_ROTR(x, 25))
+#define PL_s0(x) PL_XOR(PL_XOR(PL_ROTR(x, 7), PL_ROTR(x, 18)), PL_SRL(x, 3))
+#define PL_s1(x) PL_XOR(PL_XOR(PL_ROTR(x, 17), PL_ROTR(x, 19)), PL_SRL(x, 10))
+
+/* 64 rounds, W[i] + K[i] from WK, or from W and sha256_k when WK is NULL */
+static inline void pluck_sha256_rounds_lanes(PL_T S[8], const PL_T *W, const uint32_t *WK)
+{
+	PL_T a = S[0], b = S[1], c = S[2], d = S[3];
+	PL_T e = S[4], f = S[5], g = S[6], h = S[7];
+	int i;
+
+	for (i = 0; i < 64; i++) {
+		PL_T t0 = PL_ADD(PL_ADD(h, PL_S1(e)),
+			PL_XOR(PL_AND(e, PL_XOR(f, g)), g));
+		PL_T t1 = PL_ADD(PL_S0(a), PL_OR(PL_AND(a, PL_OR(b, c)), PL_AND(b, c)));
+		t0 = PL_ADD(t0, WK ? PL_SET1(WK[i]) : PL_ADD(W[i], PL_SET1(sha256_k[i])));
+		h = g; g = f; f = e;
+		e = PL_ADD(d, t0);
+		d = c; c = b; b = a;
+		a = PL_ADD(t0, t1);
+	}
+	S[0] = PL_ADD(S[0], a); S[1] = PL_ADD(S[1], b);
+	S[2] = PL_ADD(S[2], c); S[3] = PL_ADD(S[3], d);
+	S[4] = PL_ADD(S[4], e); S[5] = PL_ADD(S[5], f);
+	S[6] = PL_ADD(S[6], g); S[7] = PL_ADD(S[7], h);
+}
+
+/* W + K of the second block, the padding of a 64-byte message */
+static const uint32_t pad_wk[64] = {
+	0xc28a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf374,
+	0x649b69c1, 0xf0fe4786, 0x0fe1edc6, 0x240cf254,
+	0x4fe9346f, 0x6cc984be, 0x61b9411e, 0x16f988fa,
+	0xf2c65152, 0xa88e5a6d, 0xb019fc65, 0xb9d99ec7,
+	0x9a1231c3, 0xe70eeaa0, 0xfdb1232b, 0xc7353eb0,
+	0x3069bad5, 0xcb976d5f, 0x5a0f118f, 0xdc1eeefd,
+	0x0a35b689, 0xde0b7a04, 0x58f4ca9d, 0xe15d5b16,
+	0x007f3e86, 0x37088980, 0xa507ea32, 0x6fab9537,
+	0x17406110, 0x0d8cd6f1, 0xcdaa3b6d, 0xc0bbbe37,
+	0x83613bda, 0xdb48a363, 0x0b02e931, 0x6fd15ca7,
+	0x521afaca, 0x31338431, 0x6ed41a95, 0x6d437890,
+	0xc39c91f2, 0x9eccabbd, 0xb5c9a0e6, 0x532fb63c,
+	0xd2c741c6, 0x07237ea3, 0xa4954b68, 0x4c191d76,
+};
+
+/* sha256_hash512 of 16 big-endian words per lane, already byte swapped */
+static void pluck_sha256_hash512_lanes(PL_T H[8], const PL_T M[16])
+{
+	uint32_t h0[8];
+	PL_T W[64];
+	int i;
+
+	for (i = 0; i < 16; i++)
+		W[i] = M[i];
+	for (i = 16; i < 64; i++)
+		W[i] = PL_ADD(PL_ADD(PL_s1(W[i - 2]), W[i - 7]), PL_ADD(PL_s0(W[i - 15]), W[i - 16]));
+
+	sha256_init(h0);
+	for (i = 0; i < 8; i++)
+		H[i] = PL_SET1(h0[i]);
+	pluck_sha256_rounds_lanes(H, W, NULL);
+	pluck_sha256_rounds_lanes(H, NULL, pad_wk);
+}
+
+static void pluck_hash_lanes(uint32_t *hash, const uint32_t *data, uint32_t nonce, const int N)
+{
+	const int size = N * 1024;
+	const size_t stride = PLUCK_STRIDE(N);
+	PL_T _ALIGN(64) R[16], B[16], M[16], H[8];
+	uint32_t *r = (uint32_t *)R, *b = (uint32_t *)B, *m = (uint32_t *)M, *h = (uint32_t *)H;
+	uint32_t _ALIGN(64) hdr[20];
+	int l, k;
+
+	memcpy(hdr, data, 80);
+	for (l = 0; l < PLUCK_LANES; l++) {
+		uchar *hb = pluck_lanes_buf + l * stride;
+		hdr[19] = nonce + l;
+		sha256_hash(hb, (void *)hdr, BLOCK_HEADER_SIZE);
+		memset(&hb[32], 0, 32);
+	}
+
+	for (int i = 64; i < size - 32; i += 32)
+	{
+		const int randmax = i - 4;
+
+		/* randbuffer = salsa8(hashbuffer[i - 128] ^ hashbuffer[i - 64]), lane l in word l */
+		for (l = 0; l < PLUCK_LANES; l++) {
+			const uint32_t *hb = (uint32_t *)(pluck_lanes_buf + l * stride);
+			for (k = 0; k < 16; k++) {
+				r[k * PLUCK_LANES + l] = i > 128 ? hb[(i - 128) / 4 + k] : 0;
+				b[k * PLUCK_LANES + l] = r[k * PLUCK_LANES + l] ^ hb[(i - 64) / 4 + k];
+			}
+		}
+		pluck_salsa8_lanes(B);
+
+		for (l = 0; l < PLUCK_LANES; l++) {
+			const uchar *hb = pluck_lanes_buf + l * stride;
+			for (k = 0; k < 8; k++)
+				m[k * PLUCK_LANES + l] = be32dec(&hb[i - 32 + 4 * k]);
+			for (k = 0; k < 8; k++) {
+				uint32_t rand = b[k * PLUCK_LANES + l] % (randmax - 32);
+				m[(8 + k) * PLUCK_LANES + l] = be32dec(&hb[rand]);
+			}
+		}
+		pluck_sha256_hash512_lanes(H, M);
+
+		/* store the hash, then randbuffer = salsa8(hashbuffer[i - 128] ^ hashbuffer[i - 32]) */
+		for (l = 0; l < PLUCK_LANES; l++) {
+			uchar *hb = pluck_lanes_buf + l * stride;
+			for (k = 0; k < 8; k++)
+				be32enc(&hb[i + 4 * k], h[k * PLUCK_LANES + l]);
+			for (k = 0; k < 16; k++)
+				b[k * PLUCK_LANES + l] = r[k * PLUCK_LANES + l] ^ ((uint32_t *)hb)[(i - 32) / 4 + k];
+		}
+		pluck_salsa8_lanes(B);
+
+		for (l = 0; l < PLUCK_LANES; l++) {
+			uchar *hb = pluck_lanes_buf + l * stride;
+			for (k = 0; k < 16; k++) {
+				uint32_t rand = b[k * PLUCK_LANES + l] % randmax;
+				*((uint32_t *)(hb + rand)) = *((uint32_t *)(hb + 2 * k + randmax));
+			}
+		}
+	}
+
+	for (l = 0; l < PLUCK_LANES; l++)
+		memcpy(hash + 8 * l, pluck_lanes_buf + l * stride, 32);
+}
+
+/* nonces in flight per scan, each over N KiB */
+int pluck_lanes(void)
+{
+	return PLUCK_LANES;
+}
+
 int scanhash_pluck(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done,
 	unsigned char *scratchbuf, int N)
 {
-	uint32_t _ALIGN(128) hash[8];
+	uint32_t _ALIGN(128) hash[8 * PLUCK_LANES];
 	uint32_t _ALIGN(128) endiandata[20];
 	uint32_t *pdata = work->data;
 	uint32_t *ptarget = work->target;
@@ -459,21 +657,43 @@ int scanhash_pluck(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *
 	for (int k = 0; k < 19; k++)
 		be32enc(&endiandata[k], pdata[k]);
 
-	const uint32_t Htarg = ptarget[7];
-	do {
-		//be32enc(&endiandata[19], n);
-		endiandata[19] = n;
-		pluck_hash(hash, endiandata, scratchbuf, N);
+	if (N > pluck_lanes_N) {
+		hugepage_free(pluck_lanes_buf, PLUCK_STRIDE(pluck_lanes_N) * PLUCK_LANES);
+		pluck_lanes_buf = (uchar *)hugepage_alloc(PLUCK_STRIDE(N) * PLUCK_LANES);
+		pluck_lanes_N = pluck_lanes_buf ? N : 0;
+	}
 
-		if (hash[7] <= Htarg && fulltest(hash, ptarget))
-		{
-			work_set_target_ratio(work, hash);
-			*hashes_done = n - first_nonce + 1;
-			pdata[19] = htobe32(endiandata[19]);
-			return 1;
-		}
-		n++;
-	} while (n < max_nonce && !(*restart));
+	const uint32_t Htarg = ptarget[7];
+	if (pluck_lanes_buf) {
+		do {
+			pluck_hash_lanes(hash, endiandata, n, N);
+
+			int l = fulltest_lanes(hash, hash_lanes_le_target(&hash[7], 8, PLUCK_LANES, Htarg, 0), ptarget);
+			if (l >= 0)
+			{
+				work_set_target_ratio(work, hash + 8 * l);
+				*hashes_done = n + l - first_nonce + 1;
+				pdata[19] = htobe32(n + l);
+				return 1;
+			}
+			n += PLUCK_LANES;
+		} while (n < max_nonce && !(*restart));
+	} else {
+		do {
+			//be32enc(&endiandata[19], n);
+			endiandata[19] = n;
+			pluck_hash(hash, endiandata, scratchbuf, N);
+
+			if (hash[7] <= Htarg && fulltest(hash, ptarget))
+			{
+				work_set_target_ratio(work, hash);
+				*hashes_done = n - first_nonce + 1;
+				pdata[19] = htobe32(endiandata[19]);
+				return 1;
+			}
+			n++;
+		} while (n < max_nonce && !(*restart));
+	}
 
 	*hashes_done = n - first_nonce + 1;
 	pdata[19] = n;
@@ -8,15 +8,19 @@
 #define SCRYPT_R 1
 #define SCRYPT_P 1
 
+/* so only the r = 1 ROMix kernels are generated */
+#define SCRYPT_ROMIX_1_ONLY
+
 /* Only the instrinsics versions are optimized for hard-coded values - mikaelh */
 #define CPU_X86_FORCE_INTRINSICS
 
+/* Keccak-512 and ChaCha20/8 as used by the scrypt-jane coins; the mix
+ * kernel (SSE2, SSSE3 or AVX) is picked from cpuid by scryptjane_init() */
 #undef SCRYPT_KECCAK512
 #undef SCRYPT_CHACHA
 #undef SCRYPT_CHOOSE_COMPILETIME
 #define SCRYPT_KECCAK512
 #define SCRYPT_CHACHA
-#define SCRYPT_CHOOSE_COMPILETIME
 
 //#include "scrypt-jane.h"
 #include "../scryptjane/scrypt-jane-portable.h"
@@ -60,16 +64,40 @@ scrypt_free(scrypt_aligned_alloc *aa) {
 	free(aa->mem);
 }
 
+static scrypt_ROMix_1fn scrypt_ROMix_1;
+
+/* pick the ROMix kernel once, before the miner threads start */
+void
+scryptjane_init(void) {
+	scrypt_ROMix_1 = scrypt_getROMix_1();
+}
+
+/* run two nonces through one interleaved ROMix up to 32 MB of V per nonce */
+#define SCRYPT_2WAY_MAX_N (1 << 18)
+
+/*
+ * V and YX are kept per thread across scans, the buffer only grows
+ * when a larger N comes in, instead of an alloc + page faults per call.
+ */
+static __thread uint8_t *scratch_mem = NULL;
+static __thread size_t scratch_size = 0;
+
+static uint8_t *
+scrypt_scratch(size_t size) {
+	if (size > scratch_size) {
+		hugepage_free(scratch_mem, scratch_size);
+		scratch_mem = (uint8_t *)hugepage_alloc(size);
+		scratch_size = scratch_mem ? size : 0;
+	}
+	return scratch_mem;
+}
+
 void
 scrypt_N_1_1(const uint8_t *password, size_t password_len, const uint8_t *salt, size_t salt_len, uint32_t N, uint8_t *out, size_t bytes, uint8_t *X, uint8_t *Y, uint8_t *V) {
 	uint32_t chunk_bytes, i;
 	const uint32_t r = SCRYPT_R;
 	const uint32_t p = SCRYPT_P;
 
-#if !defined(SCRYPT_CHOOSE_COMPILETIME)
-	scrypt_ROMixfn scrypt_ROMix = scrypt_getROMix();
-#endif
-
 	chunk_bytes = SCRYPT_BLOCK_BYTES * r * 2;
 
 	/* 1: X = PBKDF2(password, salt) */
@@ -88,6 +116,24 @@ scrypt_N_1_1(const uint8_t *password, size_t password_len, const uint8_t *salt,
 #endif
 }
 
+#if defined(SCRYPT_CHACHA_AVX2_2WAY)
+static void
+scrypt_N_1_1_2way(const uint8_t *password0, const uint8_t *password1, size_t password_len, uint32_t N,
+	uint8_t *out0, uint8_t *out1, size_t bytes, uint8_t *X0, uint8_t *X1, uint8_t *Y0, uint8_t *Y1, uint8_t *V) {
+	const uint32_t chunk_bytes = SCRYPT_BLOCK_BYTES * 2;
+
+	scrypt_pbkdf2_1(password0, password_len, password0, password_len, X0, chunk_bytes);
+	scrypt_pbkdf2_1(password1, password_len, password1, password_len, X1, chunk_bytes);
+
+	scrypt_ROMix_1_avx2_2way((scrypt_mix_word_t *)X0, (scrypt_mix_word_t *)X1,
+		(scrypt_mix_word_t *)Y0, (scrypt_mix_word_t *)Y1,
+		(scrypt_mix_word_t *)V, (scrypt_mix_word_t *)(V + (size_t)N * chunk_bytes), N);
+
+	scrypt_pbkdf2_1(password0, password_len, X0, chunk_bytes, out0, bytes);
+	scrypt_pbkdf2_1(password1, password_len, X1, chunk_bytes, out1, bytes);
+}
+#endif
+
 
 //  increasing Nfactor gradually
 const unsigned char minNfactor = 4;
@@ -128,17 +174,29 @@ unsigned char GetNfactor(unsigned int nTimestamp, unsigned int ntime) {
 }
 
 
+/* V of one nonce and the nonces in flight per scan for this N-factor */
+size_t scryptjane_lane_bytes(int Nfactor, int *ways)
+{
+	const uint32_t N = (1 << (Nfactor + 1));
+
+	*ways = 1;
+#if defined(SCRYPT_CHACHA_AVX2_2WAY)
+	if (N <= SCRYPT_2WAY_MAX_N)
+		*ways = 2;
+#endif
+	return (size_t)N * SCRYPT_BLOCK_BYTES * SCRYPT_R * 2;
+}
+
 int scanhash_scryptjane(int Nfactor, int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done)
 {
-	scrypt_aligned_alloc YX, V;
-	uint8_t *X, *Y;
-	uint32_t N, chunk_bytes;
+	uint8_t *X, *Y, *V;
+	uint32_t N, chunk_bytes, ways;
 	const uint32_t r = SCRYPT_R;
 	const uint32_t p = SCRYPT_P;
 
 	uint32_t *pdata = work->data;
 	uint32_t *ptarget = work->target;
-	uint32_t _ALIGN(64) endiandata[20];
+	uint32_t _ALIGN(64) endiandata[2][20];
 	const uint32_t first_nonce = pdata[19];
 	uint32_t nonce = first_nonce;
 
@@ -146,7 +204,8 @@ int scanhash_scryptjane(int Nfactor, int thr_id, struct work *work, uint32_t max
 		ptarget[7] = 0x00ff;
 
 	for (int k = 0; k < 20; k++)
-		be32enc(&endiandata[k], pdata[k]);
+		be32enc(&endiandata[0][k], pdata[k]);
+	memcpy(endiandata[1], endiandata[0], 80);
 
 	//Nfactor = GetNfactor(data[17], ntime);
 	//if (Nfactor > scrypt_maxN) {
@@ -156,41 +215,54 @@ int scanhash_scryptjane(int Nfactor, int thr_id, struct work *work, uint32_t max
 
 	N = (1 << (Nfactor + 1));
 
+	ways = 1;
+#if defined(SCRYPT_CHACHA_AVX2_2WAY)
+	if (N <= SCRYPT_2WAY_MAX_N)
+		ways = 2;
+#endif
+
+	/* V[ways][N] then Y[ways], X[ways] */
 	chunk_bytes = SCRYPT_BLOCK_BYTES * r * 2;
-	if (!scrypt_alloc((uint64_t)N * chunk_bytes, &V)) return 1;
-	if (!scrypt_alloc((p + 1) * chunk_bytes, &YX)) {
-		scrypt_free(&V);
-		return 1;
+	V = scrypt_scratch((size_t)ways * (N + p + 1) * chunk_bytes);
+	if (!V) {
+		applog(LOG_ERR, "CPU #%d: unable to allocate scrypt-jane scratchpad", thr_id);
+		*hashes_done = 0;
+		return 0;
 	}
 
-	Y = YX.ptr;
-	X = Y + chunk_bytes;
+	Y = V + (size_t)ways * N * chunk_bytes;
+	X = Y + ways * chunk_bytes;
 
 	do {
 		const uint32_t Htarg = ptarget[7];
-		uint32_t hash[8];
-		be32enc(&endiandata[19], nonce);
-
-		scrypt_N_1_1((unsigned char *)endiandata, 80,
-			(unsigned char *)endiandata, 80,
-			N, (unsigned char *)hash, 32, X, Y, V.ptr);
-
-		if (hash[7] <= Htarg && fulltest(hash, ptarget)) {
-			pdata[19] = nonce;
-			*hashes_done = pdata[19] - first_nonce;
-			scrypt_free(&V);
-			scrypt_free(&YX);
+		uint32_t hash[2][8];
+		int l;
+
+		be32enc(&endiandata[0][19], nonce);
+#if defined(SCRYPT_CHACHA_AVX2_2WAY)
+		if (ways == 2) {
+			be32enc(&endiandata[1][19], nonce + 1);
+			scrypt_N_1_1_2way((unsigned char *)endiandata[0], (unsigned char *)endiandata[1], 80,
+				N, (unsigned char *)hash[0], (unsigned char *)hash[1], 32,
+				X, X + chunk_bytes, Y, Y + chunk_bytes, V);
+		} else
+#endif
+		scrypt_N_1_1((unsigned char *)endiandata[0], 80,
+			(unsigned char *)endiandata[0], 80,
+			N, (unsigned char *)hash[0], 32, X, Y, V);
+
+		l = fulltest_lanes(hash[0], hash_lanes_le_target(&hash[0][7], 8, ways, Htarg, 0), ptarget);
+		if (l >= 0) {
+			pdata[19] = nonce + l;
+			*hashes_done = pdata[19] - first_nonce + 1;
 			return 1;
 		}
-		nonce++;
+		nonce += ways;
 
 	} while (nonce < max_nonce && !work_restart[thr_id].restart);
 
 	pdata[19] = nonce;
 	*hashes_done = pdata[19] - first_nonce + 1;
-
-	scrypt_free(&V);
-	scrypt_free(&YX);
 	return 0;
 }
 
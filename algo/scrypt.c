@@ -503,9 +503,14 @@ static inline void scrypt_core(uint32_t *X, uint32_t *V, int N)
 #define scrypt_best_throughput() 1
 #endif
 
+size_t scrypt_buffer_size(int N)
+{
+	return (size_t)N * SCRYPT_MAX_WAYS * 128 + 63;
+}
+
 unsigned char *scrypt_buffer_alloc(int N)
 {
-	return (uchar*) malloc((size_t)N * SCRYPT_MAX_WAYS * 128 + 63);
+	return (uchar*) malloc(scrypt_buffer_size(N));
 }
 
 static void scrypt_1024_1_1_256(const uint32_t *input, uint32_t *output,
@@ -692,6 +697,17 @@ static void scrypt_1024_1_1_256_24way(const uint32_t *input,
 }
 #endif /* HAVE_SCRYPT_6WAY */
 
+/* nonces in flight per scan, each over N * 128 bytes of V */
+int scrypt_throughput(void)
+{
+	int throughput = scrypt_best_throughput();
+#ifdef HAVE_SHA256_4WAY
+	if (sha256_use_4way())
+		throughput *= 4;
+#endif
+	return throughput;
+}
+
 extern int scanhash_scrypt(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done,
 	unsigned char *scratchbuf, uint32_t N)
 {
@@ -701,14 +717,9 @@ extern int scanhash_scrypt(int thr_id, struct work *work, uint32_t max_nonce, ui
 	uint32_t midstate[8];
 	uint32_t n = pdata[19] - 1;
 	const uint32_t Htarg = ptarget[7];
-	int throughput = scrypt_best_throughput();
+	int throughput = scrypt_throughput();
 	int i;
-	
-#ifdef HAVE_SHA256_4WAY
-	if (sha256_use_4way())
-		throughput *= 4;
-#endif
-	
+
 	for (i = 0; i < throughput; i++)
 		memcpy(data + i * 20, pdata, 80);
 	
@@ -741,13 +752,12 @@ extern int scanhash_scrypt(int thr_id, struct work *work, uint32_t max_nonce, ui
 #endif
 		scrypt_1024_1_1_256(data, hash, midstate, scratchbuf, N);
 		
-		for (i = 0; i < throughput; i++) {
-			if (unlikely(hash[i * 8 + 7] <= Htarg && fulltest(hash + i * 8, ptarget))) {
-				work_set_target_ratio(work, hash + i * 8);
-				*hashes_done = n - pdata[19] + 1;
-				pdata[19] = data[i * 20 + 19];
-				return 1;
-			}
+		i = fulltest_lanes(hash, hash_lanes_le_target(&hash[7], 8, throughput, Htarg, 0), ptarget);
+		if (unlikely(i >= 0)) {
+			work_set_target_ratio(work, hash + i * 8);
+			*hashes_done = n - pdata[19] + 1;
+			pdata[19] = data[i * 20 + 19];
+			return 1;
 		}
 	} while (likely(n < max_nonce && !work_restart[thr_id].restart));
 	
@@ -72,6 +72,102 @@ void sha256_init(uint32_t *state)
 	    S[(70 - i) % 8], S[(71 - i) % 8], \
 	    W[i] + sha256_k[i])
 
+#ifdef HAVE_SHA256_SHANI
+
+/*
+ * SHA extensions (sha256rnds2/sha256msg1/sha256msg2).  The state is kept
+ * in the ABEF/CDGH register layout expected by sha256rnds2, each step
+ * below runs four rounds and extends the schedule by four words.
+ */
+
+static int sha256_shani = -1;
+
+int sha256_use_shani()
+{
+	if (sha256_shani < 0)
+		sha256_shani = has_sha() ? 1 : 0;
+	return sha256_shani;
+}
+
+#define SHANI_BSWAP_MASK \
+	_mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL)
+
+/* four rounds, k[i..i+3] added to the message words in M */
+#define SHANI_RNDS4(A, C, M, i) \
+	do { \
+		__m128i t_ = _mm_add_epi32(M, \
+			_mm_loadu_si128((const __m128i *)(sha256_k + (i)))); \
+		C = _mm_sha256rnds2_epu32(C, A, t_); \
+		A = _mm_sha256rnds2_epu32(A, C, _mm_shuffle_epi32(t_, 0x0E)); \
+	} while (0)
+
+/* M0 = W[i-16..i-13] becomes W[i..i+3] */
+#define SHANI_MSG(M0, M1, M2, M3) \
+	M0 = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(M0, M1), \
+		_mm_alignr_epi8(M3, M2, 4)), M3)
+
+/* rounds 16 to 63, schedule and compression interleaved */
+#define SHANI_RNDS48(A, C, M0, M1, M2, M3) \
+	do { \
+		int i_; \
+		for (i_ = 16; i_ < 64; i_ += 16) { \
+			SHANI_MSG(M0, M1, M2, M3); SHANI_RNDS4(A, C, M0, i_); \
+			SHANI_MSG(M1, M2, M3, M0); SHANI_RNDS4(A, C, M1, i_ + 4); \
+			SHANI_MSG(M2, M3, M0, M1); SHANI_RNDS4(A, C, M2, i_ + 8); \
+			SHANI_MSG(M3, M0, M1, M2); SHANI_RNDS4(A, C, M3, i_ + 12); \
+		} \
+	} while (0)
+
+/* a..h state words to ABEF/CDGH and back */
+static inline void sha256_shani_pack(__m128i *abef, __m128i *cdgh,
+	const uint32_t *state)
+{
+	__m128i t = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0xB1);
+	__m128i u = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(state + 4)), 0x1B);
+	*abef = _mm_alignr_epi8(t, u, 8);
+	*cdgh = _mm_blend_epi16(u, t, 0xF0);
+}
+
+static inline void sha256_shani_unpack(uint32_t *state, __m128i abef, __m128i cdgh)
+{
+	__m128i t = _mm_shuffle_epi32(abef, 0x1B);
+	__m128i u = _mm_shuffle_epi32(cdgh, 0xB1);
+	_mm_storeu_si128((__m128i *)state, _mm_blend_epi16(t, u, 0xF0));
+	_mm_storeu_si128((__m128i *)(state + 4), _mm_alignr_epi8(u, t, 8));
+}
+
+void sha256_transform_shani(uint32_t *state, const uint32_t *block, int swap)
+{
+	__m128i A, C, HA, HC;
+	__m128i M0, M1, M2, M3;
+
+	sha256_shani_pack(&A, &C, state);
+	HA = A;
+	HC = C;
+
+	M0 = _mm_loadu_si128((const __m128i *)(block + 0));
+	M1 = _mm_loadu_si128((const __m128i *)(block + 4));
+	M2 = _mm_loadu_si128((const __m128i *)(block + 8));
+	M3 = _mm_loadu_si128((const __m128i *)(block + 12));
+	if (swap) {
+		const __m128i mask = SHANI_BSWAP_MASK;
+		M0 = _mm_shuffle_epi8(M0, mask);
+		M1 = _mm_shuffle_epi8(M1, mask);
+		M2 = _mm_shuffle_epi8(M2, mask);
+		M3 = _mm_shuffle_epi8(M3, mask);
+	}
+
+	SHANI_RNDS4(A, C, M0, 0);
+	SHANI_RNDS4(A, C, M1, 4);
+	SHANI_RNDS4(A, C, M2, 8);
+	SHANI_RNDS4(A, C, M3, 12);
+	SHANI_RNDS48(A, C, M0, M1, M2, M3);
+
+	sha256_shani_unpack(state, _mm_add_epi32(A, HA), _mm_add_epi32(C, HC));
+}
+
+#endif /* HAVE_SHA256_SHANI */
+
 #ifndef EXTERN_SHA256
 
 /*
@@ -85,6 +181,13 @@ void sha256_transform(uint32_t *state, const uint32_t *block, int swap)
 	uint32_t t0, t1;
 	int i;
 
+#ifdef HAVE_SHA256_SHANI
+	if (sha256_use_shani()) {
+		sha256_transform_shani(state, block, swap);
+		return;
+	}
+#endif
+
 	/* 1. Prepare message schedule W. */
 	if (swap) {
 		for (i = 0; i < 16; i++)
@@ -172,6 +275,100 @@ void sha256_transform(uint32_t *state, const uint32_t *block, int swap)
 
 #endif /* EXTERN_SHA256 */
 
+/*
+ * Intrinsic 4-way (SSE2) and 8-way (AVX2) transforms, in the interleaved
+ * layout of the asm sha256_transform_4way/_8way: word i of lane l is at
+ * state[i * N + l] and block[i * N + l].
+ */
+#define SV_S0(x)   SV_XOR(SV_XOR(SV_ROTR(x, 2), SV_ROTR(x, 13)), SV_ROTR(x, 22))
+#define SV_S1(x)   SV_XOR(SV_XOR(SV_ROTR(x, 6), SV_ROTR(x, 11)), SV_ROTR(x, 25))
+#define SV_s0(x)   SV_XOR(SV_XOR(SV_ROTR(x, 7), SV_ROTR(x, 18)), SV_SRL(x, 3))
+#define SV_s1(x)   SV_XOR(SV_XOR(SV_ROTR(x, 17), SV_ROTR(x, 19)), SV_SRL(x, 10))
+#define SV_ROTR(x, n)   SV_OR(SV_SRL(x, n), SV_SLL(x, 32 - (n)))
+
+#define SHA256_TRANSFORM_VEC_BODY   do { \
+		SV_T W[64], a, b, c, d, e, f, g, h, t0, t1; \
+		int i; \
+		for (i = 0; i < 16; i++) \
+			W[i] = swap ? SV_BSWAP(((const SV_T *)block)[i]) : ((const SV_T *)block)[i]; \
+		for (i = 16; i < 64; i++) \
+			W[i] = SV_ADD(SV_ADD(SV_s1(W[i - 2]), W[i - 7]), \
+			              SV_ADD(SV_s0(W[i - 15]), W[i - 16])); \
+		a = S[0]; b = S[1]; c = S[2]; d = S[3]; \
+		e = S[4]; f = S[5]; g = S[6]; h = S[7]; \
+		for (i = 0; i < 64; i++) { \
+			t0 = SV_ADD(SV_ADD(h, SV_S1(e)), SV_XOR(SV_AND(e, SV_XOR(f, g)), g)); \
+			t0 = SV_ADD(t0, SV_ADD(W[i], SV_SET1(sha256_k[i]))); \
+			t1 = SV_ADD(SV_S0(a), SV_OR(SV_AND(a, SV_OR(b, c)), SV_AND(b, c))); \
+			h = g; g = f; f = e; \
+			e = SV_ADD(d, t0); \
+			d = c; c = b; b = a; \
+			a = SV_ADD(t0, t1); \
+		} \
+		S[0] = SV_ADD(S[0], a); S[1] = SV_ADD(S[1], b); \
+		S[2] = SV_ADD(S[2], c); S[3] = SV_ADD(S[3], d); \
+		S[4] = SV_ADD(S[4], e); S[5] = SV_ADD(S[5], f); \
+		S[6] = SV_ADD(S[6], g); S[7] = SV_ADD(S[7], h); \
+	} while (0)
+
+#define SV_T             __m128i
+#define SV_ADD(a, b)     _mm_add_epi32(a, b)
+#define SV_XOR(a, b)     _mm_xor_si128(a, b)
+#define SV_AND(a, b)     _mm_and_si128(a, b)
+#define SV_OR(a, b)      _mm_or_si128(a, b)
+#define SV_SLL(a, n)     _mm_slli_epi32(a, n)
+#define SV_SRL(a, n)     _mm_srli_epi32(a, n)
+#define SV_SET1(x)       _mm_set1_epi32((int)(x))
+#define SV_BSWAP(x)      SV_OR(SV_OR(SV_SLL(x, 24), SV_SRL(x, 24)), \
+                               SV_OR(SV_AND(SV_SLL(x, 8), SV_SET1(0x00ff0000)), \
+                                     SV_AND(SV_SRL(x, 8), SV_SET1(0x0000ff00))))
+
+void sha256_transform_4way_intrin(uint32_t *state, const uint32_t *block, int swap)
+{
+	__m128i *S = (__m128i *)state;
+	SHA256_TRANSFORM_VEC_BODY;
+}
+
+#undef SV_T
+#undef SV_ADD
+#undef SV_XOR
+#undef SV_AND
+#undef SV_OR
+#undef SV_SLL
+#undef SV_SRL
+#undef SV_SET1
+#undef SV_BSWAP
+
+#ifndef SSE
+#define SV_T             __m256i
+#define SV_ADD(a, b)     _mm256_add_epi32(a, b)
+#define SV_XOR(a, b)     _mm256_xor_si256(a, b)
+#define SV_AND(a, b)     _mm256_and_si256(a, b)
+#define SV_OR(a, b)      _mm256_or_si256(a, b)
+#define SV_SLL(a, n)     _mm256_slli_epi32(a, n)
+#define SV_SRL(a, n)     _mm256_srli_epi32(a, n)
+#define SV_SET1(x)       _mm256_set1_epi32((int)(x))
+#define SV_BSWAP(x)      _mm256_shuffle_epi8(x, _mm256_set_epi64x( \
+		0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL, 0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL))
+
+void sha256_transform_8way_intrin(uint32_t *state, const uint32_t *block, int swap)
+{
+	__m256i *S = (__m256i *)state;
+	SHA256_TRANSFORM_VEC_BODY;
+	_mm256_zeroupper();
+}
+
+#undef SV_T
+#undef SV_ADD
+#undef SV_XOR
+#undef SV_AND
+#undef SV_OR
+#undef SV_SLL
+#undef SV_SRL
+#undef SV_SET1
+#undef SV_BSWAP
+#endif
+
 
 static const uint32_t sha256d_hash1[16] = {
 	0x00000000, 0x00000000, 0x00000000, 0x00000000,
@@ -462,6 +659,151 @@ static inline void sha256d_ms(uint32_t *hash, uint32_t *W,
 
 #endif /* EXTERN_SHA256 */
 
+#ifdef HAVE_SHA256_SHANI
+
+/*
+ * Two nonces are hashed side by side: sha256rnds2 has a long latency but
+ * can issue every cycle, the second stream fills the gaps of the first.
+ * pre[] holds the packed state after rounds 0-1 of the second block,
+ * which do not depend on the nonce.
+ */
+static void sha256d_shani_prehash(__m128i *ms, __m128i *pre,
+	const uint32_t *midstate, const uint32_t *data)
+{
+	__m128i t = _mm_add_epi32(_mm_loadu_si128((const __m128i *)data),
+		_mm_loadu_si128((const __m128i *)sha256_k));
+
+	sha256_shani_pack(&ms[0], &ms[1], midstate);
+	pre[0] = ms[0];
+	pre[1] = _mm_sha256rnds2_epu32(ms[1], ms[0], t);
+}
+
+#define SHANI_RNDS48_2WAY(A0, C0, M00, M01, M02, M03, A1, C1, M10, M11, M12, M13) \
+	do { \
+		int i_; \
+		for (i_ = 16; i_ < 64; i_ += 16) { \
+			SHANI_MSG(M00, M01, M02, M03); SHANI_MSG(M10, M11, M12, M13); \
+			SHANI_RNDS4(A0, C0, M00, i_); SHANI_RNDS4(A1, C1, M10, i_); \
+			SHANI_MSG(M01, M02, M03, M00); SHANI_MSG(M11, M12, M13, M10); \
+			SHANI_RNDS4(A0, C0, M01, i_ + 4); SHANI_RNDS4(A1, C1, M11, i_ + 4); \
+			SHANI_MSG(M02, M03, M00, M01); SHANI_MSG(M12, M13, M10, M11); \
+			SHANI_RNDS4(A0, C0, M02, i_ + 8); SHANI_RNDS4(A1, C1, M12, i_ + 8); \
+			SHANI_MSG(M03, M00, M01, M02); SHANI_MSG(M13, M10, M11, M12); \
+			SHANI_RNDS4(A0, C0, M03, i_ + 12); SHANI_RNDS4(A1, C1, M13, i_ + 12); \
+		} \
+	} while (0)
+
+/* packed state to the first two message words of the second hash */
+#define SHANI_STATE_TO_MSG(M0, M1, A, C) \
+	do { \
+		__m128i t_ = _mm_shuffle_epi32(A, 0x1B); \
+		__m128i u_ = _mm_shuffle_epi32(C, 0xB1); \
+		M0 = _mm_blend_epi16(t_, u_, 0xF0); \
+		M1 = _mm_alignr_epi8(u_, t_, 8); \
+	} while (0)
+
+static void sha256d_ms_shani_2way(uint32_t *hash, const uint32_t *data,
+	const __m128i *ms, const __m128i *pre)
+{
+	__m128i A0, C0, M00, M01, M02, M03;
+	__m128i A1, C1, M10, M11, M12, M13;
+	__m128i HA, HC, t;
+
+	/* first hash, rounds 2 to 63 of the second block */
+	M00 = _mm_loadu_si128((const __m128i *)(data + 0));
+	M01 = _mm_loadu_si128((const __m128i *)(data + 4));
+	M02 = _mm_loadu_si128((const __m128i *)(data + 8));
+	M03 = _mm_loadu_si128((const __m128i *)(data + 12));
+	M10 = _mm_loadu_si128((const __m128i *)(data + 16));
+	M11 = _mm_loadu_si128((const __m128i *)(data + 20));
+	M12 = _mm_loadu_si128((const __m128i *)(data + 24));
+	M13 = _mm_loadu_si128((const __m128i *)(data + 28));
+
+	t = _mm_loadu_si128((const __m128i *)sha256_k);
+	C0 = C1 = pre[1];
+	A0 = _mm_sha256rnds2_epu32(pre[0], C0,
+		_mm_shuffle_epi32(_mm_add_epi32(M00, t), 0x0E));
+	A1 = _mm_sha256rnds2_epu32(pre[0], C1,
+		_mm_shuffle_epi32(_mm_add_epi32(M10, t), 0x0E));
+	SHANI_RNDS4(A0, C0, M01, 4);  SHANI_RNDS4(A1, C1, M11, 4);
+	SHANI_RNDS4(A0, C0, M02, 8);  SHANI_RNDS4(A1, C1, M12, 8);
+	SHANI_RNDS4(A0, C0, M03, 12); SHANI_RNDS4(A1, C1, M13, 12);
+	SHANI_RNDS48_2WAY(A0, C0, M00, M01, M02, M03, A1, C1, M10, M11, M12, M13);
+
+	A0 = _mm_add_epi32(A0, ms[0]); C0 = _mm_add_epi32(C0, ms[1]);
+	A1 = _mm_add_epi32(A1, ms[0]); C1 = _mm_add_epi32(C1, ms[1]);
+
+	/* second hash, single padded block */
+	SHANI_STATE_TO_MSG(M00, M01, A0, C0);
+	SHANI_STATE_TO_MSG(M10, M11, A1, C1);
+	M02 = M12 = _mm_set_epi32(0, 0, 0, 0x80000000);
+	M03 = M13 = _mm_set_epi32(0x00000100, 0, 0, 0);
+
+	sha256_shani_pack(&HA, &HC, sha256_h);
+	A0 = A1 = HA;
+	C0 = C1 = HC;
+	SHANI_RNDS4(A0, C0, M00, 0);  SHANI_RNDS4(A1, C1, M10, 0);
+	SHANI_RNDS4(A0, C0, M01, 4);  SHANI_RNDS4(A1, C1, M11, 4);
+	SHANI_RNDS4(A0, C0, M02, 8);  SHANI_RNDS4(A1, C1, M12, 8);
+	SHANI_RNDS4(A0, C0, M03, 12); SHANI_RNDS4(A1, C1, M13, 12);
+	SHANI_RNDS48_2WAY(A0, C0, M00, M01, M02, M03, A1, C1, M10, M11, M12, M13);
+
+	sha256_shani_unpack(hash, _mm_add_epi32(A0, HA), _mm_add_epi32(C0, HC));
+	sha256_shani_unpack(hash + 8, _mm_add_epi32(A1, HA), _mm_add_epi32(C1, HC));
+}
+
+static inline int scanhash_sha256d_shani(int thr_id, struct work *work,
+	uint32_t max_nonce, uint64_t *hashes_done)
+{
+	uint32_t _ALIGN(128) data[2 * 16];
+	uint32_t _ALIGN(32) hash[2 * 8];
+	uint32_t _ALIGN(32) midstate[8];
+	__m128i ms[2], pre[2];
+	uint32_t *pdata = work->data;
+	uint32_t *ptarget = work->target;
+	uint32_t n = pdata[19] - 1;
+	const uint32_t first_nonce = pdata[19];
+	const uint32_t Htarg = ptarget[7];
+	int i;
+	uint32_t mask;
+
+	memcpy(data, pdata + 16, 16);
+	memset(data + 4, 0, 48);
+	data[4] = 0x80000000;
+	data[15] = 0x00000280;
+	memcpy(data + 16, data, 64);
+
+	sha256_init(midstate);
+	sha256_transform(midstate, pdata, 0);
+	sha256d_shani_prehash(ms, pre, midstate, data);
+
+	do {
+		data[3] = ++n;
+		data[16 + 3] = ++n;
+
+		sha256d_ms_shani_2way(hash, data, ms, pre);
+
+		mask = hash_lanes_le_target(&hash[7], 8, 2, Htarg, 1);
+		for (i = 0; unlikely(mask); i++, mask >>= 1) {
+			if (!(mask & 1))
+				continue;
+			pdata[19] = data[16 * i + 3];
+			sha256d_80_swap(hash, pdata);
+			if (fulltest(hash, ptarget)) {
+				work_set_target_ratio(work, hash);
+				*hashes_done = n - first_nonce + 1;
+				return 1;
+			}
+		}
+	} while (likely(n < max_nonce && !work_restart[thr_id].restart));
+
+	*hashes_done = n - first_nonce + 1;
+	pdata[19] = n;
+	return 0;
+}
+
+#endif /* HAVE_SHA256_SHANI */
+
 #ifdef HAVE_SHA256_4WAY
 
 void sha256d_ms_4way(uint32_t *hash,  uint32_t *data,
@@ -480,6 +822,7 @@ static inline int scanhash_sha256d_4way(int thr_id, struct work *work,
 	const uint32_t first_nonce = pdata[19];
 	const uint32_t Htarg = ptarget[7];
 	int i, j;
+	uint32_t mask;
 	
 	memcpy(data, pdata + 16, 64);
 	sha256d_preextend(data);
@@ -504,15 +847,16 @@ static inline int scanhash_sha256d_4way(int thr_id, struct work *work,
 		
 		sha256d_ms_4way(hash, data, midstate, prehash);
 		
-		for (i = 0; i < 4; i++) {
-			if (swab32(hash[4 * 7 + i]) <= Htarg) {
-				pdata[19] = data[4 * 3 + i];
-				sha256d_80_swap(hash, pdata);
-				if (fulltest(hash, ptarget)) {
-					work_set_target_ratio(work, hash);
-					*hashes_done = n - first_nonce + 1;
-					return 1;
-				}
+		mask = hash_lanes_le_target(&hash[4 * 7], 1, 4, Htarg, 1);
+		for (i = 0; mask; i++, mask >>= 1) {
+			if (!(mask & 1))
+				continue;
+			pdata[19] = data[4 * 3 + i];
+			sha256d_80_swap(hash, pdata);
+			if (fulltest(hash, ptarget)) {
+				work_set_target_ratio(work, hash);
+				*hashes_done = n - first_nonce + 1;
+				return 1;
 			}
 		}
 	} while (n < max_nonce && !work_restart[thr_id].restart);
@@ -542,6 +886,7 @@ static inline int scanhash_sha256d_8way(int thr_id, struct work *work,
 	const uint32_t first_nonce = pdata[19];
 	const uint32_t Htarg = ptarget[7];
 	int i, j;
+	uint32_t mask;
 	
 	memcpy(data, pdata + 16, 64);
 	sha256d_preextend(data);
@@ -566,15 +911,16 @@ static inline int scanhash_sha256d_8way(int thr_id, struct work *work,
 		
 		sha256d_ms_8way(hash, data, midstate, prehash);
 		
-		for (i = 0; i < 8; i++) {
-			if (swab32(hash[8 * 7 + i]) <= Htarg) {
-				pdata[19] = data[8 * 3 + i];
-				sha256d_80_swap(hash, pdata);
-				if (fulltest(hash, ptarget)) {
-					work_set_target_ratio(work, hash);
-					*hashes_done = n - first_nonce + 1;
-					return 1;
-				}
+		mask = hash_lanes_le_target(&hash[8 * 7], 1, 8, Htarg, 1);
+		for (i = 0; mask; i++, mask >>= 1) {
+			if (!(mask & 1))
+				continue;
+			pdata[19] = data[8 * 3 + i];
+			sha256d_80_swap(hash, pdata);
+			if (fulltest(hash, ptarget)) {
+				work_set_target_ratio(work, hash);
+				*hashes_done = n - first_nonce + 1;
+				return 1;
 			}
 		}
 	} while (n < max_nonce && !work_restart[thr_id].restart);
@@ -598,6 +944,10 @@ int scanhash_sha256d(int thr_id, struct work *work, uint32_t max_nonce, uint64_t
 	const uint32_t Htarg = ptarget[7];
 	uint32_t n = pdata[19] - 1;
 
+#ifdef HAVE_SHA256_SHANI
+	if (sha256_use_shani())
+		return scanhash_sha256d_shani(thr_id, work, max_nonce, hashes_done);
+#endif
 #ifdef HAVE_SHA256_8WAY
 	if (sha256_use_8way())
 		return scanhash_sha256d_8way(thr_id, work, max_nonce, hashes_done);
@@ -3,30 +3,96 @@
 #include <string.h>
 #include <stdint.h>
 
-#include <openssl/sha.h>
-
 #include "sha3/sph_skein.h"
 
+/* sha256 of a 64-byte skein512 digest, straight on the transform */
+static void skein_sha256(uint32_t *hash, const uint32_t *block)
+{
+	static const uint32_t pad[16] = { 0x80000000, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 512 };
+	uint32_t S[8];
+
+	sha256_init(S);
+	sha256_transform(S, block, 1);
+	sha256_transform(S, pad, 0);
+	for (int i = 0; i < 8; i++)
+		be32enc(&hash[i], S[i]);
+}
+
 void skeinhash(void *state, const void *input)
 {
 	sph_skein512_context ctx_skein;
-	SHA256_CTX sha256;
 
-	uint32_t hash[16];
+	uint32_t _ALIGN(64) hash[16];
 
 	sph_skein512_init(&ctx_skein);
 	sph_skein512(&ctx_skein, input, 80);
 	sph_skein512_close(&ctx_skein, hash);
 
-	SHA256_Init(&sha256);
-	SHA256_Update(&sha256, hash, 64);
-	SHA256_Final((unsigned char*) hash, &sha256);
+	skein_sha256(hash, hash);
 
 	memcpy(state, hash, 32);
 }
 
+#ifndef SSE
+#ifdef __AVX512F__
+#define SKEIN_LANES 8
+#define skein512_80_lanes sph_skein512_80_AVX512
+#else
+#define SKEIN_LANES 4
+#define skein512_80_lanes sph_skein512_80_AVX
+#endif
+#else
+#define SKEIN_LANES 2
+#define skein512_80_lanes sph_skein512_80_SSE2
+#endif
+
+#if SKEIN_LANES == 8
+#define SHA_LANES 8
+#define sha256_transform_lanes sha256_transform_8way_intrin
+#else
+#define SHA_LANES 4
+#define sha256_transform_lanes sha256_transform_4way_intrin
+#endif
+
+/* SHA-NI one digest at a time beats the 4-way transform, not the 8-way */
+#if defined(HAVE_SHA256_SHANI) && SHA_LANES == 4
+#define SKEIN_SHANI
+#endif
+
+/* SHA_LANES nonces per iteration, in batches of SKEIN_LANES for skein512 */
+#define VHASH(w, l) vhash[((l) / SKEIN_LANES) * 8 * SKEIN_LANES + (w) * SKEIN_LANES + (l) % SKEIN_LANES]
+
+/* sha256 of the SHA_LANES digests, one per 32-bit lane */
+static void skein_sha256_lanes(uint32_t *vstate, const uint64_t *vhash)
+{
+	uint32_t _ALIGN(64) block[16 * SHA_LANES];
+	uint32_t _ALIGN(64) pad[16 * SHA_LANES] = { 0 };
+	uint32_t S[8];
+
+	sha256_init(S);
+	for (int i = 0; i < 8; i++)
+		for (int l = 0; l < SHA_LANES; l++)
+			vstate[i * SHA_LANES + l] = S[i];
+	for (int w = 0; w < 8; w++)
+		for (int l = 0; l < SHA_LANES; l++) {
+			block[(2 * w) * SHA_LANES + l] = (uint32_t)VHASH(w, l);
+			block[(2 * w + 1) * SHA_LANES + l] = (uint32_t)(VHASH(w, l) >> 32);
+		}
+	for (int l = 0; l < SHA_LANES; l++) {
+		pad[l] = 0x80000000;
+		pad[15 * SHA_LANES + l] = 512;
+	}
+	sha256_transform_lanes(vstate, block, 1);
+	sha256_transform_lanes(vstate, pad, 0);
+}
+
 int scanhash_skein(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done)
 {
+	/* 80-byte headers and 64-byte digests, interleaved by 64-bit word */
+	uint64_t _ALIGN(64) vdata[10 * SKEIN_LANES];
+	uint64_t _ALIGN(64) vhash[8 * SHA_LANES];
+	uint64_t _ALIGN(64) midstate[8];
+	uint32_t _ALIGN(64) vstate[8 * SHA_LANES];
 	uint32_t _ALIGN(128) hash32[8];
 	uint32_t _ALIGN(128) endiandata[20];
 	uint32_t *pdata = work->data;
@@ -41,16 +107,52 @@ int scanhash_skein(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *
 		be32enc(&endiandata[i], pdata[i]);
 	};
 
+	sph_skein512_80_midstate(midstate, endiandata);
+	for (int l = 0; l < SKEIN_LANES; l++)
+		vdata[8 * SKEIN_LANES + l] = ((uint64_t *)endiandata)[8];
+
 	do {
-		be32enc(&endiandata[19], n);
-		skeinhash(hash32, endiandata);
-		if (hash32[7] < Htarg && fulltest(hash32, ptarget)) {
-			work_set_target_ratio(work, hash32);
-			*hashes_done = n - first_nonce + 1;
-			pdata[19] = n;
-			return true;
+		for (int b = 0; b < SHA_LANES; b += SKEIN_LANES) {
+			for (int l = 0; l < SKEIN_LANES; l++) {
+				be32enc(&endiandata[19], n + b + l);
+				vdata[9 * SKEIN_LANES + l] = ((uint64_t *)endiandata)[9];
+			}
+			skein512_80_lanes(&vhash[b * 8], midstate, vdata);
+		}
+
+#ifdef SKEIN_SHANI
+		if (!sha256_use_shani())
+#endif
+			skein_sha256_lanes(vstate, vhash);
+
+		/* row 7 of vstate holds the big-endian last word of every lane */
+		uint32_t mask = (1u << SHA_LANES) - 1;
+#ifdef SKEIN_SHANI
+		if (!sha256_use_shani())
+#endif
+			mask = hash_lanes_le_target(&vstate[7 * SHA_LANES], 1, SHA_LANES, Htarg, 1);
+
+		for (int l = 0; mask; l++, mask >>= 1) {
+			if (!(mask & 1))
+				continue;
+#ifdef SKEIN_SHANI
+			if (sha256_use_shani()) {
+				uint64_t _ALIGN(64) digest[8];
+				for (int w = 0; w < 8; w++)
+					digest[w] = VHASH(w, l);
+				skein_sha256(hash32, (uint32_t *)digest);
+			} else
+#endif
+			for (int i = 0; i < 8; i++)
+				be32enc(&hash32[i], vstate[i * SHA_LANES + l]);
+			if (hash32[7] <= Htarg && fulltest(hash32, ptarget)) {
+				work_set_target_ratio(work, hash32);
+				*hashes_done = n + l - first_nonce + 1;
+				pdata[19] = n + l;
+				return true;
+			}
 		}
-		n++;
+		n += SHA_LANES;
 
 	} while (n < max_nonce && !work_restart[thr_id].restart);
 
@@ -22,8 +22,28 @@ void skein2hash(void *output, const void *input)
 	memcpy(output, hash, 32);
 }
 
+#ifndef SSE
+#ifdef __AVX512F__
+#define SKEIN_LANES 8
+#define skein512_80_lanes sph_skein512_80_AVX512
+#define skein512_lanes sph_skein512_AVX512
+#else
+#define SKEIN_LANES 4
+#define skein512_80_lanes sph_skein512_80_AVX
+#define skein512_lanes sph_skein512_AVX
+#endif
+#else
+#define SKEIN_LANES 2
+#define skein512_80_lanes sph_skein512_80_SSE2
+#define skein512_lanes sph_skein512_SSE2
+#endif
+
 int scanhash_skein2(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done)
 {
+	/* 80-byte headers and 64-byte digests, interleaved by 64-bit word */
+	uint64_t _ALIGN(64) vdata[10 * SKEIN_LANES];
+	uint64_t _ALIGN(64) vhash[8 * SKEIN_LANES];
+	uint64_t _ALIGN(64) midstate[8];
 	uint32_t _ALIGN(128) hash32[8];
 	uint32_t _ALIGN(128) endiandata[20];
 	uint32_t *pdata = work->data;
@@ -38,16 +58,32 @@ int scanhash_skein2(int thr_id, struct work *work, uint32_t max_nonce, uint64_t
 		be32enc(&endiandata[i], pdata[i]);
 	}
 
+	sph_skein512_80_midstate(midstate, endiandata);
+	for (int l = 0; l < SKEIN_LANES; l++)
+		vdata[8 * SKEIN_LANES + l] = ((uint64_t *)endiandata)[8];
+
 	do {
-		be32enc(&endiandata[19], n);
-		skein2hash(hash32, endiandata);
-		if (hash32[7] < Htarg && fulltest(hash32, ptarget)) {
-			work_set_target_ratio(work, hash32);
-			*hashes_done = n - first_nonce + 1;
-			pdata[19] = n;
-			return true;
+		for (int l = 0; l < SKEIN_LANES; l++) {
+			be32enc(&endiandata[19], n + l);
+			vdata[9 * SKEIN_LANES + l] = ((uint64_t *)endiandata)[9];
+		}
+		skein512_80_lanes(vhash, midstate, vdata);
+		skein512_lanes(vhash, vhash, 64);
+
+		uint32_t mask = hash_lanes_le_target((uint32_t *)&vhash[3 * SKEIN_LANES] + 1, 2, SKEIN_LANES, Htarg, 0);
+		for (int l = 0; mask; l++, mask >>= 1) {
+			if (!(mask & 1))
+				continue;
+			for (int w = 0; w < 4; w++)
+				((uint64_t *)hash32)[w] = vhash[w * SKEIN_LANES + l];
+			if (fulltest(hash32, ptarget)) {
+				work_set_target_ratio(work, hash32);
+				*hashes_done = n + l - first_nonce + 1;
+				pdata[19] = n + l;
+				return true;
+			}
 		}
-		n++;
+		n += SKEIN_LANES;
 
 	} while (n < max_nonce && !work_restart[thr_id].restart);
 
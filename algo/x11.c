@@ -36,49 +36,62 @@ void x11hash(void *output, const void *input)
 	//these uint512 in the c++ source of the client are backed by an array of uint32
 	uint32_t _ALIGN(64) hashA[16], hashB[16];
 
+	PROF_START();
+
 	sph_blake512_init(&ctx_blake);
 	sph_blake512 (&ctx_blake, input, 80);
 	sph_blake512_close (&ctx_blake, hashA);
+	PROF_STAGE(0, "blake");
 
 	sph_bmw512_init(&ctx_bmw);
 	sph_bmw512 (&ctx_bmw, hashA, 64);
 	sph_bmw512_close(&ctx_bmw, hashB);
+	PROF_STAGE(1, "bmw");
 
 	sph_groestl512_init(&ctx_groestl);
 	sph_groestl512 (&ctx_groestl, hashB, 64);
 	sph_groestl512_close(&ctx_groestl, hashA);
+	PROF_STAGE(2, "groestl");
 
 	sph_skein512_init(&ctx_skein);
 	sph_skein512 (&ctx_skein, hashA, 64);
 	sph_skein512_close (&ctx_skein, hashB);
+	PROF_STAGE(3, "skein");
 
 	sph_jh512_init(&ctx_jh);
 	sph_jh512 (&ctx_jh, hashB, 64);
 	sph_jh512_close(&ctx_jh, hashA);
+	PROF_STAGE(4, "jh");
 
 	sph_keccak512_init(&ctx_keccak);
 	sph_keccak512 (&ctx_keccak, hashA, 64);
 	sph_keccak512_close(&ctx_keccak, hashB);
+	PROF_STAGE(5, "keccak");
 
 	sph_luffa512_init (&ctx_luffa1);
 	sph_luffa512 (&ctx_luffa1, hashB, 64);
 	sph_luffa512_close (&ctx_luffa1, hashA);
+	PROF_STAGE(6, "luffa");
 
 	sph_cubehash512_init (&ctx_cubehash1);
 	sph_cubehash512 (&ctx_cubehash1, hashA, 64);
 	sph_cubehash512_close(&ctx_cubehash1, hashB);
+	PROF_STAGE(7, "cubehash");
 
 	sph_shavite512_init (&ctx_shavite1);
 	sph_shavite512 (&ctx_shavite1, hashB, 64);
 	sph_shavite512_close(&ctx_shavite1, hashA);
+	PROF_STAGE(8, "shavite");
 
 	sph_simd512_init (&ctx_simd1);
 	sph_simd512 (&ctx_simd1, hashA, 64);
 	sph_simd512_close(&ctx_simd1, hashB);
+	PROF_STAGE(9, "simd");
 
 	sph_echo512_init (&ctx_echo1);
 	sph_echo512 (&ctx_echo1, hashB, 64);
 	sph_echo512_close(&ctx_echo1, hashA);
+	PROF_STAGE(10, "echo");
 
 	memcpy(output, hashA, 32);
 }
@@ -10,8 +10,8 @@
 
 int scanhash_yescrypt(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done)
 {
-	uint32_t _ALIGN(64) vhash[8];
-	uint32_t _ALIGN(64) endiandata[20];
+	uint32_t _ALIGN(64) vhash[2][8];
+	uint32_t _ALIGN(64) endiandata[2][20];
 	uint32_t *pdata = work->data;
 	uint32_t *ptarget = work->target;
 
@@ -19,21 +19,48 @@ int scanhash_yescrypt(int thr_id, struct work *work, uint32_t max_nonce, uint64_
 	const uint32_t first_nonce = pdata[19];
 
 	uint32_t n = first_nonce;
+	int l;
 
 	for (int i=0; i < 19; i++) {
-		be32enc(&endiandata[i], pdata[i]);
+		be32enc(&endiandata[0][i], pdata[i]);
+	}
+	memcpy(endiandata[1], endiandata[0], 76);
+
+	if (opt_yescrypt_ways < 2) {
+		do {
+			be32enc(&endiandata[0][19], n);
+			if (yescrypt_hash((char*) endiandata[0], (char*) vhash[0], 80))
+				goto failed;
+			if (vhash[0][7] < Htarg && fulltest(vhash[0], ptarget)) {
+				work_set_target_ratio(work, vhash[0]);
+				*hashes_done = n - first_nonce + 1;
+				pdata[19] = n;
+				return true;
+			}
+			n++;
+
+		} while (n < max_nonce && !work_restart[thr_id].restart);
+
+		*hashes_done = n - first_nonce + 1;
+		pdata[19] = n;
+
+		return 0;
 	}
 
 	do {
-		be32enc(&endiandata[19], n);
-		yescrypt_hash((char*) endiandata, (char*) vhash, 80);
-		if (vhash[7] < Htarg && fulltest(vhash, ptarget)) {
-			work_set_target_ratio(work, vhash);
-			*hashes_done = n - first_nonce + 1;
-			pdata[19] = n;
+		be32enc(&endiandata[0][19], n);
+		be32enc(&endiandata[1][19], n + 1);
+		if (yescrypt_hash_2way((char*) endiandata[0], (char*) endiandata[1],
+				(char*) vhash[0], (char*) vhash[1], 80))
+			goto failed;
+		l = fulltest_lanes(vhash[0], hash_lanes_le_target(&vhash[0][7], 8, 2, Htarg, 0), ptarget);
+		if (l >= 0) {
+			work_set_target_ratio(work, vhash[l]);
+			*hashes_done = n - first_nonce + l + 1;
+			pdata[19] = n + l;
 			return true;
 		}
-		n++;
+		n += 2;
 
 	} while (n < max_nonce && !work_restart[thr_id].restart);
 
@@ -41,4 +68,9 @@ int scanhash_yescrypt(int thr_id, struct work *work, uint32_t max_nonce, uint64_
 	pdata[19] = n;
 
 	return 0;
+
+failed:
+	*hashes_done = n - first_nonce;
+	pdata[19] = n;
+	return -1;
 }
@@ -46,14 +46,44 @@ static const int permut[24][4] = {
 	{3, 2, 1, 0}
 };
 
-void zr5hash(void *output, const void *input)
+/* one 64-byte to 64-byte stage, in place */
+static void zr5_stage(int algo, uint32_t *phash)
 {
-	sph_keccak512_context ctx_keccak;
 	sph_blake512_context ctx_blake;
 	sph_groestl512_context ctx_groestl;
 	sph_jh512_context ctx_jh;
 	sph_skein512_context ctx_skein;
 
+	switch (algo) {
+	case ZR_BLAKE:
+		sph_blake512_init(&ctx_blake);
+		sph_blake512(&ctx_blake, (const void*) phash, 64);
+		sph_blake512_close(&ctx_blake, phash);
+		break;
+	case ZR_GROESTL:
+		sph_groestl512_init(&ctx_groestl);
+		sph_groestl512(&ctx_groestl, (const void*) phash, 64);
+		sph_groestl512_close(&ctx_groestl, phash);
+		break;
+	case ZR_JH512:
+		sph_jh512_init(&ctx_jh);
+		sph_jh512(&ctx_jh, (const void*) phash, 64);
+		sph_jh512_close(&ctx_jh, phash);
+		break;
+	case ZR_SKEIN:
+		sph_skein512_init(&ctx_skein);
+		sph_skein512(&ctx_skein, (const void*) phash, 64);
+		sph_skein512_close(&ctx_skein, phash);
+		break;
+	default:
+		break;
+	}
+}
+
+void zr5hash(void *output, const void *input)
+{
+	sph_keccak512_context ctx_keccak;
+
 	uchar _ALIGN(64) hash[64];
 	uint32_t *phash = (uint32_t *) hash;
 	uint32_t norder;
@@ -65,32 +95,8 @@ void zr5hash(void *output, const void *input)
 	norder = phash[0] % ARRAY_SIZE(permut); /* % 24 */
 
 	for(int i = 0; i < 4; i++)
-	{
-		switch (permut[norder][i]) {
-		case ZR_BLAKE:
-			sph_blake512_init(&ctx_blake);
-			sph_blake512(&ctx_blake, (const void*) phash, 64);
-			sph_blake512_close(&ctx_blake, phash);
-			break;
-		case ZR_GROESTL:
-			sph_groestl512_init(&ctx_groestl);
-			sph_groestl512(&ctx_groestl, (const void*) phash, 64);
-			sph_groestl512_close(&ctx_groestl, phash);
-			break;
-		case ZR_JH512:
-			sph_jh512_init(&ctx_jh);
-			sph_jh512(&ctx_jh, (const void*) phash, 64);
-			sph_jh512_close(&ctx_jh, phash);
-			break;
-		case ZR_SKEIN:
-			sph_skein512_init(&ctx_skein);
-			sph_skein512(&ctx_skein, (const void*) phash, 64);
-			sph_skein512_close(&ctx_skein, phash);
-			break;
-		default:
-			break;
-		}
-	}
+		zr5_stage(permut[norder][i], phash);
+
 	memcpy(output, phash, 32);
 }
 
@@ -112,6 +118,95 @@ void zr5hash_pok(void *output, uint32_t *pdata)
 	memcpy(output, hash, 32);
 }
 
+#ifndef SSE
+#ifdef __AVX512F__
+#define ZR5_LANES 8
+#define zr5_keccak512_lanes sph_keccak512_AVX512
+#define zr5_skein512_lanes sph_skein512_AVX512
+#else
+#define ZR5_LANES 4
+#define zr5_keccak512_lanes sph_keccak512_AVX
+#define zr5_skein512_lanes sph_skein512_AVX
+#endif
+#else
+#define ZR5_LANES 2
+#define zr5_keccak512_lanes sph_keccak512_SSE2
+#define zr5_skein512_lanes sph_skein512_SSE2
+#endif
+
+/* nonces per batch, enough to keep the skein bucket near a full vector */
+#define ZR5_BATCH (4 * ZR5_LANES)
+
+typedef void (*zr5_lanes_fn)(void *dst, const void *data, size_t len);
+
+/*
+ * Run a lane kernel over the lanes idx[0..cnt) of a batch, 16 words per
+ * lane. Messages are len bytes from src, digests go to dst (may alias).
+ * A short last group is padded with its first lane; a lone lane is left
+ * to the caller's scalar path and its count returned.
+ */
+static int zr5_run_lanes(zr5_lanes_fn fn, uint32_t *dst, const uint32_t *src,
+	size_t len, const int *idx, int cnt, int srcw)
+{
+	uint64_t _ALIGN(64) vin[10 * ZR5_LANES];
+	uint64_t _ALIGN(64) vout[8 * ZR5_LANES];
+	int k = 0;
+
+	for (; cnt - k >= 2; k += ZR5_LANES) {
+		for (int w = 0; w < (int)(len / 8); w++)
+			for (int l = 0; l < ZR5_LANES; l++) {
+				int x = idx[k + (k + l < cnt ? l : 0)];
+				vin[w * ZR5_LANES + l] = ((const uint64_t *)(src + x * srcw))[w];
+			}
+		fn(vout, vin, len);
+		for (int l = 0; l < ZR5_LANES && k + l < cnt; l++)
+			for (int w = 0; w < 8; w++)
+				((uint64_t *)(dst + idx[k + l] * 16))[w] = vout[w * ZR5_LANES + l];
+	}
+	return cnt > k ? cnt - k : 0;
+}
+
+/*
+ * zr5hash of cnt headers (20 words each) into hash (16 words each). The
+ * keccak head runs in SIMD lanes; each of the four stages then buckets
+ * the lanes by the algorithm their permutation picks, so skein runs as
+ * a lane kernel and the others run back to back on warm tables.
+ */
+static void zr5hash_batch(uint32_t *hash, const uint32_t *data, int cnt)
+{
+	int norder[ZR5_BATCH];
+	int bucket[4][ZR5_BATCH], nb[4];
+	int all[ZR5_BATCH] = { 0 };
+
+	for (int l = 0; l < cnt; l++)
+		all[l] = l;
+	int rest = zr5_run_lanes(zr5_keccak512_lanes, hash, data, 80, all, cnt, 20);
+	if (rest) {
+		sph_keccak512_context ctx_keccak;
+		sph_keccak512_init(&ctx_keccak);
+		sph_keccak512(&ctx_keccak, data + (cnt - 1) * 20, 80);
+		sph_keccak512_close(&ctx_keccak, hash + (cnt - 1) * 16);
+	}
+
+	for (int l = 0; l < cnt; l++)
+		norder[l] = hash[l * 16] % ARRAY_SIZE(permut);
+
+	for (int i = 0; i < 4; i++) {
+		memset(nb, 0, sizeof(nb));
+		for (int l = 0; l < cnt; l++) {
+			int a = permut[norder[l]][i];
+			bucket[a][nb[a]++] = l;
+		}
+		for (int a = 0; a < 4; a++) {
+			int k = 0;
+			if (a == ZR_SKEIN)
+				k = nb[a] - zr5_run_lanes(zr5_skein512_lanes, hash, hash, 64, bucket[a], nb[a], 16);
+			for (; k < nb[a]; k++)
+				zr5_stage(a, hash + bucket[a][k] * 16);
+		}
+	}
+}
+
 int scanhash_zr5(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done)
 {
 	uint32_t _ALIGN(64) hash[16];
@@ -119,24 +214,60 @@ int scanhash_zr5(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *ha
 	uint32_t *ptarget = work->target;
 	const uint32_t first_nonce = pdata[19];
 	uint32_t nonce = first_nonce;
-	#define tmpdata pdata
 
 	if (opt_benchmark)
 		ptarget[7] = 0x00ff;
 
+	const uint32_t version = pdata[0] & (~POK_DATA_MASK);
+	const uint32_t Htarg = ptarget[7];
+
 	do {
-		tmpdata[19] = nonce;
-		zr5hash_pok(hash, tmpdata);
-
-		if (hash[7] <= ptarget[7] && fulltest(hash, ptarget))
-		{
-			work_set_target_ratio(work, hash);
-			pdata[0] = tmpdata[0];
-			pdata[19] = nonce;
-			*hashes_done = pdata[19] - first_nonce + 1;
-			return 1;
+		uint32_t _ALIGN(64) data[ZR5_BATCH * 20];
+		uint32_t _ALIGN(64) vhash[ZR5_BATCH * 16];
+		uint32_t pok[ZR5_BATCH];
+		int redo[ZR5_BATCH], nredo = 0;
+		int cnt = ZR5_BATCH;
+
+		if (nonce < max_nonce && max_nonce - nonce < ZR5_BATCH)
+			cnt = max_nonce - nonce;
+
+		for (int l = 0; l < cnt; l++) {
+			memcpy(data + l * 20, pdata, 80);
+			data[l * 20] = version;
+			data[l * 20 + 19] = nonce + l;
+		}
+		zr5hash_batch(vhash, data, cnt);
+
+		/* fill PoK, then rehash only the lanes whose header changed */
+		for (int l = 0; l < cnt; l++) {
+			pok[l] = version | (vhash[l * 16] & POK_DATA_MASK);
+			if (pok[l] != version) {
+				memcpy(data + nredo * 20, data + l * 20, 80);
+				data[nredo * 20] = pok[l];
+				redo[nredo++] = l;
+			}
+		}
+		if (nredo) {
+			uint32_t _ALIGN(64) rhash[ZR5_BATCH * 16];
+			zr5hash_batch(rhash, data, nredo);
+			for (int r = 0; r < nredo; r++)
+				memcpy(vhash + redo[r] * 16, rhash + r * 16, 32);
+		}
+
+		uint32_t mask = hash_lanes_le_target(&vhash[7], 16, cnt, Htarg, 0);
+		for (int l = 0; mask; l++, mask >>= 1) {
+			if (!(mask & 1))
+				continue;
+			memcpy(hash, vhash + l * 16, 32);
+			if (fulltest(hash, ptarget)) {
+				work_set_target_ratio(work, hash);
+				pdata[0] = pok[l];
+				pdata[19] = nonce + l;
+				*hashes_done = pdata[19] - first_nonce + 1;
+				return 1;
+			}
 		}
-		nonce++;
+		nonce += cnt;
 
 	} while (nonce < max_nonce && !work_restart[thr_id].restart);
 
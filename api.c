@@ -8,7 +8,7 @@
  * Software Foundation; either version 2 of the License, or (at your option)
  * any later version.  See COPYING for more details.
  */
-#define APIVERSION "1.1"
+#define APIVERSION "1.4"
 
 #ifdef WIN32
 # define  _WINSOCK_DEPRECATED_NO_WARNINGS
@@ -79,7 +79,7 @@ static struct IP4ACCESS *ipaccess = NULL;
 
 // Socket data buffers
 #define MYBUFSIZ	16384
-#define SOCK_REC_BUFSZ	1024
+#define SOCK_REC_BUFSZ	4096
 
 // Socket is on 127.0.0.1
 #define QUEUE	10
@@ -113,12 +113,17 @@ static void cpustatus(int thr_id)
 {
 	if (thr_id >= 0 && thr_id < opt_n_threads) {
 		struct cpu_info *cpu = &thr_info[thr_id].cpu;
+		struct thr_stats st;
 		char buf[512]; *buf = '\0';
 
+		stats_thr_get(thr_id, &st);
 		cpu->thr_id = thr_id;
-		cpu->khashes = thr_hashrates[thr_id] / 1000.0; //todo: stats_get_speed(thr_id, 0.0) / 1000.0;
+		cpu->khashes = st.rate[STATS_60S] / 1000.0;
 
-		snprintf(buf, sizeof(buf), "CPU=%d;KHS=%.2f|", thr_id, cpu->khashes);
+		snprintf(buf, sizeof(buf), "CPU=%d;KHS=%.2f;KHS10S=%.2f;KHS15M=%.2f;"
+			"KHSMIN=%.2f;KHSMAX=%.2f;HASHES=%llu|", thr_id, cpu->khashes,
+			st.rate[STATS_10S] / 1000.0, st.rate[STATS_15M] / 1000.0,
+			st.min / 1000.0, st.max / 1000.0, (unsigned long long) st.hashes);
 
 		// append to buffer
 		strcat(buffer, buf);
@@ -138,6 +143,7 @@ static char *getsummary(char *params)
 	double accps = (60.0 * accepted_count) / (uptime ? uptime : 1.0);
 
 	struct cpu_info cpu = { 0 };
+	struct energy_stats es;
 #ifdef USE_MONITORING
 	cpu.has_monitoring = true;
 	cpu.cpu_temp = cpu_temp(0);
@@ -146,16 +152,24 @@ static char *getsummary(char *params)
 #endif
 
 	get_currentalgo(algo, sizeof(algo));
+	/* package power and efficiency over 60s, all 0 without RAPL */
+	stats_energy(&es);
 
 	*buffer = '\0';
 	sprintf(buffer, "NAME=%s;VER=%s;API=%s;"
-		"ALGO=%s;CPUS=%d;KHS=%.2f;SOLV=%d;ACC=%d;REJ=%d;"
+		"ALGO=%s;CPUS=%d;KHS=%.2f;KHS10S=%.2f;KHS15M=%.2f;EKHS=%.2f;"
+		"SOLV=%d;ACC=%d;REJ=%d;"
 		"ACCMN=%.3f;DIFF=%.6f;TEMP=%.1f;FAN=%d;FREQ=%d;"
+		"POWER=%.1f;HPJ=%.4g;JPH=%.4g;ENERGY=%.0f;"
 		"UPTIME=%.0f;TS=%u|",
 		PACKAGE_NAME, PACKAGE_VERSION, APIVERSION,
 		algo, opt_n_threads, (double)global_hashrate / 1000.0,
+		stats_hashrate(STATS_10S) / 1000.0, stats_hashrate(STATS_15M) / 1000.0,
+		stats_effective_hashrate() / 1000.0,
 		solved_count, accepted_count, rejected_count, accps, net_diff > 0. ? net_diff : stratum_diff,
 		cpu.cpu_temp, cpu.cpu_fan, cpu.cpu_clock,
+		es.watts[STATS_60S], es.hpj[STATS_60S],
+		es.hpj[STATS_60S] > 0. ? 1. / es.hpj[STATS_60S] : 0., es.joules[0],
 		uptime, (uint32_t) ts);
 	return buffer;
 }
@@ -171,6 +185,32 @@ static char *getthreads(char *params)
 	return buffer;
 }
 
+/**
+ * Share results by job age when found, and what made the stale ones late
+ */
+static char *getshares(char *params)
+{
+	return journal_report(buffer, MYBUFSIZ);
+}
+
+/**
+ * Thermal governor state, per thread temperature and clock, its decisions
+ */
+static char *getgovernor(char *params)
+{
+	return governor_report(buffer, MYBUFSIZ);
+}
+
+#ifdef HASH_PROFILE
+/**
+ * Per-stage cycles of the hash function (--profile)
+ */
+static char *getprofile(char *params)
+{
+	return prof_report(buffer, MYBUFSIZ);
+}
+#endif
+
 /**
  * Is remote control allowed ?
  */
@@ -216,6 +256,11 @@ struct CMDS {
 } cmds[] = {
 	{ "summary", getsummary },
 	{ "threads", getthreads },
+	{ "shares", getshares },
+	{ "governor", getgovernor },
+#ifdef HASH_PROFILE
+	{ "profile", getprofile },
+#endif
 	/* remote functions */
 	{ "seturl", remote_seturl },
 	{ "quit",    remote_quit },
@@ -235,18 +280,6 @@ static char *gethelp(char *params)
 }
 
 
-static int send_result(SOCKETTYPE c, char *result)
-{
-	int n;
-	if (!result) {
-		n = (int) send(c, "", 1, 0);
-	} else {
-		// ignore failure - it's closed immediately anyway
-		n = (int) send(c, result, (int) strlen(result) + 1, 0);
-	}
-	return n;
-}
-
 /* ---- Base64 Encoding/Decoding Table --- */
 static const char table64[]=
   "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
@@ -317,19 +350,19 @@ static size_t base64_encode(const uchar *indata, size_t insize, char *outptr, si
 
 #include "compat/curl-for-windows/openssl/openssl/crypto/sha/sha.h"
 
-/* websocket handshake (tested in Chrome) */
-static int websocket_handshake(SOCKETTYPE c, char *result, char *clientkey)
+/* Sec-WebSocket-Accept for the client key (tested in Chrome), false if too long */
+static bool websocket_accept(const char *clientkey, char *seckey, size_t sz)
 {
-	char answer[256];
 	char inpkey[128] = { 0 };
-	char seckey[64];
 	uchar sha1[20];
 	SHA_CTX ctx;
 
 	if (opt_protocol)
 		applog(LOG_DEBUG, "clientkey: %s", clientkey);
 
-	sprintf(inpkey, "%s258EAFA5-E914-47DA-95CA-C5AB0DC85B11", clientkey);
+	if (snprintf(inpkey, sizeof(inpkey), "%s258EAFA5-E914-47DA-95CA-C5AB0DC85B11",
+			clientkey) >= (int) sizeof(inpkey))
+		return false;
 
 	// SHA-1 test from rfc, returns in base64 "s3pPLMBiTxaQ9kYGzzhZRbK+xOo="
 	//sprintf(inpkey, "dGhlIHNhbXBsZSBub25jZQ==258EAFA5-E914-47DA-95CA-C5AB0DC85B11");
@@ -338,57 +371,8 @@ static int websocket_handshake(SOCKETTYPE c, char *result, char *clientkey)
 	SHA1_Update(&ctx, inpkey, strlen(inpkey));
 	SHA1_Final(sha1, &ctx);
 
-	base64_encode(sha1, 20, seckey, sizeof(seckey));
-
-	sprintf(answer,
-		"HTTP/1.1 101 Switching Protocol\r\n"
-		"Upgrade: WebSocket\r\nConnection: Upgrade\r\n"
-		"Sec-WebSocket-Accept: %s\r\n"
-		"Sec-WebSocket-Protocol: text\r\n"
-		"\r\n", seckey);
-
-	// data result as tcp frame
-
-	uchar hd[10] = { 0 };
-	hd[0] = 129; // 0x1 text frame (FIN + opcode)
-	uint64_t datalen = (uint64_t) strlen(result);
-	uint8_t frames = 2;
-	if (datalen <= 125) {
-		hd[1] = (uchar) (datalen);
-	} else if (datalen <= 65535) {
-		hd[1] = (uchar) 126;
-		hd[2] = (uchar) (datalen >> 8);
-		hd[3] = (uchar) (datalen);
-		frames = 4;
-	} else {
-		hd[1] = (uchar) 127;
-		hd[2] = (uchar) (datalen >> 56);
-		hd[3] = (uchar) (datalen >> 48);
-		hd[4] = (uchar) (datalen >> 40);
-		hd[5] = (uchar) (datalen >> 32);
-		hd[6] = (uchar) (datalen >> 24);
-		hd[7] = (uchar) (datalen >> 16);
-		hd[8] = (uchar) (datalen >> 8);
-		hd[9] = (uchar) (datalen);
-		frames = 10;
-	}
-
-	size_t handlen = strlen(answer);
-	uchar *data = (uchar*) calloc(1, handlen + frames + (size_t) datalen + 1);
-	if (data == NULL)
-		return -1;
-	else {
-		uchar *p = data;
-		// HTTP header 101
-		memcpy(p, answer, handlen);
-		p += handlen;
-		// WebSocket Frame - Header + Data
-		memcpy(p, hd, frames);
-		memcpy(p + frames, result, (size_t)datalen);
-		send(c, (const char*)data, (int) (strlen(answer) + frames + (size_t)datalen + 1), 0);
-		free(data);
-	}
-	return 0;
+	base64_encode(sha1, 20, seckey, sz);
+	return true;
 }
 
 /*
@@ -509,24 +493,677 @@ static bool check_connect(struct sockaddr_in *cli, char **connectaddr, char *gro
 	return addrok;
 }
 
+/*****************************************************************************/
+
+/*
+ * One poll() loop serves all the clients. Every connection has its own
+ * input and output buffers and sockets are non-blocking, so a slow or
+ * stuck client only delays itself. Commands still run one at a time on
+ * this thread and their result is copied out of the shared buffer
+ * straight away.
+ *
+ * Three ways to talk to it:
+ *  - raw: "cmd|params" or {"command":"cmd","parameter":"params"}, one
+ *    request per connection, answer terminated by a NUL (legacy);
+ *  - HTTP: GET /cmd/params, keep-alive, JSON with ?json or an Accept:
+ *    application/json header, GET /metrics for OpenMetrics;
+ *  - websocket: the HTTP request with an Upgrade, the command is pushed
+ *    every ?interval=N seconds (default 2), a text frame changes it.
+ */
+
+#ifndef WIN32
+# include <poll.h>
+# include <fcntl.h>
+# define SOCKWOULDBLOCK() (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+#else
+# define poll WSAPoll
+# define SOCKWOULDBLOCK() (WSAGetLastError() == WSAEWOULDBLOCK)
+#endif
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+#endif
+
+#define API_CLIENTS	64	/* concurrent connections */
+#define API_OUTMAX	(1024 * 1024)	/* pending output before a client is dropped */
+#define API_IDLE	30	/* seconds, keep-alive and stalled clients */
+#define API_PUSH	2	/* default seconds between websocket pushes */
+
+enum { CONN_NEW, CONN_RAW, CONN_HTTP, CONN_WS };
+
+struct api_conn {
+	SOCKETTYPE fd;
+	int mode;
+	bool json;	/* JSON instead of the pipe format */
+	bool closing;	/* close once the output is flushed */
+	time_t last;	/* last activity */
+	time_t push;	/* next websocket push */
+	int interval;
+	char cmd[128];	/* websocket push command */
+	char in[SOCK_REC_BUFSZ + 1];
+	size_t inlen;
+	char *out;
+	size_t outlen, outsize;
+};
+
+static struct api_conn conns[API_CLIENTS];
+
+static void conn_write(struct api_conn *cn, const void *data, size_t len)
+{
+	if (cn->closing && !cn->outlen)
+		return;
+	if (cn->outlen + len > API_OUTMAX) {
+		/* not reading, give up on it */
+		cn->outlen = 0;
+		cn->closing = true;
+		return;
+	}
+	if (cn->outlen + len > cn->outsize) {
+		size_t sz = cn->outsize ? cn->outsize : 4096;
+		while (sz < cn->outlen + len)
+			sz *= 2;
+		char *p = (char *) realloc(cn->out, sz);
+		if (!p) {
+			cn->outlen = 0;
+			cn->closing = true;
+			return;
+		}
+		cn->out = p;
+		cn->outsize = sz;
+	}
+	memcpy(cn->out + cn->outlen, data, len);
+	cn->outlen += len;
+}
+
+static void conn_printf(struct api_conn *cn, const char *fmt, ...)
+{
+	char tmp[512];
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(tmp, sizeof(tmp), fmt, ap);
+	va_end(ap);
+	if (n > 0)
+		conn_write(cn, tmp, n < (int) sizeof(tmp) ? n : sizeof(tmp) - 1);
+}
+
+static void conn_flush(struct api_conn *cn)
+{
+	size_t sent = 0;
+
+	while (sent < cn->outlen) {
+		int n = (int) send(cn->fd, cn->out + sent, (int) (cn->outlen - sent), MSG_NOSIGNAL);
+		if (n <= 0) {
+			if (n < 0 && SOCKWOULDBLOCK())
+				break;
+			cn->outlen = sent = 0;
+			cn->closing = true;
+			break;
+		}
+		sent += n;
+		cn->last = time(NULL);
+	}
+	if (sent) {
+		memmove(cn->out, cn->out + sent, cn->outlen - sent);
+		cn->outlen -= sent;
+	}
+}
+
+static void conn_close(struct api_conn *cn)
+{
+	CLOSESOCKET(cn->fd);
+	free(cn->out);
+	memset(cn, 0, sizeof(*cn));
+	cn->fd = INVSOCK;
+}
+
+static void conn_consume(struct api_conn *cn, size_t len)
+{
+	memmove(cn->in, cn->in + len, cn->inlen - len);
+	cn->inlen -= len;
+	cn->in[cn->inlen] = '\0';
+}
+
+/* "cmd|params", NULL if the command is unknown */
+static char *api_exec(char *cmdline)
+{
+	char *params = strchr(cmdline, '|');
+	if (params != NULL)
+		*(params++) = '\0';
+
+	if (opt_debug && opt_protocol)
+		applog(LOG_DEBUG, "API: exec command %s(%s)", cmdline, params);
+
+	for (int i = 0; i < CMDMAX; i++) {
+		if (strcmp(cmdline, cmds[i].name) == 0) {
+			if (params && strlen(params)) {
+				// remove possible trailing |
+				if (params[strlen(params) - 1] == '|')
+					params[strlen(params) - 1] = '\0';
+			}
+			return (cmds[i].func)(params);
+		}
+	}
+	return NULL;
+}
+
+static void json_str(struct api_conn *cn, const char *p, size_t len)
+{
+	conn_write(cn, "\"", 1);
+	for (size_t i = 0; i < len; i++) {
+		unsigned char ch = (unsigned char) p[i];
+		if (ch == '"' || ch == '\\')
+			conn_printf(cn, "\\%c", ch);
+		else if (ch < 0x20)
+			conn_printf(cn, "\\u%04x", ch);
+		else
+			conn_write(cn, &p[i], 1);
+	}
+	conn_write(cn, "\"", 1);
+}
+
+/* a value that can go out as a JSON number as is */
+static bool json_number(const char *p, size_t len)
+{
+	size_t i = 0;
+	if (i < len && p[i] == '-')
+		i++;
+	if (i == len || !isdigit((uchar) p[i]))
+		return false;
+	while (i < len && isdigit((uchar) p[i]))
+		i++;
+	if (i < len && p[i] == '.') {
+		if (++i == len || !isdigit((uchar) p[i]))
+			return false;
+		while (i < len && isdigit((uchar) p[i]))
+			i++;
+	}
+	return i == len;
+}
+
+/*
+ * The pipe format as JSON: every "K=V;K=V" record becomes an object,
+ * other records (help) one string per line.
+ */
+static void json_result(struct api_conn *cn, const char *cmd, const char *result)
+{
+	const char *rec = result;
+	bool first = true;
+
+	conn_write(cn, "{\"command\":", 11);
+	json_str(cn, cmd, strlen(cmd));
+	if (!result) {
+		conn_printf(cn, ",\"error\":\"unknown command\"}");
+		return;
+	}
+	conn_write(cn, ",\"result\":[", 11);
+	while (*rec) {
+		const char *end = strchr(rec, '|');
+		size_t len = end ? (size_t) (end - rec) : strlen(rec);
+
+		if (len && memchr(rec, '=', len)) {
+			const char *kv = rec;
+			bool firstkv = true;
+			conn_printf(cn, "%s{", first ? "" : ",");
+			while (kv < rec + len) {
+				const char *sep = (const char *) memchr(kv, ';', rec + len - kv);
+				const char *kend = sep ? sep : rec + len;
+				const char *eq = (const char *) memchr(kv, '=', kend - kv);
+				if (eq) {
+					conn_printf(cn, "%s", firstkv ? "" : ",");
+					json_str(cn, kv, eq - kv);
+					conn_write(cn, ":", 1);
+					if (json_number(eq + 1, kend - eq - 1))
+						conn_write(cn, eq + 1, kend - eq - 1);
+					else
+						json_str(cn, eq + 1, kend - eq - 1);
+					firstkv = false;
+				}
+				kv = kend + 1;
+			}
+			conn_write(cn, "}", 1);
+			first = false;
+		} else {
+			const char *line = rec;
+			while (line < rec + len) {
+				const char *nl = (const char *) memchr(line, '\n', rec + len - line);
+				const char *lend = nl ? nl : rec + len;
+				if (lend > line) {
+					conn_printf(cn, "%s", first ? "" : ",");
+					json_str(cn, line, lend - line);
+					first = false;
+				}
+				line = lend + 1;
+			}
+		}
+		rec += len + (end ? 1 : 0);
+	}
+	conn_write(cn, "]}", 2);
+}
+
+/* the command's answer in the connection's format, false if unknown */
+static bool conn_result(struct api_conn *cn, char *cmdline)
+{
+	char cmd[sizeof(cn->cmd)];
+	char *result;
+
+	snprintf(cmd, sizeof(cmd), "%s", cmdline);
+	result = api_exec(cmdline);
+	cmd[strcspn(cmd, "|")] = '\0';
+	if (cn->json)
+		json_result(cn, cmd, result);
+	else if (result)
+		conn_write(cn, result, strlen(result));
+	return result != NULL;
+}
+
+/* legacy protocol, answer and close */
+static void api_raw(struct api_conn *cn)
+{
+	char cmdline[SOCK_REC_BUFSZ + 1];
+	size_t mark;
+
+	if (cn->in[0] == '{') {
+		/* cgminer style {"command":"summary","parameter":""} */
+		json_error_t err;
+		json_t *req = JSON_LOADS(cn->in, &err);
+		if (!req) {
+			/* maybe not all there yet */
+			if (cn->inlen < SOCK_REC_BUFSZ && !strchr(cn->in, '\n'))
+				return;
+			cn->closing = true;
+			return;
+		}
+		const char *c = json_string_value(json_object_get(req, "command"));
+		const char *p = json_string_value(json_object_get(req, "parameter"));
+		snprintf(cmdline, sizeof(cmdline), "%s%s%s", c ? c : "", p && *p ? "|" : "", p ? p : "");
+		json_decref(req);
+		cn->json = true;
+	} else {
+		/* telnet compat \r\n */
+		cn->in[strcspn(cn->in, "\r\n")] = '\0';
+		snprintf(cmdline, sizeof(cmdline), "%s", cn->in);
+	}
+
+	mark = cn->outlen;
+	if (conn_result(cn, cmdline) || cn->json)
+		conn_write(cn, "", 1);
+	else
+		cn->outlen = mark;
+	cn->closing = true;
+}
+
+/* case-insensitive header lookup, value copied up to the end of line */
+static bool http_header(const char *hdrs, const char *name, char *val, size_t sz)
+{
+	size_t nl = strlen(name);
+	for (const char *p = hdrs; (p = strchr(p, '\n')) != NULL; ) {
+		p++;
+		if (!strncasecmp(p, name, nl) && p[nl] == ':') {
+			p += nl + 1;
+			while (*p == ' ')
+				p++;
+			size_t len = strcspn(p, "\r\n");
+			if (len >= sz)
+				len = sz - 1;
+			memcpy(val, p, len);
+			val[len] = '\0';
+			return true;
+		}
+	}
+	return false;
+}
+
+static void ws_frame(struct api_conn *cn, int opcode, const char *data, size_t len)
+{
+	uchar hd[10];
+	int n = 2;
+
+	hd[0] = (uchar) (0x80 | opcode); // FIN + opcode
+	if (len <= 125) {
+		hd[1] = (uchar) len;
+	} else if (len <= 65535) {
+		hd[1] = 126;
+		hd[2] = (uchar) (len >> 8);
+		hd[3] = (uchar) len;
+		n = 4;
+	} else {
+		hd[1] = 127;
+		for (int i = 0; i < 8; i++)
+			hd[2 + i] = (uchar) ((uint64_t) len >> (56 - 8 * i));
+		n = 10;
+	}
+	conn_write(cn, hd, n);
+	conn_write(cn, data, len);
+}
+
+static void ws_push(struct api_conn *cn)
+{
+	char cmdline[sizeof(cn->cmd)];
+	struct api_conn tmp;
+
+	/* render the answer on its own, then frame it */
+	memset(&tmp, 0, sizeof(tmp));
+	tmp.json = cn->json;
+	snprintf(cmdline, sizeof(cmdline), "%s", cn->cmd);
+	conn_result(&tmp, cmdline);
+	if (tmp.out)
+		ws_frame(cn, 1, tmp.out, tmp.outlen);
+	free(tmp.out);
+	cn->push = time(NULL) + cn->interval;
+}
+
+static void http_reply(struct api_conn *cn, const char *status, const char *type,
+	const char *body, size_t len, bool keep)
+{
+	conn_printf(cn, "HTTP/1.1 %s\r\n"
+		"Content-Type: %s\r\n"
+		"Content-Length: %u\r\n"
+		"Connection: %s\r\n\r\n",
+		status, type, (unsigned) len, keep ? "keep-alive" : "close");
+	conn_write(cn, body, len);
+	if (!keep)
+		cn->closing = true;
+}
+
+/* complete requests in the input, several when pipelined */
+static void api_http(struct api_conn *cn)
+{
+	while (!cn->closing && cn->mode == CONN_HTTP) {
+		char method[8], path[256], version[16] = "";
+		char val[128], cmdline[256];
+		char *end = strstr(cn->in, "\r\n\r\n");
+		size_t reqlen;
+		bool keep, ws;
+
+		if (!end) {
+			if (cn->inlen >= SOCK_REC_BUFSZ) {
+				http_reply(cn, "431 Request Header Fields Too Large", "text/plain", "", 0, false);
+			}
+			return;
+		}
+		*end = '\0';
+		reqlen = end + 4 - cn->in;
+
+		if (sscanf(cn->in, "%7s %255s %15s", method, path, version) < 2 || strcmp(method, "GET")) {
+			http_reply(cn, "405 Method Not Allowed", "text/plain", "", 0, false);
+			return;
+		}
+		/* HTTP/1.1 keeps the connection by default, 1.0 only if asked */
+		keep = !strcmp(version, "HTTP/1.1");
+		cn->json = false;
+		if (http_header(cn->in, "Connection", val, sizeof(val)))
+			keep = strstr(val, "lose") ? false : (strstr(val, "eep-") ? true : keep);
+		if (http_header(cn->in, "Accept", val, sizeof(val)) && strstr(val, "application/json"))
+			cn->json = true;
+		ws = http_header(cn->in, "Sec-WebSocket-Key", val, sizeof(val));
+
+		/* /cmd/params?json&interval=N */
+		char *query = strchr(path, '?');
+		if (query) {
+			*(query++) = '\0';
+			for (char *opt = query; opt; opt = strchr(opt, '&') ? strchr(opt, '&') + 1 : NULL) {
+				if (!strncmp(opt, "json", 4) && (!opt[4] || opt[4] == '&'))
+					cn->json = true;
+				else if (!strncmp(opt, "interval=", 9))
+					cn->interval = atoi(opt + 9);
+			}
+		}
+		snprintf(cmdline, sizeof(cmdline), "%s", path + 1);
+		char *params = strchr(cmdline, '/');
+		if (params)
+			*(params++) = '|';
+		params = strchr(cmdline, '/');
+		if (params)
+			*(params++) = '\0';
+
+		if (ws) {
+			char seckey[64];
+			/* the key is 24 chars, the push command must fit in cn->cmd */
+			if (!websocket_accept(val, seckey, sizeof(seckey)) ||
+			    snprintf(cn->cmd, sizeof(cn->cmd), "%s", cmdline) >= (int) sizeof(cn->cmd)) {
+				http_reply(cn, "400 Bad Request", "text/plain", "", 0, false);
+				return;
+			}
+			conn_printf(cn, "HTTP/1.1 101 Switching Protocols\r\n"
+				"Upgrade: websocket\r\nConnection: Upgrade\r\n"
+				"Sec-WebSocket-Accept: %s\r\n"
+				"Sec-WebSocket-Protocol: text\r\n"
+				"\r\n", seckey);
+			conn_consume(cn, reqlen);
+			if (cn->interval < 1)
+				cn->interval = API_PUSH;
+			cn->mode = CONN_WS;
+			ws_push(cn);
+			return;
+		}
+
+		if (!strcmp(cmdline, "metrics")) {
+			char *page = stats_metrics();
+			http_reply(cn, "200 OK", "application/openmetrics-text; version=1.0.0; charset=utf-8",
+				page, strlen(page), keep);
+			free(page);
+		} else {
+			struct api_conn tmp;
+			memset(&tmp, 0, sizeof(tmp));
+			tmp.json = cn->json;
+			bool found = conn_result(&tmp, cmdline);
+			http_reply(cn, found ? "200 OK" : "404 Not Found",
+				tmp.json ? "application/json" : "text/plain",
+				tmp.out ? tmp.out : "", tmp.outlen, keep);
+			free(tmp.out);
+		}
+		conn_consume(cn, reqlen);
+	}
+}
+
+/* client frames are masked; text sets the pushed command, close and ping answered */
+static void api_ws(struct api_conn *cn)
+{
+	while (!cn->closing && cn->inlen >= 2) {
+		uchar *p = (uchar *) cn->in;
+		int opcode = p[0] & 0x0f;
+		uint64_t len = p[1] & 0x7f;
+		size_t hd = 2;
+
+		if (len == 126) {
+			if (cn->inlen < 4)
+				return;
+			len = ((uint64_t) p[2] << 8) | p[3];
+			hd = 4;
+		} else if (len == 127) {
+			if (cn->inlen < 10)
+				return;
+			len = 0;
+			for (int i = 0; i < 8; i++)
+				len = (len << 8) | p[2 + i];
+			hd = 10;
+		}
+		if (!(p[1] & 0x80) || len > SOCK_REC_BUFSZ - hd - 4) {
+			/* unmasked or larger than we take */
+			cn->closing = true;
+			return;
+		}
+		if (cn->inlen < hd + 4 + len)
+			return;
+
+		uchar *mask = p + hd, *data = p + hd + 4;
+		for (uint64_t i = 0; i < len; i++)
+			data[i] ^= mask[i & 3];
+
+		switch (opcode) {
+		case 1: /* text: the command to push */
+			if (len && len < sizeof(cn->cmd)) {
+				memcpy(cn->cmd, data, (size_t) len);
+				cn->cmd[len] = '\0';
+				ws_push(cn);
+			}
+			break;
+		case 8: /* close */
+			ws_frame(cn, 8, (char *) data, len >= 2 ? 2 : 0);
+			cn->closing = true;
+			break;
+		case 9: /* ping */
+			ws_frame(cn, 10, (char *) data, (size_t) len);
+			break;
+		}
+		conn_consume(cn, hd + 4 + (size_t) len);
+	}
+}
+
+static void api_input(struct api_conn *cn)
+{
+	if (cn->mode == CONN_NEW) {
+		/* wait for the 4 bytes telling an HTTP request from a command */
+		if (cn->inlen < 4 && !strncmp(cn->in, "GET ", cn->inlen))
+			return;
+		cn->mode = strncmp(cn->in, "GET ", 4) ? CONN_RAW : CONN_HTTP;
+	}
+	switch (cn->mode) {
+	case CONN_RAW:
+		if (!cn->closing)
+			api_raw(cn);
+		break;
+	case CONN_HTTP:
+		api_http(cn);
+		break;
+	case CONN_WS:
+		api_ws(cn);
+		break;
+	}
+}
+
+static void api_accept(SOCKETTYPE apisock)
+{
+	for (;;) {
+		struct sockaddr_in cli;
+		socklen_t clisiz = sizeof(cli);
+		char *connectaddr;
+		char group;
+		SOCKETTYPE c = accept(apisock, (struct sockaddr *)(&cli), &clisiz);
+		int i;
+
+		if (SOCKETFAIL(c))
+			return;
+
+		bool addrok = check_connect(&cli, &connectaddr, &group);
+		if (opt_debug && opt_protocol)
+			applog(LOG_DEBUG, "API: connection from %s - %s",
+				connectaddr, addrok ? "Accepted" : "Ignored");
+
+		for (i = 0; addrok && i < API_CLIENTS; i++)
+			if (conns[i].fd == INVSOCK)
+				break;
+		if (!addrok || i == API_CLIENTS) {
+			if (addrok && opt_debug)
+				applog(LOG_DEBUG, "API: too many clients, %s refused", connectaddr);
+			CLOSESOCKET(c);
+			continue;
+		}
+#ifndef WIN32
+		fcntl(c, F_SETFL, fcntl(c, F_GETFL, 0) | O_NONBLOCK);
+#else
+		u_long nb = 1;
+		ioctlsocket(c, FIONBIO, &nb);
+#endif
+		conns[i].fd = c;
+		conns[i].mode = CONN_NEW;
+		conns[i].last = time(NULL);
+	}
+}
+
+static void api_serve(SOCKETTYPE apisock)
+{
+	struct pollfd fds[API_CLIENTS + 1];
+	int idx[API_CLIENTS + 1];
+	time_t quit = 0;
+
+	for (int i = 0; i < API_CLIENTS; i++)
+		conns[i].fd = INVSOCK;
+
+	for (;;) {
+		time_t now = time(NULL);
+		int nfds = 0, active = 0;
+
+		if (bye) {
+			/* let the last answers go out, for a second at most */
+			if (!quit)
+				quit = now + 1;
+			if (now > quit)
+				break;
+		} else {
+			fds[nfds].fd = apisock;
+			fds[nfds].events = POLLIN;
+			idx[nfds++] = -1;
+		}
+		for (int i = 0; i < API_CLIENTS; i++) {
+			struct api_conn *cn = &conns[i];
+			if (cn->fd == INVSOCK)
+				continue;
+			if ((cn->closing && !cn->outlen) ||
+			    ((cn->mode != CONN_WS || cn->outlen) && now - cn->last > API_IDLE)) {
+				conn_close(cn);
+				continue;
+			}
+			if (cn->mode == CONN_WS && !cn->closing && now >= cn->push && cn->outlen < 65536)
+				ws_push(cn);
+			fds[nfds].fd = cn->fd;
+			fds[nfds].events = (short) ((cn->closing ? 0 : POLLIN) | (cn->outlen ? POLLOUT : 0));
+			idx[nfds++] = i;
+			active++;
+		}
+		if (bye && !active)
+			break;
+
+		int n = poll(fds, nfds, 1000);
+		if (n < 0) {
+#ifndef WIN32
+			if (errno == EINTR)
+				continue;
+#endif
+			applog(LOG_ERR, "API poll failed (%s)%s", strerror(errno), UNAVAILABLE);
+			break;
+		}
+
+		for (int k = 0; k < nfds && n > 0; k++) {
+			if (!fds[k].revents)
+				continue;
+			if (idx[k] < 0) {
+				api_accept(apisock);
+				continue;
+			}
+			struct api_conn *cn = &conns[idx[k]];
+			if (fds[k].revents & (POLLIN | POLLHUP | POLLERR)) {
+				int r = (int) recv(cn->fd, cn->in + cn->inlen, (int) (SOCK_REC_BUFSZ - cn->inlen), 0);
+				if (r > 0) {
+					cn->inlen += r;
+					cn->in[cn->inlen] = '\0';
+					cn->last = now;
+					api_input(cn);
+				} else if (r == 0 || !SOCKWOULDBLOCK()) {
+					/* gone, nobody to answer */
+					cn->outlen = 0;
+					cn->closing = true;
+				}
+			}
+			if (cn->outlen)
+				conn_flush(cn);
+		}
+	}
+
+	for (int i = 0; i < API_CLIENTS; i++)
+		if (conns[i].fd != INVSOCK)
+			conn_close(&conns[i]);
+}
+
 static void api()
 {
 	const char *addr = opt_api_allow;
 	unsigned short port = (unsigned short) opt_api_listen; // 4048
-	char buf[MYBUFSIZ];
-	int c, n, bound;
-	char *connectaddr;
+	int bound;
 	char *binderror;
-	char group;
 	time_t bindstart;
 	struct sockaddr_in serv;
-	struct sockaddr_in cli;
-	socklen_t clisiz;
-	bool addrok = false;
-	long long counter;
-	char *result;
-	char *params;
-	int i;
 
 	SOCKETTYPE *apisock;
 	if (!opt_api_listen && opt_debug) {
@@ -607,96 +1244,17 @@ static void api()
 		return;
 	}
 
-	buffer = (char *) calloc(1, MYBUFSIZ + 1);
-
-	counter = 0;
-	while (bye == 0) {
-		counter++;
-
-		clisiz = sizeof(cli);
-		if (SOCKETFAIL(c = accept((SOCKETTYPE)*apisock, (struct sockaddr *)(&cli), &clisiz))) {
-			applog(LOG_ERR, "API failed (%s)%s", strerror(errno), UNAVAILABLE);
-			CLOSESOCKET(*apisock);
-			free(apisock);
-			free(buffer);
-			return;
-		}
-
-		addrok = check_connect(&cli, &connectaddr, &group);
-		if (opt_debug && opt_protocol)
-			applog(LOG_DEBUG, "API: connection from %s - %s",
-				connectaddr, addrok ? "Accepted" : "Ignored");
+#ifndef WIN32
+	fcntl(*apisock, F_SETFL, fcntl(*apisock, F_GETFL, 0) | O_NONBLOCK);
+#else
+	u_long nb = 1;
+	ioctlsocket(*apisock, FIONBIO, &nb);
+#endif
 
-		if (addrok) {
-			bool fail;
-			char *wskey = NULL;
-			n = recv(c, &buf[0], SOCK_REC_BUFSZ, 0);
-
-			fail = SOCKETFAIL(n);
-			if (fail)
-				buf[0] = '\0';
-			else if (n > 0 && buf[n-1] == '\n') {
-				/* telnet compat \r\n */
-				buf[n-1] = '\0'; n--;
-				if (n > 0 && buf[n-1] == '\r')
-					buf[n-1] = '\0';
-			}
-			if (n >= 0)
-				buf[n] = '\0';
-
-			//if (opt_debug && opt_protocol && n > 0)
-			//	applog(LOG_DEBUG, "API: recv command: (%d) '%s'+char(%x)", n, buf, buf[n-1]);
-
-			if (!fail) {
-				char *msg = NULL;
-				/* Websocket requests compat. */
-				if ((msg = strstr(buf, "GET /")) && strlen(msg) > 5) {
-					char cmd[256] = { 0 };
-					sscanf(&msg[5], "%s\n", cmd);
-					params = strchr(cmd, '/');
-					if (params)
-						*(params++) = '|';
-					params = strchr(cmd, '/');
-					if (params)
-						*(params++) = '\0';
-					wskey = strstr(msg, "Sec-WebSocket-Key");
-					if (wskey) {
-						char *eol = strchr(wskey, '\r');
-						if (eol) *eol = '\0';
-						wskey = strchr(wskey, ':');
-						wskey++;
-						while ((*wskey) == ' ') wskey++; // ltrim
-					}
-					n = sprintf(buf, "%s", cmd);
-				}
+	/* scratch for the command functions, copied out right after each call */
+	buffer = (char *) calloc(1, MYBUFSIZ + 1);
 
-				params = strchr(buf, '|');
-				if (params != NULL)
-					*(params++) = '\0';
-
-				if (opt_debug && opt_protocol && n > 0)
-					applog(LOG_DEBUG, "API: exec command %s(%s)", buf, params);
-
-				for (i = 0; i < CMDMAX; i++) {
-					if (strcmp(buf, cmds[i].name) == 0) {
-						if (params && strlen(params)) {
-							// remove possible trailing |
-							if (params[strlen(params) - 1] == '|')
-								params[strlen(params) - 1] = '\0';
-						}
-						result = (cmds[i].func)(params);
-						if (wskey) {
-							websocket_handshake(c, result, wskey);
-							break;
-						}
-						send_result(c, result);
-						break;
-					}
-				}
-				CLOSESOCKET(c);
-			}
-		}
-	}
+	api_serve(*apisock);
 
 	CLOSESOCKET(*apisock);
 	free(apisock);
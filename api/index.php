@@ -40,6 +40,9 @@ function translateField($key)
 	$intl['GPUS'] = 'GPUs';
 	$intl['CPUS'] = 'Threads';
 	$intl['KHS'] = 'Hash rate (kH/s)';
+	$intl['KHS10S'] = 'Hash rate, 10s (kH/s)';
+	$intl['KHS15M'] = 'Hash rate, 15mn (kH/s)';
+	$intl['EKHS'] = 'Effective rate (kH/s)';
 	$intl['ACC'] = 'Accepted shares';
 	$intl['ACCMN'] = 'Accepted / mn';
 	$intl['REJ'] = 'Rejected';
@@ -222,6 +222,8 @@ size_t rpc2_bloblen = 0;
 uint32_t rpc2_target = 0;
 char *rpc2_job_id = NULL;
 bool aes_ni_supported = false;
+int opt_cn_ways = 2;
+int opt_yescrypt_ways = 2;
 double opt_diff_factor = 1.0;
 pthread_mutex_t rpc2_job_lock;
 pthread_mutex_t rpc2_login_lock;
@@ -241,6 +243,12 @@ uint64_t net_blocks = 0;
 // conditional mining
 bool conditional_state[MAX_CPUS] = { 0 };
 double opt_max_temp = 0.0;
+int opt_sweep = 0;
+bool opt_autotune = false;
+char *opt_tune_file = NULL;
+bool opt_hugepages = true;
+static bool opt_cache_plan = false;
+static bool lanes_given = false;
 double opt_max_diff = 0.0;
 double opt_max_rate = 0.0;
 
@@ -250,6 +258,7 @@ uint32_t opt_work_size = 0; /* default */
 char *opt_api_allow = NULL;
 int opt_api_remote = 0;
 int opt_api_listen = 4048; /* 0 to disable */
+static char *opt_share_journal = NULL;
 
 #ifdef HAVE_GETOPT_LONG
 #include <getopt.h>
@@ -326,6 +335,9 @@ Options:\n\
   -f, --diff-factor     Divide req. difficulty by this factor (std is 1.0)\n\
   -m, --diff-multiplier Multiply difficulty by this factor (std is 1.0)\n\
   -n, --nfactor         neoscrypt N-Factor\n\
+      --cn-ways=N       cryptonight nonces hashed together per thread (1-3, default: 2)\n\
+      --yescrypt-params=N,r,p[,PERS]  yescrypt coin parameters (default: 2048,8,1)\n\
+      --yescrypt-ways=N  yescrypt nonces hashed together per thread (1-2, default: 2)\n\
       --coinbase-addr=ADDR  payout address for solo mining\n\
       --coinbase-sig=TEXT  data to insert in the coinbase when possible\n\
       --no-longpoll     disable long polling support\n\
@@ -343,15 +355,30 @@ Options:\n\
 "\
   -S, --syslog          use system log for output messages\n"
 #endif
+"\
+      --log-json        write log lines as JSON objects\n\
+      --share-journal=FILE  append the timings of every share to FILE\n"
+#ifdef HASH_PROFILE
+"\
+      --profile         count cycles per hash stage (API profile, shown at exit)\n"
+#endif
 "\
   -B, --background      run the miner in the background\n\
       --benchmark       run in offline benchmark mode\n\
+      --benchmark-sweep=N  benchmark every thread and lane count for N seconds,\n\
+                          report power and hashes per joule (linux RAPL)\n\
+      --autotune        measure thread count, SMT, lanes and huge pages on the\n\
+                          first job, cache the best per cpu and algo, reuse it\n\
+      --tune-file=FILE  autotune cache (default: cpuminer-tune.json)\n\
+      --cache-plan      run only the threads whose scratchpads fit in L3\n\
+                          (memory-hard algos, the plan is logged otherwise)\n\
+      --no-hugepages    back the scratchpads with normal pages only\n\
       --cputest         debug hashes from cpu algorithms\n\
       --cpu-affinity    set process affinity to cpu core(s), mask 0x3 for cores 0 and 1\n\
       --cpu-priority    set process priority (default: 0 idle, 2 normal to 5 highest)\n\
   -b, --api-bind        IP/Port for the miner API (default: 127.0.0.1:4048)\n\
       --api-remote      Allow remote control\n\
-      --max-temp=N      Only mine if cpu temp is less than specified value (linux)\n\
+      --max-temp=N      Park threads on the hottest cores to hold cpu temp under N (linux)\n\
       --max-rate=N[KMG] Only mine if net hashrate is less than specified value\n\
       --max-diff=N      Only mine if net difficulty is less than specified value\n\
   -c, --config=FILE     load a JSON-format configuration file\n\
@@ -372,7 +399,13 @@ static struct option const options[] = {
 	{ "api-remote", 0, NULL, 1030 },
 	{ "background", 0, NULL, 'B' },
 	{ "benchmark", 0, NULL, 1005 },
+	{ "benchmark-sweep", 1, NULL, 1090 },
+	{ "autotune", 0, NULL, 1091 },
+	{ "tune-file", 1, NULL, 1092 },
+	{ "no-hugepages", 0, NULL, 1093 },
+	{ "cache-plan", 0, NULL, 1094 },
 	{ "cputest", 0, NULL, 1006 },
+	{ "cn-ways", 1, NULL, 1084 },
 	{ "cert", 1, NULL, 1001 },
 	{ "coinbase-addr", 1, NULL, 1016 },
 	{ "coinbase-sig", 1, NULL, 1015 },
@@ -415,7 +448,14 @@ static struct option const options[] = {
 	{ "user", 1, NULL, 'u' },
 	{ "userpass", 1, NULL, 'O' },
 	{ "version", 0, NULL, 'V' },
+	{ "yescrypt-params", 1, NULL, 1085 },
+	{ "yescrypt-ways", 1, NULL, 1086 },
 	{ "segwit", 0, NULL, 1083 },
+	{ "log-json", 0, NULL, 1087 },
+	{ "share-journal", 1, NULL, 1089 },
+#ifdef HASH_PROFILE
+	{ "profile", 0, NULL, 1088 },
+#endif
 	{ 0, 0, 0, 0 }
 };
 
@@ -484,6 +524,47 @@ void get_currentalgo(char* buf, int sz)
 		snprintf(buf, sz, "%s", algo_names[opt_algo]);
 }
 
+/*
+ * Scratchpad footprint of the memory-hard algos for the cache plan: the
+ * bytes one nonce in flight touches, 0 for the others. nlanes is the
+ * number of nonces in flight per thread; when the algo reads it per
+ * scan, *lanes points to it and max_lanes is its range.
+ */
+static size_t scratch_model(int **lanes, int *nlanes, int *max_lanes)
+{
+	*lanes = NULL;
+	*nlanes = *max_lanes = 1;
+	switch (opt_algo) {
+	case ALGO_CRYPTONIGHT:
+		if (aes_ni_supported) {
+			*lanes = &opt_cn_ways;
+			*nlanes = opt_cn_ways;
+			*max_lanes = 3;
+		}
+		return 2 << 20;
+	case ALGO_CRYPTOLIGHT:
+		return 1 << 20;
+	case ALGO_AXIOM:
+		*nlanes = axiom_lanes();
+		return 2 << 20;
+	case ALGO_PLUCK:
+		*nlanes = pluck_lanes();
+		return (size_t) opt_pluck_n * 1024;
+	case ALGO_SCRYPT:
+		*nlanes = scrypt_throughput();
+		return (size_t) opt_scrypt_n * 128;
+	case ALGO_SCRYPTJANE:
+		return scryptjane_lane_bytes(opt_scrypt_n, nlanes);
+	case ALGO_YESCRYPT:
+		*lanes = &opt_yescrypt_ways;
+		*nlanes = opt_yescrypt_ways;
+		*max_lanes = 2;
+		return yescrypt_lane_bytes();
+	default:
+		return 0;
+	}
+}
+
 void proper_exit(int reason)
 {
 #ifdef WIN32
@@ -1037,23 +1118,34 @@ out:
 #define YAY "yay!!!"
 #define BOO "booooo"
 
-static int share_result(int result, struct work *work, const char *reason)
+/* the nonce as submitted, for the share journal */
+static uint32_t work_nonce(const struct work *work)
+{
+	if (jsonrpc_2)
+		return le32dec((const uchar *) work->data + 39);
+	if (opt_algo == ALGO_DECRED)
+		return work->data[35];
+	return work->data[19];
+}
+
+/* id is the submit's journal id, the stratum request id */
+static int share_result(int result, uint32_t id, struct work *work, const char *reason)
 {
 	const char *flag;
 	char suppl[32] = { 0 };
 	char s[345];
-	double hashrate;
+	double hashrate, rtt;
 	double sharediff = work ? work->sharediff : stratum.sharediff;
-	int i;
+	/* stratum answers carry no work, the journal kept the target mined at */
+	double targetdiff = work ? work->targetdiff : 0.;
 
-	hashrate = 0.;
 	pthread_mutex_lock(&stats_lock);
-	for (i = 0; i < opt_n_threads; i++)
-		hashrate += thr_hashrates[i];
 	result ? accepted_count++ : rejected_count++;
 	pthread_mutex_unlock(&stats_lock);
 
-	global_hashrate = (uint64_t) hashrate;
+	rtt = journal_result(id, result ? SHARE_ACCEPTED : SHARE_REJECTED, reason, &targetdiff);
+	stats_share(result ? SHARE_ACCEPTED : SHARE_REJECTED, targetdiff, reason, rtt);
+	hashrate = stats_hashrate(STATS_60S);
 
 	if (!net_diff || sharediff < net_diff) {
 		flag = use_colors ?
@@ -1105,6 +1197,7 @@ static bool submit_upstream_work(CURL *curl, struct work *work)
 {
 	json_t *val, *res, *reason;
 	char s[JSON_BUF_LEN];
+	uint32_t id;
 	int i;
 	bool rc = false;
 
@@ -1112,6 +1205,8 @@ static bool submit_upstream_work(CURL *curl, struct work *work)
 	if (!submit_old && memcmp(&work->data[1], &g_work.data[1], 32)) {
 		if (opt_debug)
 			applog(LOG_DEBUG, "DEBUG: stale work detected, discarding");
+		stats_share(SHARE_STALE, 0., "discarded", -1.);
+		journal_discard(work, work_nonce(work));
 		return true;
 	}
 
@@ -1125,6 +1220,8 @@ static bool submit_upstream_work(CURL *curl, struct work *work)
 		}
 	}
 
+	id = journal_submit(work, work_nonce(work));
+
 	if (have_stratum) {
 		uint32_t ntime, nonce;
 		char ntimestr[9], noncestr[9];
@@ -1144,8 +1241,8 @@ static bool submit_upstream_work(CURL *curl, struct work *work)
 			}
 			char *hashhex = abin2hex(hash, 32);
 			snprintf(s, JSON_BUF_LEN,
-					"{\"method\": \"submit\", \"params\": {\"id\": \"%s\", \"job_id\": \"%s\", \"nonce\": \"%s\", \"result\": \"%s\"}, \"id\":4}\r\n",
-					rpc2_id, work->job_id, noncestr, hashhex);
+					"{\"method\": \"submit\", \"params\": {\"id\": \"%s\", \"job_id\": \"%s\", \"nonce\": \"%s\", \"result\": \"%s\"}, \"id\":%u}\r\n",
+					rpc2_id, work->job_id, noncestr, hashhex, id);
 			free(hashhex);
 		} else {
 			char *xnonce2str;
@@ -1175,8 +1272,8 @@ static bool submit_upstream_work(CURL *curl, struct work *work)
 				xnonce2str = abin2hex(work->xnonce2, work->xnonce2_len);
 			}
 			snprintf(s, JSON_BUF_LEN,
-					"{\"method\": \"mining.submit\", \"params\": [\"%s\", \"%s\", \"%s\", \"%s\", \"%s\"], \"id\":4}",
-					rpc_user, work->job_id, xnonce2str, ntimestr, noncestr);
+					"{\"method\": \"mining.submit\", \"params\": [\"%s\", \"%s\", \"%s\", \"%s\", \"%s\"], \"id\":%u}",
+					rpc_user, work->job_id, xnonce2str, ntimestr, noncestr, id);
 			free(xnonce2str);
 		}
 
@@ -1234,10 +1331,10 @@ static bool submit_upstream_work(CURL *curl, struct work *work)
 				iter = json_object_iter_next(res, iter);
 			}
 			res_str = json_dumps(res, 0);
-			share_result(sumres, work, res_str);
+			share_result(sumres, id, work, res_str);
 			free(res_str);
 		} else
-			share_result(json_is_null(res), work, json_string_value(res));
+			share_result(json_is_null(res), id, work, json_string_value(res));
 
 		json_decref(val);
 
@@ -1281,11 +1378,11 @@ static bool submit_upstream_work(CURL *curl, struct work *work)
 			json_t *status = json_object_get(res, "status");
 			bool valid = !strcmp(status ? json_string_value(status) : "", "OK");
 			if (valid)
-				share_result(valid, work, NULL);
+				share_result(valid, id, work, NULL);
 			else {
 				json_t *err = json_object_get(res, "error");
 				const char *sreason = json_string_value(json_object_get(err, "message"));
-				share_result(valid, work, sreason);
+				share_result(valid, id, work, sreason);
 				if (!strcasecmp("Invalid job id", sreason)) {
 					work_free(work);
 					work_copy(work, &g_work);
@@ -1332,7 +1429,7 @@ static bool submit_upstream_work(CURL *curl, struct work *work)
 		}
 		res = json_object_get(val, "result");
 		reason = json_object_get(val, "reject-reason");
-		share_result(json_is_true(res), work, reason ? json_string_value(reason) : NULL);
+		share_result(json_is_true(res), id, work, reason ? json_string_value(reason) : NULL);
 
 		json_decref(val);
 	}
@@ -1414,6 +1511,8 @@ start:
 	} else {
 		rc = work_decode(json_object_get(val, "result"), work);
 	}
+	if (rc)
+		work->tv_job = tv_end;
 
 	if (opt_protocol && rc) {
 		timeval_subtract(&diff, &tv_end, &tv_start);
@@ -1681,6 +1780,8 @@ static bool submit_work(struct thr_info *thr, const struct work *work_in)
 	wc->cmd = WC_SUBMIT_WORK;
 	wc->thr = thr;
 	work_copy(wc->u.work, work_in);
+	gettimeofday(&wc->u.work->tv_found, NULL);
+	wc->u.work->thr_id = thr->id;
 
 	/* send solution to workio thread */
 	if (!tq_push(thr_info[work_thr_id].q, wc))
@@ -1708,6 +1809,7 @@ static void stratum_gen_work(struct stratum_ctx *sctx, struct work *work)
 	} else {
 		free(work->job_id);
 		work->job_id = strdup(sctx->job.job_id);
+		work->tv_job = sctx->job.tv_recv;
 		work->xnonce2_len = sctx->xnonce2_size;
 		work->xnonce2 = (uchar*) realloc(work->xnonce2, sctx->xnonce2_size);
 		memcpy(work->xnonce2, sctx->job.xnonce2, sctx->xnonce2_size);
@@ -1851,14 +1953,7 @@ static bool wanna_mine(int thr_id)
 {
 	bool state = true;
 
-	if (opt_max_temp > 0.0) {
-		float temp = cpu_temp(0);
-		if (temp > opt_max_temp) {
-			if (!thr_id && !conditional_state[thr_id] && !opt_quiet)
-				applog(LOG_INFO, "temperature too high (%.0fC), waiting...", temp);
-			state = false;
-		}
-	}
+	/* --max-temp is held by the governor, thread by thread */
 	if (opt_max_diff > 0.0 && net_diff > opt_max_diff) {
 		if (!thr_id && !conditional_state[thr_id] && !opt_quiet)
 			applog(LOG_INFO, "network diff too high, waiting...");
@@ -1887,7 +1982,6 @@ static void *miner_thread(void *userdata)
 	time_t firstwork_time = 0;
 	unsigned char *scratchbuf = NULL;
 	char s[16];
-	int i;
 
 	memset(&work, 0, sizeof(work));
 
@@ -1943,6 +2037,10 @@ static void *miner_thread(void *userdata)
 		}
 	}
 
+#ifdef HASH_PROFILE
+	prof_thread(thr_id);
+#endif
+
 	if (opt_algo == ALGO_SCRYPT) {
 		scratchbuf = scrypt_buffer_alloc(opt_scrypt_n);
 		if (!scratchbuf) {
@@ -1950,6 +2048,7 @@ static void *miner_thread(void *userdata)
 			pthread_mutex_lock(&applog_lock);
 			exit(1);
 		}
+		stats_scratchpad((int64_t) scrypt_buffer_size(opt_scrypt_n));
 	}
 
 	else if (opt_algo == ALGO_PLUCK) {
@@ -1959,10 +2058,24 @@ static void *miner_thread(void *userdata)
 			pthread_mutex_lock(&applog_lock);
 			exit(1);
 		}
+		stats_scratchpad((int64_t) opt_pluck_n * 1024);
 	}
 
+	else if (opt_algo == ALGO_YESCRYPT) {
+		/* the sweep and autotune may switch to 2 ways later */
+		int ways = opt_sweep || opt_autotune ? 2 : opt_yescrypt_ways;
+		if (yescrypt_thread_init(ways)) {
+			applog(LOG_ERR, "yescrypt buffer allocation failed");
+			pthread_mutex_lock(&applog_lock);
+			exit(1);
+		}
+		stats_scratchpad((int64_t) yescrypt_lane_bytes() * ways);
+	}
+
+	struct timeval tv_last_end = { 0 };
+
 	while (1) {
-		uint64_t hashes_done;
+		uint64_t hashes_done, overhead = 0;
 		struct timeval tv_start, tv_end, diff;
 		int64_t max64;
 		bool regen_work = false;
@@ -2029,6 +2142,8 @@ static void *miner_thread(void *userdata)
 		if (memcmp(&work.data[wkcmp_offset], &g_work.data[wkcmp_offset], wkcmp_sz) ||
 			jsonrpc_2 ? memcmp(((uint8_t*) work.data) + 43, ((uint8_t*) g_work.data) + 43, 33) : 0)
 		{
+			if (work_restart[thr_id].restart)
+				stats_job_switch(thr_id);
 			work_free(&work);
 			work_copy(&work, &g_work);
 			nonceptr = (uint32_t*) (((char*)work.data) + nonce_oft);
@@ -2056,8 +2171,14 @@ static void *miner_thread(void *userdata)
 		}
 
 		/* conditional mining */
+		if (governor_parked(thr_id)) {
+			sleep(1);
+			tv_last_end.tv_sec = 0;
+			continue;
+		}
 		if (!wanna_mine(thr_id)) {
 			sleep(5);
+			tv_last_end.tv_sec = 0;
 			continue;
 		}
 
@@ -2067,6 +2188,8 @@ static void *miner_thread(void *userdata)
 		else
 			max64 = g_work_time + (have_longpoll ? LP_SCANTIME : opt_scantime)
 					- time(NULL);
+		if (tune_running() && max64 > 1)
+			max64 = 1;
 
 		/* time limit */
 		if (opt_time_limit && firstwork_time) {
@@ -2078,9 +2201,15 @@ static void *miner_thread(void *userdata)
 					continue;
 				}
 				if (opt_benchmark) {
+					struct energy_stats es;
 					char rate[32];
 					format_hashrate((double)global_hashrate, rate);
-					applog(LOG_NOTICE, "Benchmark: %s", rate);
+					if (stats_energy(&es))
+						applog(LOG_NOTICE, "Benchmark: %s, %.1f W, %.4g H/J, %.4g J/H", rate,
+							es.watts[STATS_60S], es.hpj[STATS_60S],
+							es.hpj[STATS_60S] > 0. ? 1. / es.hpj[STATS_60S] : 0.);
+					else
+						applog(LOG_NOTICE, "Benchmark: %s", rate);
 					fprintf(stderr, "%llu\n", (long long unsigned int) global_hashrate);
 				} else {
 					applog(LOG_NOTICE,
@@ -2160,6 +2289,12 @@ static void *miner_thread(void *userdata)
 
 		hashes_done = 0;
 		gettimeofday((struct timeval *) &tv_start, NULL);
+		PROF_START();
+		if (tv_last_end.tv_sec) {
+			/* work fetch, restarts and logging since the previous scan */
+			timeval_subtract(&diff, &tv_start, &tv_last_end);
+			overhead = diff.tv_sec * 1000000ULL + diff.tv_usec;
+		}
 
 		if (firstwork_time == 0)
 			firstwork_time = time(NULL);
@@ -2293,15 +2428,22 @@ static void *miner_thread(void *userdata)
 			/* should never happen */
 			goto out;
 		}
+		if (rc < 0) {
+			applog(LOG_ERR, "CPU #%d: %s hash failed", thr_id, algo_names[opt_algo]);
+			pthread_mutex_lock(&applog_lock);
+			exit(1);
+		}
 
 		/* record scanhash elapsed time */
 		gettimeofday(&tv_end, NULL);
+		PROF_SCAN(thr_id, hashes_done);
+		tv_last_end = tv_end;
 		timeval_subtract(&diff, &tv_end, &tv_start);
 		if (diff.tv_usec || diff.tv_sec) {
-			pthread_mutex_lock(&stats_lock);
+			/* only this thread writes its slot, the totals go lock-free to stats.c */
 			thr_hashrates[thr_id] =
 				hashes_done / (diff.tv_sec + diff.tv_usec * 1e-6);
-			pthread_mutex_unlock(&stats_lock);
+			stats_record(thr_id, hashes_done, diff.tv_sec * 1000000ULL + diff.tv_usec, overhead);
 		}
 		if (!opt_quiet) {
 			switch(opt_algo) {
@@ -2319,11 +2461,19 @@ static void *miner_thread(void *userdata)
 				break;
 			}
 		}
-		if (opt_benchmark && thr_id == opt_n_threads - 1) {
-			double hashrate = 0.;
-			for (i = 0; i < opt_n_threads && thr_hashrates[i]; i++)
-				hashrate += thr_hashrates[i];
-			if (i == opt_n_threads) {
+		/* the last thread running prints the total */
+		int last = opt_n_threads - 1;
+		while (last > 0 && governor_parked(last))
+			last--;
+		if (opt_benchmark && thr_id == last) {
+			double hashrate = stats_hashrate(STATS_10S);
+			struct energy_stats es;
+			if (hashrate > 0. && stats_energy(&es)) {
+				char rate[32];
+				format_hashrate(hashrate, rate);
+				applog(LOG_NOTICE, "Total: %s, %.1f W, %.4g H/J", rate,
+					es.watts[STATS_10S], es.hpj[STATS_10S]);
+			} else if (hashrate > 0.) {
 				switch(opt_algo) {
 				case ALGO_CRYPTOLIGHT:
 				case ALGO_CRYPTONIGHT:
@@ -2337,7 +2487,6 @@ static void *miner_thread(void *userdata)
 					applog(LOG_NOTICE, "Total: %s kH/s", s);
 					break;
 				}
-				global_hashrate = (uint64_t) hashrate;
 			}
 		}
 
@@ -2368,6 +2517,8 @@ void restart_threads(void)
 {
 	int i;
 
+	stats_job_restart();
+	journal_job_restart();
 	for (i = 0; i < opt_n_threads; i++)
 		work_restart[i].restart = 1;
 }
@@ -2461,6 +2612,7 @@ start:
 			else
 				rc = work_decode(res, &g_work);
 			if (rc) {
+				gettimeofday(&g_work.tv_job, NULL);
 				bool newblock = g_work.job_id && strcmp(start_job_id, g_work.job_id);
 				newblock |= (start_diff != net_diff); // the best is the height but... longpoll...
 				if (newblock) {
@@ -2541,14 +2693,16 @@ static bool stratum_handle_response(char *buf)
 		} else {
 			valid = json_is_null(err_val);
 		}
-		share_result(valid, NULL, err_val ? json_string_value(err_val) : NULL);
+		share_result(valid, (uint32_t) json_integer_value(id_val), NULL,
+			err_val ? json_string_value(err_val) : NULL);
 
 	} else {
 
 		if (!res_val || json_integer_value(id_val) < 4)
 			goto out;
 		valid = json_is_true(res_val);
-		share_result(valid, NULL, err_val ? json_string_value(json_array_get(err_val, 1)) : NULL);
+		share_result(valid, (uint32_t) json_integer_value(id_val), NULL,
+			err_val ? json_string_value(json_array_get(err_val, 1)) : NULL);
 	}
 
 	ret = true;
@@ -3106,6 +3260,69 @@ void parse_arg(int key, char *arg)
 	case 1083:
 		opt_segwit_mode = true;
 		break;
+	case 1084:
+		v = atoi(arg);
+		if (v < 1 || v > 3)	/* sanity check */
+			show_usage_and_exit(1);
+		opt_cn_ways = v;
+		lanes_given = true;
+		break;
+	case 1085: {
+		unsigned long long N;
+		unsigned int yr, yp;
+		int pos = 0;
+		if (sscanf(arg, "%llu,%u,%u%n", &N, &yr, &yp, &pos) < 3 ||
+		    (arg[pos] && arg[pos] != ','))
+			show_usage_and_exit(1);
+		if (yescrypt_set_params(N, yr, yp, arg[pos] ? &arg[pos + 1] : NULL)) {
+			fprintf(stderr, "invalid yescrypt parameters %s\n", arg);
+			show_usage_and_exit(1);
+		}
+		break;
+	}
+	case 1086:
+		v = atoi(arg);
+		if (v < 1 || v > 2)	/* sanity check */
+			show_usage_and_exit(1);
+		opt_yescrypt_ways = v;
+		lanes_given = true;
+		break;
+	case 1087:
+		opt_log_json = true;
+		use_colors = false;
+		break;
+	case 1089:
+		free(opt_share_journal);
+		opt_share_journal = strdup(arg);
+		break;
+	case 1090:
+		v = atoi(arg);
+		if (v < 5 || v > 3600)	/* sanity check */
+			show_usage_and_exit(1);
+		opt_sweep = v;
+		opt_benchmark = true;
+		want_longpoll = false;
+		want_stratum = false;
+		have_stratum = false;
+		break;
+	case 1091:
+		opt_autotune = true;
+		break;
+	case 1092:
+		free(opt_tune_file);
+		opt_tune_file = strdup(arg);
+		break;
+	case 1093:
+		opt_hugepages = false;
+		break;
+	case 1094:
+		opt_cache_plan = true;
+		break;
+#ifdef HASH_PROFILE
+	case 1088:
+		opt_profile = true;
+		break;
+#endif
 	default:
 		show_usage_and_exit(1);
 	}
@@ -3229,6 +3446,8 @@ int main(int argc, char *argv[]) {
 	struct thr_info *thr;
 	long flags;
 	int i, err;
+	int *lanes, nlanes, max_lanes;
+	size_t lane_bytes;
 
 	pthread_mutex_init(&applog_lock, NULL);
 
@@ -3274,12 +3493,15 @@ int main(int argc, char *argv[]) {
 	if (!opt_n_threads)
 		opt_n_threads = 1;
 
+	aes_ni_supported = has_aes_ni();
+
 	if (opt_algo == ALGO_QUARK) {
 		init_quarkhash_contexts();
+	} else if (opt_algo == ALGO_SCRYPTJANE) {
+		scryptjane_init();
 	} else if(opt_algo == ALGO_CRYPTONIGHT || opt_algo == ALGO_CRYPTOLIGHT) {
 		jsonrpc_2 = true;
 		opt_extranonce = false;
-		aes_ni_supported = has_aes_ni();
 		if (!opt_quiet) {
 			applog(LOG_INFO, "Using JSON-RPC 2.0");
 			applog(LOG_INFO, "CPU Supports AES-NI: %s", aes_ni_supported ? "YES" : "NO");
@@ -3373,6 +3595,10 @@ int main(int argc, char *argv[]) {
 		openlog("cpuminer", LOG_PID, LOG_USER);
 #endif
 
+	/* after the fork, from here on miners never wait on the output */
+	if (!log_init())
+		applog(LOG_WARNING, "async logger failed to start, logging synchronously");
+
 	work_restart = (struct work_restart*) calloc(opt_n_threads, sizeof(*work_restart));
 	if (!work_restart)
 		return 1;
@@ -3385,6 +3611,29 @@ int main(int argc, char *argv[]) {
 	if (!thr_hashrates)
 		return 1;
 
+	if (!stats_init(opt_n_threads)) {
+		applog(LOG_ERR, "stats thread create failed");
+		return 1;
+	}
+	if (!journal_init(opt_share_journal))
+		return 1;
+	lane_bytes = scratch_model(&lanes, &nlanes, &max_lanes);
+	if (opt_sweep && opt_max_temp > 0.) {
+		applog(LOG_WARNING, "--max-temp is ignored during the sweep");
+		opt_max_temp = 0.;
+	}
+	if (!governor_init(opt_n_threads)) {
+		applog(LOG_ERR, "governor thread create failed");
+		return 1;
+	}
+	if (!tune_init(opt_n_threads, lanes, max_lanes, opt_algo == ALGO_CRYPTONIGHT)) {
+		applog(LOG_ERR, "tuner thread create failed");
+		return 1;
+	}
+	if (!opt_sweep && !opt_autotune)
+		tune_plan(opt_n_threads, lane_bytes, nlanes, lanes_given ? NULL : lanes, max_lanes,
+			opt_cache_plan);
+
 	/* init workio thread info */
 	work_thr_id = opt_n_threads;
 	thr = &thr_info[work_thr_id];
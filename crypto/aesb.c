@@ -142,6 +142,29 @@ y[3] = (k)[3]  ^ (t_fn[0][x[3] & 0xff] ^ t_fn[1][(x[0] >> 8) & 0xff] ^ t_fn[2][(
     ^ tab[2][bval(vf(x,2,c),rf(2,c))] \
     ^ tab[3][bval(vf(x,3,c),rf(3,c))])
 
+#include "soft_aes.h"
+
+#ifdef HAVE_SOFT_AES
+
+void aesb_single_round(const uint8_t *in, uint8_t *out, uint8_t *expandedKey)
+{
+    _mm_storeu_si128((__m128i*) out, soft_aesenc(_mm_loadu_si128((const __m128i*) in),
+        _mm_loadu_si128((const __m128i*) expandedKey)));
+}
+
+void aesb_pseudo_round_mut(uint8_t *val, uint8_t *expandedKey)
+{
+    const __m128i *k = (const __m128i*) expandedKey;
+    __m128i x = _mm_loadu_si128((const __m128i*) val);
+    int r;
+
+    for (r = 0; r < 10; r++)
+        x = soft_aesenc(x, _mm_loadu_si128(&k[r]));
+    _mm_storeu_si128((__m128i*) val, x);
+}
+
+#else /* HAVE_SOFT_AES */
+
 d_4(uint32_t, t_dec(f,n), sb_data, u0, u1, u2, u3);
 
 void aesb_single_round(const uint8_t *in, uint8_t *out, uint8_t *expandedKey)
@@ -164,6 +187,7 @@ void aesb_pseudo_round_mut(uint8_t *val, uint8_t *expandedKey)
     round(((uint32_t*) val), b1, ((const uint32_t *) expandedKey) + 9 * N_COLS);
 }
 
+#endif /* HAVE_SOFT_AES */
 
 #if defined(__cplusplus)
 }
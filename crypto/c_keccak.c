@@ -4,6 +4,7 @@
 
 #include "hash-ops.h"
 #include "c_keccak.h"
+#include "sha3/sph_keccak.h"
 
 const uint64_t keccakf_rndc[24] = 
 {
@@ -36,6 +37,11 @@ void keccakf(uint64_t st[25], int rounds)
     int i, j, round;
     uint64_t t, bc[5];
 
+    if (rounds == KECCAK_ROUNDS) {
+        sph_keccakf1600(st);
+        return;
+    }
+
     for (round = 0; round < rounds; ++round) {
 
         // Theta
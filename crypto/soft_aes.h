@@ -0,0 +1,148 @@
+#pragma once
+#ifndef SOFT_AES_H
+#define SOFT_AES_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Used by cryptonight and cryptolight on hosts without AES-NI when
+ * has_ssse3(), for the scratchpad fill and the final pass only: there
+ * eight independent blocks are in flight, while along the chain a single
+ * round is latency bound and the T-tables of aesb.c stay faster.
+ */
+#if !defined(__arm__) && (!defined(SSE) || defined(SSE3))
+#define HAVE_SOFT_AES 1
+
+#include <tmmintrin.h>
+
+#if defined(_MSC_VER)
+#define SOFT_AES_ALIGN __declspec(align(16))
+#define SOFT_AES_TARGET
+#ifndef inline
+#define inline __inline
+#endif
+#else
+#define SOFT_AES_ALIGN __attribute__ ((aligned(16)))
+#define SOFT_AES_TARGET __attribute__ ((target("ssse3")))
+#endif
+
+/*
+ * Constant time SSSE3 fallback for hosts without AES-NI, based on the
+ * vector permute S-box of M. Hamburg ("Accelerating AES with Vector
+ * Permute Instructions"): the byte is moved to a GF(2^4)^2 basis, inverted
+ * with nibble lookups (pshufb) and mapped back. The round keys stay in the
+ * standard basis, so the keys expanded by oaes_lib are usable as is.
+ */
+static const uint64_t SOFT_AES_ALIGN vp_tables[][2] = {
+    /* input transform, split in the i, k and j = i ^ k nibbles */
+    { 0x0C0B0E0905020700ULL, 0x0C0B0E0905020700ULL }, /* i lo */
+    { 0x0400030703070400ULL, 0x0C080B0F0B0F0C08ULL }, /* i hi */
+    { 0x020208080A0A0000ULL, 0x0A0A000002020808ULL }, /* k lo */
+    { 0x0C01000D010C0D00ULL, 0x0D00010C000D0C01ULL }, /* k hi */
+    { 0x0E0906010F080700ULL, 0x06010E0907000F08ULL }, /* j lo */
+    { 0x0801030A020B0900ULL, 0x01080A030B020009ULL }, /* j hi */
+    { 0x0E05060F0D080180ULL, 0x040703090A0B0C02ULL }, /* 1/i */
+    { 0x01040A060F0B0780ULL, 0x030D0E0C02050809ULL }, /* a/k */
+    { 0xD0D26D176FBDC700ULL, 0x15AABF7AC502A878ULL }, /* sbox out u */
+    { 0xCFE474A55FBB6A00ULL, 0x8E1E90D1412B35FAULL }, /* sbox out t */
+    { 0xBBBFDA2EDE619500ULL, 0x2A4F65F491044BF0ULL }, /* 2 * sbox out u */
+    { 0x85D3E851BE6DD400ULL, 0x073C3BB982566AEFULL }, /* 2 * sbox out t */
+    /* ShiftRows followed by a rotation of the columns by 0 to 3 bytes */
+    { 0x030E09040F0A0500ULL, 0x0B06010C07020D08ULL },
+    { 0x04030E09000F0A05ULL, 0x0C0B06010807020DULL },
+    { 0x0904030E05000F0AULL, 0x010C0B060D080702ULL },
+    { 0x0E0904030A05000FULL, 0x06010C0B020D0807ULL },
+};
+
+#define VP_LOAD(n) _mm_load_si128((const __m128i*) vp_tables[n])
+
+/*
+ * One AES encryption round (aesenc). ShiftRows is applied last, merged
+ * with the MixColumns rotations: out = 2.s ^ 3.r1(s) ^ r2(s) ^ r3(s).
+ */
+static inline __m128i SOFT_AES_TARGET soft_aesenc(__m128i x, __m128i key)
+{
+    const __m128i m0f = _mm_set1_epi8(0x0f);
+    const __m128i inv = VP_LOAD(6);
+    __m128i lo, hi, i, j, k, ak, io, jo, s, s2;
+
+    lo = _mm_and_si128(x, m0f);
+    hi = _mm_srli_epi32(_mm_andnot_si128(m0f, x), 4);
+    i = _mm_xor_si128(_mm_shuffle_epi8(VP_LOAD(0), lo), _mm_shuffle_epi8(VP_LOAD(1), hi));
+    k = _mm_xor_si128(_mm_shuffle_epi8(VP_LOAD(2), lo), _mm_shuffle_epi8(VP_LOAD(3), hi));
+    j = _mm_xor_si128(_mm_shuffle_epi8(VP_LOAD(4), lo), _mm_shuffle_epi8(VP_LOAD(5), hi));
+
+    /* inversion, 1/0 is 0x80 so that pshufb yields 0 */
+    ak = _mm_shuffle_epi8(VP_LOAD(7), k);
+    io = _mm_xor_si128(_mm_shuffle_epi8(inv, i), ak);
+    jo = _mm_xor_si128(_mm_shuffle_epi8(inv, j), ak);
+    io = _mm_xor_si128(_mm_shuffle_epi8(inv, io), j);
+    jo = _mm_xor_si128(_mm_shuffle_epi8(inv, jo), i);
+
+    /* SubBytes without its 0x63 constant, which MixColumns leaves as is */
+    s  = _mm_xor_si128(_mm_shuffle_epi8(VP_LOAD(8), io), _mm_shuffle_epi8(VP_LOAD(9), jo));
+    s2 = _mm_xor_si128(_mm_shuffle_epi8(VP_LOAD(10), io), _mm_shuffle_epi8(VP_LOAD(11), jo));
+
+    key = _mm_xor_si128(key, _mm_set1_epi8(0x63));
+    x = _mm_xor_si128(_mm_shuffle_epi8(s2, VP_LOAD(12)),
+        _mm_shuffle_epi8(_mm_xor_si128(s, s2), VP_LOAD(13)));
+    x = _mm_xor_si128(x, _mm_xor_si128(_mm_shuffle_epi8(s, VP_LOAD(14)),
+        _mm_shuffle_epi8(s, VP_LOAD(15))));
+    return _mm_xor_si128(x, key);
+}
+
+/* Ten rounds on eight blocks, interleaved to hide the round latency */
+static inline void SOFT_AES_TARGET soft_aes_pseudo_round_8(__m128i *x, const __m128i *k)
+{
+    int r, n;
+    for (r = 0; r < 10; r++)
+        for (n = 0; n < 8; n++)
+            x[n] = soft_aesenc(x[n], k[r]);
+}
+
+/* Scratchpad fill: the 128 bytes of text encrypted again for each 128 bytes of long_state */
+static inline void SOFT_AES_TARGET soft_aes_explode(const uint8_t *text, const uint8_t *exp_key,
+    uint8_t *long_state, size_t memory)
+{
+    __m128i *ls = (__m128i*) long_state;
+    __m128i k[10], x[8];
+    size_t i;
+    int n;
+
+    for (n = 0; n < 10; n++)
+        k[n] = _mm_loadu_si128((const __m128i*) exp_key + n);
+    for (n = 0; n < 8; n++)
+        x[n] = _mm_loadu_si128((const __m128i*) text + n);
+    for (i = 0; i < memory / 16; i += 8) {
+        soft_aes_pseudo_round_8(x, k);
+        for (n = 0; n < 8; n++)
+            _mm_store_si128(&ls[i + n], x[n]);
+    }
+}
+
+/* Final pass: text xored with each 128 bytes of long_state and encrypted */
+static inline void SOFT_AES_TARGET soft_aes_implode(uint8_t *text, const uint8_t *exp_key,
+    const uint8_t *long_state, size_t memory)
+{
+    const __m128i *ls = (const __m128i*) long_state;
+    __m128i k[10], x[8];
+    size_t i;
+    int n;
+
+    for (n = 0; n < 10; n++)
+        k[n] = _mm_loadu_si128((const __m128i*) exp_key + n);
+    for (n = 0; n < 8; n++)
+        x[n] = _mm_loadu_si128((const __m128i*) text + n);
+    for (i = 0; i < memory / 16; i += 8) {
+        for (n = 0; n < 8; n++)
+            x[n] = _mm_xor_si128(x[n], _mm_load_si128(&ls[i + n]));
+        soft_aes_pseudo_round_8(x, k);
+    }
+    for (n = 0; n < 8; n++)
+        _mm_storeu_si128((__m128i*) text + n, x[n]);
+}
+
+#endif /* HAVE_SOFT_AES */
+
+#endif /* SOFT_AES_H */
@@ -0,0 +1,291 @@
+/**
+ * Thermal governor
+ *
+ * With --max-temp, threads are shed one at a time instead of all of
+ * them pausing for 5 seconds. Every GOV_PERIOD seconds the governor reads
+ * the temperature and clock of the cpu each miner thread is bound to,
+ * parks the thread on the hottest core while the hottest one is above
+ * the target and brings parked threads back once every core is
+ * GOV_HYST degrees below it.
+ *
+ * A thread brought back is on probation: if the total rate has not grown
+ * by GOV_GAIN of a thread's average once it settled, the extra thread
+ * only adds heat (memory bound or throttled cores), it is parked again
+ * and the number of running threads is capped for GOV_CAP_SECS.
+ *
+ * The tuner (tune.c) switches threads off through governor_select(),
+ * those are left alone here whatever the temperature.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "miner.h"
+
+#define GOV_PERIOD	2	/* seconds between two decisions */
+#define GOV_HYST	3.0	/* degrees under the target to resume a thread */
+#define GOV_HARD	5.0	/* degrees over the target to shed a quarter of the threads */
+#define GOV_SETTLE	5	/* periods after resuming a thread, the 10s rate catches up */
+#define GOV_GAIN	0.25	/* of a thread's average rate a resumed thread must add */
+#define GOV_CAP_SECS	300
+#define GOV_EVENTS	16
+
+extern int num_cpus;
+extern int64_t opt_affinity;
+extern double opt_max_temp;
+extern uint32_t cpu_clock(int);
+
+struct gov_thread {
+	int cpu;		/* bound to, -1 when not pinned */
+	volatile bool parked;
+	volatile bool off;	/* left out by the tuner, not ours to resume */
+	float temp;
+	uint32_t freq;		/* kHz */
+	double rate;
+};
+
+struct gov_event {
+	time_t time;
+	char text[96];
+};
+
+static struct gov_thread *gthr = NULL;
+static int gov_threads = 0;
+static int gov_active = 0;
+static int gov_cap = 0;		/* threads worth running, 0 when unknown */
+static time_t gov_cap_until;
+static int gov_settle = 0;
+static int gov_trial = -1;	/* thread on probation */
+static int gov_trial_active;	/* threads running before it came back */
+static double gov_trial_base;	/* and their rate */
+static float gov_hottest;
+
+static struct gov_event events[GOV_EVENTS];
+static unsigned nevents = 0;
+static pthread_mutex_t gov_lock = PTHREAD_MUTEX_INITIALIZER;
+
+bool governor_parked(int thr_id)
+{
+	return gthr && (gthr[thr_id].parked || gthr[thr_id].off);
+}
+
+/* log and remember a decision, with gov_lock held */
+static void gov_event(const char *fmt, ...)
+{
+	struct gov_event *e = &events[nevents++ % GOV_EVENTS];
+	va_list ap;
+
+	e->time = time(NULL);
+	va_start(ap, fmt);
+	vsnprintf(e->text, sizeof(e->text), fmt, ap);
+	va_end(ap);
+	applog(LOG_INFO, "governor: %s", e->text);
+}
+
+static void gov_set(int thr_id, bool park)
+{
+	gthr[thr_id].parked = park;
+	if (gthr[thr_id].off)
+		return;
+	if (park) {
+		/* leave the current scan now */
+		work_restart[thr_id].restart = 1;
+		gov_active--;
+	} else {
+		gov_active++;
+	}
+}
+
+/* the running thread on the hottest core, the slowest clock on a tie */
+static int gov_hottest_thread(void)
+{
+	int best = -1;
+	for (int i = 0; i < gov_threads; i++) {
+		struct gov_thread *t = &gthr[i];
+		if (t->parked || t->off)
+			continue;
+		if (best < 0 || t->temp > gthr[best].temp ||
+		    (t->temp == gthr[best].temp && t->freq < gthr[best].freq))
+			best = i;
+	}
+	return best;
+}
+
+static int gov_coolest_parked(void)
+{
+	int best = -1;
+	for (int i = 0; i < gov_threads; i++)
+		if (gthr[i].parked && !gthr[i].off &&
+		    (best < 0 || gthr[i].temp < gthr[best].temp))
+			best = i;
+	return best;
+}
+
+static void gov_step(void)
+{
+	double total = stats_hashrate(STATS_10S);
+	time_t now = time(NULL);
+	float target = (float) opt_max_temp;
+	struct thr_stats st;
+	int i;
+
+	pthread_mutex_lock(&gov_lock);
+	gov_hottest = 0.;
+	for (i = 0; i < gov_threads; i++) {
+		struct gov_thread *t = &gthr[i];
+		int cpu = t->cpu >= 0 ? t->cpu : 0;
+		t->temp = cpu_temp(cpu);
+		t->freq = cpu_clock(cpu);
+		stats_thr_get(i, &st);
+		t->rate = st.rate[STATS_10S];
+		if (t->temp > gov_hottest)
+			gov_hottest = t->temp;
+	}
+	if (gov_hottest <= 0.)
+		goto out;	/* no sensor */
+
+	if (gov_settle && gov_hottest <= target + GOV_HARD) {
+		if (--gov_settle || gov_trial < 0)
+			goto out;
+		/* probation over */
+		i = gov_trial;
+		gov_trial = -1;
+		if (gov_trial_active && !gthr[i].parked) {
+			double avg = gov_trial_base / gov_trial_active;
+			if (total - gov_trial_base < GOV_GAIN * avg) {
+				gov_set(i, true);
+				gov_cap = gov_active;
+				gov_cap_until = now + GOV_CAP_SECS;
+				gov_event("thread %d added %.0f H/s of %.0f, %d threads for %ds",
+					i, total - gov_trial_base, avg, gov_cap, GOV_CAP_SECS);
+				goto out;
+			}
+		}
+	}
+
+	if (gov_hottest > target) {
+		/* shed a quarter of the threads when far over, keep one otherwise */
+		int n = 1, keep = 1;
+		if (gov_hottest > target + GOV_HARD) {
+			n = gov_active / 4 > 1 ? gov_active / 4 : 1;
+			keep = 0;
+		}
+		while (n-- && gov_active > keep) {
+			i = gov_hottest_thread();
+			gov_set(i, true);
+			gov_event("%.0fC > %.0fC, parked thread %d (cpu %d, %.0fC, %u MHz), %d running",
+				gov_hottest, target, i, gthr[i].cpu, gthr[i].temp,
+				gthr[i].freq / 1000, gov_active);
+		}
+		gov_trial = -1;
+		gov_settle = 1;
+	} else if (gov_hottest < target - GOV_HYST && (i = gov_coolest_parked()) >= 0) {
+		if (gov_cap && now >= gov_cap_until)
+			gov_cap = 0;
+		if (gov_cap && gov_active >= gov_cap)
+			goto out;
+		gov_trial = i;
+		gov_trial_active = gov_active;
+		gov_trial_base = total;
+		gov_set(i, false);
+		gov_event("%.0fC < %.0fC, resumed thread %d (cpu %d), %d running",
+			gov_hottest, target - GOV_HYST, i, gthr[i].cpu, gov_active);
+		gov_settle = GOV_SETTLE;
+	}
+out:
+	pthread_mutex_unlock(&gov_lock);
+}
+
+static void *governor_thread(void *arg)
+{
+	for (;;) {
+		sleep(GOV_PERIOD);
+		gov_step();
+	}
+	return NULL;
+}
+
+/* the tuner runs the threads of run[] only; the others stay off */
+void governor_select(const bool *run)
+{
+	pthread_mutex_lock(&gov_lock);
+	for (int i = 0; i < gov_threads; i++) {
+		struct gov_thread *t = &gthr[i];
+		if (t->off == !run[i])
+			continue;
+		t->off = !run[i];
+		if (!t->parked)
+			gov_active += t->off ? -1 : 1;
+		work_restart[i].restart = 1;
+	}
+	/* a new configuration, the probation and the cap no longer apply */
+	gov_trial = -1;
+	gov_settle = 0;
+	gov_cap = 0;
+	pthread_mutex_unlock(&gov_lock);
+}
+
+/* thermal thread only with --max-temp, the parking is shared with the tuner */
+bool governor_init(int nthreads)
+{
+	pthread_t pth;
+
+	gthr = (struct gov_thread *) calloc(nthreads, sizeof(*gthr));
+	if (!gthr)
+		return false;
+	for (int i = 0; i < nthreads; i++) {
+		/* as miner_thread() binds them */
+		gthr[i].cpu = (num_cpus > 1 && opt_affinity == -1 && nthreads > 1) ?
+			i % num_cpus : -1;
+	}
+	gov_threads = gov_active = nthreads;
+
+	if (opt_max_temp <= 0.)
+		return true;
+	if (pthread_create(&pth, NULL, governor_thread, NULL))
+		return false;
+	pthread_detach(pth);
+	return true;
+}
+
+/* the cpu thr_id is bound to, -1 when not pinned */
+int governor_cpu(int thr_id)
+{
+	return gthr ? gthr[thr_id].cpu : -1;
+}
+
+/* API: the state, one record per thread, then the latest decisions */
+char *governor_report(char *buf, size_t sz)
+{
+	size_t len = 0;
+
+	int parked = 0, off = 0;
+
+	*buf = '\0';
+	if (!gthr)
+		return buf;
+
+	pthread_mutex_lock(&gov_lock);
+	for (int i = 0; i < gov_threads; i++) {
+		off += gthr[i].off;
+		parked += gthr[i].parked && !gthr[i].off;
+	}
+	len += snprintf(buf + len, sz - len, "TARGET=%.1f;TEMP=%.1f;ACTIVE=%d;PARKED=%d;OFF=%d;CAP=%d|",
+		opt_max_temp, gov_hottest, gov_active, parked, off, gov_cap);
+	for (int i = 0; i < gov_threads && len < sz; i++) {
+		struct gov_thread *t = &gthr[i];
+		len += snprintf(buf + len, sz - len, "THR=%d;CPU=%d;TEMP=%.1f;FREQ=%u;KHS=%.2f;PARKED=%d;OFF=%d|",
+			i, t->cpu, t->temp, t->freq / 1000, t->rate / 1000., t->parked ? 1 : 0, t->off ? 1 : 0);
+	}
+	unsigned first = nevents > GOV_EVENTS ? nevents - GOV_EVENTS : 0;
+	for (unsigned n = first; n < nevents && len < sz; n++) {
+		struct gov_event *e = &events[n % GOV_EVENTS];
+		len += snprintf(buf + len, sz - len, "TS=%u;EVENT=%s|", (uint32_t) e->time, e->text);
+	}
+	pthread_mutex_unlock(&gov_lock);
+	return buf;
+}
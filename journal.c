@@ -0,0 +1,419 @@
+/**
+ * Share journal
+ *
+ * Every share is followed from the nonce to the pool's answer: how old
+ * its job was when it was found, how long it waited to be sent and how
+ * long the pool took to reply. Completed shares are folded into
+ * counters by job age, stale ones are also charged to what the job
+ * switch overlapped, and with --share-journal each one is appended as
+ * a fixed-size record to a memory-mapped file.
+ *
+ * File layout, little-endian: a 64-byte struct journal_header, then
+ * header.count records of header.record_size bytes (struct
+ * journal_record). The file is grown in chunks while mining and cut to
+ * the used length at exit; a reader should trust header.count only.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include "miner.h"
+
+#define JOURNAL_MAGIC	"CPMSHRJ1"
+#define JOURNAL_CHUNK	4096	/* records added each time the file grows */
+#define JOURNAL_PENDING	64	/* submits awaiting an answer, power of 2 */
+#define JOURNAL_JOBS	16	/* job restarts remembered */
+#define JOURNAL_NONE	0xffffffffU
+#define JOURNAL_LOST	0xff	/* result of a submit never answered */
+
+struct journal_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+	uint64_t count;		/* records written */
+	uint64_t created;	/* unix time */
+	char algo[32];
+};
+
+struct journal_record {
+	uint64_t found_us;	/* unix time the nonce was found, microseconds */
+	double diff;		/* target difficulty */
+	uint32_t nonce;
+	uint32_t job_age_ms;	/* job received to nonce found, JOURNAL_NONE if unknown */
+	uint32_t submit_us;	/* found to sent, JOURNAL_NONE if discarded */
+	uint32_t rtt_us;	/* sent to answered, JOURNAL_NONE if no answer */
+	uint16_t thr_id;
+	uint8_t result;		/* SHARE_*, JOURNAL_LOST */
+	uint8_t cause;		/* STALE_* of a stale share */
+	char job_id[28];
+	char reason[32];
+};
+
+struct journal_pending {
+	uint32_t id;		/* 0 when free */
+	uint64_t job_us;
+	uint64_t sent_us;
+	struct journal_record rec;
+};
+
+const char *stale_causes[STALE_CAUSES] = { "pool", "late_switch", "queued", "in_flight" };
+static const double age_le[SHARE_AGES - 1] = { 1, 2, 5, 10, 20, 30, 60, 120 };
+
+static pthread_mutex_t journal_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct journal_pending pending[JOURNAL_PENDING];
+static uint32_t next_id = 4;	/* stratum ids below 4 are not submits */
+static uint64_t restarts[JOURNAL_JOBS];
+static unsigned nrestarts = 0;
+static struct share_ages ages = { age_le };
+
+/* the mapped file */
+static struct journal_header *jhdr = NULL;
+static uint64_t jcap = 0;	/* records the mapping holds */
+#ifdef WIN32
+static HANDLE jfile = INVALID_HANDLE_VALUE;
+static HANDLE jmap = NULL;
+#else
+static int jfd = -1;
+#endif
+
+static uint64_t tv_usecs(const struct timeval *tv)
+{
+	return tv->tv_sec * 1000000ULL + tv->tv_usec;
+}
+
+static uint64_t now_usecs(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv_usecs(&tv);
+}
+
+static size_t journal_size(uint64_t records)
+{
+	return sizeof(struct journal_header) + records * sizeof(struct journal_record);
+}
+
+static void journal_unmap(void)
+{
+	if (!jhdr)
+		return;
+#ifdef WIN32
+	UnmapViewOfFile(jhdr);
+	CloseHandle(jmap);
+	jmap = NULL;
+#else
+	munmap(jhdr, journal_size(jcap));
+#endif
+	jhdr = NULL;
+}
+
+/* (re)map the file to hold cap records, extending it as needed */
+static bool journal_map(uint64_t cap)
+{
+	size_t size = journal_size(cap);
+
+	journal_unmap();
+#ifdef WIN32
+	jmap = CreateFileMapping(jfile, NULL, PAGE_READWRITE,
+		(DWORD) ((uint64_t) size >> 32), (DWORD) size, NULL);
+	if (!jmap)
+		return false;
+	jhdr = (struct journal_header *) MapViewOfFile(jmap, FILE_MAP_WRITE, 0, 0, size);
+	if (!jhdr) {
+		CloseHandle(jmap);
+		jmap = NULL;
+		return false;
+	}
+#else
+	if (ftruncate(jfd, size))
+		return false;
+	void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, jfd, 0);
+	if (p == MAP_FAILED)
+		return false;
+	jhdr = (struct journal_header *) p;
+#endif
+	jcap = cap;
+	return true;
+}
+
+static void journal_write(const struct journal_record *rec)
+{
+	if (!jhdr)
+		return;
+	if (jhdr->count == jcap && !journal_map(jcap + JOURNAL_CHUNK)) {
+		applog(LOG_ERR, "share journal: cannot grow the file, journal stopped");
+		return;
+	}
+	struct journal_record *recs = (struct journal_record *) (jhdr + 1);
+	recs[jhdr->count] = *rec;
+	jhdr->count++;
+}
+
+/* cut the file to what was written */
+static void journal_close(void)
+{
+	uint64_t count;
+
+	pthread_mutex_lock(&journal_lock);
+	if (!jhdr) {
+		pthread_mutex_unlock(&journal_lock);
+		return;
+	}
+	count = jhdr->count;
+	journal_unmap();
+#ifdef WIN32
+	LARGE_INTEGER end;
+	end.QuadPart = journal_size(count);
+	SetFilePointerEx(jfile, end, NULL, FILE_BEGIN);
+	SetEndOfFile(jfile);
+	CloseHandle(jfile);
+	jfile = INVALID_HANDLE_VALUE;
+#else
+	if (ftruncate(jfd, journal_size(count)))
+		applog(LOG_WARNING, "share journal: %s", strerror(errno));
+	close(jfd);
+	jfd = -1;
+#endif
+	pthread_mutex_unlock(&journal_lock);
+}
+
+bool journal_init(const char *path)
+{
+	struct journal_header hdr;
+	uint64_t size, count = 0;
+
+	if (!path)
+		return true;
+
+#ifdef WIN32
+	LARGE_INTEGER fsize;
+	DWORD nread = 0;
+	jfile = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+		OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (jfile == INVALID_HANDLE_VALUE || !GetFileSizeEx(jfile, &fsize)) {
+		applog(LOG_ERR, "share journal %s: cannot open", path);
+		return false;
+	}
+	size = fsize.QuadPart;
+	if (size >= sizeof(hdr) && (!ReadFile(jfile, &hdr, sizeof(hdr), &nread, NULL) || nread != sizeof(hdr))) {
+		applog(LOG_ERR, "share journal %s: cannot read the header", path);
+		return false;
+	}
+#else
+	struct stat st;
+	jfd = open(path, O_RDWR | O_CREAT, 0644);
+	if (jfd < 0 || fstat(jfd, &st)) {
+		applog(LOG_ERR, "share journal %s: %s", path, strerror(errno));
+		return false;
+	}
+	size = st.st_size;
+	if (size >= sizeof(hdr) && pread(jfd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+		applog(LOG_ERR, "share journal %s: cannot read the header", path);
+		return false;
+	}
+#endif
+
+	if (size) {
+		/* append to a journal of ours, never clobber anything else */
+		if (size < sizeof(hdr) || memcmp(hdr.magic, JOURNAL_MAGIC, 8) ||
+		    hdr.record_size != sizeof(struct journal_record)) {
+			applog(LOG_ERR, "share journal %s: not a share journal", path);
+			return false;
+		}
+		count = hdr.count;
+		if (journal_size(count) > size)
+			count = (size - sizeof(hdr)) / sizeof(struct journal_record);
+	}
+
+	if (!journal_map(count + JOURNAL_CHUNK)) {
+		applog(LOG_ERR, "share journal %s: cannot map the file", path);
+		return false;
+	}
+	if (!size) {
+		memset(jhdr, 0, sizeof(*jhdr));
+		memcpy(jhdr->magic, JOURNAL_MAGIC, 8);
+		jhdr->version = 1;
+		jhdr->record_size = sizeof(struct journal_record);
+		jhdr->created = (uint64_t) time(NULL);
+		get_currentalgo(jhdr->algo, sizeof(jhdr->algo));
+	}
+	jhdr->count = count;
+	atexit(journal_close);
+	applog(LOG_INFO, "share journal %s, %llu records", path, (unsigned long long) count);
+	return true;
+}
+
+void journal_job_restart(void)
+{
+	pthread_mutex_lock(&journal_lock);
+	restarts[nrestarts++ % JOURNAL_JOBS] = now_usecs();
+	pthread_mutex_unlock(&journal_lock);
+}
+
+/* when the job of a share was replaced, 0 if it still is current */
+static uint64_t job_superseded(uint64_t job_us)
+{
+	uint64_t t = 0;
+	unsigned n = nrestarts < JOURNAL_JOBS ? nrestarts : JOURNAL_JOBS;
+
+	for (unsigned i = 0; i < n; i++) {
+		uint64_t r = restarts[i];
+		if (r > job_us && (!t || r < t))
+			t = r;
+	}
+	return t;
+}
+
+static void journal_fill(struct journal_record *rec, uint64_t *job_us,
+	const struct work *work, uint32_t nonce)
+{
+	uint64_t found = tv_usecs(&work->tv_found);
+
+	memset(rec, 0, sizeof(*rec));
+	rec->found_us = found;
+	rec->diff = work->targetdiff;
+	rec->nonce = nonce;
+	rec->thr_id = (uint16_t) work->thr_id;
+	rec->submit_us = rec->rtt_us = JOURNAL_NONE;
+	if (work->job_id)
+		snprintf(rec->job_id, sizeof(rec->job_id), "%s", work->job_id);
+
+	*job_us = tv_usecs(&work->tv_job);
+	if (*job_us && found >= *job_us)
+		rec->job_age_ms = (uint32_t) ((found - *job_us) / 1000);
+	else
+		rec->job_age_ms = JOURNAL_NONE;
+}
+
+/* fold a finished share into the counters and the file, with journal_lock held */
+static void journal_done(struct journal_record *rec, uint64_t job_us, uint64_t sent_us,
+	uint64_t answer_us)
+{
+	if (rec->result == SHARE_STALE) {
+		/* what had started when the job was replaced */
+		uint64_t t = job_superseded(job_us);
+		if (!t || t > answer_us)
+			rec->cause = STALE_POOL;
+		else if (t <= rec->found_us)
+			rec->cause = STALE_LATE;
+		else if (!sent_us || t <= sent_us)
+			rec->cause = STALE_QUEUED;
+		else
+			rec->cause = STALE_IN_FLIGHT;
+		ages.causes[rec->cause]++;
+	}
+	if (rec->result <= SHARE_STALE && rec->job_age_ms != JOURNAL_NONE) {
+		double age = rec->job_age_ms * 1e-3;
+		int i = 0;
+		while (i < SHARE_AGES - 1 && age > age_le[i])
+			i++;
+		ages.count[i][rec->result]++;
+		ages.sum[rec->result] += age;
+	}
+	journal_write(rec);
+}
+
+uint32_t journal_submit(const struct work *work, uint32_t nonce)
+{
+	struct journal_pending *p;
+	uint32_t id;
+
+	pthread_mutex_lock(&journal_lock);
+	id = next_id++;
+	if (next_id == 0)
+		next_id = 4;
+	p = &pending[id & (JOURNAL_PENDING - 1)];
+	if (p->id) {
+		/* the pool never answered this one */
+		p->rec.result = JOURNAL_LOST;
+		journal_write(&p->rec);
+	}
+	journal_fill(&p->rec, &p->job_us, work, nonce);
+	p->sent_us = now_usecs();
+	if (p->sent_us >= p->rec.found_us)
+		p->rec.submit_us = (uint32_t) (p->sent_us - p->rec.found_us);
+	p->id = id;
+	pthread_mutex_unlock(&journal_lock);
+	return id;
+}
+
+void journal_discard(const struct work *work, uint32_t nonce)
+{
+	struct journal_record rec;
+	uint64_t job_us;
+
+	pthread_mutex_lock(&journal_lock);
+	journal_fill(&rec, &job_us, work, nonce);
+	rec.result = SHARE_STALE;
+	strcpy(rec.reason, "discarded");
+	journal_done(&rec, job_us, 0, now_usecs());
+	pthread_mutex_unlock(&journal_lock);
+}
+
+/* the round trip in seconds, -1 when unknown; *diff gets the target the share was mined at */
+double journal_result(uint32_t id, int result, const char *reason, double *diff)
+{
+	struct journal_pending *p = &pending[id & (JOURNAL_PENDING - 1)];
+	uint64_t now = now_usecs();
+	double rtt = -1.;
+
+	pthread_mutex_lock(&journal_lock);
+	if (id && p->id == id) {
+		p->rec.result = (uint8_t) stats_share_kind(result, reason);
+		*diff = p->rec.diff;
+		if (reason)
+			snprintf(p->rec.reason, sizeof(p->rec.reason), "%s", reason);
+		if (now >= p->sent_us) {
+			p->rec.rtt_us = (uint32_t) (now - p->sent_us);
+			rtt = p->rec.rtt_us * 1e-6;
+		}
+		journal_done(&p->rec, p->job_us, p->sent_us, now);
+		p->id = 0;
+	}
+	pthread_mutex_unlock(&journal_lock);
+	return rtt;
+}
+
+void journal_ages(struct share_ages *out)
+{
+	pthread_mutex_lock(&journal_lock);
+	*out = ages;
+	pthread_mutex_unlock(&journal_lock);
+}
+
+/* API: one AGE=..;ACC=..;REJ=..;STALE=.. record per job age bucket, then the stale causes */
+char *journal_report(char *buf, size_t sz)
+{
+	struct share_ages a;
+	size_t len = 0;
+
+	journal_ages(&a);
+	*buf = '\0';
+	for (int i = 0; i < SHARE_AGES && len < sz; i++) {
+		uint64_t *c = a.count[i];
+		uint64_t total = c[SHARE_ACCEPTED] + c[SHARE_REJECTED] + c[SHARE_STALE];
+		char le[16];
+		if (i < SHARE_AGES - 1)
+			snprintf(le, sizeof(le), "%g", age_le[i]);
+		else
+			strcpy(le, "inf");
+		len += snprintf(buf + len, sz - len, "AGE=%s;ACC=%llu;REJ=%llu;STALE=%llu;STALEPCT=%.2f|",
+			le, (unsigned long long) c[SHARE_ACCEPTED], (unsigned long long) c[SHARE_REJECTED],
+			(unsigned long long) c[SHARE_STALE], total ? 100. * c[SHARE_STALE] / total : 0.);
+	}
+	if (len < sz)
+		len += snprintf(buf + len, sz - len, "LATE=%llu;QUEUED=%llu;INFLIGHT=%llu;POOL=%llu|",
+			(unsigned long long) a.causes[STALE_LATE], (unsigned long long) a.causes[STALE_QUEUED],
+			(unsigned long long) a.causes[STALE_IN_FLIGHT], (unsigned long long) a.causes[STALE_POOL]);
+	return buf;
+}
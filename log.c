@@ -0,0 +1,328 @@
+/**
+ * Asynchronous logger
+ *
+ * applog() formats the message straight into a slot of a bounded
+ * multi-producer ring and returns; a single writer thread drains the
+ * ring, formats the lines and writes them in one batch per wake-up. A
+ * congested terminal or pipe only stalls the writer: when the ring is
+ * full new messages are dropped and counted, the miners never wait.
+ *
+ * The writer folds runs of identical messages into a "repeated" line
+ * and can emit JSON objects instead of text (--log-json).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "miner.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define log_load(p)		(*(volatile uint64_t *)(p))
+#define log_store(p, v)		(*(volatile uint64_t *)(p) = (v))
+#define log_cas(p, o, n)	log_cas64(p, &(o), n)
+#define log_add(p, v)		_InterlockedExchangeAdd64((volatile __int64 *)(p), (__int64)(v))
+#define log_xchg(p, v)		_InterlockedExchange64((volatile __int64 *)(p), (__int64)(v))
+
+/* as __atomic_compare_exchange_n: on failure *o gets the current value */
+static __inline bool log_cas64(volatile uint64_t *p, uint64_t *o, uint64_t n)
+{
+	__int64 cur = _InterlockedCompareExchange64((volatile __int64 *)p, (__int64)n, (__int64)*o);
+	if (cur == (__int64)*o)
+		return true;
+	*o = (uint64_t)cur;
+	return false;
+}
+#else
+#define log_load(p)		__atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define log_store(p, v)		__atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define log_cas(p, o, n)	__atomic_compare_exchange_n(p, &(o), n, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+#define log_add(p, v)		__atomic_fetch_add(p, v, __ATOMIC_RELAXED)
+#define log_xchg(p, v)		__atomic_exchange_n(p, v, __ATOMIC_RELAXED)
+#endif
+
+#define LOG_SLOTS	1024	/* power of 2 */
+#define LOG_MSG_MAX	1000
+#define LOG_BATCH	(64 * 1024)
+#define LOG_REPEAT_SECS	30	/* longest run folded into one "repeated" line */
+
+bool opt_log_json = false;
+
+/* seq == pos: free for the producer of pos, seq == pos + 1: ready to be read */
+struct log_slot {
+	uint64_t seq;
+	time_t time;
+	int prio;
+	int len;
+	char text[LOG_MSG_MAX];
+};
+
+static struct log_slot *ring = NULL;
+static uint64_t log_head = 0;	/* next position to claim, shared by producers */
+static uint64_t log_tail = 0;	/* next position to read, writer only */
+static uint64_t log_dropped = 0;
+static volatile bool log_running = false;
+
+static pthread_mutex_t log_consume_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t log_wait_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_cond = PTHREAD_COND_INITIALIZER;
+
+/* owned by whoever holds log_consume_lock */
+static char batch[LOG_BATCH];
+static size_t batch_len = 0;
+static char last_text[LOG_MSG_MAX];
+static int last_prio = -1;
+static unsigned repeats = 0;
+static time_t repeat_since, repeat_last;
+
+bool applog_async(int prio, const char *fmt, va_list ap)
+{
+	struct log_slot *s;
+	uint64_t pos;
+	int n;
+
+	if (!log_running)
+		return false;
+
+	pos = log_load(&log_head);
+	for (;;) {
+		s = &ring[pos & (LOG_SLOTS - 1)];
+		int64_t dif = (int64_t) (log_load(&s->seq) - pos);
+		if (dif == 0) {
+			if (log_cas(&log_head, pos, pos + 1))
+				break;
+		} else if (dif < 0) {
+			/* full, the writer is stuck on the output */
+			log_add(&log_dropped, 1);
+			return true;
+		} else {
+			pos = log_load(&log_head);
+		}
+	}
+
+	s->time = time(NULL);
+	s->prio = prio;
+	n = vsnprintf(s->text, LOG_MSG_MAX, fmt, ap);
+	if (n < 0)
+		n = 0;
+	if (n >= LOG_MSG_MAX) {
+		memcpy(&s->text[LOG_MSG_MAX - 4], "...", 4);
+		n = LOG_MSG_MAX - 1;
+	}
+	s->len = n;
+	log_store(&s->seq, pos + 1);
+
+	pthread_cond_signal(&log_cond);
+	return true;
+}
+
+static void batch_flush(void)
+{
+	if (!batch_len)
+		return;
+	fwrite(batch, 1, batch_len, stdout);
+	fflush(stdout);
+	batch_len = 0;
+}
+
+static void batch_json_string(const char *p)
+{
+	static const char hex[] = "0123456789abcdef";
+	char *o = &batch[batch_len];
+
+	*o++ = '"';
+	for (; *p; p++) {
+		unsigned char ch = (unsigned char) *p;
+		if (ch == '\033') {
+			/* drop colour escapes, \033[..m */
+			while (p[1] && p[1] != 'm')
+				p++;
+			if (p[1])
+				p++;
+			continue;
+		}
+		if (ch == '"' || ch == '\\') {
+			*o++ = '\\';
+			*o++ = ch;
+		} else if (ch < 0x20) {
+			memcpy(o, "\\u00", 4);
+			o[4] = hex[ch >> 4];
+			o[5] = hex[ch & 15];
+			o += 6;
+		} else {
+			*o++ = ch;
+		}
+	}
+	*o++ = '"';
+	batch_len = o - batch;
+}
+
+static void log_line(int prio, time_t t, const char *text)
+{
+	const char *color = "", *level = "info";
+	struct tm tm;
+
+#ifdef HAVE_SYSLOG_H
+	if (use_syslog) {
+		syslog(prio == LOG_BLUE ? LOG_NOTICE : prio, "%s", text);
+		return;
+	}
+#endif
+	/* worst case, every byte escaped as \u00xx */
+	if (LOG_BATCH - batch_len < 6 * LOG_MSG_MAX + 128)
+		batch_flush();
+
+	switch (prio) {
+		case LOG_ERR:     color = CL_RED; level = "error"; break;
+		case LOG_WARNING: color = CL_YLW; level = "warning"; break;
+		case LOG_NOTICE:  color = CL_WHT; level = "notice"; break;
+		case LOG_INFO:    color = ""; break;
+		case LOG_DEBUG:   color = CL_GRY; level = "debug"; break;
+
+		case LOG_BLUE:
+			color = CL_CYN;
+			level = "notice";
+			break;
+	}
+	if (!use_colors)
+		color = "";
+
+	localtime_r(&t, &tm);
+	if (opt_log_json) {
+		batch_len += sprintf(&batch[batch_len],
+			"{\"time\":\"%d-%02d-%02dT%02d:%02d:%02d\",\"level\":\"%s\",\"msg\":",
+			tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+			tm.tm_hour, tm.tm_min, tm.tm_sec, level);
+		batch_json_string(text);
+		batch_len += sprintf(&batch[batch_len], "}\n");
+	} else {
+		batch_len += snprintf(&batch[batch_len], LOG_BATCH - batch_len,
+			"[%d-%02d-%02d %02d:%02d:%02d]%s %s%s\n",
+			tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+			tm.tm_hour, tm.tm_min, tm.tm_sec,
+			color, text, use_colors ? CL_N : "");
+	}
+}
+
+static void log_repeats(void)
+{
+	char msg[64];
+	if (!repeats)
+		return;
+	sprintf(msg, "last message repeated %u times", repeats);
+	log_line(LOG_INFO, repeat_last, msg);
+	repeats = 0;
+}
+
+/* empty the ring, called with log_consume_lock held */
+static int log_drain(void)
+{
+	uint64_t dropped;
+	int n = 0;
+
+	for (;; n++) {
+		struct log_slot *s = &ring[log_tail & (LOG_SLOTS - 1)];
+		if (log_load(&s->seq) != log_tail + 1)
+			break;
+
+		if (s->prio == last_prio && !strcmp(s->text, last_text) &&
+		    s->time - repeat_since < LOG_REPEAT_SECS) {
+			if (!repeats++)
+				repeat_since = s->time;
+			repeat_last = s->time;
+		} else {
+			log_repeats();
+			log_line(s->prio, s->time, s->text);
+			memcpy(last_text, s->text, s->len + 1);
+			last_prio = s->prio;
+			repeat_since = s->time;
+		}
+		log_store(&s->seq, log_tail + LOG_SLOTS);
+		log_tail++;
+	}
+
+	/* do not hold a run back forever when nothing else is logged */
+	if (repeats && time(NULL) - repeat_since >= LOG_REPEAT_SECS) {
+		log_repeats();
+		last_prio = -1;
+	}
+
+	dropped = log_xchg(&log_dropped, 0);
+	if (dropped) {
+		char msg[80];
+		sprintf(msg, "%llu log messages dropped, the output is not keeping up",
+			(unsigned long long) dropped);
+		log_line(LOG_WARNING, time(NULL), msg);
+	}
+	batch_flush();
+	return n;
+}
+
+static void *log_thread(void *arg)
+{
+	for (;;) {
+		struct timeval now;
+		struct timespec abstime;
+		int n;
+
+		pthread_mutex_lock(&log_consume_lock);
+		n = log_drain();
+		pthread_mutex_unlock(&log_consume_lock);
+		if (n)
+			continue;
+
+		/* producers signal without the lock, a missed wake-up costs 100ms */
+		gettimeofday(&now, NULL);
+		abstime.tv_sec = now.tv_sec;
+		abstime.tv_nsec = (now.tv_usec + 100000) * 1000;
+		if (abstime.tv_nsec >= 1000000000) {
+			abstime.tv_sec++;
+			abstime.tv_nsec -= 1000000000;
+		}
+		pthread_mutex_lock(&log_wait_lock);
+		pthread_cond_timedwait(&log_cond, &log_wait_lock, &abstime);
+		pthread_mutex_unlock(&log_wait_lock);
+	}
+	return NULL;
+}
+
+/* write out what is left when the process exits */
+static void log_flush(void)
+{
+	/* the writer may be blocked on the output, do not wait on it forever */
+	for (int i = 0; i < 50; i++) {
+		if (!pthread_mutex_trylock(&log_consume_lock)) {
+			log_drain();
+			log_repeats();
+			batch_flush();
+			pthread_mutex_unlock(&log_consume_lock);
+			return;
+		}
+		usleep(2000);
+	}
+}
+
+bool log_init(void)
+{
+	pthread_t pth;
+
+	ring = (struct log_slot *) calloc(LOG_SLOTS, sizeof(*ring));
+	if (!ring)
+		return false;
+	for (uint64_t i = 0; i < LOG_SLOTS; i++)
+		ring[i].seq = i;
+
+	if (pthread_create(&pth, NULL, log_thread, NULL)) {
+		free(ring);
+		ring = NULL;
+		return false;
+	}
+	pthread_detach(pth);
+	atexit(log_flush);
+	log_running = true;
+	return true;
+}
@@ -116,6 +116,8 @@ int LYRA2(void *K, int64_t kLen, const void *pwd, int32_t pwdlen, const void *sa
 	ptrByte += saltlen;
 
 	memset(ptrByte, 0, nBlocksInput * BLOCK_LEN_BLAKE2_SAFE_BYTES - (saltlen + pwdlen));
+	// v1 absorbs its 2nd block from BLOCK_LEN * 8 bytes on, which must read as zeros
+	memset((byte*)wholeMatrix + BLOCK_LEN * 8, 0, 64);
 
 	//Concatenates the basil: every integer passed as parameter, in the order they are provided by the interface
 	memcpy(ptrByte, &kLen, sizeof(int64_t));
@@ -197,12 +197,30 @@ void sha256_transform_8way(uint32_t *state, const uint32_t *block, int swap);
 #endif
 #endif
 
+/* intrinsic versions of the 4/8-way transforms, same interleaved layout */
+void sha256_transform_4way_intrin(uint32_t *state, const uint32_t *block, int swap);
+#ifndef SSE
+void sha256_transform_8way_intrin(uint32_t *state, const uint32_t *block, int swap);
+#endif
+
+#if defined(__x86_64__) && !defined(SSE) && (defined(__SHA__) || defined(_MSC_VER))
+#define HAVE_SHA256_SHANI 1
+int sha256_use_shani();
+void sha256_transform_shani(uint32_t *state, const uint32_t *block, int swap);
+#endif
+
 struct work;
 
 int scanhash_axiom(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done);
+int axiom_lanes(void);
 int scanhash_bastion(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done);
 int scanhash_blake(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done);
 int scanhash_blakecoin(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done);
+#ifndef SSE
+int blake256_scan_lanes(int thr_id, struct work *work, const uint32_t *pre_h,
+	const uint32_t *m, int nonce_w, bool swap, uint32_t bits, int rounds,
+	uint32_t *nonce, uint32_t max_nonce, uint64_t *hashes_done);
+#endif
 int scanhash_blake2s(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done);
 int scanhash_bmw(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done);
 int scanhash_cryptolight(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done);
@@ -224,14 +242,19 @@ int scanhash_nist5(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *
 int scanhash_pentablake(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done);
 int scanhash_pluck(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done,
 					unsigned char *scratchbuf, int N);
+int pluck_lanes(void);
 int scanhash_quark(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done);
 void init_quarkhash_contexts();
 int scanhash_qubit(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done);
 int scanhash_sha256d(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done);
+size_t scrypt_buffer_size(int N);
 unsigned char *scrypt_buffer_alloc(int N);
+int scrypt_throughput(void);
 int scanhash_scrypt(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done,
 					unsigned char *scratchbuf, uint32_t N);
 int scanhash_scryptjane(int Nfactor, int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done);
+size_t scryptjane_lane_bytes(int Nfactor, int *ways);
+void scryptjane_init(void);
 int scanhash_sib(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done);
 int scanhash_skein(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done);
 int scanhash_skein2(int thr_id, struct work *work, uint32_t max_nonce, uint64_t *hashes_done);
@@ -296,6 +319,7 @@ extern long opt_proxy_type;
 extern bool use_syslog;
 extern bool use_colors;
 extern pthread_mutex_t applog_lock;
+extern bool opt_log_json;
 extern struct thr_info *thr_info;
 extern int longpoll_thr_id;
 extern int stratum_thr_id;
@@ -305,6 +329,121 @@ extern struct work_restart *work_restart;
 extern uint32_t opt_work_size;
 extern double *thr_hashrates;
 extern uint64_t global_hashrate;
+
+/* stats.c */
+enum { STATS_10S, STATS_60S, STATS_15M, STATS_WINDOWS };
+struct thr_stats {
+	double rate[STATS_WINDOWS];	/* EWMA hashrates, H/s */
+	double min, max;		/* extremes of the 10s rate */
+	uint64_t hashes;
+};
+enum { SHARE_ACCEPTED, SHARE_REJECTED, SHARE_STALE };
+bool stats_init(int nthreads);
+void stats_record(int thr_id, uint64_t hashes, uint64_t usecs, uint64_t overhead_usecs);
+void stats_job_restart(void);
+void stats_job_switch(int thr_id);
+void stats_scratchpad(int64_t bytes);
+void stats_share(int result, double targetdiff, const char *reason, double rtt);
+int stats_share_kind(int result, const char *reason);
+char *stats_metrics(void);
+double stats_hashrate(int window);
+void stats_thr_get(int thr_id, struct thr_stats *st);
+double stats_effective_hashrate(void);
+struct energy_stats {
+	bool valid;
+	double joules[2];		/* RAPL package and core, since start */
+	double watts[STATS_WINDOWS];	/* package power */
+	double hpj[STATS_WINDOWS];	/* hashes per joule */
+};
+bool stats_energy(struct energy_stats *out);
+void stats_totals(uint64_t *hashes, double *joules, double *secs);
+
+/* journal.c */
+#define SHARE_AGES 9	/* job age buckets, the last one is +Inf */
+enum { STALE_POOL, STALE_LATE, STALE_QUEUED, STALE_IN_FLIGHT, STALE_CAUSES };
+struct share_ages {
+	const double *le;		/* upper bounds of the buckets, seconds */
+	uint64_t count[SHARE_AGES][3];	/* by job age at find, then SHARE_* */
+	double sum[3];			/* of the job ages, seconds */
+	uint64_t causes[STALE_CAUSES];	/* stale shares by when their job was replaced */
+};
+extern const char *stale_causes[STALE_CAUSES];
+bool journal_init(const char *path);
+void journal_job_restart(void);
+uint32_t journal_submit(const struct work *work, uint32_t nonce);
+void journal_discard(const struct work *work, uint32_t nonce);
+double journal_result(uint32_t id, int result, const char *reason, double *diff);
+void journal_ages(struct share_ages *out);
+char *journal_report(char *buf, size_t sz);
+
+/* governor.c */
+bool governor_init(int nthreads);
+bool governor_parked(int thr_id);
+void governor_select(const bool *run);
+int governor_cpu(int thr_id);
+char *governor_report(char *buf, size_t sz);
+
+/* tune.c */
+bool tune_init(int nthreads, int *lanes, int max_lanes, bool huge);
+bool tune_running(void);
+void tune_plan(int nthreads, size_t lane_bytes, int nlanes, int *lanes, int max_lanes, bool apply);
+
+/*
+ * Per-stage cycle counters, built with --enable-profile (HASH_PROFILE)
+ * and switched on with --profile. A hash function marks the start with
+ * PROF_START() and the end of each stage with PROF_STAGE(id, name). Ids
+ * are per algorithm; one id may close several stages, e.g. all the
+ * transposes.
+ */
+#define PROF_STAGES 16
+#ifdef HASH_PROFILE
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define prof_clock() __rdtsc()
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define prof_clock() __rdtsc()
+#else
+static inline uint64_t prof_clock(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+struct prof_counters {
+	const char *name[PROF_STAGES];
+	uint64_t cycles[PROF_STAGES];
+	uint64_t calls[PROF_STAGES];
+	uint64_t hashes;	/* from the miner loop, to get cycles per hash */
+	uint64_t scan_cycles;
+	char padding[128 - (3 * PROF_STAGES * 8 + 16) % 128];
+};
+extern bool opt_profile;
+extern __thread struct prof_counters *prof_thr;
+static inline void prof_stage(int id, const char *name, uint64_t *t)
+{
+	uint64_t now = prof_clock();
+	struct prof_counters *p = prof_thr;
+	if (p) {
+		p->name[id] = name;
+		p->cycles[id] += now - *t;
+		p->calls[id]++;
+	}
+	*t = now;
+}
+void prof_thread(int thr_id);
+void prof_scan(int thr_id, uint64_t hashes, uint64_t cycles);
+char *prof_report(char *buf, size_t sz);
+#define PROF_START()		uint64_t prof_t0 = opt_profile ? prof_clock() : 0
+#define PROF_STAGE(id, name)	do { if (opt_profile) prof_stage(id, name, &prof_t0); } while (0)
+#define PROF_SCAN(thr_id, hashes) \
+	do { if (opt_profile) prof_scan(thr_id, hashes, prof_clock() - prof_t0); } while (0)
+#else
+#define PROF_START()
+#define PROF_STAGE(id, name)	do {} while (0)
+#define PROF_SCAN(thr_id, hashes)	do {} while (0)
+#endif
 extern double stratum_diff;
 extern double net_diff;
 extern double net_hashrate;
@@ -347,6 +486,8 @@ extern double net_hashrate;
 #define CL_WHT  "\x1B[01;37m" /* white */
 
 void applog(int prio, const char *fmt, ...);
+bool applog_async(int prio, const char *fmt, va_list ap);
+bool log_init(void);
 void restart_threads(void);
 extern json_t *json_rpc_call(CURL *curl, const char *url, const char *userpass,
 	const char *rpc_req, int *curl_err, int flags);
@@ -358,6 +499,54 @@ int varint_encode(unsigned char *p, uint64_t n);
 size_t address_to_script(unsigned char *out, size_t outsz, const char *addr);
 int timeval_subtract(struct timeval *result, struct timeval *x, struct timeval *y);
 bool fulltest(const uint32_t *hash, const uint32_t *target);
+int fulltest_lanes(const uint32_t *hash, uint32_t mask, const uint32_t *target);
+
+/*
+ * Pre-filter for lane-parallel scanners: bitmask of the lanes (up to 32)
+ * whose high hash word, read at h7[l * stride] and byte swapped first if
+ * swap is set, is <= htarg. Only those lanes need fulltest.
+ */
+static inline uint32_t hash_lanes_le_target(const uint32_t *h7, int stride, int lanes,
+	uint32_t htarg, int swap)
+{
+	uint32_t mask = 0;
+	int l = 0;
+#ifndef SSE
+	const __m256i t8 = _mm256_set1_epi32((int)htarg);
+	const __m256i idx = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+		_mm256_set1_epi32(stride));
+	for (; l + 8 <= lanes; l += 8) {
+		__m256i h = stride == 1 ? _mm256_loadu_si256((const __m256i *)(h7 + l))
+			: _mm256_i32gather_epi32((const int *)(h7 + l * stride), idx, 4);
+		if (swap)
+			h = _mm256_shuffle_epi8(h, _mm256_set_epi64x(0x0c0d0e0f08090a0bULL,
+				0x0405060700010203ULL, 0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL));
+		h = _mm256_cmpeq_epi32(_mm256_min_epu32(h, t8), h);
+		mask |= (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(h)) << l;
+	}
+#endif
+	{
+		/* no unsigned compare in SSE2: flip the sign bits, h <= t is !(h > t) */
+		const __m128i bias = _mm_set1_epi32((int)0x80000000);
+		const __m128i t4 = _mm_xor_si128(_mm_set1_epi32((int)htarg), bias);
+		for (; l + 4 <= lanes; l += 4) {
+			__m128i h = _mm_setr_epi32((int)h7[l * stride], (int)h7[(l + 1) * stride],
+				(int)h7[(l + 2) * stride], (int)h7[(l + 3) * stride]);
+			if (swap)
+				h = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(h, 24), _mm_srli_epi32(h, 24)),
+					_mm_or_si128(_mm_and_si128(_mm_slli_epi32(h, 8), _mm_set1_epi32(0x00ff0000)),
+						_mm_and_si128(_mm_srli_epi32(h, 8), _mm_set1_epi32(0x0000ff00))));
+			h = _mm_cmpgt_epi32(_mm_xor_si128(h, bias), t4);
+			mask |= (uint32_t)(~_mm_movemask_ps(_mm_castsi128_ps(h)) & 0xf) << l;
+		}
+	}
+	for (; l < lanes; l++) {
+		uint32_t h = swap ? swab32(h7[l * stride]) : h7[l * stride];
+		if (h <= htarg)
+			mask |= 1U << l;
+	}
+	return mask;
+}
 void work_set_target(struct work* work, double diff);
 double target_to_diff(uint32_t* target);
 
@@ -365,9 +554,18 @@ double hash_target_ratio(uint32_t* hash, uint32_t* target);
 void work_set_target_ratio(struct work* work, uint32_t* hash);
 
 void get_currentalgo(char* buf, int sz);
+extern bool opt_hugepages;
+void *hugepage_alloc(size_t size);
+void hugepage_free(void *p, size_t size);
 bool has_aes_ni(void);
+bool has_ssse3(void);
+bool has_sha(void);
 void bestcpu_feature(char *outbuf, int maxsz);
 float cpu_temp(int core);
+bool cpu_energy(double *pkg, double *core);
+bool cpu_smt_sibling(int cpu);
+int cpu_cache(int cpu, int level, size_t *size, char *cpus, size_t sz);
+void cpu_getname(char *outbuf, size_t maxsz);
 
 struct work {
 	uint32_t data[48];
@@ -384,6 +582,10 @@ struct work {
 	char *job_id;
 	size_t xnonce2_len;
 	unsigned char *xnonce2;
+
+	struct timeval tv_job;		/* when the job arrived */
+	struct timeval tv_found;	/* when the nonce was found */
+	int thr_id;
 };
 
 struct stratum_job {
@@ -399,6 +601,7 @@ struct stratum_job {
 	unsigned char ntime[4];
 	bool clean;
 	double diff;
+	struct timeval tv_recv;
 };
 
 struct stratum_ctx {
@@ -438,6 +641,8 @@ bool stratum_handle_method(struct stratum_ctx *sctx, const char *s);
 /* rpc 2.0 (xmr) */
 extern bool jsonrpc_2;
 extern bool aes_ni_supported;
+extern int opt_cn_ways;
+extern int opt_yescrypt_ways;
 extern char rpc2_id[64];
 extern char *rpc2_blob;
 extern size_t rpc2_bloblen;
@@ -492,6 +697,7 @@ void inkhash(void *state, const void *input); /* shavite */
 void luffahash(void *output, const void *input);
 #ifndef SSE
 void lyra2_hash(void *state, const void *input, __m256i *wholeMatrix);
+void lyra2_hash_AVX(void *state, const void *input, __m256i *wholeMatrix, const void *pre_h);
 void lyra2rev2_hash(void *state, const void *input, __m256i *wholeMatrix, int32_t *flag, __m256i *wholeMatrix2);
 #else
 void lyra2_hash_SSE(void *state, const void *input, __m128i *wholeMatrix);
@@ -515,6 +721,9 @@ void x14hash(void *output, const void *input);
 void x15hash(void *output, const void *input);
 void zr5hash(void *output, const void *input);
 void yescrypthash(void *output, const void *input);
+int yescrypt_set_params(uint64_t N, uint32_t r, uint32_t p, const char *pers);
+size_t yescrypt_lane_bytes(void);
+int yescrypt_thread_init(int ways);
 void zr5hash_pok(void *output, uint32_t *pdata);
 
 void memrev(unsigned char *p, size_t len);
@@ -15,6 +15,7 @@ typedef uint32_t scrypt_mix_word_t;
 #include "scrypt-jane-mix_chacha-ssse3.h"
 #include "scrypt-jane-mix_chacha-sse2.h"
 #include "scrypt-jane-mix_chacha.h"
+#include "scrypt-jane-mix_chacha-avx2.h"
 
 #if defined(SCRYPT_CHACHA_AVX)
 	#define SCRYPT_CHUNKMIX_FN scrypt_ChunkMix_avx
@@ -23,6 +24,7 @@ typedef uint32_t scrypt_mix_word_t;
 		#define SCRYPT_CHUNKMIX_1_XOR_FN scrypt_ChunkMix_avx_1_xor
 	#endif
 	#define SCRYPT_ROMIX_FN scrypt_ROMix_avx
+	#define SCRYPT_ROMIX_1_FN scrypt_ROMix_1_avx
 	#define SCRYPT_MIX_FN chacha_core_avx
 	#define SCRYPT_ROMIX_TANGLE_FN scrypt_romix_nop
 	#define SCRYPT_ROMIX_UNTANGLE_FN scrypt_romix_nop
@@ -36,6 +38,7 @@ typedef uint32_t scrypt_mix_word_t;
 		#define SCRYPT_CHUNKMIX_1_XOR_FN scrypt_ChunkMix_ssse3_1_xor
 	#endif
 	#define SCRYPT_ROMIX_FN scrypt_ROMix_ssse3
+	#define SCRYPT_ROMIX_1_FN scrypt_ROMix_1_ssse3
 	#define SCRYPT_MIX_FN chacha_core_ssse3
 	#define SCRYPT_ROMIX_TANGLE_FN scrypt_romix_nop
 	#define SCRYPT_ROMIX_UNTANGLE_FN scrypt_romix_nop
@@ -49,6 +52,7 @@ typedef uint32_t scrypt_mix_word_t;
 		#define SCRYPT_CHUNKMIX_1_XOR_FN scrypt_ChunkMix_sse2_1_xor
 	#endif
 	#define SCRYPT_ROMIX_FN scrypt_ROMix_sse2
+	#define SCRYPT_ROMIX_1_FN scrypt_ROMix_1_sse2
 	#define SCRYPT_MIX_FN chacha_core_sse2
 	#define SCRYPT_ROMIX_TANGLE_FN scrypt_romix_nop
 	#define SCRYPT_ROMIX_UNTANGLE_FN scrypt_romix_nop
@@ -57,35 +61,36 @@ typedef uint32_t scrypt_mix_word_t;
 
 /* cpu agnostic */
 #define SCRYPT_ROMIX_FN scrypt_ROMix_basic
+#define SCRYPT_ROMIX_1_FN scrypt_ROMix_1_basic
 #define SCRYPT_MIX_FN chacha_core_basic
 #define SCRYPT_ROMIX_TANGLE_FN scrypt_romix_convert_endian
 #define SCRYPT_ROMIX_UNTANGLE_FN scrypt_romix_convert_endian
 #include "scrypt-jane-romix-template.h"
 
 #if !defined(SCRYPT_CHOOSE_COMPILETIME)
-static scrypt_ROMixfn
-scrypt_getROMix() {
+static scrypt_ROMix_1fn
+scrypt_getROMix_1() {
 	size_t cpuflags = detect_cpu();
 
 #if defined(SCRYPT_CHACHA_AVX)
 	if (cpuflags & cpu_avx)
-		return scrypt_ROMix_avx;
+		return scrypt_ROMix_1_avx;
 	else
 #endif
 
 #if defined(SCRYPT_CHACHA_SSSE3)
 	if (cpuflags & cpu_ssse3)
-		return scrypt_ROMix_ssse3;
+		return scrypt_ROMix_1_ssse3;
 	else
 #endif
 
 #if defined(SCRYPT_CHACHA_SSE2)
 	if (cpuflags & cpu_sse2)
-		return scrypt_ROMix_sse2;
+		return scrypt_ROMix_1_sse2;
 	else
 #endif
 
-	return scrypt_ROMix_basic;
+	return scrypt_ROMix_1_basic;
 }
 #endif
 
@@ -0,0 +1,155 @@
+/* 2-way intrinsic, r = 1: lane 0 in the low, lane 1 in the high 128 bits */
+#if defined(X86_INTRINSIC_AVX2) && defined(X86_INTRINSIC_SSSE3) && !defined(SCRYPT_CHACHA_AVX2_2WAY)
+
+#define SCRYPT_CHACHA_AVX2_2WAY
+
+#define CHACHA_2WAY_LOAD(p0, p1, k) \
+	_mm256_inserti128_si256(_mm256_castsi128_si256(((xmmi *)(p0))[k]), ((xmmi *)(p1))[k], 1)
+
+#define CHACHA_2WAY_XOR(p0, p1) { \
+	x0 = _mm256_xor_si256(x0, CHACHA_2WAY_LOAD(p0, p1, 0)); \
+	x1 = _mm256_xor_si256(x1, CHACHA_2WAY_LOAD(p0, p1, 1)); \
+	x2 = _mm256_xor_si256(x2, CHACHA_2WAY_LOAD(p0, p1, 2)); \
+	x3 = _mm256_xor_si256(x3, CHACHA_2WAY_LOAD(p0, p1, 3)); \
+}
+
+#define CHACHA_2WAY_STORE(p0, p1, k, x) { \
+	((xmmi *)(p0))[k] = _mm256_castsi256_si128(x); \
+	((xmmi *)(p1))[k] = _mm256_extracti128_si256(x, 1); \
+}
+
+/*
+ * Bout = ChunkMix(Bin ^ Bxor) for two independent chunks, r = 1.
+ * Bxor0/Bxor1 may be NULL (both or neither).
+ */
+static void NOINLINE
+scrypt_ChunkMix_avx2_1_2way(uint32_t *Bout0, uint32_t *Bout1, uint32_t *Bin0, uint32_t *Bin1, uint32_t *Bxor0, uint32_t *Bxor1) {
+	const uint32_t r = 1;
+	uint32_t i, blocksPerChunk = r * 2, half = 0;
+	__m256i x0,x1,x2,x3,x6,t0,t1,t2,t3;
+	const __m256i x4 = _mm256_broadcastsi128_si256(*(xmmi *)&ssse3_rotl16_32bit);
+	const __m256i x5 = _mm256_broadcastsi128_si256(*(xmmi *)&ssse3_rotl8_32bit);
+	size_t rounds;
+
+	/* 1: X = B_{2r - 1} */
+	x0 = CHACHA_2WAY_LOAD(scrypt_block(Bin0, blocksPerChunk - 1), scrypt_block(Bin1, blocksPerChunk - 1), 0);
+	x1 = CHACHA_2WAY_LOAD(scrypt_block(Bin0, blocksPerChunk - 1), scrypt_block(Bin1, blocksPerChunk - 1), 1);
+	x2 = CHACHA_2WAY_LOAD(scrypt_block(Bin0, blocksPerChunk - 1), scrypt_block(Bin1, blocksPerChunk - 1), 2);
+	x3 = CHACHA_2WAY_LOAD(scrypt_block(Bin0, blocksPerChunk - 1), scrypt_block(Bin1, blocksPerChunk - 1), 3);
+
+	if (Bxor0)
+		CHACHA_2WAY_XOR(scrypt_block(Bxor0, blocksPerChunk - 1), scrypt_block(Bxor1, blocksPerChunk - 1));
+
+	/* 2: for i = 0 to 2r - 1 do */
+	for (i = 0; i < blocksPerChunk; i++, half ^= r) {
+		/* 3: X = H(X ^ B_i) */
+		CHACHA_2WAY_XOR(scrypt_block(Bin0, i), scrypt_block(Bin1, i));
+
+		if (Bxor0)
+			CHACHA_2WAY_XOR(scrypt_block(Bxor0, i), scrypt_block(Bxor1, i));
+
+		t0 = x0;
+		t1 = x1;
+		t2 = x2;
+		t3 = x3;
+
+		for (rounds = 8; rounds; rounds -= 2) {
+			x0 = _mm256_add_epi32(x0, x1);
+			x3 = _mm256_xor_si256(x3, x0);
+			x3 = _mm256_shuffle_epi8(x3, x4);
+			x2 = _mm256_add_epi32(x2, x3);
+			x1 = _mm256_xor_si256(x1, x2);
+			x6 = _mm256_srli_epi32(x1, 20);
+			x1 = _mm256_slli_epi32(x1, 12);
+			x1 = _mm256_or_si256(x1, x6);
+			x0 = _mm256_add_epi32(x0, x1);
+			x3 = _mm256_xor_si256(x3, x0);
+			x3 = _mm256_shuffle_epi8(x3, x5);
+			x0 = _mm256_shuffle_epi32(x0, 0x93);
+			x2 = _mm256_add_epi32(x2, x3);
+			x3 = _mm256_shuffle_epi32(x3, 0x4e);
+			x1 = _mm256_xor_si256(x1, x2);
+			x2 = _mm256_shuffle_epi32(x2, 0x39);
+			x6 = _mm256_srli_epi32(x1, 25);
+			x1 = _mm256_slli_epi32(x1, 7);
+			x1 = _mm256_or_si256(x1, x6);
+			x0 = _mm256_add_epi32(x0, x1);
+			x3 = _mm256_xor_si256(x3, x0);
+			x3 = _mm256_shuffle_epi8(x3, x4);
+			x2 = _mm256_add_epi32(x2, x3);
+			x1 = _mm256_xor_si256(x1, x2);
+			x6 = _mm256_srli_epi32(x1, 20);
+			x1 = _mm256_slli_epi32(x1, 12);
+			x1 = _mm256_or_si256(x1, x6);
+			x0 = _mm256_add_epi32(x0, x1);
+			x3 = _mm256_xor_si256(x3, x0);
+			x3 = _mm256_shuffle_epi8(x3, x5);
+			x0 = _mm256_shuffle_epi32(x0, 0x39);
+			x2 = _mm256_add_epi32(x2, x3);
+			x3 = _mm256_shuffle_epi32(x3, 0x4e);
+			x1 = _mm256_xor_si256(x1, x2);
+			x2 = _mm256_shuffle_epi32(x2, 0x93);
+			x6 = _mm256_srli_epi32(x1, 25);
+			x1 = _mm256_slli_epi32(x1, 7);
+			x1 = _mm256_or_si256(x1, x6);
+		}
+
+		x0 = _mm256_add_epi32(x0, t0);
+		x1 = _mm256_add_epi32(x1, t1);
+		x2 = _mm256_add_epi32(x2, t2);
+		x3 = _mm256_add_epi32(x3, t3);
+
+		/* 4: Y_i = X */
+		/* 6: B'[0..r-1] = Y_even */
+		/* 6: B'[r..2r-1] = Y_odd */
+		CHACHA_2WAY_STORE(scrypt_block(Bout0, (i / 2) + half), scrypt_block(Bout1, (i / 2) + half), 0, x0);
+		CHACHA_2WAY_STORE(scrypt_block(Bout0, (i / 2) + half), scrypt_block(Bout1, (i / 2) + half), 1, x1);
+		CHACHA_2WAY_STORE(scrypt_block(Bout0, (i / 2) + half), scrypt_block(Bout1, (i / 2) + half), 2, x2);
+		CHACHA_2WAY_STORE(scrypt_block(Bout0, (i / 2) + half), scrypt_block(Bout1, (i / 2) + half), 3, x3);
+	}
+}
+
+#undef CHACHA_2WAY_LOAD
+#undef CHACHA_2WAY_XOR
+#undef CHACHA_2WAY_STORE
+
+/*
+ * ROMix with r = 1 over two independent chunks X0 and X1, each with its
+ * own scratch chunk and its own V of N chunks.
+ */
+static void NOINLINE FASTCALL
+scrypt_ROMix_1_avx2_2way(scrypt_mix_word_t *X0, scrypt_mix_word_t *X1, scrypt_mix_word_t *Y0, scrypt_mix_word_t *Y1,
+	scrypt_mix_word_t *V0, scrypt_mix_word_t *V1, uint32_t N) {
+	const uint32_t r = 1;
+	uint32_t i, j0, j1, chunkWords = SCRYPT_BLOCK_WORDS * r * 2;
+	scrypt_mix_word_t *block0 = V0, *block1 = V1;
+
+	/* 2: for i = 0 to N - 1 do */
+	memcpy(block0, X0, chunkWords * sizeof(scrypt_mix_word_t));
+	memcpy(block1, X1, chunkWords * sizeof(scrypt_mix_word_t));
+	for (i = 0; i < N - 1; i++, block0 += chunkWords, block1 += chunkWords) {
+		/* 3: V_i = X */
+		/* 4: X = H(X) */
+		scrypt_ChunkMix_avx2_1_2way(block0 + chunkWords, block1 + chunkWords, block0, block1, NULL, NULL);
+	}
+	scrypt_ChunkMix_avx2_1_2way(X0, X1, block0, block1, NULL, NULL);
+
+	/* 6: for i = 0 to N - 1 do */
+	for (i = 0; i < N; i += 2) {
+		/* 7: j = Integerify(X) % N */
+		j0 = X0[chunkWords - SCRYPT_BLOCK_WORDS] & (N - 1);
+		j1 = X1[chunkWords - SCRYPT_BLOCK_WORDS] & (N - 1);
+
+		/* 8: X = H(Y ^ V_j) */
+		scrypt_ChunkMix_avx2_1_2way(Y0, Y1, X0, X1, scrypt_item(V0, j0, chunkWords), scrypt_item(V1, j1, chunkWords));
+
+		/* 7: j = Integerify(Y) % N */
+		j0 = Y0[chunkWords - SCRYPT_BLOCK_WORDS] & (N - 1);
+		j1 = Y1[chunkWords - SCRYPT_BLOCK_WORDS] & (N - 1);
+
+		/* 8: X = H(Y ^ V_j) */
+		scrypt_ChunkMix_avx2_1_2way(X0, X1, Y0, Y1, scrypt_item(V0, j0, chunkWords), scrypt_item(V1, j1, chunkWords));
+	}
+}
+
+#endif
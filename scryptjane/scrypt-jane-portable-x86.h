@@ -49,6 +49,10 @@
 #define X86_INTRINSIC_AVX
 #endif
 
+#ifdef __AVX2__
+#define X86_INTRINSIC_AVX2
+#endif
+
 #if defined(COMPILER_GCC) && defined(CPU_X86_FORCE_INTRINSICS)
 	#define X86_INTRINSIC
 	#if defined(__SSE__)
@@ -271,12 +275,12 @@ get_cpuid(x86_regs *regs, uint32_t flags) {
 		a2(mov [%1 + 8], ecx)
 		a2(mov [%1 + 12], edx)
 		a1(pop cpuid_bx)
-		asm_gcc_parms() : "+a"(flags) : "S"(regs)  : "%ecx", "%edx", "cc"
+		asm_gcc_parms() : "+a"(flags) : "S"(regs)  : "%ecx", "%edx", "cc", "memory"
 	asm_gcc_end()
 #endif
 }
 
-#if defined(X86ASM_AVX) || defined(X86_64ASM_AVX)
+#if defined(X86ASM_AVX) || defined(X86_64ASM_AVX) || defined(X86_INTRINSIC_AVX)
 static uint64_t NOINLINE
 get_xgetbv(uint32_t flags) {
 #if defined(COMPILER_MSVC)
@@ -303,7 +307,7 @@ detect_cpu(void) {
 	x86_regs regs;
 	uint32_t max_level;
 	size_t cpu_flags = 0;
-#if defined(X86ASM_AVX) || defined(X86_64ASM_AVX)
+#if defined(X86ASM_AVX) || defined(X86_64ASM_AVX) || defined(X86_INTRINSIC_AVX)
 	uint64_t xgetbv_flags;
 #endif
 
@@ -333,7 +337,7 @@ detect_cpu(void) {
 		return cpu_flags;
 
 	get_cpuid(&regs, 1);
-#if defined(X86ASM_AVX) || defined(X86_64ASM_AVX)
+#if defined(X86ASM_AVX) || defined(X86_64ASM_AVX) || defined(X86_INTRINSIC_AVX)
 	/* xsave/xrestore */
 	if (regs.ecx & (1 << 27)) {
 		xgetbv_flags = get_xgetbv(0);
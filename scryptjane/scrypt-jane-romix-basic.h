@@ -1,6 +1,8 @@
 #if !defined(SCRYPT_CHOOSE_COMPILETIME)
 /* function type returned by scrypt_getROMix, used with cpu detection */
 typedef void (FASTCALL *scrypt_ROMixfn)(scrypt_mix_word_t *X/*[chunkWords]*/, scrypt_mix_word_t *Y/*[chunkWords]*/, scrypt_mix_word_t *V/*[chunkWords * N]*/, uint32_t N, uint32_t r);
+/* same with r = 1 hard-coded, returned by scrypt_getROMix_1 */
+typedef void (FASTCALL *scrypt_ROMix_1fn)(scrypt_mix_word_t *X/*[chunkWords]*/, scrypt_mix_word_t *Y/*[chunkWords]*/, scrypt_mix_word_t *V/*[chunkWords * N]*/, uint32_t N);
 #endif
 
 /* romix pre/post nop function */
@@ -3,6 +3,12 @@
 #if defined(SCRYPT_CHOOSE_COMPILETIME)
 #undef SCRYPT_ROMIX_FN
 #define SCRYPT_ROMIX_FN scrypt_ROMix
+#undef SCRYPT_ROMIX_1_FN
+#define SCRYPT_ROMIX_1_FN scrypt_ROMix_1
+#endif
+
+#if !defined(SCRYPT_ROMIX_1_FN)
+#define SCRYPT_ROMIX_1_FN scrypt_ROMix_1
 #endif
 
 #undef SCRYPT_HAVE_ROMIX
@@ -67,6 +73,7 @@ SCRYPT_CHUNKMIX_FN(scrypt_mix_word_t *Bout/*[chunkWords]*/, scrypt_mix_word_t *B
 	2*r: number of blocks in a chunk
 */
 
+#if !defined(SCRYPT_ROMIX_1_ONLY)
 static void NOINLINE FASTCALL
 SCRYPT_ROMIX_FN(scrypt_mix_word_t *X/*[chunkWords]*/, scrypt_mix_word_t *Y/*[chunkWords]*/, scrypt_mix_word_t *V/*[N * chunkWords]*/, uint32_t N, uint32_t r) {
 	uint32_t i, j, chunkWords = SCRYPT_BLOCK_WORDS * r * 2;
@@ -106,13 +113,14 @@ SCRYPT_ROMIX_FN(scrypt_mix_word_t *X/*[chunkWords]*/, scrypt_mix_word_t *Y/*[chu
 
 	SCRYPT_ROMIX_UNTANGLE_FN(X, r * 2);
 }
+#endif /* !defined(SCRYPT_ROMIX_1_ONLY) */
 
 /*
  * Special version with hard-coded r = 1
  *  - mikaelh
  */
 static void NOINLINE FASTCALL
-scrypt_ROMix_1(scrypt_mix_word_t *X/*[chunkWords]*/, scrypt_mix_word_t *Y/*[chunkWords]*/, scrypt_mix_word_t *V/*[N * chunkWords]*/, uint32_t N) {
+SCRYPT_ROMIX_1_FN(scrypt_mix_word_t *X/*[chunkWords]*/, scrypt_mix_word_t *Y/*[chunkWords]*/, scrypt_mix_word_t *V/*[N * chunkWords]*/, uint32_t N) {
 	const uint32_t r = 1;
 	uint32_t i, j, chunkWords = SCRYPT_BLOCK_WORDS * r * 2;
 	scrypt_mix_word_t *block = V;
@@ -172,7 +180,10 @@ scrypt_ROMix_1(scrypt_mix_word_t *X/*[chunkWords]*/, scrypt_mix_word_t *Y/*[chun
 
 
 #undef SCRYPT_CHUNKMIX_FN
+#undef SCRYPT_CHUNKMIX_1_FN
+#undef SCRYPT_CHUNKMIX_1_XOR_FN
 #undef SCRYPT_ROMIX_FN
+#undef SCRYPT_ROMIX_1_FN
 #undef SCRYPT_MIX_FN
 #undef SCRYPT_ROMIX_TANGLE_FN
 #undef SCRYPT_ROMIX_UNTANGLE_FN
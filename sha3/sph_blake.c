@@ -1286,6 +1286,164 @@ sph_blake256_80_AVX(void *cc, const void *data, size_t len, void* pre_h)
 	_mm256_zeroupper();
 }
 
+/*
+ * Last block of BLAKE-256 for 8 nonces at once, the 14 round function or
+ * the 8 round one of Blakecoin.  pre_h is the chaining value before the
+ * block and data its 16 padded message words, in host order, except for
+ * word nonce_w which comes from nonce_m[lane].  bits is the message length
+ * in bits, and the block must hold some of the message.  Hash word i of
+ * each lane goes, as sph_blake256_close() would write it, to
+ * ((uint32_t*)cc)[8 * i + lane].  Returns the mask of the lanes with hash
+ * word 7 <= htarg.
+ */
+#define ROT16_AVX _mm256_set_epi8(13,12,15,14, 9,8,11,10, 5,4,7,6, 1,0,3,2, \
+	13,12,15,14, 9,8,11,10, 5,4,7,6, 1,0,3,2)
+#define ROT8_AVX _mm256_set_epi8(12,15,14,13, 8,11,10,9, 4,7,6,5, 0,3,2,1, \
+	12,15,14,13, 8,11,10,9, 4,7,6,5, 0,3,2,1)
+
+#define GS_8WAY(a,b,c,d,x,r) { \
+	v[a] = _mm256_add_epi32(_mm256_add_epi32(v[a], v[b]), \
+		_mm256_xor_si256(m[sigma[r][x]], _mm256_set1_epi32(u256[sigma[r][(x)+1]]))); \
+	v[d] = _mm256_shuffle_epi8(_mm256_xor_si256(v[d], v[a]), ROT16_AVX); \
+	v[c] = _mm256_add_epi32(v[c], v[d]); \
+	v[b] = ROTR32_AVX(_mm256_xor_si256(v[b], v[c]), 12); \
+	v[a] = _mm256_add_epi32(_mm256_add_epi32(v[a], v[b]), \
+		_mm256_xor_si256(m[sigma[r][(x)+1]], _mm256_set1_epi32(u256[sigma[r][x]]))); \
+	v[d] = _mm256_shuffle_epi8(_mm256_xor_si256(v[d], v[a]), ROT8_AVX); \
+	v[c] = _mm256_add_epi32(v[c], v[d]); \
+	v[b] = ROTR32_AVX(_mm256_xor_si256(v[b], v[c]), 7); \
+}
+
+#define ROUND_8WAY(r) \
+	GS_8WAY(0, 4, 0x8, 0xC, 0x0, r); \
+	GS_8WAY(1, 5, 0x9, 0xD, 0x2, r); \
+	GS_8WAY(2, 6, 0xA, 0xE, 0x4, r); \
+	GS_8WAY(3, 7, 0xB, 0xF, 0x6, r); \
+	GS_8WAY(0, 5, 0xA, 0xF, 0x8, r); \
+	GS_8WAY(1, 6, 0xB, 0xC, 0xA, r); \
+	GS_8WAY(2, 7, 0x8, 0xD, 0xC, r); \
+	GS_8WAY(3, 4, 0x9, 0xE, 0xE, r);
+
+int
+sph_blake256_final_8way(void *cc, const void *pre_h, const uint32_t *data,
+	int nonce_w, const uint32_t *nonce_m, uint32_t bits, int rounds,
+	uint32_t htarg)
+{
+	__m256i m[16];
+	__m256i v[16];
+	__m256i h7;
+	int i;
+
+	for (i = 0; i < 16; i++)
+		m[i] = _mm256_set1_epi32(data[i]);
+	m[nonce_w] = _mm256_loadu_si256((const __m256i*) nonce_m);
+
+	for (i = 0; i < 8; i++)
+		v[i] = _mm256_set1_epi32(((const uint32_t*)pre_h)[i]);
+	v[8] = _mm256_set1_epi32(u256[0]);
+	v[9] = _mm256_set1_epi32(u256[1]);
+	v[10] = _mm256_set1_epi32(u256[2]);
+	v[11] = _mm256_set1_epi32(u256[3]);
+	v[12] = _mm256_set1_epi32(u256[4] ^ bits);
+	v[13] = _mm256_set1_epi32(u256[5] ^ bits);
+	v[14] = _mm256_set1_epi32(u256[6]);
+	v[15] = _mm256_set1_epi32(u256[7]);
+
+	ROUND_8WAY(0); ROUND_8WAY(1); ROUND_8WAY(2); ROUND_8WAY(3);
+	ROUND_8WAY(4); ROUND_8WAY(5); ROUND_8WAY(6); ROUND_8WAY(7);
+	if (rounds == 14) {
+		ROUND_8WAY(8); ROUND_8WAY(9); ROUND_8WAY(10);
+		ROUND_8WAY(11); ROUND_8WAY(12); ROUND_8WAY(13);
+	}
+
+	for (i = 0; i < 8; i++) {
+		__m256i h = _mm256_xor_si256(_mm256_set1_epi32(((const uint32_t*)pre_h)[i]),
+			_mm256_xor_si256(v[i], v[i + 8]));
+		((__m256i*)cc)[i] = bswap32_AVX(h);
+	}
+
+	/* unsigned h7 <= htarg */
+	h7 = ((__m256i*)cc)[7];
+	h7 = _mm256_cmpeq_epi32(_mm256_max_epu32(h7, _mm256_set1_epi32(htarg)),
+		_mm256_set1_epi32(htarg));
+	i = _mm256_movemask_ps(_mm256_castsi256_ps(h7));
+
+	_mm256_zeroupper();
+	return i;
+}
+
+#ifdef __AVX512F__
+
+#define GS_16WAY(a,b,c,d,x,r) { \
+	v[a] = _mm512_add_epi32(_mm512_add_epi32(v[a], v[b]), \
+		_mm512_xor_si512(m[sigma[r][x]], _mm512_set1_epi32(u256[sigma[r][(x)+1]]))); \
+	v[d] = _mm512_ror_epi32(_mm512_xor_si512(v[d], v[a]), 16); \
+	v[c] = _mm512_add_epi32(v[c], v[d]); \
+	v[b] = _mm512_ror_epi32(_mm512_xor_si512(v[b], v[c]), 12); \
+	v[a] = _mm512_add_epi32(_mm512_add_epi32(v[a], v[b]), \
+		_mm512_xor_si512(m[sigma[r][(x)+1]], _mm512_set1_epi32(u256[sigma[r][x]]))); \
+	v[d] = _mm512_ror_epi32(_mm512_xor_si512(v[d], v[a]), 8); \
+	v[c] = _mm512_add_epi32(v[c], v[d]); \
+	v[b] = _mm512_ror_epi32(_mm512_xor_si512(v[b], v[c]), 7); \
+}
+
+#define ROUND_16WAY(r) \
+	GS_16WAY(0, 4, 0x8, 0xC, 0x0, r); \
+	GS_16WAY(1, 5, 0x9, 0xD, 0x2, r); \
+	GS_16WAY(2, 6, 0xA, 0xE, 0x4, r); \
+	GS_16WAY(3, 7, 0xB, 0xF, 0x6, r); \
+	GS_16WAY(0, 5, 0xA, 0xF, 0x8, r); \
+	GS_16WAY(1, 6, 0xB, 0xC, 0xA, r); \
+	GS_16WAY(2, 7, 0x8, 0xD, 0xC, r); \
+	GS_16WAY(3, 4, 0x9, 0xE, 0xE, r);
+
+/* As sph_blake256_final_8way(), for 16 nonces: cc[16 * i + lane] */
+int
+sph_blake256_final_16way(void *cc, const void *pre_h, const uint32_t *data,
+	int nonce_w, const uint32_t *nonce_m, uint32_t bits, int rounds,
+	uint32_t htarg)
+{
+	const __m512i bswap = _mm512_broadcast_i32x4(
+		_mm_set_epi8(12,13,14,15, 8,9,10,11, 4,5,6,7, 0,1,2,3));
+	__m512i m[16];
+	__m512i v[16];
+	int i;
+
+	for (i = 0; i < 16; i++)
+		m[i] = _mm512_set1_epi32(data[i]);
+	m[nonce_w] = _mm512_loadu_si512(nonce_m);
+
+	for (i = 0; i < 8; i++)
+		v[i] = _mm512_set1_epi32(((const uint32_t*)pre_h)[i]);
+	v[8] = _mm512_set1_epi32(u256[0]);
+	v[9] = _mm512_set1_epi32(u256[1]);
+	v[10] = _mm512_set1_epi32(u256[2]);
+	v[11] = _mm512_set1_epi32(u256[3]);
+	v[12] = _mm512_set1_epi32(u256[4] ^ bits);
+	v[13] = _mm512_set1_epi32(u256[5] ^ bits);
+	v[14] = _mm512_set1_epi32(u256[6]);
+	v[15] = _mm512_set1_epi32(u256[7]);
+
+	ROUND_16WAY(0); ROUND_16WAY(1); ROUND_16WAY(2); ROUND_16WAY(3);
+	ROUND_16WAY(4); ROUND_16WAY(5); ROUND_16WAY(6); ROUND_16WAY(7);
+	if (rounds == 14) {
+		ROUND_16WAY(8); ROUND_16WAY(9); ROUND_16WAY(10);
+		ROUND_16WAY(11); ROUND_16WAY(12); ROUND_16WAY(13);
+	}
+
+	for (i = 0; i < 8; i++) {
+		__m512i h = _mm512_xor_si512(_mm512_set1_epi32(((const uint32_t*)pre_h)[i]),
+			_mm512_xor_si512(v[i], v[i + 8]));
+		((__m512i*)cc)[i] = _mm512_shuffle_epi8(h, bswap);
+	}
+
+	i = (int) _mm512_cmple_epu32_mask(((__m512i*)cc)[7], _mm512_set1_epi32(htarg));
+	_mm256_zeroupper();
+	return i;
+}
+
+#endif /* __AVX512F__ */
+
 #else
 
 #define ROTR32_SSE2(a,b) _mm_or_si128(_mm_srli_epi32(a,b),_mm_slli_epi32(a,32-(b)))
@@ -212,6 +212,14 @@ void sph_blake256_80_init(void *cc, const void *data, size_t len);
 void sph_blake256_80(void *cc, const void *data, size_t len, const void *pre_h);
 #ifndef SSE
 void sph_blake256_80_AVX(void *cc, const void *data, size_t len, const void *pre_h);
+int sph_blake256_final_8way(void *cc, const void *pre_h, const uint32_t *data,
+	int nonce_w, const uint32_t *nonce_m, uint32_t bits, int rounds,
+	uint32_t htarg);
+#ifdef __AVX512F__
+int sph_blake256_final_16way(void *cc, const void *pre_h, const uint32_t *data,
+	int nonce_w, const uint32_t *nonce_m, uint32_t bits, int rounds,
+	uint32_t htarg);
+#endif
 #else
 void sph_blake256_80_SSE2(void *cc, const void *data, size_t len, const void *pre_h);
 #endif
@@ -3114,6 +3114,188 @@ sph_groestl512_addbits_and_close(void *cc, unsigned ub, unsigned n, void *dst)
 	groestl_big_close(cc, ub, n, dst, 64);
 }
 
+/*
+ * Built in every AVX2 build (no SSE define) whatever -maes says, MSVC never
+ * defining __AES__; callers pick it at runtime with has_aes_ni().
+ */
+#if !defined(SSE) && (defined(_MSC_VER) || defined(__GNUC__))
+#include <immintrin.h>
+
+#if defined(_MSC_VER)
+#define GROESTL_ALIGN16 __declspec(align(16))
+#define GROESTL_AES_TARGET
+#else
+#define GROESTL_ALIGN16 __attribute__((aligned(16)))
+#define GROESTL_AES_TARGET __attribute__((target("aes,ssse3")))
+#endif
+
+/*
+ * Groestl-256 of two 32-byte messages with AES-NI.  The state is kept as
+ * its 8 rows, xmm i holding row i of two permutations side by side: P in
+ * the low and Q in the high 8 bytes for the compression, two P for the
+ * output transformation.  SubBytes is AESENCLAST with a zero key, the
+ * PSHUFB ahead of it undoing ShiftRows and applying ShiftBytes.
+ */
+static const uint8_t groestl_shuf_pq[8][16] GROESTL_ALIGN16 = {
+	{  0, 14, 11,  7,  4,  1, 15, 12,  9,  5,  2,  8, 13, 10,  6,  3 },
+	{  1,  8, 13,  0,  5,  2,  9, 14, 11,  6,  3, 10, 15, 12,  7,  4 },
+	{  2, 10, 15,  1,  6,  3, 11,  8, 13,  7,  4, 12,  9, 14,  0,  5 },
+	{  3, 12,  9,  2,  7,  4, 13, 10, 15,  0,  5, 14, 11,  8,  1,  6 },
+	{  4, 13, 10,  3,  0,  5, 14, 11,  8,  1,  6, 15, 12,  9,  2,  7 },
+	{  5, 15, 12,  4,  1,  6,  8, 13, 10,  2,  7,  9, 14, 11,  3,  0 },
+	{  6,  9, 14,  5,  2,  7, 10, 15, 12,  3,  0, 11,  8, 13,  4,  1 },
+	{  7, 11,  8,  6,  3,  0, 12,  9, 14,  4,  1, 13, 10, 15,  5,  2 },
+};
+
+static const uint8_t groestl_shuf_pp[8][16] GROESTL_ALIGN16 = {
+	{  0, 13, 10,  7,  4,  1, 14, 11,  8,  5,  2, 15, 12,  9,  6,  3 },
+	{  1, 14, 11,  0,  5,  2, 15, 12,  9,  6,  3,  8, 13, 10,  7,  4 },
+	{  2, 15, 12,  1,  6,  3,  8, 13, 10,  7,  4,  9, 14, 11,  0,  5 },
+	{  3,  8, 13,  2,  7,  4,  9, 14, 11,  0,  5, 10, 15, 12,  1,  6 },
+	{  4,  9, 14,  3,  0,  5, 10, 15, 12,  1,  6, 11,  8, 13,  2,  7 },
+	{  5, 10, 15,  4,  1,  6, 11,  8, 13,  2,  7, 12,  9, 14,  3,  0 },
+	{  6, 11,  8,  5,  2,  7, 12,  9, 14,  3,  0, 13, 10, 15,  4,  1 },
+	{  7, 12,  9,  6,  3,  0, 13, 10, 15,  4,  1, 14, 11,  8,  5,  2 },
+};
+
+/* byte-wise multiplication by 2 in GF(2^8) mod 0x11b */
+#define GROESTL_MUL2(x) _mm_xor_si128(_mm_add_epi8(x, x), \
+	_mm_and_si128(_mm_cmpgt_epi8(_mm_setzero_si128(), x), _mm_set1_epi8(0x1b)))
+
+#define GROESTL_SUB_SHIFT(i) \
+	a[i] = _mm_aesenclast_si128(_mm_shuffle_epi8(x[i], \
+		_mm_load_si128((const __m128i *)shuf[i])), _mm_setzero_si128())
+
+/* row i = 2a_i ^ 2a_i+1 ^ 3a_i+2 ^ 4a_i+3 ^ 5a_i+4 ^ 3a_i+5 ^ 5a_i+6 ^ 7a_i+7 */
+#define GROESTL_MIX(i) { \
+	__m128i s1, s2, s4, t; \
+	s4 = _mm_xor_si128(_mm_xor_si128(a[(i + 3) & 7], a[(i + 4) & 7]), \
+		_mm_xor_si128(a[(i + 6) & 7], a[(i + 7) & 7])); \
+	s2 = _mm_xor_si128(_mm_xor_si128(a[i], a[(i + 1) & 7]), \
+		_mm_xor_si128(_mm_xor_si128(a[(i + 2) & 7], a[(i + 5) & 7]), a[(i + 7) & 7])); \
+	s1 = _mm_xor_si128(_mm_xor_si128(a[(i + 2) & 7], a[(i + 4) & 7]), \
+		_mm_xor_si128(_mm_xor_si128(a[(i + 5) & 7], a[(i + 6) & 7]), a[(i + 7) & 7])); \
+	t = _mm_xor_si128(s2, GROESTL_MUL2(s4)); \
+	x[i] = _mm_xor_si128(s1, GROESTL_MUL2(t)); \
+}
+
+/*
+ * 10 rounds over the rows x[0..7].  c0, cm and c7 are the round constants
+ * of rows 0, 1 to 6 and 7 for round 0; r0 and r7 select the bytes of rows 0
+ * and 7 which also take the round number.
+ */
+static inline void GROESTL_AES_TARGET
+groestl_perm_aes(__m128i *x, const uint8_t (*shuf)[16],
+	__m128i c0, __m128i cm, __m128i c7, __m128i r0, __m128i r7)
+{
+	__m128i a[8];
+	int r;
+
+	for (r = 0; r < 10; r++) {
+		__m128i rc = _mm_set1_epi8((char)r);
+
+		/* AddRoundConstant */
+		x[0] = _mm_xor_si128(x[0], _mm_xor_si128(c0, _mm_and_si128(rc, r0)));
+		x[1] = _mm_xor_si128(x[1], cm);
+		x[2] = _mm_xor_si128(x[2], cm);
+		x[3] = _mm_xor_si128(x[3], cm);
+		x[4] = _mm_xor_si128(x[4], cm);
+		x[5] = _mm_xor_si128(x[5], cm);
+		x[6] = _mm_xor_si128(x[6], cm);
+		x[7] = _mm_xor_si128(x[7], _mm_xor_si128(c7, _mm_and_si128(rc, r7)));
+
+		/* SubBytes, ShiftBytes */
+		GROESTL_SUB_SHIFT(0); GROESTL_SUB_SHIFT(1);
+		GROESTL_SUB_SHIFT(2); GROESTL_SUB_SHIFT(3);
+		GROESTL_SUB_SHIFT(4); GROESTL_SUB_SHIFT(5);
+		GROESTL_SUB_SHIFT(6); GROESTL_SUB_SHIFT(7);
+
+		/* MixBytes */
+		GROESTL_MIX(0); GROESTL_MIX(1); GROESTL_MIX(2); GROESTL_MIX(3);
+		GROESTL_MIX(4); GROESTL_MIX(5); GROESTL_MIX(6); GROESTL_MIX(7);
+	}
+}
+
+#undef GROESTL_SUB_SHIFT
+#undef GROESTL_MIX
+#undef GROESTL_MUL2
+
+/* 8x8 byte transpose: columns (0|1) .. (6|7) to rows (0|1) .. (6|7), and back */
+static inline void GROESTL_AES_TARGET
+groestl_transpose_aes(__m128i *v)
+{
+	__m128i t0, t1, t2, t3, u0, u1, u2, u3;
+
+	t0 = _mm_unpacklo_epi8(v[0], _mm_srli_si128(v[0], 8));
+	t1 = _mm_unpacklo_epi8(v[1], _mm_srli_si128(v[1], 8));
+	t2 = _mm_unpacklo_epi8(v[2], _mm_srli_si128(v[2], 8));
+	t3 = _mm_unpacklo_epi8(v[3], _mm_srli_si128(v[3], 8));
+	u0 = _mm_unpacklo_epi16(t0, t1);
+	u1 = _mm_unpackhi_epi16(t0, t1);
+	u2 = _mm_unpacklo_epi16(t2, t3);
+	u3 = _mm_unpackhi_epi16(t2, t3);
+	v[0] = _mm_unpacklo_epi32(u0, u2);
+	v[1] = _mm_unpackhi_epi32(u0, u2);
+	v[2] = _mm_unpacklo_epi32(u1, u3);
+	v[3] = _mm_unpackhi_epi32(u1, u3);
+}
+
+/* see sph_groestl.h */
+void GROESTL_AES_TARGET
+sph_groestl256_32_AES(void *cc, const void *data, size_t len)
+{
+	const __m128i lo = _mm_set_epi32(0, 0, -1, -1);
+	const __m128i hi = _mm_set_epi32(-1, -1, 0, 0);
+	const __m128i jc = _mm_set_epi32(0, 0, 0x70605040, 0x30201000);
+	/* the chaining value only differs from 0 in row 6, column 7 */
+	const __m128i iv6 = _mm_set_epi32(0, 0, 0x01000000, 0);
+	__m128i m[2][4], h[2][8], x[8];
+	int l, i;
+
+	(void)len;
+	for (l = 0; l < 2; l++) {
+		/* message block: 32 bytes, 0x80, zeros, a block count of 1 */
+		m[l][0] = _mm_loadu_si128((const __m128i *)data + 2 * l);
+		m[l][1] = _mm_loadu_si128((const __m128i *)data + 2 * l + 1);
+		m[l][2] = _mm_set_epi32(0, 0, 0, 0x80);
+		m[l][3] = _mm_set_epi32(0x01000000, 0, 0, 0);
+		groestl_transpose_aes(m[l]);
+
+		/* h = P(h ^ m) ^ Q(m) ^ h */
+		for (i = 0; i < 8; i += 2) {
+			__m128i p = m[l][i >> 1];
+			if (i == 6)
+				p = _mm_xor_si128(p, iv6);
+			x[i] = _mm_unpacklo_epi64(p, m[l][i >> 1]);
+			x[i + 1] = _mm_unpackhi_epi64(p, m[l][i >> 1]);
+		}
+		groestl_perm_aes(x, groestl_shuf_pq, _mm_or_si128(jc, hi), hi,
+			_mm_xor_si128(_mm_slli_si128(jc, 8), hi), lo, hi);
+		for (i = 0; i < 8; i++)
+			h[l][i] = _mm_xor_si128(x[i], _mm_srli_si128(x[i], 8));
+		h[l][6] = _mm_xor_si128(h[l][6], iv6);
+	}
+
+	/* output transformation of both messages: P(h) ^ h, the last 256 bits */
+	for (i = 0; i < 8; i++)
+		x[i] = _mm_unpacklo_epi64(h[0][i], h[1][i]);
+	groestl_perm_aes(x, groestl_shuf_pp, _mm_unpacklo_epi64(jc, jc),
+		_mm_setzero_si128(), _mm_setzero_si128(), _mm_set1_epi8(-1), _mm_setzero_si128());
+	for (i = 0; i < 8; i++)
+		x[i] = _mm_xor_si128(x[i], _mm_unpacklo_epi64(h[0][i], h[1][i]));
+
+	for (l = 0; l < 2; l++) {
+		__m128i v[4];
+		for (i = 0; i < 4; i++)
+			v[i] = l ? _mm_unpackhi_epi64(x[2 * i], x[2 * i + 1])
+				: _mm_unpacklo_epi64(x[2 * i], x[2 * i + 1]);
+		groestl_transpose_aes(v);
+		_mm_storeu_si128((__m128i *)cc + 2 * l, v[2]);
+		_mm_storeu_si128((__m128i *)cc + 2 * l + 1, v[3]);
+	}
+}
+#endif
+
 #ifdef __cplusplus
 }
 #endif
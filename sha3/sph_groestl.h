@@ -232,6 +232,17 @@ void sph_groestl256_close(void *cc, void *dst);
 void sph_groestl256_addbits_and_close(
 	void *cc, unsigned ub, unsigned n, void *dst);
 
+/**
+ * Hash two consecutive 32-byte messages with AES-NI, writing their two
+ * Groestl-256 digests to <code>cc</code> (64 bytes). Built in the AVX2
+ * (non-<code>SSE</code>) builds; only call it when <code>has_aes_ni()</code>.
+ *
+ * @param cc     the destination buffer
+ * @param data   the two messages
+ * @param len    the length of each message, which must be 32
+ */
+void sph_groestl256_32_AES(void *cc, const void *data, size_t len);
+
 /**
  * Initialize a Groestl-384 context. This process performs no memory allocation.
  *
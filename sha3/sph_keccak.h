@@ -88,10 +88,7 @@ typedef struct {
 	unsigned char buf[144];    /* first field, for alignment */
 	size_t ptr, lim;
 	union {
-#if SPH_64
 		sph_u64 wide[25];
-#endif
-		sph_u32 narrow[50];
 	} u;
 #endif
 } sph_keccak_context;
@@ -299,6 +296,42 @@ void sph_keccak512_close(void *cc, void *dst);
 void sph_keccak512_addbits_and_close(
 	void *cc, unsigned ub, unsigned n, void *dst);
 
+/**
+ * Apply the Keccak-f[1600] permutation (24 rounds) to a 25-word state,
+ * as used by all Keccak variants here and by CryptoNight.
+ *
+ * @param s   the state
+ */
+void sph_keccakf1600(sph_u64 *s);
+
+/**
+ * Apply Keccak-f[1600] to 8 (AVX512), 4 (AVX) or 2 (SSE2) states at
+ * once. The states are interleaved by 64-bit word: word w of state l is
+ * at ((sph_u64 *)state)[w * 8 + l] for AVX512, [w * 4 + l] for AVX and
+ * [w * 2 + l] for SSE2. The buffer must be aligned to the vector size.
+ *
+ * @param state   the interleaved states
+ */
+void sph_keccakf1600_AVX512(void *state);
+void sph_keccakf1600_AVX(void *state);
+void sph_keccakf1600_SSE2(void *state);
+
+/**
+ * Compute the Keccak-256 or Keccak-512 digests of 8 (AVX512), 4 (AVX)
+ * or 2 (SSE2) messages of the same length at once. Messages and digests
+ * are interleaved by 64-bit word, as for the permutation above.
+ *
+ * @param dst    the destination buffer (4 or 8 words per message)
+ * @param data   the interleaved messages
+ * @param len    the length of each message (in bytes, a multiple of 8)
+ */
+void sph_keccak256_AVX512(void *dst, const void *data, size_t len);
+void sph_keccak256_AVX(void *dst, const void *data, size_t len);
+void sph_keccak256_SSE2(void *dst, const void *data, size_t len);
+void sph_keccak512_AVX512(void *dst, const void *data, size_t len);
+void sph_keccak512_AVX(void *dst, const void *data, size_t len);
+void sph_keccak512_SSE2(void *dst, const void *data, size_t len);
+
 #ifdef __cplusplus
 }
 #endif
@@ -803,6 +803,169 @@ sph_shabal512_addbits_and_close(void *cc, unsigned ub, unsigned n, void *dst)
 {
 	shabal_close(cc, ub, n, dst, 16);
 }
+/*
+ * Shabal-256 of several messages of the same length at once, one per
+ * 32-bit SIMD lane: 8 with AVX2, 4 with SSE2.  Data and digests are
+ * interleaved by word, word w of lane l at ((uint32_t *)p)[w * lanes + l].
+ */
+#ifndef SSE
+#include <immintrin.h>
+
+#define SHL_T          __m256i
+#define SHL_SET1(x)    _mm256_set1_epi32((int)(x))
+#define SHL_ZERO       _mm256_setzero_si256()
+#define SHL_ADD(a, b)  _mm256_add_epi32(a, b)
+#define SHL_SUB(a, b)  _mm256_sub_epi32(a, b)
+#define SHL_XOR(a, b)  _mm256_xor_si256(a, b)
+#define SHL_ANDN(a, b) _mm256_andnot_si256(a, b)
+#define SHL_SLL(a, n)  _mm256_slli_epi32(a, n)
+#define SHL_SRL(a, n)  _mm256_srli_epi32(a, n)
+#define SHL_OR(a, b)   _mm256_or_si256(a, b)
+#else
+#include <emmintrin.h>
+
+#define SHL_T          __m128i
+#define SHL_SET1(x)    _mm_set1_epi32((int)(x))
+#define SHL_ZERO       _mm_setzero_si128()
+#define SHL_ADD(a, b)  _mm_add_epi32(a, b)
+#define SHL_SUB(a, b)  _mm_sub_epi32(a, b)
+#define SHL_XOR(a, b)  _mm_xor_si128(a, b)
+#define SHL_ANDN(a, b) _mm_andnot_si128(a, b)
+#define SHL_SLL(a, n)  _mm_slli_epi32(a, n)
+#define SHL_SRL(a, n)  _mm_srli_epi32(a, n)
+#define SHL_OR(a, b)   _mm_or_si128(a, b)
+#endif
+
+#define SHL_ROL(a, n)  SHL_OR(SHL_SLL(a, n), SHL_SRL(a, 32 - (n)))
+
+/* PERM_ELT, with x * 5 and x * 3 as shift and add */
+#define SHL_ELT(xa0, xa1, xb0, xb1, xb2, xb3, xc, xm) { \
+	SHL_T t = SHL_ROL(A[xa1], 15); \
+	t = SHL_XOR(SHL_XOR(A[xa0], SHL_ADD(SHL_SLL(t, 2), t)), C[xc]); \
+	t = SHL_ADD(SHL_SLL(t, 1), t); \
+	A[xa0] = SHL_XOR(SHL_XOR(t, B[xb1]), SHL_XOR(SHL_ANDN(B[xb3], B[xb2]), M[xm])); \
+	B[xb0] = SHL_XOR(SHL_XOR(SHL_ROL(B[xb0], 1), A[xa0]), ones); \
+}
+
+#define SHL_STEP(s) \
+	SHL_ELT((16 * s +  0) % 12, (16 * s + 11) % 12,  0, 13,  9,  6,  8,  0); \
+	SHL_ELT((16 * s +  1) % 12, (16 * s + 12) % 12,  1, 14, 10,  7,  7,  1); \
+	SHL_ELT((16 * s +  2) % 12, (16 * s + 13) % 12,  2, 15, 11,  8,  6,  2); \
+	SHL_ELT((16 * s +  3) % 12, (16 * s + 14) % 12,  3,  0, 12,  9,  5,  3); \
+	SHL_ELT((16 * s +  4) % 12, (16 * s + 15) % 12,  4,  1, 13, 10,  4,  4); \
+	SHL_ELT((16 * s +  5) % 12, (16 * s + 16) % 12,  5,  2, 14, 11,  3,  5); \
+	SHL_ELT((16 * s +  6) % 12, (16 * s + 17) % 12,  6,  3, 15, 12,  2,  6); \
+	SHL_ELT((16 * s +  7) % 12, (16 * s + 18) % 12,  7,  4,  0, 13,  1,  7); \
+	SHL_ELT((16 * s +  8) % 12, (16 * s + 19) % 12,  8,  5,  1, 14,  0,  8); \
+	SHL_ELT((16 * s +  9) % 12, (16 * s + 20) % 12,  9,  6,  2, 15, 15,  9); \
+	SHL_ELT((16 * s + 10) % 12, (16 * s + 21) % 12, 10,  7,  3,  0, 14, 10); \
+	SHL_ELT((16 * s + 11) % 12, (16 * s + 22) % 12, 11,  8,  4,  1, 13, 11); \
+	SHL_ELT((16 * s + 12) % 12, (16 * s + 23) % 12, 12,  9,  5,  2, 12, 12); \
+	SHL_ELT((16 * s + 13) % 12, (16 * s + 24) % 12, 13, 10,  6,  3, 11, 13); \
+	SHL_ELT((16 * s + 14) % 12, (16 * s + 25) % 12, 14, 11,  7,  4, 10, 14); \
+	SHL_ELT((16 * s + 15) % 12, (16 * s + 26) % 12, 15, 12,  8,  5,  9, 15); \
+	do { } while (0)
+
+/* A[11 - i] += C[o - i], i = 0 .. 11 */
+#define SHL_ADD_C(o) do { \
+	int i; \
+	for (i = 0; i < 12; i++) \
+		A[11 - i] = SHL_ADD(A[11 - i], C[(o + 16 - i) & 15]); \
+} while (0)
+
+#define SHL_APPLY_P do { \
+	int k; \
+	for (k = 0; k < 16; k++) \
+		B[k] = SHL_ROL(B[k], 17); \
+	SHL_STEP(0); \
+	SHL_STEP(1); \
+	SHL_STEP(2); \
+	SHL_ADD_C(6); \
+	SHL_ADD_C(10); \
+	SHL_ADD_C(14); \
+} while (0)
+
+static void
+shabal256_lanes(void *dst, const void *data, size_t len)
+{
+	const SHL_T *in = (const SHL_T *)data;
+	const SHL_T ones = SHL_SET1(0xFFFFFFFF);
+	SHL_T A[12], BC[32], M[16];
+	SHL_T *B = BC, *C = BC + 16, *T;
+	sph_u32 Wlow = 1;
+	size_t k;
+
+	for (k = 0; k < 12; k++)
+		A[k] = SHL_SET1(A_init_256[k]);
+	for (k = 0; k < 16; k++) {
+		B[k] = SHL_SET1(B_init_256[k]);
+		C[k] = SHL_SET1(C_init_256[k]);
+	}
+
+	/* Whigh stays 0, the messages being far shorter than 2^32 blocks */
+	for (;;) {
+		int last = len < 64;
+
+		for (k = 0; k < 16; k++)
+			M[k] = !last || k < len >> 2 ? in[k]
+				: k == len >> 2 ? SHL_SET1(0x80) : SHL_ZERO;
+		for (k = 0; k < 16; k++)
+			B[k] = SHL_ADD(B[k], M[k]);
+		A[0] = SHL_XOR(A[0], SHL_SET1(Wlow));
+		SHL_APPLY_P;
+		if (last)
+			break;
+		for (k = 0; k < 16; k++)
+			C[k] = SHL_SUB(C[k], M[k]);
+		T = B; B = C; C = T;
+		Wlow++;
+		in += 16;
+		len -= 64;
+	}
+
+	for (k = 0; k < 3; k++) {
+		T = B; B = C; C = T;
+		A[0] = SHL_XOR(A[0], SHL_SET1(Wlow));
+		SHL_APPLY_P;
+	}
+
+	for (k = 0; k < 8; k++)
+		((SHL_T *)dst)[k] = B[8 + k];
+}
+
+#ifndef SSE
+/* see sph_shabal.h */
+void
+sph_shabal256_AVX(void *dst, const void *data, size_t len)
+{
+	shabal256_lanes(dst, data, len);
+	_mm256_zeroupper();
+}
+#else
+/* see sph_shabal.h */
+void
+sph_shabal256_SSE2(void *dst, const void *data, size_t len)
+{
+	shabal256_lanes(dst, data, len);
+}
+#endif
+
+#undef SHL_T
+#undef SHL_SET1
+#undef SHL_ZERO
+#undef SHL_ADD
+#undef SHL_SUB
+#undef SHL_XOR
+#undef SHL_ANDN
+#undef SHL_SLL
+#undef SHL_SRL
+#undef SHL_OR
+#undef SHL_ROL
+#undef SHL_ELT
+#undef SHL_STEP
+#undef SHL_ADD_C
+#undef SHL_APPLY_P
+
 #ifdef __cplusplus
 }
 #endif
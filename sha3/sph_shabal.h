@@ -246,6 +246,19 @@ void sph_shabal256_close(void *cc, void *dst);
 void sph_shabal256_addbits_and_close(
 	void *cc, unsigned ub, unsigned n, void *dst);
 
+/**
+ * Compute the Shabal-256 digests of 8 (AVX) or 4 (SSE2) messages of
+ * the same length at once. Messages and digests are interleaved by
+ * 32-bit word: word w of message l is at ((uint32_t *)data)[w * 8 + l]
+ * for AVX, [w * 4 + l] for SSE2.
+ *
+ * @param dst    the destination buffer (8 words per message)
+ * @param data   the interleaved messages
+ * @param len    the length of each message (in bytes, a multiple of 4)
+ */
+void sph_shabal256_AVX(void *dst, const void *data, size_t len);
+void sph_shabal256_SSE2(void *dst, const void *data, size_t len);
+
 /**
  * Initialize a Shabal-384 context. This process performs no memory allocation.
  *
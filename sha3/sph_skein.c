@@ -1640,6 +1640,211 @@ sph_skein512_addbits_and_close(void *cc, unsigned ub, unsigned n, void *dst)
 	sph_skein512_init(cc);
 }
 
+
+/*
+ * Skein-512-512 over several messages at once, one message per 64-bit
+ * vector lane. The UBI block body is written once over the SK_* macros
+ * defined before each instantiation below.
+ */
+#define SK_ROUND(a0, a1, a2, a3, a4, a5, a6, a7, R0, R1, R2, R3)   do { \
+		a0 = SK_ADD(a0, a1); a1 = SK_XOR(SK_ROTL(a1, R0), a0); \
+		a2 = SK_ADD(a2, a3); a3 = SK_XOR(SK_ROTL(a3, R1), a2); \
+		a4 = SK_ADD(a4, a5); a5 = SK_XOR(SK_ROTL(a5, R2), a4); \
+		a6 = SK_ADD(a6, a7); a7 = SK_XOR(SK_ROTL(a7, R3), a6); \
+	} while (0)
+
+#define SK_INJECT(s)   do { \
+		p0 = SK_ADD(p0, k[((s) + 0) % 9]); \
+		p1 = SK_ADD(p1, k[((s) + 1) % 9]); \
+		p2 = SK_ADD(p2, k[((s) + 2) % 9]); \
+		p3 = SK_ADD(p3, k[((s) + 3) % 9]); \
+		p4 = SK_ADD(p4, k[((s) + 4) % 9]); \
+		p5 = SK_ADD(p5, SK_ADD(k[((s) + 5) % 9], SK_SET1(tw[(s) % 3]))); \
+		p6 = SK_ADD(p6, SK_ADD(k[((s) + 6) % 9], SK_SET1(tw[((s) + 1) % 3]))); \
+		p7 = SK_ADD(p7, SK_ADD(k[((s) + 7) % 9], SK_SET1((sph_u64)(s)))); \
+	} while (0)
+
+/* h = Threefish-512(key h, tweak t0/t1, m) ^ m */
+#define SKEIN512_UBI_BODY(h, m, t0, t1)   do { \
+		const sph_u64 tw[3] = { (t0), (t1), (t0) ^ (t1) }; \
+		SK_T k[9], p0, p1, p2, p3, p4, p5, p6, p7; \
+		int s; \
+		k[8] = SK_SET1(SPH_C64(0x1BD11BDAA9FC1A22)); \
+		for (s = 0; s < 8; s++) { \
+			k[s] = h[s]; \
+			k[8] = SK_XOR(k[8], h[s]); \
+		} \
+		p0 = m[0]; p1 = m[1]; p2 = m[2]; p3 = m[3]; \
+		p4 = m[4]; p5 = m[5]; p6 = m[6]; p7 = m[7]; \
+		SK_INJECT(0); \
+		for (s = 1; s < 19; s += 2) { \
+			SK_ROUND(p0, p1, p2, p3, p4, p5, p6, p7, 46, 36, 19, 37); \
+			SK_ROUND(p2, p1, p4, p7, p6, p5, p0, p3, 33, 27, 14, 42); \
+			SK_ROUND(p4, p1, p6, p3, p0, p5, p2, p7, 17, 49, 36, 39); \
+			SK_ROUND(p6, p1, p0, p7, p2, p5, p4, p3, 44, 9, 54, 56); \
+			SK_INJECT(s); \
+			SK_ROUND(p0, p1, p2, p3, p4, p5, p6, p7, 39, 30, 34, 24); \
+			SK_ROUND(p2, p1, p4, p7, p6, p5, p0, p3, 13, 50, 10, 17); \
+			SK_ROUND(p4, p1, p6, p3, p0, p5, p2, p7, 25, 29, 39, 43); \
+			SK_ROUND(p6, p1, p0, p7, p2, p5, p4, p3, 8, 35, 56, 22); \
+			SK_INJECT(s + 1); \
+		} \
+		h[0] = SK_XOR(p0, m[0]); h[1] = SK_XOR(p1, m[1]); \
+		h[2] = SK_XOR(p2, m[2]); h[3] = SK_XOR(p3, m[3]); \
+		h[4] = SK_XOR(p4, m[4]); h[5] = SK_XOR(p5, m[5]); \
+		h[6] = SK_XOR(p6, m[6]); h[7] = SK_XOR(p7, m[7]); \
+	} while (0)
+
+/* message blocks: first 0x40, final 0x80, type 48; output block: type 63 */
+#define SKEIN_T1_FIRST   SPH_C64(0x4000000000000000)
+#define SKEIN_T1_FINAL   SPH_C64(0x8000000000000000)
+#define SKEIN_T1_MSG     SPH_C64(0x3000000000000000)
+#define SKEIN_T1_OUT     SPH_C64(0xFF00000000000000)
+
+/* one-shot over len bytes (a multiple of 8) per lane, from chaining value h */
+#define SKEIN512_LANES_BODY(h, in, len, t0)   do { \
+		SK_T m[8]; \
+		size_t left = (len), j; \
+		sph_u64 t1 = ((t0) == 0 ? SKEIN_T1_FIRST : 0) | SKEIN_T1_MSG; \
+		sph_u64 tc = (t0); \
+		do { \
+			size_t n = left > 64 ? 64 : left; \
+			for (j = 0; j < 8; j++) \
+				m[j] = j < n / 8 ? SK_LOAD(in + j) : SK_SET1(0); \
+			left -= n; \
+			tc += n; \
+			if (!left) \
+				t1 |= SKEIN_T1_FINAL; \
+			SKEIN512_UBI_BODY(h, m, tc, t1); \
+			t1 &= ~SKEIN_T1_FIRST; \
+			in += 8; \
+		} while (left); \
+		for (j = 0; j < 8; j++) \
+			m[j] = SK_SET1(0); \
+		SKEIN512_UBI_BODY(h, m, 8, SKEIN_T1_OUT); \
+	} while (0)
+
+#define SK_T          sph_u64
+#define SK_ADD(a, b)  ((a) + (b))
+#define SK_XOR(a, b)  ((a) ^ (b))
+#define SK_ROTL(a, n) SPH_ROTL64(a, n)
+#define SK_SET1(x)    ((sph_u64)(x))
+
+/* see sph_skein.h */
+void
+sph_skein512_80_midstate(void *midstate, const void *data)
+{
+	sph_u64 *h = (sph_u64 *)midstate;
+	sph_u64 m[8];
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		h[i] = IV512[i];
+		m[i] = sph_dec64le((const unsigned char *)data + 8 * i);
+	}
+	SKEIN512_UBI_BODY(h, m, 64, SKEIN_T1_FIRST | SKEIN_T1_MSG);
+}
+
+#undef SK_T
+#undef SK_ADD
+#undef SK_XOR
+#undef SK_ROTL
+#undef SK_SET1
+
+/* hash of 80-byte messages from the midstate, and of len-byte messages */
+#define SKEIN512_LANES_FUNCS(sfx)   \
+void \
+sph_skein512_80_ ## sfx(void *dst, const void *midstate, const void *data) \
+{ \
+	const SK_T *in = (const SK_T *)data + 8; \
+	SK_T h[8]; \
+	int j; \
+	for (j = 0; j < 8; j++) \
+		h[j] = SK_SET1(((const sph_u64 *)midstate)[j]); \
+	SKEIN512_LANES_BODY(h, in, 16, 64); \
+	for (j = 0; j < 8; j++) \
+		SK_STORE((SK_T *)dst + j, h[j]); \
+	SK_END; \
+} \
+\
+void \
+sph_skein512_ ## sfx(void *dst, const void *data, size_t len) \
+{ \
+	const SK_T *in = (const SK_T *)data; \
+	SK_T h[8]; \
+	int j; \
+	for (j = 0; j < 8; j++) \
+		h[j] = SK_SET1(IV512[j]); \
+	SKEIN512_LANES_BODY(h, in, len, 0); \
+	for (j = 0; j < 8; j++) \
+		SK_STORE((SK_T *)dst + j, h[j]); \
+	SK_END; \
+}
+
+#ifndef SSE
+#define SK_T           __m256i
+#define SK_ADD(a, b)   _mm256_add_epi64(a, b)
+#define SK_XOR(a, b)   _mm256_xor_si256(a, b)
+#define SK_ROTL(a, n)  _mm256_or_si256(_mm256_slli_epi64(a, n), _mm256_srli_epi64(a, 64 - (n)))
+#define SK_SET1(x)     _mm256_set1_epi64x(x)
+#define SK_LOAD(p)     _mm256_loadu_si256(p)
+#define SK_STORE(p, x) _mm256_storeu_si256(p, x)
+#define SK_END         _mm256_zeroupper()
+
+/* see sph_skein.h */
+SKEIN512_LANES_FUNCS(AVX)
+
+#undef SK_T
+#undef SK_ADD
+#undef SK_XOR
+#undef SK_ROTL
+#undef SK_SET1
+#undef SK_LOAD
+#undef SK_STORE
+
+#ifdef __AVX512F__
+#define SK_T           __m512i
+#define SK_ADD(a, b)   _mm512_add_epi64(a, b)
+#define SK_XOR(a, b)   _mm512_xor_si512(a, b)
+#define SK_ROTL(a, n)  _mm512_rol_epi64(a, n)
+#define SK_SET1(x)     _mm512_set1_epi64(x)
+#define SK_LOAD(p)     _mm512_loadu_si512(p)
+#define SK_STORE(p, x) _mm512_storeu_si512(p, x)
+
+/* see sph_skein.h */
+SKEIN512_LANES_FUNCS(AVX512)
+
+#undef SK_T
+#undef SK_ADD
+#undef SK_XOR
+#undef SK_ROTL
+#undef SK_SET1
+#undef SK_LOAD
+#undef SK_STORE
+#endif
+#undef SK_END
+#else
+#define SK_T           __m128i
+#define SK_ADD(a, b)   _mm_add_epi64(a, b)
+#define SK_XOR(a, b)   _mm_xor_si128(a, b)
+#define SK_ROTL(a, n)  _mm_or_si128(_mm_slli_epi64(a, n), _mm_srli_epi64(a, 64 - (n)))
+#define SK_SET1(x)     _mm_set_epi32((int)((sph_u64)(x) >> 32), (int)(x), (int)((sph_u64)(x) >> 32), (int)(x))
+#define SK_LOAD(p)     _mm_loadu_si128(p)
+#define SK_STORE(p, x) _mm_storeu_si128(p, x)
+#define SK_END         (void)0
+
+/* see sph_skein.h */
+SKEIN512_LANES_FUNCS(SSE2)
+
+#undef SK_T
+#undef SK_ADD
+#undef SK_XOR
+#undef SK_ROTL
+#undef SK_SET1
+#undef SK_LOAD
+#undef SK_STORE
+#undef SK_END
+#endif
 #endif
 
 
@@ -305,6 +305,37 @@ void sph_skein512_close(void *cc, void *dst);
 void sph_skein512_addbits_and_close(
 	void *cc, unsigned ub, unsigned n, void *dst);
 
+/**
+ * Compute the Skein-512 chaining value after the first 64 bytes of an
+ * 80-byte message. The last 16 bytes (with the nonce) are hashed by
+ * <code>sph_skein512_80_AVX</code> and friends from this midstate.
+ *
+ * @param midstate   the destination buffer (8 64-bit words)
+ * @param data       the 80-byte message
+ */
+void sph_skein512_80_midstate(void *midstate, const void *data);
+
+/**
+ * Compute the Skein-512 digests of 8 (AVX512), 4 (AVX) or 2 (SSE2)
+ * messages of the same length at once. Messages and digests are
+ * interleaved by 64-bit word: word w of message l is at
+ * ((sph_u64 *)data)[w * 8 + l] for AVX512, [w * 4 + l] for AVX and
+ * [w * 2 + l] for SSE2. The <code>_80</code> variants hash 80-byte
+ * messages sharing their first 64 bytes, from their midstate; only
+ * words 8 and 9 of each message are read.
+ *
+ * @param dst        the destination buffer (8 words per message)
+ * @param midstate   the shared midstate
+ * @param data       the interleaved messages
+ * @param len        the length of each message (in bytes, a multiple of 8)
+ */
+void sph_skein512_80_AVX512(void *dst, const void *midstate, const void *data);
+void sph_skein512_80_AVX(void *dst, const void *midstate, const void *data);
+void sph_skein512_80_SSE2(void *dst, const void *midstate, const void *data);
+void sph_skein512_AVX512(void *dst, const void *data, size_t len);
+void sph_skein512_AVX(void *dst, const void *data, size_t len);
+void sph_skein512_SSE2(void *dst, const void *data, size_t len);
+
 #endif
 
 #ifdef __cplusplus
@@ -0,0 +1,707 @@
+/**
+ * Hashrate statistics
+ *
+ * Miner threads only publish running totals (hashes and time spent in
+ * scanhash) into their own padded slot; a seqlock lets the aggregator
+ * read a consistent pair without the miners ever taking a lock. Once a
+ * second the aggregator turns the totals into 10s, 60s and 15min EWMA
+ * rates per thread, tracks per-thread min/max and the effective rate
+ * implied by accepted shares, and renders the /metrics page the API
+ * serves.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "miner.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+/* aligned 64-bit accesses are atomic on x64, only stop the compiler */
+#define stats_load(p)		(*(volatile uint64_t *)(p))
+#define stats_store(p, v)	(*(volatile uint64_t *)(p) = (v))
+#define stats_add(p, v)		_InterlockedExchangeAdd64((volatile __int64 *)(p), (__int64)(v))
+#define stats_barrier()		_ReadWriteBarrier()
+#else
+#define stats_load(p)		__atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define stats_store(p, v)	__atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define stats_add(p, v)		__atomic_fetch_add(p, v, __ATOMIC_RELAXED)
+#define stats_barrier()		__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+extern int opt_api_listen;
+extern float cpu_temp(int);
+extern uint32_t cpu_clock(int);
+
+/* written by one miner thread, read by the aggregator */
+struct thr_counters {
+	uint64_t seq;		/* odd while an update is in progress */
+	uint64_t hashes;
+	uint64_t usecs;
+	uint64_t overhead_usecs;	/* between two scanhash calls */
+	uint64_t switches;	/* job switches seen, and the last one's latency */
+	uint64_t switch_usecs;
+	char padding[128 - 6 * sizeof(uint64_t)];
+};
+
+/* fixed upper bounds, +Inf is implied */
+struct stats_hist {
+	const double *le;
+	int n;
+	uint64_t count[32];
+	uint64_t total;
+	double sum;
+};
+
+static const double hist_rate_le[] = {
+	1, 2, 5, 1e1, 2e1, 5e1, 1e2, 2e2, 5e2, 1e3, 2e3, 5e3, 1e4, 2e4, 5e4,
+	1e5, 2e5, 5e5, 1e6, 2e6, 5e6, 1e7, 2e7, 5e7, 1e8, 2e8, 5e8, 1e9
+};
+static const double hist_secs_le[] = {
+	.001, .0025, .005, .01, .025, .05, .1, .25, .5, 1, 2.5, 5, 10
+};
+
+/* owned by the aggregator, read under stats_agg_lock */
+struct thr_rates {
+	uint64_t hashes;	/* totals at the previous sample */
+	uint64_t usecs;
+	uint64_t overhead_usecs;
+	uint64_t switches;
+	double ewma[STATS_WINDOWS];
+	double min, max;	/* of the 10s rate, once it has settled */
+	double age;		/* seconds of scan time seen */
+	bool seeded;
+	struct stats_hist hist;	/* rate of each new stretch of scan time */
+};
+
+#define STATS_REASONS 32
+struct share_count {
+	int result;
+	char reason[32];
+	uint64_t count;
+};
+
+static const double stats_tau[STATS_WINDOWS] = { 10., 60., 900. };
+static const char *share_results[] = { "accepted", "rejected", "stale" };
+
+static struct thr_counters *counters = NULL;
+static struct thr_rates *rates = NULL;
+static int stats_threads = 0;
+
+static pthread_mutex_t stats_agg_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct timeval stats_start;
+static double total_ewma[STATS_WINDOWS];
+static double shares_work = 0.;	/* sum of accepted share difficulties */
+static struct share_count shares[STATS_REASONS];
+static int nshares = 0;
+static uint64_t shares_other[ARRAY_SIZE(share_results)];	/* reasons past a full table */
+static struct stats_hist total_hist = { hist_rate_le, ARRAY_SIZE(hist_rate_le) };
+static struct stats_hist rtt_hist = { hist_secs_le, ARRAY_SIZE(hist_secs_le) };
+static struct stats_hist switch_hist = { hist_secs_le, ARRAY_SIZE(hist_secs_le) };
+
+static uint64_t sample_usecs = 0;	/* when stats_sample() last ran */
+static uint64_t restart_usecs = 0;	/* when restart_threads() last ran */
+static int64_t scratchpad_bytes = 0;
+
+/* RAPL package and core joules since start, package power */
+static bool energy_valid = false;
+static uint64_t energy_usecs = 0;
+static double energy_joules[2];
+static double power_ewma[STATS_WINDOWS];
+
+/* latest rendered /metrics page, swapped under its own lock */
+static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+static char *metrics_page = NULL;
+
+static uint64_t now_usecs(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+static void hist_observe(struct stats_hist *h, double v)
+{
+	int i = 0;
+	while (i < h->n && v > h->le[i])
+		i++;
+	if (i < h->n)
+		h->count[i]++;
+	h->total++;
+	h->sum += v;
+}
+
+void stats_record(int thr_id, uint64_t hashes, uint64_t usecs, uint64_t overhead_usecs)
+{
+	struct thr_counters *c = &counters[thr_id];
+	uint64_t seq = c->seq;
+
+	stats_store(&c->seq, seq + 1);
+	stats_barrier();
+	stats_store(&c->hashes, c->hashes + hashes);
+	stats_store(&c->usecs, c->usecs + usecs);
+	stats_store(&c->overhead_usecs, c->overhead_usecs + overhead_usecs);
+	stats_store(&c->seq, seq + 2);
+}
+
+void stats_job_restart(void)
+{
+	stats_store(&restart_usecs, now_usecs());
+}
+
+void stats_job_switch(int thr_id)
+{
+	struct thr_counters *c = &counters[thr_id];
+	uint64_t since = stats_load(&restart_usecs);
+	uint64_t now = now_usecs();
+	uint64_t seq = c->seq;
+
+	if (!since || now < since)
+		return;
+	stats_store(&c->seq, seq + 1);
+	stats_barrier();
+	stats_store(&c->switch_usecs, now - since);
+	stats_store(&c->switches, c->switches + 1);
+	stats_store(&c->seq, seq + 2);
+}
+
+void stats_scratchpad(int64_t bytes)
+{
+	stats_add(&scratchpad_bytes, bytes);
+}
+
+static void stats_read(int thr_id, struct thr_counters *out)
+{
+	struct thr_counters *c = &counters[thr_id];
+	uint64_t seq;
+
+	do {
+		seq = stats_load(&c->seq);
+		out->hashes = stats_load(&c->hashes);
+		out->usecs = stats_load(&c->usecs);
+		out->overhead_usecs = stats_load(&c->overhead_usecs);
+		out->switches = stats_load(&c->switches);
+		out->switch_usecs = stats_load(&c->switch_usecs);
+		stats_barrier();
+	} while ((seq & 1) || seq != stats_load(&c->seq));
+}
+
+/* pool reasons as label values: lower case, [a-z0-9_] only */
+static void share_reason(char *dst, size_t sz, const char *reason)
+{
+	size_t n = 0;
+	for (; reason && *reason && n + 1 < sz; reason++) {
+		char ch = (char) tolower((unsigned char) *reason);
+		if (!isalnum((unsigned char) ch))
+			ch = '_';
+		if (ch == '_' && (!n || dst[n - 1] == '_'))
+			continue;
+		dst[n++] = ch;
+	}
+	while (n && dst[n - 1] == '_')
+		n--;
+	dst[n] = '\0';
+}
+
+/* rejects the pool explains as stale count as such */
+int stats_share_kind(int result, const char *reason)
+{
+	char label[32];
+
+	if (result != SHARE_REJECTED)
+		return result;
+	share_reason(label, sizeof(label), reason);
+	if (strstr(label, "stale") || strstr(label, "job_not_found"))
+		return SHARE_STALE;
+	return result;
+}
+
+void stats_share(int result, double targetdiff, const char *reason, double rtt)
+{
+	char label[32];
+	int i;
+
+	share_reason(label, sizeof(label), result == SHARE_ACCEPTED ? NULL : reason);
+	result = stats_share_kind(result, reason);
+
+	pthread_mutex_lock(&stats_agg_lock);
+	if (result == SHARE_ACCEPTED && targetdiff > 0.)
+		shares_work += targetdiff;
+	if (rtt >= 0.)
+		hist_observe(&rtt_hist, rtt);
+
+	for (i = 0; i < nshares; i++)
+		if (shares[i].result == result && !strcmp(shares[i].reason, label))
+			break;
+	if (i == nshares && nshares < STATS_REASONS) {
+		shares[i].result = result;
+		strcpy(shares[i].reason, label);
+		nshares++;
+	}
+	if (i < nshares)
+		shares[i].count++;
+	else
+		shares_other[result]++;
+	pthread_mutex_unlock(&stats_agg_lock);
+}
+
+/*
+ * Fold the counters into the rates. Each new stretch of scan time pulls
+ * the averages towards its own rate with a weight set by its length, so
+ * the slice boundaries do not show through as they would sampling by
+ * wall clock.
+ */
+static void stats_sample(void)
+{
+	double total[STATS_WINDOWS] = { 0. };
+	uint64_t now = now_usecs();
+	double wall = sample_usecs && now > sample_usecs ? (now - sample_usecs) * 1e-6 : 0.;
+	double pkg, core;
+
+	sample_usecs = now;
+	for (int i = 0; i < stats_threads; i++) {
+		struct thr_rates *r = &rates[i];
+		struct thr_counters c;
+
+		stats_read(i, &c);
+		if (c.usecs > r->usecs) {
+			double dt = (c.usecs - r->usecs) * 1e-6;
+			double rate = (c.hashes - r->hashes) / dt;
+			if (!r->seeded) {
+				r->seeded = true;
+				for (int w = 0; w < STATS_WINDOWS; w++)
+					r->ewma[w] = rate;
+				r->min = r->max = rate;
+			} else {
+				for (int w = 0; w < STATS_WINDOWS; w++)
+					r->ewma[w] += (rate - r->ewma[w]) * (1. - exp(-dt / stats_tau[w]));
+			}
+			r->age += dt;
+			/* ignore the warm-up, the first 10s window is still seeded */
+			if (r->age >= stats_tau[STATS_10S]) {
+				if (r->ewma[STATS_10S] < r->min) r->min = r->ewma[STATS_10S];
+				if (r->ewma[STATS_10S] > r->max) r->max = r->ewma[STATS_10S];
+			}
+			hist_observe(&r->hist, rate);
+			r->hashes = c.hashes;
+			r->usecs = c.usecs;
+		} else if (governor_parked(i)) {
+			/* a parked thread does not scan, let its rate fall to zero */
+			for (int w = 0; w < STATS_WINDOWS; w++)
+				r->ewma[w] -= r->ewma[w] * (1. - exp(-wall / stats_tau[w]));
+		}
+		r->overhead_usecs = c.overhead_usecs;
+		if (c.switches != r->switches) {
+			/* several switches within a second only leave the last one */
+			hist_observe(&switch_hist, c.switch_usecs * 1e-6);
+			r->switches = c.switches;
+		}
+		for (int w = 0; w < STATS_WINDOWS; w++)
+			total[w] += r->ewma[w];
+	}
+	memcpy(total_ewma, total, sizeof(total));
+	if (total[STATS_10S] > 0.)
+		hist_observe(&total_hist, total[STATS_10S]);
+	global_hashrate = (uint64_t) total_ewma[STATS_60S];
+
+	if (cpu_energy(&pkg, &core)) {
+		if (energy_usecs && now > energy_usecs) {
+			double watts = (pkg - energy_joules[0]) / ((now - energy_usecs) * 1e-6);
+			for (int w = 0; w < STATS_WINDOWS; w++) {
+				if (!energy_valid)
+					power_ewma[w] = watts;
+				else
+					power_ewma[w] += (watts - power_ewma[w]) *
+						(1. - exp(-(now - energy_usecs) * 1e-6 / stats_tau[w]));
+			}
+			energy_valid = true;
+		}
+		energy_usecs = now;
+		energy_joules[0] = pkg;
+		energy_joules[1] = core;
+	}
+}
+
+#ifdef HASH_PROFILE
+bool opt_profile = false;
+__thread struct prof_counters *prof_thr = NULL;
+static struct prof_counters *prof = NULL;
+
+void prof_thread(int thr_id)
+{
+	if (prof && opt_profile)
+		prof_thr = &prof[thr_id];
+}
+
+void prof_scan(int thr_id, uint64_t hashes, uint64_t cycles)
+{
+	prof[thr_id].hashes += hashes;
+	prof[thr_id].scan_cycles += cycles;
+}
+
+/* all threads added up; read while they run, close enough for a profile */
+static void prof_sum(struct prof_counters *sum)
+{
+	memset(sum, 0, sizeof(*sum));
+	for (int i = 0; i < stats_threads; i++) {
+		for (int s = 0; s < PROF_STAGES; s++) {
+			if (prof[i].name[s])
+				sum->name[s] = prof[i].name[s];
+			sum->cycles[s] += prof[i].cycles[s];
+			sum->calls[s] += prof[i].calls[s];
+		}
+		sum->hashes += prof[i].hashes;
+		sum->scan_cycles += prof[i].scan_cycles;
+	}
+}
+
+/* API: one STAGE=..;CPH=..;PCT=.. record per stage, cycles per hash and share of scanhash */
+char *prof_report(char *buf, size_t sz)
+{
+	struct prof_counters sum;
+	size_t len = 0;
+
+	*buf = '\0';
+	if (!prof)
+		return buf;
+	prof_sum(&sum);
+	double hashes = sum.hashes ? (double) sum.hashes : 1.;
+	double scan = sum.scan_cycles ? (double) sum.scan_cycles : 1.;
+	for (int s = 0; s < PROF_STAGES && len < sz; s++) {
+		if (!sum.name[s])
+			continue;
+		len += snprintf(&buf[len], sz - len, "STAGE=%s;CPH=%.1f;PCT=%.1f;CALLS=%llu|",
+			sum.name[s], sum.cycles[s] / hashes, 100. * sum.cycles[s] / scan,
+			(unsigned long long) sum.calls[s]);
+	}
+	if (len < sz)
+		snprintf(&buf[len], sz - len, "STAGE=scanhash;CPH=%.1f;PCT=100.0;CALLS=%llu|",
+			sum.scan_cycles / hashes, (unsigned long long) sum.hashes);
+	return buf;
+}
+
+static void prof_dump(void)
+{
+	struct prof_counters sum;
+
+	prof_sum(&sum);
+	if (!sum.hashes)
+		return;
+	applog(LOG_BLUE, "Stage profile, %llu hashes, %.0f cycles/hash in scanhash",
+		(unsigned long long) sum.hashes, (double) sum.scan_cycles / sum.hashes);
+	for (int s = 0; s < PROF_STAGES; s++) {
+		if (!sum.name[s])
+			continue;
+		applog(LOG_INFO, "%-12s %10.1f cycles/hash %5.1f%%", sum.name[s],
+			(double) sum.cycles[s] / sum.hashes, 100. * sum.cycles[s] / sum.scan_cycles);
+	}
+}
+#endif
+
+/* growable string for the metrics page */
+struct mbuf {
+	char *p;
+	size_t len, size;
+};
+
+static void mprintf(struct mbuf *m, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	if (!m->p)
+		return;
+	for (;;) {
+		va_start(ap, fmt);
+		n = vsnprintf(m->p + m->len, m->size - m->len, fmt, ap);
+		va_end(ap);
+		if (n >= 0 && (size_t) n < m->size - m->len)
+			break;
+		char *q = (char *) realloc(m->p, m->size * 2);
+		if (!q) {
+			free(m->p);
+			m->p = NULL;
+			return;
+		}
+		m->p = q;
+		m->size *= 2;
+	}
+	m->len += n;
+}
+
+static void render_hist(struct mbuf *m, const char *name, const char *labels,
+	const struct stats_hist *h)
+{
+	uint64_t cum = 0;
+	const char *sep = *labels ? "," : "";
+	char set[40] = "";
+
+	for (int i = 0; i < h->n; i++) {
+		cum += h->count[i];
+		mprintf(m, "%s_bucket{%s%sle=\"%g\"} %llu\n", name, labels, sep,
+			h->le[i], (unsigned long long) cum);
+	}
+	mprintf(m, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels, sep,
+		(unsigned long long) h->total);
+	if (*labels)
+		snprintf(set, sizeof(set), "{%s}", labels);
+	mprintf(m, "%s_count%s %llu\n", name, set, (unsigned long long) h->total);
+	mprintf(m, "%s_sum%s %.6f\n", name, set, h->sum);
+}
+
+/* OpenMetrics text exposition, called by the aggregator under stats_agg_lock */
+static void stats_render(void)
+{
+	static const char *wname[STATS_WINDOWS] = { "10s", "1m", "15m" };
+	struct mbuf m = { (char *) malloc(16384), 0, 16384 };
+	char labels[32];
+	int i, w;
+
+	mprintf(&m, "# TYPE cpuminer_total_hashrate gauge\n"
+		"# HELP cpuminer_total_hashrate Exponentially weighted hashrate of all threads in H/s.\n");
+	for (w = 0; w < STATS_WINDOWS; w++)
+		mprintf(&m, "cpuminer_total_hashrate{window=\"%s\"} %.3f\n", wname[w], total_ewma[w]);
+	mprintf(&m, "# TYPE cpuminer_hashrate gauge\n"
+		"# HELP cpuminer_hashrate Exponentially weighted hashrate per thread in H/s.\n");
+	for (i = 0; i < stats_threads; i++)
+		for (w = 0; w < STATS_WINDOWS; w++)
+			mprintf(&m, "cpuminer_hashrate{thread=\"%d\",window=\"%s\"} %.3f\n",
+				i, wname[w], rates[i].ewma[w]);
+
+	mprintf(&m, "# TYPE cpuminer_total_sampled_hashrate histogram\n"
+		"# HELP cpuminer_total_sampled_hashrate 10s hashrate of all threads in H/s, sampled each second.\n");
+	render_hist(&m, "cpuminer_total_sampled_hashrate", "", &total_hist);
+	mprintf(&m, "# TYPE cpuminer_sampled_hashrate histogram\n"
+		"# HELP cpuminer_sampled_hashrate Hashrate of each scan slice per thread in H/s.\n");
+	for (i = 0; i < stats_threads; i++) {
+		snprintf(labels, sizeof(labels), "thread=\"%d\"", i);
+		render_hist(&m, "cpuminer_sampled_hashrate", labels, &rates[i].hist);
+	}
+
+	mprintf(&m, "# TYPE cpuminer_hashes counter\n"
+		"# HELP cpuminer_hashes Hashes computed.\n");
+	for (i = 0; i < stats_threads; i++)
+		mprintf(&m, "cpuminer_hashes_total{thread=\"%d\"} %llu\n", i,
+			(unsigned long long) rates[i].hashes);
+	mprintf(&m, "# TYPE cpuminer_scan_seconds counter\n"
+		"# HELP cpuminer_scan_seconds Time spent in scanhash.\n");
+	for (i = 0; i < stats_threads; i++)
+		mprintf(&m, "cpuminer_scan_seconds_total{thread=\"%d\"} %.6f\n", i, rates[i].usecs * 1e-6);
+	mprintf(&m, "# TYPE cpuminer_thread_parked gauge\n"
+		"# HELP cpuminer_thread_parked 1 while the thermal governor holds the thread.\n");
+	for (i = 0; i < stats_threads; i++)
+		mprintf(&m, "cpuminer_thread_parked{thread=\"%d\"} %d\n", i, governor_parked(i) ? 1 : 0);
+	mprintf(&m, "# TYPE cpuminer_scan_overhead_seconds counter\n"
+		"# HELP cpuminer_scan_overhead_seconds Time spent between two scanhash calls.\n");
+	for (i = 0; i < stats_threads; i++)
+		mprintf(&m, "cpuminer_scan_overhead_seconds_total{thread=\"%d\"} %.6f\n", i,
+			rates[i].overhead_usecs * 1e-6);
+
+	mprintf(&m, "# TYPE cpuminer_shares counter\n"
+		"# HELP cpuminer_shares Share results from the pool, by reason.\n");
+	for (i = 0; i < nshares; i++)
+		mprintf(&m, "cpuminer_shares_total{result=\"%s\",reason=\"%s\"} %llu\n",
+			share_results[shares[i].result], shares[i].reason,
+			(unsigned long long) shares[i].count);
+	for (i = 0; i < (int) ARRAY_SIZE(shares_other); i++)
+		if (shares_other[i])
+			mprintf(&m, "cpuminer_shares_total{result=\"%s\",reason=\"other\"} %llu\n",
+				share_results[i], (unsigned long long) shares_other[i]);
+
+	mprintf(&m, "# TYPE cpuminer_share_rtt_seconds histogram\n"
+		"# HELP cpuminer_share_rtt_seconds Time from share submission to the pool's answer.\n");
+	render_hist(&m, "cpuminer_share_rtt_seconds", "", &rtt_hist);
+
+	struct share_ages ages;
+	journal_ages(&ages);
+	mprintf(&m, "# TYPE cpuminer_share_job_age_seconds histogram\n"
+		"# HELP cpuminer_share_job_age_seconds Age of the job when a share was found, by result.\n");
+	for (int r = SHARE_ACCEPTED; r <= SHARE_STALE; r++) {
+		struct stats_hist h = { ages.le, SHARE_AGES - 1 };
+		for (i = 0; i < SHARE_AGES; i++) {
+			if (i < h.n)
+				h.count[i] = ages.count[i][r];
+			h.total += ages.count[i][r];
+		}
+		h.sum = ages.sum[r];
+		snprintf(labels, sizeof(labels), "result=\"%s\"", share_results[r]);
+		render_hist(&m, "cpuminer_share_job_age_seconds", labels, &h);
+	}
+	mprintf(&m, "# TYPE cpuminer_stale_shares counter\n"
+		"# HELP cpuminer_stale_shares Stale shares by what was under way when their job was replaced.\n");
+	for (i = 0; i < STALE_CAUSES; i++)
+		mprintf(&m, "cpuminer_stale_shares_total{cause=\"%s\"} %llu\n", stale_causes[i],
+			(unsigned long long) ages.causes[i]);
+	mprintf(&m, "# TYPE cpuminer_job_switch_seconds histogram\n"
+		"# HELP cpuminer_job_switch_seconds Time from a work restart to a thread scanning the new job.\n");
+	render_hist(&m, "cpuminer_job_switch_seconds", "", &switch_hist);
+
+	mprintf(&m, "# TYPE cpuminer_scratchpad_bytes gauge\n"
+		"# HELP cpuminer_scratchpad_bytes Memory held by hash scratchpads.\n"
+		"cpuminer_scratchpad_bytes %lld\n", (long long) stats_load(&scratchpad_bytes));
+	if (energy_valid) {
+		mprintf(&m, "# TYPE cpuminer_energy_joules counter\n"
+			"# HELP cpuminer_energy_joules RAPL energy used since start.\n"
+			"cpuminer_energy_joules_total{domain=\"package\"} %.3f\n", energy_joules[0]);
+		if (energy_joules[1] > 0.)
+			mprintf(&m, "cpuminer_energy_joules_total{domain=\"core\"} %.3f\n", energy_joules[1]);
+		mprintf(&m, "# TYPE cpuminer_power_watts gauge\n"
+			"# HELP cpuminer_power_watts Exponentially weighted package power.\n");
+		for (w = 0; w < STATS_WINDOWS; w++)
+			mprintf(&m, "cpuminer_power_watts{window=\"%s\"} %.3f\n", wname[w], power_ewma[w]);
+		mprintf(&m, "# TYPE cpuminer_hashes_per_joule gauge\n"
+			"# HELP cpuminer_hashes_per_joule Hashrate over package power.\n");
+		for (w = 0; w < STATS_WINDOWS; w++)
+			mprintf(&m, "cpuminer_hashes_per_joule{window=\"%s\"} %.6f\n", wname[w],
+				power_ewma[w] > 0. ? total_ewma[w] / power_ewma[w] : 0.);
+	}
+	mprintf(&m, "# TYPE cpuminer_cpu_temperature_celsius gauge\n"
+		"cpuminer_cpu_temperature_celsius %.1f\n", cpu_temp(0));
+	mprintf(&m, "# TYPE cpuminer_cpu_frequency_hertz gauge\n"
+		"cpuminer_cpu_frequency_hertz %.0f\n", cpu_clock(0) * 1e3);
+#ifdef HASH_PROFILE
+	if (prof && opt_profile) {
+		struct prof_counters sum;
+		prof_sum(&sum);
+		mprintf(&m, "# TYPE cpuminer_stage_cycles counter\n"
+			"# HELP cpuminer_stage_cycles TSC cycles spent in each hash stage, all threads.\n");
+		for (int s = 0; s < PROF_STAGES; s++)
+			if (sum.name[s])
+				mprintf(&m, "cpuminer_stage_cycles_total{stage=\"%s\"} %llu\n",
+					sum.name[s], (unsigned long long) sum.cycles[s]);
+		mprintf(&m, "cpuminer_stage_cycles_total{stage=\"scanhash\"} %llu\n",
+			(unsigned long long) sum.scan_cycles);
+	}
+#endif
+	mprintf(&m, "# EOF\n");
+
+	if (!m.p)
+		return;
+	pthread_mutex_lock(&metrics_lock);
+	free(metrics_page);
+	metrics_page = m.p;
+	pthread_mutex_unlock(&metrics_lock);
+}
+
+char *stats_metrics(void)
+{
+	char *page;
+	pthread_mutex_lock(&metrics_lock);
+	page = strdup(metrics_page ? metrics_page : "# EOF\n");
+	pthread_mutex_unlock(&metrics_lock);
+	return page;
+}
+
+static void *stats_thread(void *arg)
+{
+	for (;;) {
+		sleep(1);
+		pthread_mutex_lock(&stats_agg_lock);
+		stats_sample();
+		if (opt_api_listen)
+			stats_render();
+		pthread_mutex_unlock(&stats_agg_lock);
+	}
+	return NULL;
+}
+
+bool stats_init(int nthreads)
+{
+	pthread_t pth;
+
+	counters = (struct thr_counters *) calloc(nthreads, sizeof(*counters));
+	rates = (struct thr_rates *) calloc(nthreads, sizeof(*rates));
+	if (!counters || !rates)
+		return false;
+	for (int i = 0; i < nthreads; i++) {
+		rates[i].hist.le = hist_rate_le;
+		rates[i].hist.n = ARRAY_SIZE(hist_rate_le);
+	}
+	stats_threads = nthreads;
+#ifdef HASH_PROFILE
+	if (opt_profile) {
+		prof = (struct prof_counters *) calloc(nthreads, sizeof(*prof));
+		if (!prof)
+			return false;
+		/* runs before the logger's own exit hook drains the lines */
+		atexit(prof_dump);
+	}
+#endif
+	gettimeofday(&stats_start, NULL);
+
+	if (pthread_create(&pth, NULL, stats_thread, NULL))
+		return false;
+	pthread_detach(pth);
+	return true;
+}
+
+double stats_hashrate(int window)
+{
+	double rate;
+	pthread_mutex_lock(&stats_agg_lock);
+	rate = total_ewma[window];
+	pthread_mutex_unlock(&stats_agg_lock);
+	return rate;
+}
+
+void stats_thr_get(int thr_id, struct thr_stats *st)
+{
+	memset(st, 0, sizeof(*st));
+	if (thr_id < 0 || thr_id >= stats_threads)
+		return;
+	pthread_mutex_lock(&stats_agg_lock);
+	memcpy(st->rate, rates[thr_id].ewma, sizeof(st->rate));
+	st->min = rates[thr_id].min;
+	st->max = rates[thr_id].max;
+	st->hashes = rates[thr_id].hashes;
+	pthread_mutex_unlock(&stats_agg_lock);
+}
+
+/* package power and hashes per joule, false without RAPL */
+bool stats_energy(struct energy_stats *out)
+{
+	memset(out, 0, sizeof(*out));
+	pthread_mutex_lock(&stats_agg_lock);
+	out->valid = energy_valid;
+	memcpy(out->joules, energy_joules, sizeof(out->joules));
+	for (int w = 0; w < STATS_WINDOWS; w++) {
+		out->watts[w] = power_ewma[w];
+		if (power_ewma[w] > 0.)
+			out->hpj[w] = total_ewma[w] / power_ewma[w];
+	}
+	pthread_mutex_unlock(&stats_agg_lock);
+	return out->valid;
+}
+
+/* hashes and package joules as of the last sample, and its time since start */
+void stats_totals(uint64_t *hashes, double *joules, double *secs)
+{
+	pthread_mutex_lock(&stats_agg_lock);
+	*hashes = 0;
+	for (int i = 0; i < stats_threads; i++)
+		*hashes += rates[i].hashes;
+	*joules = energy_joules[0];
+	*secs = sample_usecs ? (sample_usecs - (stats_start.tv_sec * 1000000ULL + stats_start.tv_usec)) * 1e-6 : 0.;
+	pthread_mutex_unlock(&stats_agg_lock);
+}
+
+/* hashes per second the accepted shares account for since start */
+double stats_effective_hashrate(void)
+{
+	struct timeval now, diff;
+	double work;
+
+	gettimeofday(&now, NULL);
+	pthread_mutex_lock(&stats_agg_lock);
+	timeval_subtract(&diff, &now, &stats_start);
+	work = shares_work;
+	pthread_mutex_unlock(&stats_agg_lock);
+
+	double secs = diff.tv_sec + diff.tv_usec * 1e-6;
+	return secs > 0. ? work * 4294967296.0 / secs : 0.;
+}
@@ -8,9 +8,12 @@
 #include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "miner.h"
 
+extern int num_cpus;
+
 #ifndef WIN32
 
 #define HWMON_PATH \
@@ -26,12 +29,156 @@
 #define HWMON_ALT5 \
  "/sys/class/hwmon/hwmon0/device/temp1_input"
 
+#define HWMON_CLASS "/sys/class/hwmon"
+#define SYS_CPU "/sys/devices/system/cpu"
+#define RAPL_PATH "/sys/class/powercap/intel-rapl"
+
+/* a temperature input of a cpu driver; core -1 covers the whole package */
+struct temp_sensor {
+	int pkg, core;
+	char path[64];
+};
+
+#define MAX_SENSORS 256
+
+static struct temp_sensor sensors[MAX_SENSORS];
+static int nsensors = 0;
+static const char **cpu_sensor = NULL;	/* by logical cpu */
+static int ncpu_sensor = 0;
+static pthread_mutex_t sensors_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool sensors_scanned = false;
+
+static bool read_line(const char *path, char *buf, size_t sz)
+{
+	FILE *fd = fopen(path, "r");
+	bool ok;
+
+	if (!fd)
+		return false;
+	ok = fgets(buf, (int) sz, fd) != NULL;
+	fclose(fd);
+	if (ok)
+		buf[strcspn(buf, "\r\n")] = '\0';
+	return ok;
+}
+
+static int read_int(const char *path, int def)
+{
+	char buf[32];
+	if (!read_line(path, buf, sizeof(buf)))
+		return def;
+	return atoi(buf);
+}
+
+static void add_sensor(int pkg, int core, const char *path)
+{
+	int i;
+
+	for (i = 0; i < nsensors; i++)
+		if (sensors[i].pkg == pkg && sensors[i].core == core)
+			break;
+	if (i == MAX_SENSORS)
+		return;
+	sensors[i].pkg = pkg;
+	sensors[i].core = core;
+	snprintf(sensors[i].path, sizeof(sensors[i].path), "%s", path);
+	if (i == nsensors)
+		nsensors++;
+}
+
+static const char *find_sensor(int pkg, int core)
+{
+	for (int i = 0; i < nsensors; i++)
+		if (sensors[i].pkg == pkg && sensors[i].core == core)
+			return sensors[i].path;
+	return NULL;
+}
+
+/*
+ * Walk /sys/class/hwmon for the cpu drivers: coretemp has one input per
+ * physical core plus the package, k10temp and zenpower one per node.
+ * Each logical cpu then gets the input of its core, else of its package.
+ */
+static void scan_sensors(void)
+{
+	char dir[64], path[96], buf[64];
+	int nodes = 0;
+
+	for (int h = 0; h < 64; h++) {
+		int pkg = 0;
+		bool per_node;
+
+		snprintf(dir, sizeof(dir), HWMON_CLASS "/hwmon%d", h);
+		snprintf(path, sizeof(path), "%s/name", dir);
+		if (!read_line(path, buf, sizeof(buf)))
+			continue;
+		per_node = !strcmp(buf, "k10temp") || !strcmp(buf, "zenpower");
+		if (!per_node && strcmp(buf, "coretemp") && strcmp(buf, "cpu_thermal"))
+			continue;
+		if (per_node)
+			pkg = nodes++;
+
+		for (int t = 1; t < 128; t++) {
+			int id;
+			snprintf(path, sizeof(path), "%s/temp%d_label", dir, t);
+			if (!read_line(path, buf, sizeof(buf)))
+				*buf = '\0';
+			snprintf(path, sizeof(path), "%s/temp%d_input", dir, t);
+			if (access(path, R_OK))
+				continue;
+			if (sscanf(buf, "Package id %d", &id) == 1) {
+				pkg = id;
+				add_sensor(pkg, -1, path);
+			} else if (sscanf(buf, "Core %d", &id) == 1) {
+				add_sensor(pkg, id, path);
+			} else if (!find_sensor(pkg, -1) || !strcmp(buf, "Tdie")) {
+				/* Tctl, Tdie or unlabelled; Tdie has no offset, prefer it */
+				add_sensor(pkg, -1, path);
+			}
+		}
+	}
+
+	ncpu_sensor = num_cpus;
+	cpu_sensor = (const char **) calloc(ncpu_sensor, sizeof(*cpu_sensor));
+	if (!cpu_sensor) {
+		ncpu_sensor = 0;
+		return;
+	}
+	for (int c = 0; c < ncpu_sensor; c++) {
+		int pkg, core;
+		snprintf(path, sizeof(path), SYS_CPU "/cpu%d/topology/physical_package_id", c);
+		pkg = read_int(path, 0);
+		snprintf(path, sizeof(path), SYS_CPU "/cpu%d/topology/core_id", c);
+		core = read_int(path, -1);
+		cpu_sensor[c] = find_sensor(pkg, core);
+		if (!cpu_sensor[c])
+			cpu_sensor[c] = find_sensor(pkg, -1);
+		if (!cpu_sensor[c] && nsensors)
+			cpu_sensor[c] = sensors[0].path;
+	}
+}
+
 static float linux_cputemp(int core)
 {
 	float tc = 0.0;
-	FILE *fd = fopen(HWMON_PATH, "r");
+	FILE *fd = NULL;
 	uint32_t val = 0;
 
+	pthread_mutex_lock(&sensors_lock);
+	if (!sensors_scanned) {
+		scan_sensors();
+		sensors_scanned = true;
+	}
+	pthread_mutex_unlock(&sensors_lock);
+
+	if (core >= 0 && core < ncpu_sensor && cpu_sensor[core])
+		fd = fopen(cpu_sensor[core], "r");
+	else if (nsensors)
+		fd = fopen(sensors[0].path, "r");
+
+	if (!fd)
+		fd = fopen(HWMON_PATH, "r");
+
 	if (!fd)
 		fd = fopen(HWMON_ALT, "r");
 
@@ -57,20 +204,152 @@ static float linux_cputemp(int core)
 	return tc;
 }
 
-#define CPUFREQ_PATH \
- "/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_cur_freq"
+/* kHz, the governor's view first, then the hardware's */
 static uint32_t linux_cpufreq(int core)
 {
-	FILE *fd = fopen(CPUFREQ_PATH, "r");
-	uint32_t freq = 0;
+	char path[96];
+	int freq;
+
+	if (core < 0)
+		return 0;
+	snprintf(path, sizeof(path), SYS_CPU "/cpu%d/cpufreq/scaling_cur_freq", core);
+	freq = read_int(path, 0);
+	if (freq <= 0) {
+		snprintf(path, sizeof(path), SYS_CPU "/cpu%d/cpufreq/cpuinfo_cur_freq", core);
+		freq = read_int(path, 0);
+	}
+	return freq > 0 ? (uint32_t) freq : 0;
+}
 
-	if (!fd)
-		return freq;
+/*
+ * RAPL energy counters of the powercap framework, intel-rapl:N for the
+ * packages and intel-rapl:N:M named "core" below them; AMD Zen exposes
+ * the same tree. The microjoule counters wrap at max_energy_range_uj,
+ * reading them more often than they wrap keeps the totals monotonic.
+ */
+struct rapl_domain {
+	char path[80];
+	bool core;
+	uint64_t range, last;
+	double joules;
+	bool seen;
+};
+
+#define MAX_RAPL 16
 
-	if (!fscanf(fd, "%d", &freq))
-		return freq;
+static struct rapl_domain rapl[MAX_RAPL];
+static int nrapl = -1;
+static pthread_mutex_t rapl_lock = PTHREAD_MUTEX_INITIALIZER;
 
-	return freq;
+static void add_rapl(const char *dir, bool core)
+{
+	char path[96], buf[32];
+	struct rapl_domain *d;
+
+	if (nrapl == MAX_RAPL)
+		return;
+	d = &rapl[nrapl];
+	snprintf(d->path, sizeof(d->path), "%s/energy_uj", dir);
+	if (!read_line(d->path, buf, sizeof(buf)))
+		return;	/* root only on recent kernels */
+	snprintf(path, sizeof(path), "%s/max_energy_range_uj", dir);
+	if (!read_line(path, buf, sizeof(buf)))
+		return;
+	d->range = strtoull(buf, NULL, 10);
+	d->core = core;
+	nrapl++;
+}
+
+static void scan_rapl(void)
+{
+	char dir[64], sub[80], path[96], buf[32];
+
+	nrapl = 0;
+	for (int p = 0; p < 8; p++) {
+		snprintf(dir, sizeof(dir), RAPL_PATH ":%d", p);
+		snprintf(path, sizeof(path), "%s/name", dir);
+		if (!read_line(path, buf, sizeof(buf)))
+			continue;
+		if (strncmp(buf, "package", 7))
+			continue;
+		add_rapl(dir, false);
+		for (int s = 0; s < 8; s++) {
+			snprintf(sub, sizeof(sub), "%s/intel-rapl:%d:%d", dir, p, s);
+			snprintf(path, sizeof(path), "%s/name", sub);
+			if (read_line(path, buf, sizeof(buf)) && !strcmp(buf, "core"))
+				add_rapl(sub, true);
+		}
+	}
+}
+
+static bool linux_energy(double *pkg, double *core)
+{
+	char buf[32];
+	bool ok = false;
+
+	*pkg = *core = 0.;
+	pthread_mutex_lock(&rapl_lock);
+	if (nrapl < 0)
+		scan_rapl();
+	for (int i = 0; i < nrapl; i++) {
+		struct rapl_domain *d = &rapl[i];
+		uint64_t uj;
+		if (!read_line(d->path, buf, sizeof(buf)))
+			continue;
+		uj = strtoull(buf, NULL, 10);
+		if (d->seen)
+			d->joules += ((uj >= d->last ? 0 : d->range) + uj - d->last) * 1e-6;
+		d->last = uj;
+		d->seen = true;
+		*(d->core ? core : pkg) += d->joules;
+		ok |= !d->core;
+	}
+	pthread_mutex_unlock(&rapl_lock);
+	return ok;
+}
+
+/* cpu is not the first hardware thread of its core */
+static bool linux_smt_sibling(int cpu)
+{
+	char path[96], buf[64];
+	snprintf(path, sizeof(path), SYS_CPU "/cpu%d/topology/thread_siblings_list", cpu);
+	if (!read_line(path, buf, sizeof(buf)))
+		return false;
+	return atoi(buf) != cpu;
+}
+
+/*
+ * Data or unified cache of the given level seen by cpu: its size and
+ * the cpus sharing it. The first of those names the slice, so cpus of
+ * the same L3 (a CCX on EPYC) get the same id.
+ */
+static int linux_cache(int cpu, int level, size_t *size, char *cpus, size_t sz)
+{
+	char dir[96], path[128], buf[64];
+
+	for (int i = 0; i < 8; i++) {
+		char unit = 'K';
+		unsigned long kb;
+
+		snprintf(dir, sizeof(dir), SYS_CPU "/cpu%d/cache/index%d", cpu, i);
+		snprintf(path, sizeof(path), "%s/level", dir);
+		if (read_int(path, -1) != level)
+			continue;
+		snprintf(path, sizeof(path), "%s/type", dir);
+		if (!read_line(path, buf, sizeof(buf)) || !strcmp(buf, "Instruction"))
+			continue;
+		snprintf(path, sizeof(path), "%s/size", dir);
+		if (!read_line(path, buf, sizeof(buf)) || sscanf(buf, "%lu%c", &kb, &unit) < 1)
+			continue;
+		*size = (size_t) kb << (unit == 'M' ? 20 : 10);
+		snprintf(path, sizeof(path), "%s/shared_cpu_list", dir);
+		if (!read_line(path, buf, sizeof(buf)))
+			snprintf(buf, sizeof(buf), "%d", cpu);
+		if (cpus)
+			snprintf(cpus, sz, "%s", buf);
+		return atoi(buf);
+	}
+	return -1;
 }
 
 #else /* WIN32 */
@@ -105,6 +384,38 @@ uint32_t cpu_clock(int core)
 #endif
 }
 
+/* joules used since the first call, packages and cores; false without RAPL */
+bool cpu_energy(double *pkg, double *core)
+{
+#ifdef WIN32
+	*pkg = *core = 0.;
+	return false;
+#else
+	return linux_energy(pkg, core);
+#endif
+}
+
+bool cpu_smt_sibling(int cpu)
+{
+#ifdef WIN32
+	return false;
+#else
+	return cpu >= 0 && linux_smt_sibling(cpu);
+#endif
+}
+
+/* id of the cache of this level cpu is on, -1 when unknown */
+int cpu_cache(int cpu, int level, size_t *size, char *cpus, size_t sz)
+{
+#ifdef WIN32
+	return -1;
+#else
+	if (cpu < 0)
+		return -1;
+	return linux_cache(cpu, level, size, cpus, sz);
+#endif
+}
+
 int cpu_fanpercent()
 {
 	return 0;
@@ -146,11 +457,13 @@ static inline void cpuid(int functionnumber, int output[4]) {
 #define FMA3_Flag    ((1 << 12)|AVX1_Flag|OSXSAVE_Flag)
 #define AES_Flag      (1 << 25)
 #define SSE42_Flag    (1 << 20)
+#define SSSE3_Flag    (1 << 9)
 
 #define SSE_Flag      (1 << 25) // EDX
 #define SSE2_Flag     (1 << 26) // EDX
 
 #define AVX2_Flag     (1 << 5) // ADV EBX
+#define SHA_Flag      (1 << 29) // ADV EBX
 
 bool has_aes_ni()
 {
@@ -163,6 +476,28 @@ bool has_aes_ni()
 #endif
 }
 
+bool has_ssse3()
+{
+#ifdef __arm__
+	return false;
+#else
+	int cpu_info[4] = { 0 };
+	cpuid(1, cpu_info);
+	return cpu_info[2] & SSSE3_Flag;
+#endif
+}
+
+bool has_sha()
+{
+#ifdef __arm__
+	return false;
+#else
+	int cpu_info[4] = { 0 };
+	cpuid(7, cpu_info);
+	return cpu_info[1] & SHA_Flag;
+#endif
+}
+
 void bestcpu_feature(char *outbuf, int maxsz)
 {
 #ifdef __arm__
@@ -188,5 +523,30 @@ void bestcpu_feature(char *outbuf, int maxsz)
 		sprintf(outbuf, "SSE");
 	else
 		*outbuf = '\0';
+	if (*outbuf && (cpu_info_adv[1] & SHA_Flag))
+		strcat(outbuf, " SHA");
+#endif
+}
+
+/* the brand string, "unknown" when the cpu has none */
+void cpu_getname(char *outbuf, size_t maxsz)
+{
+#ifdef __arm__
+	snprintf(outbuf, maxsz, "ARM");
+#else
+	int brand[12] = { 0 };
+	char *p = (char *) brand;
+	cpuid(0x80000000, brand);
+	if ((uint32_t) brand[0] < 0x80000004) {
+		snprintf(outbuf, maxsz, "unknown");
+		return;
+	}
+	for (int i = 0; i < 3; i++)
+		cpuid(0x80000002 + i, &brand[i * 4]);
+	while (*p == ' ')
+		p++;
+	snprintf(outbuf, maxsz, "%.48s", p);
+	for (p = outbuf + strlen(outbuf); p > outbuf && p[-1] == ' '; p--)
+		p[-1] = '\0';
 #endif
 }
@@ -0,0 +1,419 @@
+/**
+ * Benchmark sweep and auto-tuner
+ *
+ * Both measure configurations of the running miner: threads are switched
+ * off through the governor, the lane count of the algos which read it per
+ * scan is set, and the hashes and package joules the stats aggregator
+ * counted over a few seconds give the rate and the power.
+ *
+ * --benchmark-sweep=N measures every thread and lane count for N seconds,
+ * logs the fastest and the most efficient configuration in hashes per
+ * joule and exits.
+ *
+ * --autotune searches the thread count on the live or the benchmark job,
+ * the first hardware thread of each core first so the count also tells
+ * if SMT pays, then the lane count and huge pages at that count. The
+ * result is cached per cpu model and algo in --tune-file and applied at
+ * the next start without measuring again.
+ *
+ * Without either, tune_plan() logs how many threads of a memory-hard algo
+ * would have their scratchpads fit in the L3 slice they share (a CCX on
+ * EPYC). It is only a model, so it is applied on --cache-plan alone.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "miner.h"
+
+#define TUNE_SETTLE	3	/* seconds before measuring a configuration */
+#define TUNE_SECS	8	/* measured per configuration by --autotune */
+#define TUNE_KNEE	0.90	/* of the best rate, stop removing threads under it */
+#define TUNE_EPS	0.01	/* a costlier configuration must be this much faster */
+#define TUNE_FILE	"cpuminer-tune.json"
+#define PLAN_SLICES	64
+
+extern int opt_sweep;
+extern bool opt_autotune;
+extern char *opt_tune_file;
+
+struct tune_point {
+	int threads, lanes;
+	bool huge;
+	double rate, watts, hpj;
+};
+
+static int tune_threads;
+static int *tune_order;		/* first hardware thread of each core first */
+static int tune_primary;	/* threads on the first hardware thread of their core */
+static bool *tune_run;
+static int *tune_lanes;		/* lane count read per scan, NULL when fixed */
+static int tune_max_lanes;
+static bool tune_huge;		/* the algo reallocates on a page size change */
+static volatile bool tuning = false;
+static char tune_cpu[64], tune_algo[64];
+
+/* miners keep their scans short meanwhile, a scan is counted when it ends */
+bool tune_running(void)
+{
+	return tuning;
+}
+
+static void tune_apply(const struct tune_point *p)
+{
+	for (int i = 0; i < tune_threads; i++)
+		tune_run[i] = false;
+	for (int i = 0; i < p->threads; i++)
+		tune_run[tune_order[i]] = true;
+	if (tune_lanes)
+		*tune_lanes = p->lanes;
+	opt_hugepages = p->huge;
+	governor_select(tune_run);
+	for (int i = 0; i < tune_threads; i++)
+		work_restart[i].restart = 1;
+}
+
+static void tune_measure(struct tune_point *p, int secs)
+{
+	uint64_t h0, h1;
+	double j0, j1, s0, s1;
+
+	tune_apply(p);
+	sleep(TUNE_SETTLE);
+	stats_totals(&h0, &j0, &s0);
+	sleep(secs);
+	stats_totals(&h1, &j1, &s1);
+
+	p->rate = s1 > s0 ? (h1 - h0) / (s1 - s0) : 0.;
+	p->watts = s1 > s0 ? (j1 - j0) / (s1 - s0) : 0.;
+	p->hpj = p->watts > 0. ? p->rate / p->watts : 0.;
+}
+
+static void tune_log(const char *what, const struct tune_point *p)
+{
+	char rate[32];
+	format_hashrate(p->rate, rate);
+	if (p->watts > 0.)
+		applog(LOG_NOTICE, "%s%d threads x %d lanes%s: %s, %.1f W, %.4g H/J",
+			what, p->threads, p->lanes, p->huge ? "" : " (small pages)",
+			rate, p->watts, p->hpj);
+	else
+		applog(LOG_NOTICE, "%s%d threads x %d lanes%s: %s", what, p->threads,
+			p->lanes, p->huge ? "" : " (small pages)", rate);
+}
+
+static void *sweep_thread(void *arg)
+{
+	struct tune_point p = { 0 }, fastest = { 0 }, efficient = { 0 };
+
+	applog(LOG_NOTICE, "sweep: %d thread counts x %d lane counts, %ds each",
+		tune_threads, tune_max_lanes, TUNE_SETTLE + opt_sweep);
+	fprintf(stderr, "threads,lanes,hashrate,watts,hashes_per_joule\n");
+	tuning = true;
+	p.huge = opt_hugepages;
+	for (p.lanes = 1; p.lanes <= tune_max_lanes; p.lanes++) {
+		for (p.threads = 1; p.threads <= tune_threads; p.threads++) {
+			tune_measure(&p, opt_sweep);
+			tune_log("sweep: ", &p);
+			fprintf(stderr, "%d,%d,%.3f,%.3f,%.6f\n",
+				p.threads, p.lanes, p.rate, p.watts, p.hpj);
+			if (p.rate > fastest.rate)
+				fastest = p;
+			if (p.hpj > efficient.hpj)
+				efficient = p;
+		}
+	}
+
+	tune_log("Fastest: ", &fastest);
+	if (efficient.hpj > 0.)
+		tune_log("Most efficient: ", &efficient);
+	else
+		applog(LOG_WARNING, "sweep: no RAPL energy counters, efficiency unknown");
+	proper_exit(0);
+	return NULL;
+}
+
+static const char *tune_path(void)
+{
+	return opt_tune_file ? opt_tune_file : TUNE_FILE;
+}
+
+static bool tune_cache_get(struct tune_point *p)
+{
+	json_error_t err;
+	json_t *root = json_load_file(tune_path(), 0, &err);
+	json_t *e = json_object_get(json_object_get(root, tune_cpu), tune_algo);
+	bool ok = false;
+
+	if (json_is_object(e)) {
+		p->threads = (int) json_integer_value(json_object_get(e, "threads"));
+		p->lanes = (int) json_integer_value(json_object_get(e, "lanes"));
+		p->huge = json_is_true(json_object_get(e, "hugepages"));
+		p->rate = json_number_value(json_object_get(e, "hashrate"));
+		p->watts = json_number_value(json_object_get(e, "watts"));
+		p->hpj = p->watts > 0. ? p->rate / p->watts : 0.;
+		/* tuned with more threads or another lane range, measure again */
+		ok = p->threads >= 1 && p->threads <= tune_threads &&
+			p->lanes >= 1 && p->lanes <= tune_max_lanes;
+	}
+	if (root)
+		json_decref(root);
+	return ok;
+}
+
+static void tune_cache_put(const struct tune_point *p)
+{
+	json_error_t err;
+	json_t *root = json_load_file(tune_path(), 0, &err);
+	json_t *cpu, *e;
+
+	if (!json_is_object(root)) {
+		if (root)
+			json_decref(root);
+		root = json_object();
+	}
+	cpu = json_object_get(root, tune_cpu);
+	if (!json_is_object(cpu)) {
+		cpu = json_object();
+		json_object_set_new(root, tune_cpu, cpu);
+	}
+	e = json_object();
+	json_object_set_new(e, "threads", json_integer(p->threads));
+	json_object_set_new(e, "smt", json_boolean(p->threads > tune_primary));
+	json_object_set_new(e, "lanes", json_integer(p->lanes));
+	json_object_set_new(e, "hugepages", json_boolean(p->huge));
+	json_object_set_new(e, "hashrate", json_real(p->rate));
+	json_object_set_new(e, "watts", json_real(p->watts));
+	json_object_set_new(e, "time", json_integer((json_int_t) time(NULL)));
+	json_object_set_new(cpu, tune_algo, e);
+
+	if (json_dump_file(root, tune_path(), JSON_INDENT(2)))
+		applog(LOG_WARNING, "autotune: unable to write %s", tune_path());
+	json_decref(root);
+}
+
+static void *autotune_thread(void *arg)
+{
+	struct tune_point best, p;
+	double top;
+	uint64_t hashes;
+	double joules, secs;
+
+	/* nothing to measure before the first job */
+	do {
+		sleep(1);
+		stats_totals(&hashes, &joules, &secs);
+	} while (!hashes);
+
+	applog(LOG_NOTICE, "autotune: %s on %s, %ds per configuration",
+		tune_algo, tune_cpu, TUNE_SETTLE + TUNE_SECS);
+	tuning = true;
+
+	best.threads = tune_threads;
+	best.lanes = tune_lanes ? *tune_lanes : 1;
+	best.huge = opt_hugepages;
+	tune_measure(&best, TUNE_SECS);
+	tune_log("autotune: ", &best);
+	top = best.rate;
+
+	/* fewer threads while the rate holds, memory bound algos peak early */
+	p = best;
+	for (p.threads = tune_threads - 1; p.threads >= 1; p.threads--) {
+		tune_measure(&p, TUNE_SECS);
+		tune_log("autotune: ", &p);
+		if (p.rate > top)
+			top = p.rate;
+		if (p.rate >= (1. - TUNE_EPS) * top)
+			best = p;
+		else if (p.rate < TUNE_KNEE * top)
+			break;
+	}
+
+	for (int l = 1; l <= tune_max_lanes; l++) {
+		if (l == best.lanes)
+			continue;
+		p = best;
+		p.lanes = l;
+		tune_measure(&p, TUNE_SECS);
+		tune_log("autotune: ", &p);
+		if (p.rate > (1. + TUNE_EPS) * best.rate)
+			best = p;
+	}
+
+	if (tune_huge) {
+		p = best;
+		p.huge = !best.huge;
+		tune_measure(&p, TUNE_SECS);
+		tune_log("autotune: ", &p);
+		if (p.rate > (1. + TUNE_EPS) * best.rate)
+			best = p;
+	}
+
+	tune_apply(&best);
+	tuning = false;
+	tune_log("autotune: using ", &best);
+	if (best.threads > tune_primary)
+		applog(LOG_NOTICE, "autotune: SMT siblings help, %d threads on %d cores",
+			best.threads, tune_primary);
+	tune_cache_put(&best);
+	return NULL;
+}
+
+/* lanes: the lane count read per scan by the algo, NULL when fixed */
+bool tune_init(int nthreads, int *lanes, int max_lanes, bool huge)
+{
+	struct tune_point p;
+	pthread_t pth;
+	int n = 0;
+
+	if (!opt_sweep && !opt_autotune)
+		return true;
+
+	tune_threads = nthreads;
+	tune_lanes = lanes;
+	tune_max_lanes = lanes ? max_lanes : 1;
+	tune_huge = huge;
+	tune_order = (int *) calloc(nthreads, sizeof(*tune_order));
+	tune_run = (bool *) calloc(nthreads, sizeof(*tune_run));
+	if (!tune_order || !tune_run)
+		return false;
+	for (int i = 0; i < nthreads; i++)
+		if (!cpu_smt_sibling(governor_cpu(i)))
+			tune_order[n++] = i;
+	tune_primary = n;
+	for (int i = 0; i < nthreads; i++)
+		if (cpu_smt_sibling(governor_cpu(i)))
+			tune_order[n++] = i;
+
+	if (opt_sweep) {
+		if (pthread_create(&pth, NULL, sweep_thread, NULL))
+			return false;
+		pthread_detach(pth);
+		return true;
+	}
+
+	cpu_getname(tune_cpu, sizeof(tune_cpu));
+	get_currentalgo(tune_algo, sizeof(tune_algo));
+	if (tune_cache_get(&p)) {
+		tune_apply(&p);
+		tune_log("autotune: cached ", &p);
+		return true;
+	}
+	if (pthread_create(&pth, NULL, autotune_thread, NULL))
+		return false;
+	pthread_detach(pth);
+	return true;
+}
+
+struct plan_slice {
+	int id;			/* first cpu sharing it */
+	size_t size;
+	int threads, fit;
+	char cpus[64];
+};
+
+static int plan_fit(const struct plan_slice *s, size_t thread_bytes)
+{
+	int fit = (int) (s->size / thread_bytes);
+	/* not even one fits, memory bound anyway: no reason to hold threads back */
+	if (!fit || fit > s->threads)
+		fit = s->threads;
+	return fit;
+}
+
+/*
+ * Per L3 slice, run as many threads as their scratchpads fit in, the
+ * first hardware thread of each core first. When the algo reads its lane
+ * count per scan, take the one fitting the most lanes, the current one
+ * on a tie. apply is false when the user chose the threads or binding,
+ * the plan is only logged then.
+ */
+void tune_plan(int nthreads, size_t lane_bytes, int nlanes, int *lanes, int max_lanes, bool apply)
+{
+	struct plan_slice slice[PLAN_SLICES];
+	int nslices = 0, running = 0, best = nlanes, best_total = 0, n = 0;
+	int *slice_of, *order;
+	bool *run;
+	char algo[64];
+
+	if (!lane_bytes)
+		return;
+	slice_of = (int *) calloc(nthreads, sizeof(*slice_of));
+	order = (int *) calloc(nthreads, sizeof(*order));
+	run = (bool *) calloc(nthreads, sizeof(*run));
+	if (!slice_of || !order || !run)
+		goto out;
+
+	for (int i = 0; i < nthreads; i++) {
+		struct plan_slice cur = { 0 };
+		int cpu = governor_cpu(i), s;
+
+		cur.id = cpu_cache(cpu, 3, &cur.size, cur.cpus, sizeof(cur.cpus));
+		if (cur.id < 0 || !cur.size)
+			goto out;	/* not pinned or no L3 in sysfs */
+		for (s = 0; s < nslices; s++)
+			if (slice[s].id == cur.id)
+				break;
+		if (s == nslices) {
+			if (nslices == PLAN_SLICES)
+				goto out;
+			slice[nslices++] = cur;
+		}
+		slice[s].threads++;
+		slice_of[i] = s;
+	}
+
+	for (int l = 1; l <= (lanes ? max_lanes : 1); l++) {
+		int w = lanes ? l : nlanes, total = 0;
+		for (int s = 0; s < nslices; s++)
+			total += plan_fit(&slice[s], lane_bytes * w) * w;
+		if (total > best_total || (total == best_total && w == nlanes)) {
+			best_total = total;
+			best = w;
+		}
+	}
+
+	get_currentalgo(algo, sizeof(algo));
+	applog(LOG_INFO, "cache plan: %s, %u KiB per lane, %d lanes per thread",
+		algo, (uint32_t) (lane_bytes >> 10), best);
+	for (int s = 0; s < nslices; s++) {
+		slice[s].fit = plan_fit(&slice[s], lane_bytes * best);
+		running += slice[s].fit;
+		applog(LOG_INFO, "cache plan: L3 of cpus %s, %u KiB: %d of %d threads",
+			slice[s].cpus, (uint32_t) (slice[s].size >> 10), slice[s].fit, slice[s].threads);
+	}
+	if (running == nthreads && best == nlanes)
+		goto out;
+	if (!apply) {
+		applog(LOG_NOTICE, "cache plan: %d threads x %d lanes would fit in L3, "
+			"--cache-plan to run only those", running, best);
+		goto out;
+	}
+
+	/* the first hardware thread of each core first, as the tuner does */
+	for (int i = 0; i < nthreads; i++)
+		if (!cpu_smt_sibling(governor_cpu(i)))
+			order[n++] = i;
+	for (int i = 0; i < nthreads; i++)
+		if (cpu_smt_sibling(governor_cpu(i)))
+			order[n++] = i;
+	for (int k = 0; k < nthreads; k++) {
+		int i = order[k];
+		if (slice[slice_of[i]].fit > 0) {
+			slice[slice_of[i]].fit--;
+			run[i] = true;
+		}
+	}
+	if (lanes)
+		*lanes = best;
+	governor_select(run);
+	applog(LOG_NOTICE, "cache plan: %d of %d threads x %d lanes, to fit in L3",
+		running, nthreads, best);
+out:
+	free(slice_of);
+	free(order);
+	free(run);
+}
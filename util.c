@@ -34,6 +34,7 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <sys/mman.h>
 #endif
 
 #ifndef _MSC_VER
@@ -44,8 +45,6 @@
 #include "miner.h"
 #include "elist.h"
 
-extern pthread_mutex_t stats_lock;
-
 struct data_buffer {
 	void		*buf;
 	size_t		len;
@@ -83,6 +82,12 @@ void applog(int prio, const char *fmt, ...)
 
 	va_start(ap, fmt);
 
+	/* handed to the writer thread once log_init() ran */
+	if (applog_async(prio, fmt, ap)) {
+		va_end(ap);
+		return;
+	}
+
 #ifdef HAVE_SYSLOG_H
 	if (use_syslog) {
 		va_list ap2;
@@ -919,6 +924,16 @@ bool fulltest(const uint32_t *hash, const uint32_t *target)
 	return rc;
 }
 
+/* fulltest of the lanes set in mask, lane l at hash + 8 * l; first passing lane or -1 */
+int fulltest_lanes(const uint32_t *hash, uint32_t mask, const uint32_t *target)
+{
+	for (int l = 0; mask; l++, mask >>= 1) {
+		if ((mask & 1) && fulltest(hash + 8 * l, target))
+			return l;
+	}
+	return -1;
+}
+
 void diff_to_target(uint32_t *target, double diff)
 {
 	uint64_t m;
@@ -1611,11 +1626,6 @@ bool rpc2_job_decode(const json_t *job, struct work *work)
 
 		jobj_binary(job, "target", &target, 4);
 		if(rpc2_target != target) {
-			double hashrate = 0.0;
-			pthread_mutex_lock(&stats_lock);
-			for (int i = 0; i < opt_n_threads; i++)
-				hashrate += thr_hashrates[i];
-			pthread_mutex_unlock(&stats_lock);
 			double difficulty = (((double) 0xffffffff) / target);
 			if (!opt_quiet) {
 				// xmr pool diff can change a lot...
@@ -1639,6 +1649,7 @@ bool rpc2_job_decode(const json_t *job, struct work *work)
 		work->target[7] = rpc2_target;
 		if (work->job_id) free(work->job_id);
 		work->job_id = strdup(rpc2_job_id);
+		gettimeofday(&work->tv_job, NULL);
 	}
 	return true;
 
@@ -1729,8 +1740,10 @@ static bool stratum_notify(struct stratum_ctx *sctx, json_t *params)
 	sctx->job.xnonce2 = sctx->job.coinbase + coinb1_size + sctx->xnonce1_size;
 	hex2bin(sctx->job.coinbase, coinb1, coinb1_size);
 	memcpy(sctx->job.coinbase + coinb1_size, sctx->xnonce1, sctx->xnonce1_size);
-	if (!sctx->job.job_id || strcmp(sctx->job.job_id, job_id))
+	if (!sctx->job.job_id || strcmp(sctx->job.job_id, job_id)) {
 		memset(sctx->job.xnonce2, 0, sctx->xnonce2_size);
+		gettimeofday(&sctx->job.tv_recv, NULL);
+	}
 	hex2bin(sctx->job.xnonce2 + sctx->xnonce2_size, coinb2, coinb2_size);
 
 	free(sctx->job.job_id);
@@ -2188,6 +2201,7 @@ void print_hash_tests(void)
 	scrypthash(&hash[0], &buf[0], 2048);
 	printpfx("scrypt:2048", hash);
 
+	scryptjane_init();
 	scryptjanehash(&hash[0], &buf[0], 9);
 	printpfx("scrypt-jane", hash);
 
@@ -2243,3 +2257,61 @@ void memrev(unsigned char *p, size_t len)
 		*q = c;
 	}
 }
+
+/*
+ * Scratchpads of the memory-hard algos are hit at random offsets, back
+ * them with 2MB pages when the system has some reserved (hugetlbfs) or
+ * at least ask for transparent huge pages, else plain pages. With
+ * opt_hugepages off (--no-hugepages or the tuner) only plain pages.
+ */
+#define HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+static size_t hugepage_round(size_t size)
+{
+	return (size + HUGEPAGE_SIZE - 1) & ~((size_t) HUGEPAGE_SIZE - 1);
+}
+
+void *hugepage_alloc(size_t size)
+{
+	void *p;
+	size = hugepage_round(size);
+#ifdef WIN32
+	p = NULL;
+	if (opt_hugepages)
+		p = VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+	if (!p)
+		p = VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+	p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+	if (opt_hugepages)
+		p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+	if (p == MAP_FAILED) {
+		p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			return NULL;
+#if defined(MADV_HUGEPAGE) && defined(MADV_NOHUGEPAGE)
+		madvise(p, size, opt_hugepages ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+#elif defined(MADV_HUGEPAGE)
+		if (opt_hugepages)
+			madvise(p, size, MADV_HUGEPAGE);
+#endif
+	}
+#endif
+	if (p)
+		stats_scratchpad((int64_t) size);
+	return p;
+}
+
+void hugepage_free(void *p, size_t size)
+{
+	if (!p)
+		return;
+#ifdef WIN32
+	VirtualFree(p, 0, MEM_RELEASE);
+#else
+	munmap(p, hugepage_round(size));
+#endif
+	stats_scratchpad(-(int64_t) hugepage_round(size));
+}
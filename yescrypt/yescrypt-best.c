@@ -271,7 +271,7 @@ blockmix_salsa8(const salsa20_blk_t *restrict Bin,
 #if !defined(__x86_64__) && defined(__SSE4_1__)
 /* 32-bit with SSE4.1 */
 #define PWXFORM_X_T __m128i
-#define PWXFORM_SIMD(X, x, s0, s1) \
+#define PWXFORM_SIMD_L(X, x, s0, s1, S0, S1) \
 	x = _mm_and_si128(X, _mm_set1_epi64x(S_MASK2)); \
 	s0 = *(const __m128i *)(S0 + (uint32_t)_mm_cvtsi128_si32(x)); \
 	s1 = *(const __m128i *)(S1 + (uint32_t)_mm_extract_epi32(x, 1)); \
@@ -281,7 +281,7 @@ blockmix_salsa8(const salsa20_blk_t *restrict Bin,
 #else
 /* 64-bit, or 32-bit without SSE4.1 */
 #define PWXFORM_X_T uint64_t
-#define PWXFORM_SIMD(X, x, s0, s1) \
+#define PWXFORM_SIMD_L(X, x, s0, s1, S0, S1) \
 	x = EXTRACT64(X) & S_MASK2; \
 	s0 = *(const __m128i *)(S0 + (uint32_t)x); \
 	s1 = *(const __m128i *)(S1 + (x >> 32)); \
@@ -290,6 +290,9 @@ blockmix_salsa8(const salsa20_blk_t *restrict Bin,
 	X = _mm_xor_si128(X, s1);
 #endif
 
+#define PWXFORM_SIMD(X, x, s0, s1) \
+	PWXFORM_SIMD_L(X, x, s0, s1, S0, S1)
+
 #define PWXFORM_ROUND \
 	PWXFORM_SIMD(X0, x0, s00, s01) \
 	PWXFORM_SIMD(X1, x1, s10, s11) \
@@ -639,6 +642,229 @@ blockmix_xor_save(const salsa20_blk_t *restrict Bin1,
 		return _mm_cvtsi128_si32(X0);
 }
 
+/*
+ * Two independent hashes, one per lane, with their pwxform rounds
+ * interleaved so that the S-box lookups of one lane overlap the multiply and
+ * load latency of the other.  Lane 0 is kept in X0 ... X3, lane 1 in
+ * Z0 ... Z3.  Only the pwxform variants exist: the 2-way code always has S.
+ */
+#define LOAD4_L(X, in) \
+	X##0 = (in)[0]; \
+	X##1 = (in)[1]; \
+	X##2 = (in)[2]; \
+	X##3 = (in)[3];
+
+#define XOR4_L(X, in) \
+	X##0 = _mm_xor_si128(X##0, (in)[0]); \
+	X##1 = _mm_xor_si128(X##1, (in)[1]); \
+	X##2 = _mm_xor_si128(X##2, (in)[2]); \
+	X##3 = _mm_xor_si128(X##3, (in)[3]);
+
+#define XOR4_2_L(X, in1, in2) \
+	X##0 = _mm_xor_si128((in1)[0], (in2)[0]); \
+	X##1 = _mm_xor_si128((in1)[1], (in2)[1]); \
+	X##2 = _mm_xor_si128((in1)[2], (in2)[2]); \
+	X##3 = _mm_xor_si128((in1)[3], (in2)[3]);
+
+/* out <-- in \xor out, X <-- X \xor out */
+#define XOR4_SAVE_L(X, in, out) \
+	(out)[0] = _mm_xor_si128((in)[0], (out)[0]); \
+	(out)[1] = _mm_xor_si128((in)[1], (out)[1]); \
+	(out)[2] = _mm_xor_si128((in)[2], (out)[2]); \
+	(out)[3] = _mm_xor_si128((in)[3], (out)[3]); \
+	XOR4_L(X, out)
+
+#define XOUT_L(X, out) \
+	(out)[0] = X##0; \
+	(out)[1] = X##1; \
+	(out)[2] = X##2; \
+	(out)[3] = X##3;
+
+#define PWXFORM_ROUND_2 \
+	PWXFORM_SIMD_L(X0, x0, s00, s01, S0, S1) \
+	PWXFORM_SIMD_L(Z0, z0, t00, t01, T0, T1) \
+	PWXFORM_SIMD_L(X1, x1, s10, s11, S0, S1) \
+	PWXFORM_SIMD_L(Z1, z1, t10, t11, T0, T1) \
+	PWXFORM_SIMD_L(X2, x2, s20, s21, S0, S1) \
+	PWXFORM_SIMD_L(Z2, z2, t20, t21, T0, T1) \
+	PWXFORM_SIMD_L(X3, x3, s30, s31, S0, S1) \
+	PWXFORM_SIMD_L(Z3, z3, t30, t31, T0, T1)
+
+#define PWXFORM_2 \
+	{ \
+		PWXFORM_X_T x0, x1, x2, x3, z0, z1, z2, z3; \
+		__m128i s00, s01, s10, s11, s20, s21, s30, s31; \
+		__m128i t00, t01, t10, t11, t20, t21, t30, t31; \
+		PWXFORM_ROUND_2 PWXFORM_ROUND_2 \
+		PWXFORM_ROUND_2 PWXFORM_ROUND_2 \
+		PWXFORM_ROUND_2 PWXFORM_ROUND_2 \
+	}
+
+/* The final salsa20/8 is run once per lane through X0 ... X3 */
+#define SALSA20_8_2(out0, out1) \
+	SALSA20_8(out0) \
+	X0 = Z0; \
+	X1 = Z1; \
+	X2 = Z2; \
+	X3 = Z3; \
+	SALSA20_8(out1)
+
+#define SBOX_PTRS_2(S) \
+	S0 = (const uint8_t *)(S)[0]; \
+	S1 = S0 + S_SIZE_ALL / 2; \
+	T0 = (const uint8_t *)(S)[1]; \
+	T1 = T0 + S_SIZE_ALL / 2;
+
+/**
+* blockmix_2way(Bin, Bout, r, S):
+* blockmix() of two lanes, with Bin[l], Bout[l] and S[l] for lane l.
+*/
+static void
+blockmix_2way(salsa20_blk_t *const Bin[2], salsa20_blk_t *const Bout[2],
+	size_t r, const __m128i *const S[2])
+{
+	const uint8_t * S0, *S1, *T0, *T1;
+	__m128i X0, X1, X2, X3, Z0, Z1, Z2, Z3;
+	size_t i;
+
+	SBOX_PTRS_2(S)
+
+	/* Convert 128-byte blocks to 64-byte blocks */
+	r *= 2;
+
+	r--;
+
+	/* X <-- B_{r1 - 1} */
+	LOAD4_L(X, Bin[0][r].q)
+	LOAD4_L(Z, Bin[1][r].q)
+
+	/* for i = 0 to r1 - 1 do */
+	for (i = 0; i < r; i++) {
+		/* X <-- H'(X \xor B_i) */
+		XOR4_L(X, Bin[0][i].q)
+		XOR4_L(Z, Bin[1][i].q)
+		PWXFORM_2
+		/* B'_i <-- X */
+		XOUT_L(X, Bout[0][i].q)
+		XOUT_L(Z, Bout[1][i].q)
+	}
+
+	/* Last iteration of the loop above */
+	XOR4_L(X, Bin[0][i].q)
+	XOR4_L(Z, Bin[1][i].q)
+	PWXFORM_2
+
+	/* B'_i <-- H(B'_i) */
+	SALSA20_8_2(Bout[0][i].q, Bout[1][i].q)
+}
+
+/**
+* blockmix_xor_2way(Bin1, Bin2, Bout, r, S, j):
+* blockmix_xor() of two lanes with Bin2 in RAM, returning Integerify() of
+* each lane in j.
+*/
+static void
+blockmix_xor_2way(salsa20_blk_t *const Bin1[2], salsa20_blk_t *const Bin2[2],
+	salsa20_blk_t *const Bout[2], size_t r, const __m128i *const S[2],
+	uint32_t j[2])
+{
+	const uint8_t * S0, *S1, *T0, *T1;
+	__m128i X0, X1, X2, X3, Z0, Z1, Z2, Z3;
+	size_t i;
+
+	SBOX_PTRS_2(S)
+
+	/* Convert 128-byte blocks to 64-byte blocks */
+	r *= 2;
+
+	r--;
+	for (i = 0; i <= r; i++) {
+		PREFETCH(&Bin2[0][i], _MM_HINT_T0)
+		PREFETCH(&Bin2[1][i], _MM_HINT_T0)
+	}
+
+	/* X <-- B_{r1 - 1} */
+	XOR4_2_L(X, Bin1[0][r].q, Bin2[0][r].q)
+	XOR4_2_L(Z, Bin1[1][r].q, Bin2[1][r].q)
+
+	/* for i = 0 to r1 - 1 do */
+	for (i = 0; i < r; i++) {
+		/* X <-- H'(X \xor B_i) */
+		XOR4_L(X, Bin1[0][i].q)
+		XOR4_L(X, Bin2[0][i].q)
+		XOR4_L(Z, Bin1[1][i].q)
+		XOR4_L(Z, Bin2[1][i].q)
+		PWXFORM_2
+		/* B'_i <-- X */
+		XOUT_L(X, Bout[0][i].q)
+		XOUT_L(Z, Bout[1][i].q)
+	}
+
+	/* Last iteration of the loop above */
+	XOR4_L(X, Bin1[0][i].q)
+	XOR4_L(X, Bin2[0][i].q)
+	XOR4_L(Z, Bin1[1][i].q)
+	XOR4_L(Z, Bin2[1][i].q)
+	PWXFORM_2
+
+	/* B'_i <-- H(B'_i) */
+	SALSA20_8_2(Bout[0][i].q, Bout[1][i].q)
+
+	j[0] = Bout[0][i].w[0];
+	j[1] = Bout[1][i].w[0];
+}
+
+/**
+* blockmix_xor_save_2way(Bin1, Bin2, Bout, r, S, j):
+* blockmix_xor_save() of two lanes, returning Integerify() of each lane in j.
+*/
+static void
+blockmix_xor_save_2way(salsa20_blk_t *const Bin1[2],
+	salsa20_blk_t *const Bin2[2], salsa20_blk_t *const Bout[2],
+	size_t r, const __m128i *const S[2], uint32_t j[2])
+{
+	const uint8_t * S0, *S1, *T0, *T1;
+	__m128i X0, X1, X2, X3, Z0, Z1, Z2, Z3;
+	size_t i;
+
+	SBOX_PTRS_2(S)
+
+	/* Convert 128-byte blocks to 64-byte blocks */
+	r *= 2;
+
+	r--;
+	for (i = 0; i <= r; i++) {
+		PREFETCH(&Bin2[0][i], _MM_HINT_T0)
+		PREFETCH(&Bin2[1][i], _MM_HINT_T0)
+	}
+
+	/* X <-- B_{r1 - 1} */
+	XOR4_2_L(X, Bin1[0][r].q, Bin2[0][r].q)
+	XOR4_2_L(Z, Bin1[1][r].q, Bin2[1][r].q)
+
+	/* for i = 0 to r1 - 1 do */
+	for (i = 0; i < r; i++) {
+		/* X <-- H'(X \xor B_i) */
+		XOR4_SAVE_L(X, Bin1[0][i].q, Bin2[0][i].q)
+		XOR4_SAVE_L(Z, Bin1[1][i].q, Bin2[1][i].q)
+		PWXFORM_2
+		/* B'_i <-- X */
+		XOUT_L(X, Bout[0][i].q)
+		XOUT_L(Z, Bout[1][i].q)
+	}
+
+	/* Last iteration of the loop above */
+	XOR4_SAVE_L(X, Bin1[0][i].q, Bin2[0][i].q)
+	XOR4_SAVE_L(Z, Bin1[1][i].q, Bin2[1][i].q)
+	PWXFORM_2
+
+	/* B'_i <-- H(B'_i) */
+	SALSA20_8_2(Bout[0][i].q, Bout[1][i].q)
+
+	j[0] = Bout[0][i].w[0];
+	j[1] = Bout[1][i].w[0];
+}
+
 #undef ARX
 #undef SALSA20_2ROUNDS
 #undef SALSA20_8
@@ -653,6 +879,17 @@ blockmix_xor_save(const salsa20_blk_t *restrict Bin1,
 #undef XOR4
 #undef XOR4_2
 #undef XOR4_Y
+#undef PWXFORM_SIMD
+#undef PWXFORM_SIMD_L
+#undef LOAD4_L
+#undef XOR4_L
+#undef XOR4_2_L
+#undef XOR4_SAVE_L
+#undef XOUT_L
+#undef PWXFORM_ROUND_2
+#undef PWXFORM_2
+#undef SALSA20_8_2
+#undef SBOX_PTRS_2
 
 /**
 * integerify(B, r):
@@ -1034,6 +1271,180 @@ smix2(uint8_t * B, size_t r, uint32_t N, uint64_t Nloop,
 	}
 }
 
+/**
+* smix1_2way(B, r, N, V, XY, S):
+* smix1() of two lanes for the YESCRYPT_RW | YESCRYPT_PWXFORM flags without
+* ROM, with B[l], V[l], XY[l] and S[l] for lane l.
+*/
+static void
+smix1_2way(uint8_t *const B[2], size_t r, uint32_t N,
+	salsa20_blk_t *const V[2], salsa20_blk_t *const XY[2],
+	const __m128i *const S[2])
+{
+	size_t s = 2 * r;
+	salsa20_blk_t * X[2], *Y[2], *V_j[2];
+	uint32_t i, j[2], n;
+	size_t k;
+	int l;
+
+	/* 1: X <-- B */
+	/* 3: V_i <-- X */
+	for (l = 0; l < 2; l++) {
+		X[l] = V[l];
+		for (k = 0; k < 2 * r; k++) {
+			for (i = 0; i < 16; i++) {
+				X[l][k].w[i] = le32dec(&B[l][(k * 16 + (i * 5 % 16)) * 4]);
+			}
+		}
+		Y[l] = &V[l][s];
+	}
+
+	/* 4: X <-- H(X) */
+	/* 3: V_i <-- X */
+	blockmix_2way(X, Y, r, S);
+
+	/* 4: X <-- H(X) */
+	/* 3: V_i <-- X */
+	for (l = 0; l < 2; l++)
+		X[l] = &V[l][2 * s];
+	blockmix_2way(Y, X, r, S);
+	for (l = 0; l < 2; l++)
+		j[l] = integerify(X[l], r);
+
+	for (n = 2; n < N; n <<= 1) {
+		uint32_t m = (n < N / 2) ? n : (N - 1 - n);
+
+		/* 2: for i = 0 to N - 1 do */
+		for (i = 1; i < m; i += 2) {
+			for (l = 0; l < 2; l++) {
+				Y[l] = &V[l][(n + i) * s];
+
+				/* j <-- Wrap(Integerify(X), i) */
+				j[l] &= n - 1;
+				j[l] += i - 1;
+				V_j[l] = &V[l][j[l] * s];
+			}
+
+			/* X <-- X \xor V_j */
+			/* 4: X <-- H(X) */
+			/* 3: V_i <-- X */
+			blockmix_xor_2way(X, V_j, Y, r, S, j);
+
+			for (l = 0; l < 2; l++) {
+				/* j <-- Wrap(Integerify(X), i) */
+				j[l] &= n - 1;
+				j[l] += i;
+				V_j[l] = &V[l][j[l] * s];
+				X[l] = &V[l][(n + i + 1) * s];
+			}
+
+			/* X <-- X \xor V_j */
+			/* 4: X <-- H(X) */
+			/* 3: V_i <-- X */
+			blockmix_xor_2way(Y, V_j, X, r, S, j);
+		}
+	}
+
+	n >>= 1;
+
+	for (l = 0; l < 2; l++) {
+		/* j <-- Wrap(Integerify(X), i) */
+		j[l] &= n - 1;
+		j[l] += N - 2 - n;
+		V_j[l] = &V[l][j[l] * s];
+		Y[l] = &V[l][(N - 1) * s];
+	}
+
+	/* X <-- X \xor V_j */
+	/* 4: X <-- H(X) */
+	/* 3: V_i <-- X */
+	blockmix_xor_2way(X, V_j, Y, r, S, j);
+
+	for (l = 0; l < 2; l++) {
+		/* j <-- Wrap(Integerify(X), i) */
+		j[l] &= n - 1;
+		j[l] += N - 1 - n;
+		V_j[l] = &V[l][j[l] * s];
+		X[l] = XY[l];
+	}
+
+	/* X <-- X \xor V_j */
+	/* 4: X <-- H(X) */
+	blockmix_xor_2way(Y, V_j, X, r, S, j);
+
+	/* B' <-- X */
+	for (l = 0; l < 2; l++) {
+		for (k = 0; k < 2 * r; k++) {
+			for (i = 0; i < 16; i++) {
+				le32enc(&B[l][(k * 16 + (i * 5 % 16)) * 4], X[l][k].w[i]);
+			}
+		}
+	}
+}
+
+/**
+* smix2_2way(B, r, N, Nloop, V, XY, S):
+* smix2() of two lanes for the YESCRYPT_RW | YESCRYPT_PWXFORM flags without
+* ROM.  The value Nloop must be even.
+*/
+static void
+smix2_2way(uint8_t *const B[2], size_t r, uint32_t N, uint64_t Nloop,
+	salsa20_blk_t *const V[2], salsa20_blk_t *const XY[2],
+	const __m128i *const S[2])
+{
+	size_t s = 2 * r;
+	salsa20_blk_t * X[2], *Y[2], *V_j[2];
+	uint64_t i;
+	uint32_t j[2];
+	size_t k;
+	int l;
+
+	if (Nloop == 0)
+		return;
+
+	/* X <-- B' */
+	for (l = 0; l < 2; l++) {
+		X[l] = XY[l];
+		Y[l] = &XY[l][s];
+		for (k = 0; k < 2 * r; k++) {
+			for (i = 0; i < 16; i++) {
+				X[l][k].w[i] = le32dec(&B[l][(k * 16 + (i * 5 % 16)) * 4]);
+			}
+		}
+
+		/* 7: j <-- Integerify(X) mod N */
+		j[l] = integerify(X[l], r) & (N - 1);
+	}
+
+	/* 6: for i = 0 to N - 1 do */
+	i = Nloop / 2;
+	do {
+		/* 8: X <-- H(X \xor V_j) */
+		/* V_j <-- Xprev \xor V_j */
+		/* 7: j <-- Integerify(X) mod N */
+		for (l = 0; l < 2; l++)
+			V_j[l] = &V[l][j[l] * s];
+		blockmix_xor_save_2way(X, V_j, Y, r, S, j);
+
+		for (l = 0; l < 2; l++) {
+			j[l] &= N - 1;
+			V_j[l] = &V[l][j[l] * s];
+		}
+		blockmix_xor_save_2way(Y, V_j, X, r, S, j);
+		for (l = 0; l < 2; l++)
+			j[l] &= N - 1;
+	} while (--i);
+
+	/* 10: B' <-- X */
+	for (l = 0; l < 2; l++) {
+		for (k = 0; k < 2 * r; k++) {
+			for (i = 0; i < 16; i++) {
+				le32enc(&B[l][(k * 16 + (i * 5 % 16)) * 4], X[l][k].w[i]);
+			}
+		}
+	}
+}
+
 /**
 * p2floor(x):
 * Largest power of 2 not greater than argument.
@@ -1143,6 +1554,52 @@ smix(uint8_t * B, size_t r, uint32_t N, uint32_t p, uint32_t t,
 #endif
 }
 
+/**
+* kdf_final(passwd, passwdlen, salt, saltlen, B, B_size, sha256, post, buf,
+*     buflen):
+* Last steps of yescrypt_kdf(), after the smix.  post is set unless computing
+* classic scrypt; sha256 holds the prehash and is clobbered.
+*/
+static void
+kdf_final(const uint8_t * passwd, size_t passwdlen,
+	const uint8_t * salt, size_t saltlen,
+	const uint8_t * B, size_t B_size, uint8_t * sha256, int post,
+	uint8_t * buf, size_t buflen)
+{
+	/* 5: DK <-- PBKDF2(P, B, 1, dkLen) */
+	PBKDF2_SHA256(passwd, passwdlen, B, B_size, 1, buf, buflen);
+
+	/*
+	* Except when computing classic scrypt, allow all computation so far
+	* to be performed on the client.  The final steps below match those of
+	* SCRAM (RFC 5802), so that an extension of SCRAM (with the steps so
+	* far in place of SCRAM's use of PBKDF2 and with SHA-256 in place of
+	* SCRAM's use of SHA-1) would be usable with yescrypt hashes.
+	*/
+	if (post && buflen == 32) {
+		/* Compute ClientKey */
+		{
+			HMAC_SHA256_CTX_Y ctx;
+			HMAC_SHA256_Init_Y(&ctx, buf, buflen);
+			if (yescrypt_client_key)
+				/* Personalised, "Client Key" for proper yescrypt */
+				HMAC_SHA256_Update_Y(&ctx, yescrypt_client_key,
+					yescrypt_client_key_len);
+			else
+				/* GlobalBoost-Y buggy yescrypt */
+				HMAC_SHA256_Update_Y(&ctx, salt, saltlen);
+			HMAC_SHA256_Final_Y(sha256, &ctx);
+		}
+		/* Compute StoredKey */
+		{
+			SHA256_CTX_Y ctx;
+			SHA256_Init_Y(&ctx);
+			SHA256_Update_Y(&ctx, sha256, 32);
+			SHA256_Final_Y(buf, &ctx);
+		}
+	}
+}
+
 /**
 * yescrypt_kdf(shared, local, passwd, passwdlen, salt, saltlen,
 *     N, r, p, t, flags, buf, buflen):
@@ -1357,41 +1814,178 @@ yescrypt_kdf(const yescrypt_shared_t * shared, yescrypt_local_t * local,
 		}
 	}
 
-	/* 5: DK <-- PBKDF2(P, B, 1, dkLen) */
-	PBKDF2_SHA256(passwd, passwdlen, B, B_size, 1, buf, buflen);
+	kdf_final(passwd, passwdlen, salt, saltlen, B, B_size, sha256,
+		t || flags, buf, buflen);
 
-	/*
-	* Except when computing classic scrypt, allow all computation so far
-	* to be performed on the client.  The final steps below match those of
-	* SCRAM (RFC 5802), so that an extension of SCRAM (with the steps so
-	* far in place of SCRAM's use of PBKDF2 and with SHA-256 in place of
-	* SCRAM's use of SHA-1) would be usable with yescrypt hashes.
-	*/
-	if ((t || flags) && buflen == sizeof(sha256)) {
-		/* Compute ClientKey */
-		{
-			HMAC_SHA256_CTX_Y ctx;
-			HMAC_SHA256_Init_Y(&ctx, buf, buflen);
-#if 0
-			/* Proper yescrypt */
-			HMAC_SHA256_Update_Y(&ctx, "Client Key", 10);
+	if (free_region(&tmp))
+		return -1;
+
+	/* Success! */
+	return 0;
+}
+
+/**
+* local_size(N, r, p, flags):
+* Size of the local region yescrypt_kdf() needs for these parameters without
+* a shared ROM, or 0 if they are out of range.
+*/
+static size_t
+local_size(uint64_t N, uint32_t r, uint32_t p, yescrypt_flags_t flags)
+{
+	size_t V_size, B_size, XY_size, S_size, need;
+
+	if (p == 1)
+		flags &= ~YESCRYPT_PARALLEL_SMIX;
+	if (!r || !p || (uint64_t)(r) * (uint64_t)(p) >= (1 << 30) ||
+		N > UINT32_MAX || r > SIZE_MAX / 256 / p ||
+		N > SIZE_MAX / 128 / r)
+		return 0;
+
+	V_size = (size_t)128 * r * N;
+	B_size = (size_t)128 * r * p;
+	XY_size = (size_t)256 * r;
+	S_size = (flags & YESCRYPT_PWXFORM) ? S_SIZE_ALL : 0;
+#ifdef _OPENMP
+	if (!(flags & YESCRYPT_PARALLEL_SMIX)) {
+		if (V_size > SIZE_MAX / p)
+			return 0;
+		V_size *= p;
+	}
+	XY_size *= p;
+	S_size *= p;
 #else
-			/* GlobalBoost-Y buggy yescrypt */
-			HMAC_SHA256_Update_Y(&ctx, salt, saltlen);
+	if (flags & YESCRYPT_PARALLEL_SMIX)
+		S_size *= p;
 #endif
-			HMAC_SHA256_Final_Y(sha256, &ctx);
+	need = V_size + B_size;
+	if (need < B_size || need + XY_size < XY_size)
+		return 0;
+	need += XY_size;
+	if (need + S_size < S_size)
+		return 0;
+	return need + S_size;
+}
+
+/**
+* yescrypt_prealloc_local(local, N, r, p, flags):
+* Allocate the region of local for yescrypt_kdf() with these parameters, on
+* huge pages when the system has them, and fault all of its pages in now.
+*
+* Return 0 on success; or -1 on error.
+*/
+int
+yescrypt_prealloc_local(yescrypt_local_t * local,
+	uint64_t N, uint32_t r, uint32_t p, yescrypt_flags_t flags)
+{
+	size_t need = local_size(N, r, p, flags);
+
+	if (!need) {
+		errno = ENOMEM;
+		return -1;
+	}
+	if (local->aligned_size < need) {
+		if (free_region(local))
+			return -1;
+		if (!alloc_region(local, need))
+			return -1;
+	}
+	prefault_region(local);
+	return 0;
+}
+
+/**
+* yescrypt_kdf_2way(shared, local, passwd, passwdlen, salt, saltlen,
+*     N, r, p, t, flags, buf, buflen):
+* yescrypt_kdf() of two independent inputs, passwd[l] and salt[l] giving
+* buf[l] and using local[l] for lane l.  The two smix are run interleaved for
+* the YESCRYPT_RW | YESCRYPT_PWXFORM flags without ROM and with t = 0, which
+* is what the miner uses; anything else is computed one lane at a time.
+*
+* Return 0 on success; or -1 on error.
+*/
+int
+yescrypt_kdf_2way(const yescrypt_shared_t * shared, yescrypt_local_t * local,
+	const uint8_t * const passwd[2], size_t passwdlen,
+	const uint8_t * const salt[2], size_t saltlen,
+	uint64_t N, uint32_t r, uint32_t p, uint32_t t, yescrypt_flags_t flags,
+	uint8_t * const buf[2], size_t buflen)
+{
+	uint8_t _ALIGN(128) sha256[2][32];
+	uint8_t * B[2], *Bp[2];
+	salsa20_blk_t * V[2], *XY[2];
+	const __m128i * S[2];
+	size_t B_size, V_size, need;
+	uint64_t Nloop_all, Nloop_rw;
+	uint32_t i;
+	int l;
+
+	need = local_size(N, r, p, flags);
+	if (t || flags != (YESCRYPT_RW | YESCRYPT_PWXFORM) ||
+		shared->shared1.aligned || !need ||
+		(N & (N - 1)) != 0 || N <= 7 ||
+		(SIZE_MAX > UINT32_MAX && buflen > (((uint64_t)(1) << 32) - 1) * 32)) {
+		for (l = 0; l < 2; l++) {
+			if (yescrypt_kdf(shared, &local[l], passwd[l], passwdlen,
+				salt[l], saltlen, N, r, p, t, flags, buf[l], buflen))
+				return -1;
 		}
-		/* Compute StoredKey */
+		return 0;
+	}
+
+	B_size = (size_t)128 * r * p;
+	V_size = (size_t)128 * r * N;
+	for (l = 0; l < 2; l++) {
+		if (local[l].aligned_size < need) {
+			if (free_region(&local[l]))
+				return -1;
+			if (!alloc_region(&local[l], need))
+				return -1;
+		}
+		B[l] = (uint8_t *)local[l].aligned;
+		V[l] = (salsa20_blk_t *)(B[l] + B_size);
+		XY[l] = (salsa20_blk_t *)((uint8_t *)V[l] + V_size);
+		S[l] = (const __m128i *)((uint8_t *)XY[l] + (size_t)256 * r);
+
 		{
 			SHA256_CTX_Y ctx;
 			SHA256_Init_Y(&ctx);
-			SHA256_Update_Y(&ctx, sha256, sizeof(sha256));
-			SHA256_Final_Y(buf, &ctx);
+			SHA256_Update_Y(&ctx, passwd[l], passwdlen);
+			SHA256_Final_Y(sha256[l], &ctx);
 		}
+
+		/* 1: (B_0 ... B_{p-1}) <-- PBKDF2(P, S, 1, p * MFLen) */
+		PBKDF2_SHA256(sha256[l], sizeof(sha256[l]), salt[l], saltlen, 1,
+			B[l], B_size);
+		memcpy(sha256[l], B[l], sizeof(sha256[l]));
 	}
 
-	if (free_region(&tmp))
-		return -1;
+	/* Loop counts of smix() at p = 1 and t = 0, see there */
+	Nloop_all = (N + 2) / 3;
+	Nloop_rw = Nloop_all;
+	Nloop_all++; Nloop_all &= ~(uint64_t)1;
+	Nloop_rw &= ~(uint64_t)1;
+
+	/* 2: for i = 0 to p - 1 do */
+	for (i = 0; i < p; i++) {
+		/* 3: B_i <-- MF(B_i, N) */
+		for (l = 0; l < 2; l++) {
+			Bp[l] = &B[l][(size_t)128 * r * i];
+			smix1(Bp[l], 1, S_SIZE_ALL / 128, YESCRYPT_RW,
+				(salsa20_blk_t *)S[l], 0, shared, XY[l], NULL);
+		}
+		smix1_2way(Bp, r, N, V, XY, S);
+		smix2_2way(Bp, r, N, Nloop_rw, V, XY, S);
+		if (Nloop_all > Nloop_rw) {
+			for (l = 0; l < 2; l++)
+				smix2(Bp[l], r, N, Nloop_all - Nloop_rw,
+					YESCRYPT_PWXFORM, V[l], 0, shared, XY[l],
+					(void *)S[l]);
+		}
+	}
+
+	for (l = 0; l < 2; l++)
+		kdf_final(sha256[l], sizeof(sha256[l]), salt[l], saltlen,
+			B[l], B_size, sha256[l], 1, buf[l], buflen);
 
 	/* Success! */
 	return 0;
@@ -325,46 +325,97 @@ uint8_t* yescrypt_gensalt(uint32_t N_log2, uint32_t r, uint32_t p, yescrypt_flag
 	    buf, sizeof(buf));
 }
 
-static int yescrypt_bsty(const uint8_t * passwd, size_t passwdlen,
-    const uint8_t * salt, size_t saltlen, uint64_t N, uint32_t r, uint32_t p,
-    uint8_t * buf, size_t buflen)
+/* Coin parameters, see yescrypt_set_params() */
+static uint64_t param_N = 2048;
+static uint32_t param_r = 8;
+static uint32_t param_p = 1;
+static char *param_pers = NULL;
+
+const uint8_t * yescrypt_client_key = NULL;
+size_t yescrypt_client_key_len = 0;
+
+/* V of one hash for the coin parameters */
+size_t yescrypt_lane_bytes(void)
 {
-	static __thread int initialized = 0;
-	static __thread yescrypt_shared_t shared;
-	static __thread yescrypt_local_t local;
-	int retval;
+	return (size_t) 128 * param_r * param_N;
+}
+
+int yescrypt_set_params(uint64_t N, uint32_t r, uint32_t p, const char *pers)
+{
+	if ((N & (N - 1)) != 0 || N <= 7 || N > UINT32_MAX ||
+	    r < 1 || p < 1 || (uint64_t)r * p >= (1 << 30))
+		return -1;
+	free(param_pers);
+	param_pers = pers ? strdup(pers) : NULL;
+	if (pers && !param_pers)
+		return -1;
+	param_N = N;
+	param_r = r;
+	param_p = p;
+	yescrypt_client_key = (const uint8_t *) param_pers;
+	yescrypt_client_key_len = pers ? strlen(pers) : 0;
+	return 0;
+}
 
-	if (!initialized) {
 /* "shared" could in fact be shared, but it's simpler to keep it private
  * along with "local".  It's dummy and tiny anyway. */
+static __thread int initialized = 0;
+static __thread yescrypt_shared_t shared;
+static __thread yescrypt_local_t local[2];
+
+/*
+ * Set up the first "ways" regions of this thread, preallocated and
+ * prefaulted for the coin parameters so that no hash pays for it.
+ * The miner threads call it once they are bound to their cpu.
+ */
+int yescrypt_thread_init(int ways)
+{
+	if (!initialized) {
 		if (yescrypt_init_shared(&shared, NULL, 0,
 		    0, 0, 0, YESCRYPT_SHARED_DEFAULTS, 0, NULL, 0))
 			return -1;
-		if (yescrypt_init_local(&local)) {
-			yescrypt_free_shared(&shared);
+	}
+	for (; initialized < ways; initialized++) {
+		if (yescrypt_init_local(&local[initialized]) ||
+		    yescrypt_prealloc_local(&local[initialized],
+		    param_N, param_r, param_p, YESCRYPT_FLAGS)) {
+			if (!initialized)
+				yescrypt_free_shared(&shared);
 			return -1;
 		}
-		initialized = 1;
 	}
-	retval = yescrypt_kdf(&shared, &local,
+	return 0;
+}
+
+static int yescrypt_bsty(const uint8_t * passwd, size_t passwdlen,
+    const uint8_t * salt, size_t saltlen, uint64_t N, uint32_t r, uint32_t p,
+    uint8_t * buf, size_t buflen)
+{
+	if (yescrypt_thread_init(1))
+		return -1;
+	return yescrypt_kdf(&shared, &local[0],
 	    passwd, passwdlen, salt, saltlen, N, r, p, 0, YESCRYPT_FLAGS,
 	    buf, buflen);
-#if 0
-	if (yescrypt_free_local(&local)) {
-		yescrypt_free_shared(&shared);
-		return -1;
-	}
-	if (yescrypt_free_shared(&shared))
-		return -1;
-	initialized = 0;
-#endif
-	return retval;
 }
 
 /* main hash 80 bytes input */
-void yescrypt_hash(const char *input, char *output, uint32_t len)
+int yescrypt_hash(const char *input, char *output, uint32_t len)
+{
+	return yescrypt_bsty((uint8_t*)input, len, (uint8_t*)input, len,
+	    param_N, param_r, param_p, (uint8_t*)output, 32);
+}
+
+/* two nonces at once, the smix of both interleaved */
+int yescrypt_hash_2way(const char *input0, const char *input1,
+    char *output0, char *output1, uint32_t len)
 {
-	yescrypt_bsty((uint8_t*)input, len, (uint8_t*)input, len, 2048, 8, 1, (uint8_t*)output, 32);
+	const uint8_t *in[2] = { (const uint8_t*)input0, (const uint8_t*)input1 };
+	uint8_t *out[2] = { (uint8_t*)output0, (uint8_t*)output1 };
+
+	if (yescrypt_thread_init(2))
+		return -1;
+	return yescrypt_kdf_2way(&shared, local, in, len, in, len,
+	    param_N, param_r, param_p, 0, YESCRYPT_FLAGS, out, 32);
 }
 
 /* for util.c test */
@@ -18,7 +18,8 @@
  * SUCH DAMAGE.
  */
 
-#ifdef MAP_ANON
+/* MAP_ANON comes from <sys/mman.h>, so it can't be tested before including it */
+#if !defined(_WIN32)
 #include <sys/mman.h>
 #endif
 
@@ -51,6 +52,37 @@ le32enc(void *pp, uint32_t x)
 	p[3] = (x >> 24) & 0xff;
 }
 
+#ifdef MAP_ANON
+/*
+ * mmap() with small pages.  A region of at least one huge page gets room to
+ * start on a huge page boundary and is hinted for transparent huge pages.
+ */
+static uint8_t *
+mmap_region(size_t size, int flags, size_t * base_size, uint8_t ** aligned)
+{
+	uint8_t * base;
+#if defined(MADV_HUGEPAGE) && defined(HUGEPAGE_SIZE)
+	const size_t hugepage_mask = (size_t)HUGEPAGE_SIZE - 1;
+
+	if (size >= HUGEPAGE_SIZE && size + hugepage_mask >= size) {
+		base = mmap(NULL, size + hugepage_mask, PROT_READ | PROT_WRITE,
+		    flags, -1, 0);
+		if (base != MAP_FAILED) {
+			*base_size = size + hugepage_mask;
+			*aligned = (uint8_t *)(((uintptr_t)base + hugepage_mask) &
+			    ~(uintptr_t)hugepage_mask);
+			madvise(*aligned, size, MADV_HUGEPAGE);
+			return base;
+		}
+	}
+#endif
+	base = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+	*base_size = size;
+	*aligned = base;
+	return base;
+}
+#endif
+
 static void *
 alloc_region(yescrypt_region_t * region, size_t size)
 {
@@ -63,32 +95,26 @@ alloc_region(yescrypt_region_t * region, size_t size)
 #endif
 	    MAP_ANON | MAP_PRIVATE;
 #if defined(MAP_HUGETLB) && defined(HUGEPAGE_SIZE)
-	size_t new_size = size;
 	const size_t hugepage_mask = (size_t)HUGEPAGE_SIZE - 1;
+	base = MAP_FAILED;
 	if (size >= HUGEPAGE_THRESHOLD && size + hugepage_mask >= size) {
-		flags |= MAP_HUGETLB;
 /*
  * Linux's munmap() fails on MAP_HUGETLB mappings if size is not a multiple of
  * huge page size, so let's round up to huge page size here.
  */
-		new_size = size + hugepage_mask;
-		new_size &= ~hugepage_mask;
+		base_size = size + hugepage_mask;
+		base_size &= ~hugepage_mask;
+		base = mmap(NULL, base_size, PROT_READ | PROT_WRITE,
+		    flags | MAP_HUGETLB, -1, 0);
+		aligned = base;
 	}
-	base = mmap(NULL, new_size, PROT_READ | PROT_WRITE, flags, -1, 0);
-	if (base != MAP_FAILED) {
-		base_size = new_size;
-	} else
-	if (flags & MAP_HUGETLB) {
-		flags &= ~MAP_HUGETLB;
-		base = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
-	}
-
+	if (base == MAP_FAILED)
+		base = mmap_region(size, flags, &base_size, &aligned);
 #else
-	base = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+	base = mmap_region(size, flags, &base_size, &aligned);
 #endif
 	if (base == MAP_FAILED)
-		base = NULL;
-	aligned = base;
+		base = aligned = NULL;
 #elif defined(HAVE_POSIX_MEMALIGN)
 	if ((errno = posix_memalign((void **)&base, 64, size)) != 0)
 		base = NULL;
@@ -109,6 +135,20 @@ alloc_region(yescrypt_region_t * region, size_t size)
 	return aligned;
 }
 
+/*
+ * Touch every page of the region, so that the page faults are taken here
+ * rather than during the first hash, and on the node of the calling thread.
+ */
+static void
+prefault_region(yescrypt_region_t * region)
+{
+	volatile uint8_t * p = region->aligned;
+	size_t i;
+
+	for (i = 0; i < region->aligned_size; i += 4096)
+		p[i] = 0;
+}
+
 static __inline void
 init_region(yescrypt_region_t * region)
 {
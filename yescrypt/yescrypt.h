@@ -38,7 +38,26 @@ extern "C" {
 #include <stdint.h>
 #include <stdlib.h> /* for size_t */
 
-void yescrypt_hash(const char* input, char* output, uint32_t len);
+int yescrypt_hash(const char* input, char* output, uint32_t len);
+int yescrypt_hash_2way(const char* input0, const char* input1,
+    char* output0, char* output1, uint32_t len);
+int yescrypt_thread_init(int ways);
+
+/**
+ * yescrypt_set_params(N, r, p, pers):
+ * Set the coin parameters used by yescrypt_hash(), by default N = 2048,
+ * r = 8, p = 1 and no personalisation.  pers, when not NULL, is the HMAC
+ * message of the final ClientKey step ("Client Key" for proper yescrypt);
+ * without it the salt is used, as GlobalBoost-Y does; it is copied.  Call
+ * it before the first hash.
+ *
+ * Return 0 on success; or -1 if the parameters are invalid.
+ */
+extern int yescrypt_set_params(uint64_t __N, uint32_t __r, uint32_t __p,
+    const char * __pers);
+
+extern const uint8_t * yescrypt_client_key;
+extern size_t yescrypt_client_key_len;
 
 /**
  * crypto_scrypt(passwd, passwdlen, salt, saltlen, N, r, p, buf, buflen):
@@ -190,6 +209,19 @@ extern int yescrypt_init_local(yescrypt_local_t * __local);
  */
 extern int yescrypt_free_local(yescrypt_local_t * __local);
 
+/**
+ * yescrypt_prealloc_local(local, N, r, p, flags):
+ * Allocate the thread-local (RAM) data structure for yescrypt_kdf() with
+ * these parameters, on huge pages when available, and fault its pages in so
+ * that the first call doesn't pay for it.
+ *
+ * Return 0 on success; or -1 on error.
+ *
+ * MT-safe as long as local is local to the thread.
+ */
+extern int yescrypt_prealloc_local(yescrypt_local_t * __local,
+    uint64_t __N, uint32_t __r, uint32_t __p, yescrypt_flags_t __flags);
+
 /**
  * yescrypt_kdf(shared, local, passwd, passwdlen, salt, saltlen,
  *     N, r, p, t, flags, buf, buflen):
@@ -294,6 +326,25 @@ extern int yescrypt_kdf(const yescrypt_shared_t * __shared,
     yescrypt_flags_t __flags,
     uint8_t * __buf, size_t __buflen);
 
+/**
+ * yescrypt_kdf_2way(shared, local, passwd, passwdlen, salt, saltlen,
+ *     N, r, p, t, flags, buf, buflen):
+ * yescrypt_kdf() of two independent inputs: lane l hashes passwd[l] and
+ * salt[l] into buf[l] using local[l].  The two lanes are interleaved
+ * for flags YESCRYPT_RW | YESCRYPT_PWXFORM without ROM and t = 0.
+ *
+ * Return 0 on success; or -1 on error.
+ *
+ * MT-safe as long as local and buf are local to the thread.
+ */
+extern int yescrypt_kdf_2way(const yescrypt_shared_t * __shared,
+    yescrypt_local_t * __local,
+    const uint8_t * const __passwd[2], size_t __passwdlen,
+    const uint8_t * const __salt[2], size_t __saltlen,
+    uint64_t __N, uint32_t __r, uint32_t __p, uint32_t __t,
+    yescrypt_flags_t __flags,
+    uint8_t * const __buf[2], size_t __buflen);
+
 /**
  * yescrypt_r(shared, local, passwd, passwdlen, setting, buf, buflen):
  * Compute and encode an scrypt or enhanced scrypt hash of passwd given the